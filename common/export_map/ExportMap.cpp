@@ -18,6 +18,10 @@
  * Copyright (C) 2005-2008 Simon Newton
  */
 
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
 #include <algorithm>
 #include <string>
 #include <map>
@@ -31,6 +35,216 @@ namespace ola {
 using std::string;
 using std::stringstream;
 
+const unsigned int ShardedCounterVariable::SHARDS;
+const unsigned int Histogram::BUCKETS;
+
+
+/*
+ * The Prometheus output is built up in a buffer that the caller reuses, so
+ * none of these allocate once the buffer has grown to size.
+ */
+static void AppendUInt(string *output, uint64_t value) {
+  char buffer[20];
+  unsigned int i = sizeof(buffer);
+  do {
+    buffer[--i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value);
+  output->append(buffer + i, sizeof(buffer) - i);
+}
+
+
+static void AppendInt(string *output, int value) {
+  if (value < 0) {
+    output->push_back('-');
+    AppendUInt(output, static_cast<uint64_t>(-(value + 1)) + 1);
+  } else {
+    AppendUInt(output, value);
+  }
+}
+
+
+static void AppendNumber(string *output, int value) {
+  AppendInt(output, value);
+}
+
+
+static void AppendNumber(string *output, unsigned int value) {
+  AppendUInt(output, value);
+}
+
+
+/*
+ * Prometheus names can only contain letters, digits, underscores & colons, so
+ * our names like rpc-latency-us become rpc_latency_us.
+ */
+static void AppendName(string *output, const string &name, bool allow_colon) {
+  for (unsigned int i = 0; i < name.size(); i++) {
+    char c = name[i];
+    bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 c == '_' || (allow_colon && c == ':') ||
+                 (i && c >= '0' && c <= '9');
+    output->push_back(valid ? c : '_');
+  }
+}
+
+
+static void AppendLabelValue(string *output, const string &value) {
+  for (unsigned int i = 0; i < value.size(); i++) {
+    switch (value[i]) {
+      case '\\':
+        output->append("\\\\");
+        break;
+      case '"':
+        output->append("\\\"");
+        break;
+      case '\n':
+        output->append("\\n");
+        break;
+      default:
+        output->push_back(value[i]);
+    }
+  }
+}
+
+
+/*
+ * The label used for maps that weren't given one.
+ */
+static const string &DefaultLabel() {
+  static const string label("key");
+  return label;
+}
+
+
+static void AppendType(string *output, const string &name, const char *type) {
+  output->append("# TYPE ");
+  AppendName(output, name, true);
+  output->push_back(' ');
+  output->append(type);
+  output->push_back('\n');
+}
+
+
+/*
+ * Append the start of a sample, up to and including the space before the
+ * value. suffix and le may be NULL.
+ */
+static void AppendSample(string *output, const string &name,
+                         const char *suffix, const string &label,
+                         const string &key, const char *le) {
+  AppendName(output, name, true);
+  if (suffix)
+    output->append(suffix);
+  if (!label.empty() || le) {
+    output->push_back('{');
+    if (!label.empty()) {
+      AppendName(output, label, false);
+      output->append("=\"");
+      AppendLabelValue(output, key);
+      output->push_back('"');
+      if (le)
+        output->push_back(',');
+    }
+    if (le) {
+      output->append("le=\"");
+      output->append(le);
+      output->push_back('"');
+    }
+    output->push_back('}');
+  }
+  output->push_back(' ');
+}
+
+
+/*
+ * Append a sample without labels.
+ */
+static void AppendSample(string *output, const string &name,
+                         const char *type, uint64_t value) {
+  AppendType(output, name, type);
+  AppendName(output, name, true);
+  output->push_back(' ');
+  AppendUInt(output, value);
+  output->push_back('\n');
+}
+
+
+void BoolVariable::AppendPrometheus(string *output) const {
+  AppendSample(output, Name(), "gauge", m_value ? 1 : 0);
+}
+
+
+void IntegerVariable::AppendPrometheus(string *output) const {
+  AppendType(output, Name(), "gauge");
+  AppendName(output, Name(), true);
+  output->push_back(' ');
+  AppendInt(output, m_value);
+  output->push_back('\n');
+}
+
+
+void CounterVariable::AppendPrometheus(string *output) const {
+  AppendSample(output, Name(), "counter", m_value);
+}
+
+
+ShardedCounterVariable::ShardedCounterVariable(const string &name)
+    : BaseVariable(name) {
+  Reset();
+}
+
+
+/*
+ * Zero the counter. Adds that race with this may be lost.
+ */
+void ShardedCounterVariable::Reset() {
+  for (unsigned int i = 0; i < SHARDS; i++)
+    m_shards[i].value = 0;
+}
+
+
+/*
+ * Sum the shards.
+ */
+unsigned int ShardedCounterVariable::Get() const {
+  unsigned int total = 0;
+  for (unsigned int i = 0; i < SHARDS; i++)
+    total += __sync_fetch_and_add(&m_shards[i].value, 0);
+  return total;
+}
+
+
+const string ShardedCounterVariable::Value() const {
+  stringstream out;
+  out << Get();
+  return out.str();
+}
+
+
+void ShardedCounterVariable::AppendPrometheus(string *output) const {
+  AppendSample(output, Name(), "counter", Get());
+}
+
+
+/*
+ * Pick the shard for the calling thread. pthread_t is opaque, so we hash its
+ * bytes. Threads that end up on the same shard are still counted correctly,
+ * they just share a cache line. The shard is only worked out once per thread.
+ */
+unsigned int ShardedCounterVariable::ShardIndex() {
+  static __thread unsigned int shard = SHARDS;
+  if (shard == SHARDS) {
+    pthread_t self = pthread_self();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&self);
+    unsigned int hash = 2166136261u;
+    for (unsigned int i = 0; i < sizeof(self); i++)
+      hash = (hash ^ bytes[i]) * 16777619u;
+    shard = hash % SHARDS;
+  }
+  return shard;
+}
+
 
 /*
  * Return the string representation of this map variable.
@@ -66,14 +280,224 @@ const string MapVariable<string>::Value() const {
 }
 
 
+/*
+ * Maps of numbers are untyped, since some are counters and some gauges.
+ */
+template<typename Type>
+void MapVariable<Type>::AppendPrometheus(string *output) const {
+  if (m_variables.empty())
+    return;
+
+  AppendType(output, Name(), "untyped");
+  const string &label = m_label.empty() ? DefaultLabel() : m_label;
+  typename map<string, Type>::const_iterator iter;
+  for (iter = m_variables.begin(); iter != m_variables.end(); ++iter) {
+    AppendSample(output, Name(), NULL, label, iter->first, NULL);
+    AppendNumber(output, iter->second);
+    output->push_back('\n');
+  }
+}
+
+
+/*
+ * Strings aren't exported to Prometheus.
+ */
+template<>
+void MapVariable<string>::AppendPrometheus(string*) const {}
+
+
+/*
+ * Add a value to the histogram.
+ */
+void Histogram::Add(unsigned int value) {
+  m_buckets[Bucket(value)]++;
+  m_count++;
+  m_sum += value;
+  if (value > m_max)
+    m_max = value;
+}
+
+
+/*
+ * Clear the histogram.
+ */
+void Histogram::Reset() {
+  m_count = 0;
+  m_max = 0;
+  m_sum = 0;
+  memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+
+/*
+ * Return a percentile of the values added.
+ * @param percent the percentile, from 0 to 100.
+ * @return the upper limit of the bucket the percentile falls in, or 0 if the
+ *   histogram is empty.
+ */
+unsigned int Histogram::Percentile(unsigned int percent) const {
+  if (!m_count)
+    return 0;
+
+  // the rank of the value we're after, rounded up
+  uint64_t rank = (static_cast<uint64_t>(m_count) * percent + 99) / 100;
+  if (!rank)
+    rank = 1;
+
+  uint64_t total = 0;
+  const unsigned int buckets = sizeof(m_buckets) / sizeof(m_buckets[0]);
+  for (unsigned int i = 0; i < buckets; i++) {
+    total += m_buckets[i];
+    if (total >= rank)
+      return std::min(BucketLimit(i), m_max);
+  }
+  return m_max;
+}
+
+
+/*
+ * Prometheus buckets are cumulative, and each one is a line of output, so
+ * rather than one per bucket we only output the buckets that end just before a
+ * power of two: 0, 1, 3, 7, 15 and so on, stopping once all the values are
+ * covered.
+ */
+void Histogram::AppendPrometheus(string *output, const string &name,
+                                 const string &label,
+                                 const string &key) const {
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < BUCKETS; i++) {
+    total += m_buckets[i];
+    if (i > 1 && i % 4 != 3)
+      continue;
+
+    // big enough for a 32 bit number
+    char le[11];
+    unsigned int limit = BucketLimit(i);
+    unsigned int j = sizeof(le) - 1;
+    le[j] = 0;
+    do {
+      le[--j] = static_cast<char>('0' + limit % 10);
+      limit /= 10;
+    } while (limit);
+
+    AppendSample(output, name, "_bucket", label, key, le + j);
+    AppendUInt(output, total);
+    output->push_back('\n');
+    if (total == m_count)
+      break;
+  }
+  AppendSample(output, name, "_bucket", label, key, "+Inf");
+  AppendUInt(output, m_count);
+  output->push_back('\n');
+  AppendSample(output, name, "_sum", label, key, NULL);
+  AppendUInt(output, m_sum);
+  output->push_back('\n');
+  AppendSample(output, name, "_count", label, key, NULL);
+  AppendUInt(output, m_count);
+  output->push_back('\n');
+}
+
+
+/*
+ * Values below 4 get a bucket each, after that each power of two is split
+ * into 4 buckets.
+ */
+unsigned int Histogram::Bucket(unsigned int value) {
+  if (value < 4)
+    return value;
+
+  unsigned int exponent = 2;
+  while (exponent < 31 && (value >> (exponent + 1)))
+    exponent++;
+  unsigned int quarter = (value >> (exponent - 2)) & 3;
+  return 4 * (exponent - 1) + quarter;
+}
+
+
+/*
+ * Return the largest value that falls in a bucket.
+ */
+unsigned int Histogram::BucketLimit(unsigned int bucket) {
+  if (bucket < 4)
+    return bucket;
+
+  unsigned int exponent = bucket / 4 + 1;
+  unsigned int quarter = bucket % 4;
+  uint64_t lower = static_cast<uint64_t>(4 + quarter) << (exponent - 2);
+  uint64_t limit = lower + (static_cast<uint64_t>(1) << (exponent - 2)) - 1;
+  return static_cast<unsigned int>(
+      std::min(limit, static_cast<uint64_t>(UINT_MAX)));
+}
+
+
+/*
+ * Append the count, percentiles & max of a histogram.
+ */
+static void AppendSummary(stringstream *value, const Histogram &histogram) {
+  *value << "count=" << histogram.Count() << ",p50=" <<
+    histogram.Percentile(50) << ",p90=" << histogram.Percentile(90) <<
+    ",p99=" << histogram.Percentile(99) << ",max=" << histogram.Max();
+}
+
+
+/*
+ * Return the string representation of the histogram.
+ * The form is:
+ *   var_name  count=1,p50=2,p90=3,p99=4,max=5
+ */
+const string HistogramVariable::Value() const {
+  stringstream value;
+  AppendSummary(&value, m_histogram);
+  return value.str();
+}
+
+
+void HistogramVariable::AppendPrometheus(string *output) const {
+  AppendType(output, Name(), "histogram");
+  m_histogram.AppendPrometheus(output, Name(), "", "");
+}
+
+
+/*
+ * Return the string representation of the histograms.
+ * The form is:
+ *   var_name  map:label_name key1:count=1,p50=2,p90=3,p99=4,max=5
+ */
+const string HistogramMap::Value() const {
+  stringstream value;
+  value << "map:" << m_label;
+  map<string, Histogram>::const_iterator iter;
+  for (iter = m_histograms.begin(); iter != m_histograms.end(); ++iter) {
+    value << " " << iter->first << ":";
+    AppendSummary(&value, iter->second);
+  }
+  return value.str();
+}
+
+
+void HistogramMap::AppendPrometheus(string *output) const {
+  if (m_histograms.empty())
+    return;
+
+  AppendType(output, Name(), "histogram");
+  const string &label = m_label.empty() ? DefaultLabel() : m_label;
+  map<string, Histogram>::const_iterator iter;
+  for (iter = m_histograms.begin(); iter != m_histograms.end(); ++iter)
+    iter->second.AppendPrometheus(output, Name(), label, iter->first);
+}
+
+
 ExportMap::~ExportMap() {
   DeleteVariables(&m_bool_variables);
   DeleteVariables(&m_counter_variables);
+  DeleteVariables(&m_sharded_counter_variables);
   DeleteVariables(&m_int_map_variables);
   DeleteVariables(&m_int_variables);
   DeleteVariables(&m_str_map_variables);
   DeleteVariables(&m_string_variables);
   DeleteVariables(&m_uint_map_variables);
+  DeleteVariables(&m_histogram_map_variables);
+  DeleteVariables(&m_histogram_variables);
 }
 
 
@@ -108,6 +532,17 @@ CounterVariable *ExportMap::GetCounterVar(const string &name) {
 }
 
 
+/*
+ * Lookup or create a sharded counter variable. This must be called from a
+ * single thread, but the counter can then be added to from any thread.
+ * @param name the name of the variable.
+ * @return a ShardedCounterVariable.
+ */
+ShardedCounterVariable *ExportMap::GetShardedCounterVar(const string &name) {
+  return GetVar(&m_sharded_counter_variables, name);
+}
+
+
 /*
  * Lookup or create a string variable.
  * @param name the name of the variable.
@@ -118,6 +553,16 @@ StringVariable *ExportMap::GetStringVar(const string &name) {
 }
 
 
+/*
+ * Lookup or create a histogram variable.
+ * @param name the name of the variable.
+ * @return a HistogramVariable.
+ */
+HistogramVariable *ExportMap::GetHistogramVar(const string &name) {
+  return GetVar(&m_histogram_variables, name);
+}
+
+
 /*
  * Lookup or create a string map variable
  * @param name the name of the variable
@@ -151,6 +596,18 @@ UIntMap *ExportMap::GetUIntMapVar(const string &name, const string &label) {
 }
 
 
+/*
+ * Lookup or create a histogram map variable
+ * @param name the name of the variable
+ * @param label the label to use for the map (optional)
+ * @return a HistogramMap
+ */
+HistogramMap *ExportMap::GetHistogramMapVar(const string &name,
+                                            const string &label) {
+  return GetMapVar(&m_histogram_map_variables, name, label);
+}
+
+
 /*
  * Return a list of all variables.
  * @return a vector of all variables.
@@ -159,24 +616,76 @@ vector<BaseVariable*> ExportMap::AllVariables() const {
   vector<BaseVariable*> variables;
   AddVariablesToVector(&variables, m_bool_variables);
   AddVariablesToVector(&variables, m_counter_variables);
+  AddVariablesToVector(&variables, m_sharded_counter_variables);
   AddVariablesToVector(&variables, m_int_map_variables);
   AddVariablesToVector(&variables, m_int_variables);
   AddVariablesToVector(&variables, m_str_map_variables);
   AddVariablesToVector(&variables, m_string_variables);
   AddVariablesToVector(&variables, m_uint_map_variables);
+  AddVariablesToVector(&variables, m_histogram_map_variables);
+  AddVariablesToVector(&variables, m_histogram_variables);
+
+  vector<const ExportMap*>::const_iterator iter = m_children.begin();
+  for (; iter != m_children.end(); ++iter) {
+    vector<BaseVariable*> child_variables = (*iter)->AllVariables();
+    variables.insert(variables.end(), child_variables.begin(),
+                     child_variables.end());
+  }
 
   sort(variables.begin(), variables.end(), VariableLessThan());
   return variables;
 }
 
 
+/*
+ * Append all the variables in the Prometheus text format. Unlike
+ * AllVariables() this doesn't sort the variables, so nothing is allocated
+ * other than the space in output.
+ * @param output the string to append to.
+ */
+void ExportMap::AppendPrometheus(string *output) const {
+  AppendPrometheusVariables(output, m_bool_variables);
+  AppendPrometheusVariables(output, m_counter_variables);
+  AppendPrometheusVariables(output, m_sharded_counter_variables);
+  AppendPrometheusVariables(output, m_int_map_variables);
+  AppendPrometheusVariables(output, m_int_variables);
+  AppendPrometheusVariables(output, m_uint_map_variables);
+  AppendPrometheusVariables(output, m_histogram_map_variables);
+  AppendPrometheusVariables(output, m_histogram_variables);
+
+  vector<const ExportMap*>::const_iterator iter = m_children.begin();
+  for (; iter != m_children.end(); ++iter)
+    (*iter)->AppendPrometheus(output);
+}
+
+
+/*
+ * Add a child map. The child must outlive this map, or be removed first.
+ * @param child the map to add.
+ */
+void ExportMap::AddChild(const ExportMap *child) {
+  if (find(m_children.begin(), m_children.end(), child) == m_children.end())
+    m_children.push_back(child);
+}
+
+
+/*
+ * Remove a child map.
+ * @param child the map to remove.
+ */
+void ExportMap::RemoveChild(const ExportMap *child) {
+  m_children.erase(remove(m_children.begin(), m_children.end(), child),
+                   m_children.end());
+}
+
+
 template<typename Type>
 Type *ExportMap::GetVar(map<string, Type*> *var_map, const string &name) {
   typename map<string, Type*>::iterator iter;
   iter = var_map->find(name);
 
   if (iter == var_map->end()) {
-    Type *var = new Type(name);
+    Type *var = new Type(m_prefix + name);
     (*var_map)[name] = var;
     return var;
   }
@@ -192,7 +701,7 @@ Type *ExportMap::GetMapVar(map<string, Type*> *var_map,
   iter = var_map->find(name);
 
   if (iter == var_map->end()) {
-    Type *var = new Type(name, label);
+    Type *var = new Type(m_prefix + name, label);
     (*var_map)[name] = var;
     return var;
   }
@@ -208,6 +717,15 @@ void ExportMap::AddVariablesToVector(vector<BaseVariable*> *variables,
 }
 
 
+template<typename Type>
+void ExportMap::AppendPrometheusVariables(string *output,
+                                          const Type &var_map) const {
+  typename Type::const_iterator iter;
+  for (iter = var_map.begin(); iter != var_map.end(); ++iter)
+    iter->second->AppendPrometheus(output);
+}
+
+
 template<typename Type>
 void ExportMap::DeleteVariables(Type *var_map) const {
   typename Type::const_iterator iter;
@@ -19,20 +19,28 @@
  */
 
 #include <cppunit/extensions/HelperMacros.h>
+#include <limits.h>
 #include <string>
 #include <vector>
 
 #include "ola/ExportMap.h"
 #include "ola/testing/TestUtils.h"
+#include "ola/thread/Thread.h"
 
 using ola::BaseVariable;
 using ola::BoolVariable;
+using ola::CounterHandle;
 using ola::CounterVariable;
 using ola::ExportMap;
+using ola::Histogram;
+using ola::HistogramMap;
+using ola::HistogramVariable;
 using ola::IntMap;
 using ola::IntegerVariable;
+using ola::ShardedCounterVariable;
 using ola::StringMap;
 using ola::StringVariable;
+using ola::UIntMap;
 using std::string;
 using std::vector;
 
@@ -41,21 +49,35 @@ class ExportMapTest: public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(ExportMapTest);
   CPPUNIT_TEST(testIntegerVariable);
   CPPUNIT_TEST(testCounterVariable);
+  CPPUNIT_TEST(testShardedCounterVariable);
   CPPUNIT_TEST(testStringVariable);
   CPPUNIT_TEST(testBoolVariable);
   CPPUNIT_TEST(testStringMapVariable);
   CPPUNIT_TEST(testIntMapVariable);
+  CPPUNIT_TEST(testHistogramMapVariable);
+  CPPUNIT_TEST(testHistogramVariable);
+  CPPUNIT_TEST(testCounterHandle);
+  CPPUNIT_TEST(testConcurrentCounters);
   CPPUNIT_TEST(testExportMap);
+  CPPUNIT_TEST(testPrometheus);
+  CPPUNIT_TEST(testChildMaps);
   CPPUNIT_TEST_SUITE_END();
 
   public:
     void testIntegerVariable();
     void testCounterVariable();
+    void testShardedCounterVariable();
     void testStringVariable();
     void testBoolVariable();
     void testStringMapVariable();
     void testIntMapVariable();
+    void testHistogramMapVariable();
+    void testHistogramVariable();
+    void testCounterHandle();
+    void testConcurrentCounters();
     void testExportMap();
+    void testPrometheus();
+    void testChildMaps();
 };
 
 
@@ -106,6 +128,25 @@ void ExportMapTest::testCounterVariable() {
 }
 
 
+/*
+ * Check that the ShardedCounterVariable works correctly.
+ */
+void ExportMapTest::testShardedCounterVariable() {
+  ShardedCounterVariable var("foo");
+
+  OLA_ASSERT_EQ(string("foo"), var.Name());
+  OLA_ASSERT_EQ(string("0"), var.Value());
+  OLA_ASSERT_EQ(0u, var.Get());
+  var++;
+  OLA_ASSERT_EQ(1u, var.Get());
+  var += 10;
+  OLA_ASSERT_EQ(11u, var.Get());
+  OLA_ASSERT_EQ(string("11"), var.Value());
+  var.Reset();
+  OLA_ASSERT_EQ(0u, var.Get());
+}
+
+
 /*
  * Check that the StringVariable works correctly.
  */
@@ -213,6 +254,153 @@ void ExportMapTest::testIntMapVariable() {
   OLA_ASSERT_EQ(var.Value(), string("map:count key1:1"));
 }
 
+
+/*
+ * Check that the HistogramMap works correctly.
+ */
+void ExportMapTest::testHistogramMapVariable() {
+  HistogramMap var("foo", "method");
+  OLA_ASSERT_EQ(string("foo"), var.Name());
+  OLA_ASSERT_EQ(string("method"), var.Label());
+  OLA_ASSERT_EQ(string("map:method"), var.Value());
+
+  Histogram &histogram = var["key1"];
+  OLA_ASSERT_EQ(0u, histogram.Count());
+  OLA_ASSERT_EQ(0u, histogram.Percentile(50));
+
+  // small values are exact
+  var.Add("key1", 3);
+  OLA_ASSERT_EQ(1u, histogram.Count());
+  OLA_ASSERT_EQ(3u, histogram.Percentile(50));
+  OLA_ASSERT_EQ(3u, histogram.Max());
+
+  // larger ones are rounded up to the end of their bucket
+  histogram.Reset();
+  for (unsigned int i = 1; i <= 100; i++)
+    histogram.Add(i);
+  OLA_ASSERT_EQ(100u, histogram.Count());
+  OLA_ASSERT_EQ(1u, histogram.Percentile(0));
+  OLA_ASSERT_EQ(55u, histogram.Percentile(50));
+  OLA_ASSERT_EQ(95u, histogram.Percentile(90));
+  // but never past the max
+  OLA_ASSERT_EQ(100u, histogram.Percentile(99));
+  OLA_ASSERT_EQ(100u, histogram.Max());
+  OLA_ASSERT_EQ(string("map:method key1:count=100,p50=55,p90=95,p99=100,"
+                       "max=100"),
+                var.Value());
+
+  histogram.Reset();
+  histogram.Add(UINT_MAX);
+  OLA_ASSERT_EQ(UINT_MAX, histogram.Percentile(50));
+
+  var.Remove("key1");
+  OLA_ASSERT_EQ(string("map:method"), var.Value());
+}
+
+
+/*
+ * Check that the HistogramVariable works correctly.
+ */
+void ExportMapTest::testHistogramVariable() {
+  HistogramVariable var("foo");
+  OLA_ASSERT_EQ(string("foo"), var.Name());
+  OLA_ASSERT_EQ(string("count=0,p50=0,p90=0,p99=0,max=0"), var.Value());
+
+  var.Add(1);
+  var.Add(2);
+  var.Add(3);
+  OLA_ASSERT_EQ(3u, var.Get().Count());
+  OLA_ASSERT_EQ(static_cast<uint64_t>(6), var.Get().Sum());
+  OLA_ASSERT_EQ(string("count=3,p50=2,p90=3,p99=3,max=3"), var.Value());
+
+  var.Reset();
+  OLA_ASSERT_EQ(0u, var.Get().Count());
+  OLA_ASSERT_EQ(static_cast<uint64_t>(0), var.Get().Sum());
+}
+
+
+/*
+ * Check that handles update the variables they were created from.
+ */
+void ExportMapTest::testCounterHandle() {
+  // unbound handles ignore updates
+  CounterHandle unbound;
+  OLA_ASSERT_FALSE(unbound.IsBound());
+  unbound++;
+  unbound += 10;
+  OLA_ASSERT_EQ(0u, unbound.Get());
+
+  CounterVariable counter("foo");
+  CounterHandle handle = counter.Handle();
+  OLA_ASSERT_TRUE(handle.IsBound());
+  handle++;
+  handle += 10;
+  OLA_ASSERT_EQ(11u, counter.Get());
+  counter++;
+  OLA_ASSERT_EQ(12u, handle.Get());
+
+  UIntMap map("bar", "universe");
+  CounterHandle entry = map.Handle("1");
+  OLA_ASSERT_EQ(string("map:universe 1:0"), map.Value());
+  entry++;
+  entry++;
+  entry--;
+  OLA_ASSERT_EQ(1u, map["1"]);
+  // adding other keys doesn't move the entry
+  for (unsigned int i = 2; i < 100; i++)
+    map.Increment(string(1, static_cast<char>('a' + i % 26)) + "x");
+  entry.Set(5);
+  OLA_ASSERT_EQ(5u, map["1"]);
+}
+
+
+
+/*
+ * Bumps a sharded counter and a handle from another thread.
+ */
+class CounterThread: public ola::thread::Thread {
+  public:
+    CounterThread(ShardedCounterVariable *counter, CounterHandle handle)
+        : m_counter(counter),
+          m_handle(handle) {
+    }
+
+    void *Run() {
+      for (unsigned int i = 0; i < COUNT; i++) {
+        (*m_counter)++;
+        m_handle++;
+      }
+      return NULL;
+    }
+
+    static const unsigned int COUNT = 100000;
+
+  private:
+    ShardedCounterVariable *m_counter;
+    CounterHandle m_handle;
+};
+
+
+/*
+ * Check that counts from many threads aren't lost.
+ */
+void ExportMapTest::testConcurrentCounters() {
+  const unsigned int THREADS = 4;
+  ShardedCounterVariable counter("sharded");
+  UIntMap map("map", "loop");
+  CounterThread *threads[THREADS];
+  for (unsigned int i = 0; i < THREADS; i++) {
+    threads[i] = new CounterThread(&counter, map.Handle("1"));
+    threads[i]->Start();
+  }
+  for (unsigned int i = 0; i < THREADS; i++) {
+    threads[i]->Join();
+    delete threads[i];
+  }
+  OLA_ASSERT_EQ(THREADS * CounterThread::COUNT, counter.Get());
+  OLA_ASSERT_EQ(THREADS * CounterThread::COUNT, map["1"]);
+}
+
 /*
  * Check the export map works correctly.
  */
@@ -240,4 +428,94 @@ void ExportMapTest::testExportMap() {
 
   vector<BaseVariable*> variables = map.AllVariables();
   OLA_ASSERT_EQ(variables.size(), (size_t) 4);
+
+  map.GetShardedCounterVar("sharded_var");
+  map.GetHistogramVar("histogram_var");
+  variables = map.AllVariables();
+  OLA_ASSERT_EQ(variables.size(), (size_t) 6);
+}
+
+
+/*
+ * Check the Prometheus output.
+ */
+void ExportMapTest::testPrometheus() {
+  ExportMap map;
+  map.GetBoolVar("bool")->Set(true);
+  map.GetIntegerVar("int-var")->Set(-12);
+  (*map.GetCounterVar("counter")) += 3;
+  (*map.GetShardedCounterVar("sharded")) += 4;
+  map.GetStringVar("string")->Set("not exported");
+  (*map.GetStringMapVar("string-map", "key"))["a"] = "not exported";
+  IntMap *int_map = map.GetIntMapVar("int-map");
+  (*int_map)["a\"b"] = 2;
+  map.GetUIntMapVar("empty-map", "universe");
+  map.GetHistogramMapVar("latency", "method")->Add("Echo", 5);
+  map.GetHistogramVar("sizes");
+
+  string output;
+  map.AppendPrometheus(&output);
+  OLA_ASSERT_EQ(string(
+      "# TYPE bool gauge\n"
+      "bool 1\n"
+      "# TYPE counter counter\n"
+      "counter 3\n"
+      "# TYPE sharded counter\n"
+      "sharded 4\n"
+      "# TYPE int_map untyped\n"
+      "int_map{key=\"a\\\"b\"} 2\n"
+      "# TYPE int_var gauge\n"
+      "int_var -12\n"
+      "# TYPE latency histogram\n"
+      "latency_bucket{method=\"Echo\",le=\"0\"} 0\n"
+      "latency_bucket{method=\"Echo\",le=\"1\"} 0\n"
+      "latency_bucket{method=\"Echo\",le=\"3\"} 0\n"
+      "latency_bucket{method=\"Echo\",le=\"7\"} 1\n"
+      "latency_bucket{method=\"Echo\",le=\"+Inf\"} 1\n"
+      "latency_sum{method=\"Echo\"} 5\n"
+      "latency_count{method=\"Echo\"} 1\n"
+      "# TYPE sizes histogram\n"
+      "sizes_bucket{le=\"0\"} 0\n"
+      "sizes_bucket{le=\"+Inf\"} 0\n"
+      "sizes_sum 0\n"
+      "sizes_count 0\n"),
+    output);
+
+  // the output is appended
+  string more;
+  map.AppendPrometheus(&more);
+  map.AppendPrometheus(&output);
+  OLA_ASSERT_EQ(more + more, output);
+}
+
+
+/*
+ * Check that the variables of child maps are included.
+ */
+void ExportMapTest::testChildMaps() {
+  ExportMap map;
+  ExportMap child("loop-1.");
+  (*map.GetCounterVar("counter")) += 1;
+  (*child.GetCounterVar("counter")) += 2;
+  OLA_ASSERT_EQ(string("loop-1.counter"),
+                child.GetCounterVar("counter")->Name());
+
+  map.AddChild(&child);
+  map.AddChild(&child);
+  vector<BaseVariable*> variables = map.AllVariables();
+  OLA_ASSERT_EQ((size_t) 2, variables.size());
+  OLA_ASSERT_EQ(string("counter"), variables[0]->Name());
+  OLA_ASSERT_EQ(string("loop-1.counter"), variables[1]->Name());
+
+  string output;
+  map.AppendPrometheus(&output);
+  OLA_ASSERT_EQ(string(
+      "# TYPE counter counter\n"
+      "counter 1\n"
+      "# TYPE loop_1_counter counter\n"
+      "loop_1_counter 2\n"),
+    output);
+
+  map.RemoveChild(&child);
+  OLA_ASSERT_EQ((size_t) 1, map.AllVariables().size());
 }
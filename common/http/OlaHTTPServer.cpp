@@ -22,6 +22,7 @@
 #include <ola/http/OlaHTTPServer.h>
 #include <ola/ExportMap.h>
 #include <ola/Clock.h>
+#include <ola/thread/Trace.h>
 #include <memory>
 #include <string>
 #include <vector>
@@ -45,6 +46,8 @@ OlaHTTPServer::OlaHTTPServer(const HTTPServer::HTTPServerOptions &options,
     : m_export_map(export_map),
       m_server(options) {
   RegisterHandler("/debug", &OlaHTTPServer::DisplayDebug);
+  RegisterHandler("/metrics", &OlaHTTPServer::DisplayMetrics);
+  RegisterHandler("/trace", &OlaHTTPServer::DisplayTrace);
   RegisterHandler("/help", &OlaHTTPServer::DisplayHandlers);
 
   StringVariable *data_dir_var = export_map->GetStringVar(K_DATA_DIR_VAR);
@@ -90,6 +93,43 @@ int OlaHTTPServer::DisplayDebug(const HTTPRequest*,
 }
 
 
+/**
+ * Display the contents of the ExportMap in the Prometheus text format. The
+ * buffer is kept between requests so once it's grown, scrapes don't allocate
+ * other than the copy in the response.
+ */
+int OlaHTTPServer::DisplayMetrics(const HTTPRequest*,
+                                  HTTPResponse *raw_response) {
+  auto_ptr<HTTPResponse> response(raw_response);
+  m_metrics.clear();
+  m_export_map->AppendPrometheus(&m_metrics);
+  response->SetContentType(HTTPServer::CONTENT_TYPE_PLAIN);
+  response->Append(m_metrics);
+  int r = response->Send();
+  return r;
+}
+
+
+/**
+ * Display the recorded trace events, in the Chrome trace format. Tracing can
+ * be turned on or off with ?enable=1 or ?enable=0.
+ */
+int OlaHTTPServer::DisplayTrace(const HTTPRequest *request,
+                                HTTPResponse *raw_response) {
+  auto_ptr<HTTPResponse> response(raw_response);
+  const string enable = request->GetParameter("enable");
+  if (!enable.empty())
+    ola::thread::EnableTracing(enable != "0");
+
+  string trace;
+  ola::thread::AppendTrace(&trace);
+  response->SetContentType(HTTPServer::CONTENT_TYPE_PLAIN);
+  response->Append(trace);
+  int r = response->Send();
+  return r;
+}
+
+
 /**
  * Display a list of registered handlers
  */
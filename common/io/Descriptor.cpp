@@ -36,6 +36,8 @@
 #else
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #endif
 
 #include <string>
@@ -46,6 +48,8 @@
 namespace ola {
 namespace io {
 
+using std::string;
+
 
 /**
  * Helper function to create a annonymous pipe
@@ -273,7 +277,7 @@ int ConnectedDescriptor::Receive(uint8_t *buffer,
       return 0;
     }
     data_read += ret;
-    data += data_read;
+    data += ret;
   }
   return 0;
 }
@@ -471,6 +475,201 @@ bool UnixSocket::CloseClient() {
 }
 
 
+/*
+ * Fill in a sockaddr_un for a path.
+ * @returns false if the path is too long.
+ */
+static bool UnixSocketAddress(const string &path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    OLA_WARN << "Invalid unix socket path: " << path;
+    return false;
+  }
+  addr->sun_family = AF_UNIX;
+  strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+  return true;
+}
+
+
+/*
+ * Connect to a named unix socket.
+ * @param path the path of the socket
+ * @returns a new UnixSocket or NULL if the connection failed.
+ */
+UnixSocket *UnixSocket::Connect(const string &path) {
+  struct sockaddr_un server_address;
+  if (!UnixSocketAddress(path, &server_address))
+    return NULL;
+
+  int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sd < 0) {
+    OLA_WARN << "socket() failed, " << strerror(errno);
+    return NULL;
+  }
+
+  if (connect(sd, reinterpret_cast<struct sockaddr*>(&server_address),
+              sizeof(server_address))) {
+    OLA_DEBUG << "connect to " << path << " failed, " << strerror(errno);
+    close(sd);
+    return NULL;
+  }
+  UnixSocket *socket = new UnixSocket(sd);
+  socket->SetReadNonBlocking();
+  return socket;
+}
+
+
+/*
+ * Get the user id of the process at the other end of the socket.
+ * @param uid set to the user id
+ * @returns false if the platform doesn't support this, or the socket isn't
+ *   connected.
+ */
+bool UnixSocket::PeerUID(uid_t *uid) const {
+#if defined(__linux__) && defined(SO_PEERCRED)
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(m_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0) {
+    *uid = credentials.uid;
+    return true;
+  }
+#elif HAVE_GETPEEREID
+  gid_t gid;
+  if (getpeereid(m_fd, uid, &gid) == 0)
+    return true;
+#else
+  (void) uid;
+#endif
+  return false;
+}
+
+
+// UnixAcceptingSocket
+// ------------------------------------------------
+
+UnixAcceptingSocket::UnixAcceptingSocket()
+    : ReadFileDescriptor(),
+      m_fd(INVALID_DESCRIPTOR),
+      m_on_accept(NULL) {
+}
+
+
+UnixAcceptingSocket::~UnixAcceptingSocket() {
+  Close();
+  if (m_on_accept)
+    delete m_on_accept;
+}
+
+
+/*
+ * Start listening on a named socket. A stale socket left at the path by a
+ * previous process is removed.
+ * @param path the path of the socket
+ * @param backlog the backlog
+ * @return true if it succeeded, false otherwise
+ */
+bool UnixAcceptingSocket::Listen(const string &path, int backlog) {
+  struct sockaddr_un server_address;
+  if (m_fd != INVALID_DESCRIPTOR)
+    return false;
+
+  if (!UnixSocketAddress(path, &server_address))
+    return false;
+
+  struct stat stat_buf;
+  if (lstat(path.c_str(), &stat_buf) == 0) {
+    if (!S_ISSOCK(stat_buf.st_mode)) {
+      OLA_WARN << path << " exists and isn't a socket";
+      return false;
+    }
+    if (unlink(path.c_str())) {
+      OLA_WARN << "Failed to remove " << path << ", " << strerror(errno);
+      return false;
+    }
+  }
+
+  int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sd < 0) {
+    OLA_WARN << "socket() failed: " << strerror(errno);
+    return false;
+  }
+
+  if (bind(sd, reinterpret_cast<struct sockaddr*>(&server_address),
+           sizeof(server_address)) == -1) {
+    OLA_WARN << "bind to " << path << " failed, " << strerror(errno);
+    close(sd);
+    return false;
+  }
+
+  // Who can connect is controlled by the permissions of the directory.
+  chmod(path.c_str(), 0666);
+
+  if (listen(sd, backlog)) {
+    OLA_WARN << "listen on " << path << " failed, " << strerror(errno);
+    close(sd);
+    unlink(path.c_str());
+    return false;
+  }
+  m_fd = sd;
+  m_path = path;
+  return true;
+}
+
+
+/*
+ * Stop listening, close this socket and remove the path.
+ * @return true if close succeeded, false otherwise
+ */
+bool UnixAcceptingSocket::Close() {
+  bool ret = true;
+  if (m_fd != INVALID_DESCRIPTOR) {
+    if (close(m_fd)) {
+      OLA_WARN << "close() failed " << strerror(errno);
+      ret = false;
+    }
+    unlink(m_path.c_str());
+  }
+  m_fd = INVALID_DESCRIPTOR;
+  m_path.clear();
+  return ret;
+}
+
+
+/*
+ * Accept a new connection
+ */
+void UnixAcceptingSocket::PerformRead() {
+  if (m_fd == INVALID_DESCRIPTOR)
+    return;
+
+  int sd = accept(m_fd, NULL, NULL);
+  if (sd < 0) {
+    OLA_WARN << "accept() failed, " << strerror(errno);
+    return;
+  }
+
+  if (m_on_accept) {
+    UnixSocket *socket = new UnixSocket(sd);
+    socket->SetReadNonBlocking();
+    m_on_accept->Run(socket);
+  } else {
+    OLA_WARN << "Accepted new unix socket connection but no callback "
+             << "registered";
+    close(sd);
+  }
+}
+
+
+/*
+ * Set the callback to run when a new connection is accepted.
+ */
+void UnixAcceptingSocket::SetOnAccept(AcceptCallback *on_accept) {
+  if (m_on_accept)
+    delete m_on_accept;
+  m_on_accept = on_accept;
+}
+
+
 // DeviceDescriptor
 // ------------------------------------------------
 
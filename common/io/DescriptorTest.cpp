@@ -21,6 +21,8 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <sstream>
 #include <string>
 
 #include "ola/Callback.h"
@@ -34,6 +36,7 @@ using std::string;
 using ola::io::ConnectedDescriptor;
 using ola::io::LoopbackDescriptor;
 using ola::io::PipeDescriptor;
+using ola::io::UnixAcceptingSocket;
 using ola::io::UnixSocket;
 using ola::io::SelectServer;
 
@@ -49,6 +52,7 @@ class DescriptorTest: public CppUnit::TestFixture {
   CPPUNIT_TEST(testPipeDescriptorServerClose);
   CPPUNIT_TEST(testUnixSocketClientClose);
   CPPUNIT_TEST(testUnixSocketServerClose);
+  CPPUNIT_TEST(testUnixAcceptingSocket);
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -59,6 +63,7 @@ class DescriptorTest: public CppUnit::TestFixture {
     void testPipeDescriptorServerClose();
     void testUnixSocketClientClose();
     void testUnixSocketServerClose();
+    void testUnixAcceptingSocket();
 
     // timing out indicates something went wrong
     void Timeout() {
@@ -72,6 +77,7 @@ class DescriptorTest: public CppUnit::TestFixture {
     void Receive(ConnectedDescriptor *socket);
     void ReceiveAndSend(ConnectedDescriptor *socket);
     void ReceiveSendAndClose(ConnectedDescriptor *socket);
+    void NewConnectionSend(UnixSocket *socket);
 
     // Socket close actions
     void TerminateOnClose() {
@@ -158,6 +164,44 @@ void DescriptorTest::testPipeDescriptorServerClose() {
 }
 
 
+/*
+ * Test a named unix socket works correctly.
+ * The client connects and the server sends some data. The client checks the
+ * data matches and then closes the connection.
+ */
+void DescriptorTest::testUnixAcceptingSocket() {
+  std::stringstream str;
+  str << "/tmp/ola-descriptor-test-" << getpid();
+  const string path = str.str();
+
+  UnixAcceptingSocket socket;
+  socket.SetOnAccept(
+      ola::NewCallback(this, &DescriptorTest::NewConnectionSend));
+  OLA_ASSERT_TRUE(socket.Listen(path));
+  OLA_ASSERT_FALSE(socket.Listen(path));
+  OLA_ASSERT_EQ(path, socket.Path());
+  OLA_ASSERT_TRUE(m_ss->AddReadDescriptor(&socket));
+
+  UnixSocket *client_socket = UnixSocket::Connect(path);
+  OLA_ASSERT_NOT_NULL(client_socket);
+  uid_t uid;
+  if (client_socket->PeerUID(&uid))
+    OLA_ASSERT_EQ(geteuid(), uid);
+  client_socket->SetOnData(ola::NewCallback(
+        this, &DescriptorTest::ReceiveAndClose,
+        static_cast<ConnectedDescriptor*>(client_socket)));
+  OLA_ASSERT_TRUE(m_ss->AddReadDescriptor(client_socket));
+  m_ss->Run();
+  m_ss->RemoveReadDescriptor(&socket);
+  m_ss->RemoveReadDescriptor(client_socket);
+  delete client_socket;
+
+  // closing the socket removes the path
+  OLA_ASSERT_TRUE(socket.Close());
+  OLA_ASSERT_NULL(UnixSocket::Connect(path));
+}
+
+
 /*
  * Test a unix socket works correctly.
  * The client sends some data and expects the same data to be returned. The
@@ -184,6 +228,21 @@ void DescriptorTest::testUnixSocketServerClose() {
 }
 
 
+/*
+ * Accept a new connection and send some data
+ */
+void DescriptorTest::NewConnectionSend(UnixSocket *new_socket) {
+  OLA_ASSERT_NOT_NULL(new_socket);
+  ssize_t bytes_sent = new_socket->Send(
+      static_cast<const uint8_t*>(test_cstring),
+      sizeof(test_cstring));
+  OLA_ASSERT_EQ(static_cast<ssize_t>(sizeof(test_cstring)), bytes_sent);
+  new_socket->SetOnClose(
+      ola::NewSingleCallback(this, &DescriptorTest::TerminateOnClose));
+  m_ss->AddReadDescriptor(new_socket, true);
+}
+
+
 /*
  * Receive some data and close the socket
  */
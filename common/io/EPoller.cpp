@@ -0,0 +1,531 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * EPoller.cpp
+ * A Poller which uses epoll()
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "common/io/EPoller.h"
+#include "ola/Logging.h"
+#include "ola/io/Descriptor.h"
+#include "ola/io/SelectServer.h"
+#include "ola/stl/STLUtils.h"
+
+namespace ola {
+namespace io {
+
+using std::vector;
+
+/*
+ * Constructor
+ * @param export_map an ExportMap to update when descriptors are dropped.
+ * @param clock the Clock to use to update the wake up time.
+ * @param profiler the LoopProfiler to time the handlers with, may be NULL.
+ */
+EPoller::EPoller(ExportMap *export_map, Clock *clock,
+                 LoopProfiler *profiler)
+    : m_export_map(export_map),
+      m_clock(clock),
+      m_profiler(profiler),
+      m_epoll_fd(INVALID_DESCRIPTOR) {
+}
+
+
+EPoller::~EPoller() {
+  UnregisterAll();
+  if (m_epoll_fd != INVALID_DESCRIPTOR)
+    close(m_epoll_fd);
+}
+
+
+/*
+ * Create the epoll descriptor.
+ * @returns true if successful, false otherwise.
+ */
+bool EPoller::Init() {
+  if (m_epoll_fd != INVALID_DESCRIPTOR)
+    return true;
+
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll_fd < 0) {
+    OLA_WARN << "epoll_create1() failed: " << strerror(errno);
+    m_epoll_fd = INVALID_DESCRIPTOR;
+    return false;
+  }
+  m_clock->CurrentTime(&m_last_closed_check);
+  return true;
+}
+
+
+bool EPoller::AddReadDescriptor(ReadFileDescriptor *descriptor) {
+  EPollDescriptor *epoll_descriptor = LookupOrCreate(
+      descriptor->ReadDescriptor());
+  if (epoll_descriptor->read_descriptor ||
+      epoll_descriptor->connected_descriptor) {
+    if (epoll_descriptor->read_descriptor != descriptor)
+      OLA_WARN << "Descriptor " << epoll_descriptor->fd
+               << " is already registered for reading";
+    return false;
+  }
+
+  epoll_descriptor->read_descriptor = descriptor;
+  if (!AddEvents(epoll_descriptor, EPOLLIN)) {
+    epoll_descriptor->read_descriptor = NULL;
+    return false;
+  }
+  if (m_profiler)
+    epoll_descriptor->read_source = m_profiler->ReadSource(descriptor);
+  return true;
+}
+
+
+bool EPoller::AddReadDescriptor(ConnectedDescriptor *descriptor,
+                                bool delete_on_close) {
+  EPollDescriptor *epoll_descriptor = LookupOrCreate(
+      descriptor->ReadDescriptor());
+  if (epoll_descriptor->read_descriptor ||
+      epoll_descriptor->connected_descriptor) {
+    if (epoll_descriptor->connected_descriptor != descriptor)
+      OLA_WARN << "Descriptor " << epoll_descriptor->fd
+               << " is already registered for reading";
+    return false;
+  }
+
+  epoll_descriptor->connected_descriptor = descriptor;
+  epoll_descriptor->delete_connected_on_close = delete_on_close;
+  if (!AddEvents(epoll_descriptor, EPOLLIN)) {
+    epoll_descriptor->connected_descriptor = NULL;
+    epoll_descriptor->delete_connected_on_close = false;
+    return false;
+  }
+  if (m_profiler) {
+    epoll_descriptor->read_source = m_profiler->ReadSource(descriptor);
+    epoll_descriptor->close_source = m_profiler->CloseSource(descriptor);
+  }
+  return true;
+}
+
+
+bool EPoller::RemoveReadDescriptor(ReadFileDescriptor *descriptor) {
+  EPollDescriptor *epoll_descriptor = Find(descriptor->ReadDescriptor(),
+                                           descriptor,
+                                           &EPollDescriptor::read_descriptor);
+  if (!epoll_descriptor)
+    return false;
+
+  epoll_descriptor->read_descriptor = NULL;
+  RemoveEvents(epoll_descriptor, EPOLLIN);
+  return true;
+}
+
+
+bool EPoller::RemoveReadDescriptor(ConnectedDescriptor *descriptor) {
+  EPollDescriptor *epoll_descriptor = Find(
+      descriptor->ReadDescriptor(),
+      descriptor,
+      &EPollDescriptor::connected_descriptor);
+  if (!epoll_descriptor)
+    return false;
+
+  epoll_descriptor->connected_descriptor = NULL;
+  epoll_descriptor->delete_connected_on_close = false;
+  RemoveEvents(epoll_descriptor, EPOLLIN);
+  return true;
+}
+
+
+bool EPoller::AddWriteDescriptor(WriteFileDescriptor *descriptor) {
+  EPollDescriptor *epoll_descriptor = LookupOrCreate(
+      descriptor->WriteDescriptor());
+  if (epoll_descriptor->write_descriptor) {
+    if (epoll_descriptor->write_descriptor != descriptor)
+      OLA_WARN << "Descriptor " << epoll_descriptor->fd
+               << " is already registered for writing";
+    return false;
+  }
+
+  epoll_descriptor->write_descriptor = descriptor;
+  if (!AddEvents(epoll_descriptor, EPOLLOUT)) {
+    epoll_descriptor->write_descriptor = NULL;
+    return false;
+  }
+  if (m_profiler)
+    epoll_descriptor->write_source = m_profiler->WriteSource(descriptor);
+  return true;
+}
+
+
+bool EPoller::RemoveWriteDescriptor(WriteFileDescriptor *descriptor) {
+  EPollDescriptor *epoll_descriptor = Find(descriptor->WriteDescriptor(),
+                                           descriptor,
+                                           &EPollDescriptor::write_descriptor);
+  if (!epoll_descriptor)
+    return false;
+
+  epoll_descriptor->write_descriptor = NULL;
+  RemoveEvents(epoll_descriptor, EPOLLOUT);
+  return true;
+}
+
+
+/*
+ * Wait for I/O and run the handlers.
+ * @return false on error, true on success.
+ */
+bool EPoller::Poll(const TimeInterval &poll_interval) {
+  // Round up, otherwise we'd spin when the next timeout is less than 1ms
+  // away.
+  int64_t poll_usec = poll_interval.AsInt();
+  int timeout_ms = poll_usec <= 0 ? 0 : (poll_usec + 999) / 1000;
+  if (!m_always_ready_descriptors.empty())
+    timeout_ms = 0;
+
+  int ready = epoll_wait(m_epoll_fd, m_events, K_MAX_EVENTS, timeout_ms);
+  if (ready < 0) {
+    if (errno == EINTR)
+      return true;
+    OLA_WARN << "epoll_wait() error, " << strerror(errno);
+    return false;
+  }
+
+  m_clock->CurrentTime(&m_wake_up_time);
+  for (int i = 0; i < ready; i++)
+    HandleEvent(m_events[i]);
+
+  if (!m_always_ready_descriptors.empty()) {
+    // The handlers may remove entries, they won't be freed until the end of
+    // this call.
+    DescriptorList always_ready = m_always_ready_descriptors;
+    DescriptorList::iterator iter = always_ready.begin();
+    for (; iter != always_ready.end(); ++iter) {
+      epoll_event event;
+      event.events = (*iter)->events;
+      event.data.ptr = *iter;
+      HandleEvent(event);
+    }
+    ready += static_cast<int>(always_ready.size());
+  }
+
+  if ((m_wake_up_time - m_last_closed_check).InMilliSeconds() >=
+      K_CLOSED_CHECK_INTERVAL_MS) {
+    CheckForClosedDescriptors();
+    m_last_closed_check = m_wake_up_time;
+  }
+  RunCloseHandlers();
+
+  // Nothing in the kernel refers to the orphans now.
+  STLDeleteElements(&m_orphaned_descriptors);
+
+  if (ready)
+    m_clock->CurrentTime(&m_wake_up_time);
+  return true;
+}
+
+
+/*
+ * Remove all registrations.
+ */
+void EPoller::UnregisterAll() {
+  DescriptorMap::iterator iter = m_descriptor_map.begin();
+  for (; iter != m_descriptor_map.end(); ++iter) {
+    EPollDescriptor *epoll_descriptor = iter->second;
+    if (m_epoll_fd != INVALID_DESCRIPTOR) {
+      epoll_event event;
+      epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, epoll_descriptor->fd, &event);
+    }
+    if (epoll_descriptor->connected_descriptor &&
+        epoll_descriptor->delete_connected_on_close)
+      delete epoll_descriptor->connected_descriptor;
+    delete epoll_descriptor;
+  }
+  m_descriptor_map.clear();
+  m_always_ready_descriptors.clear();
+
+  ClosedDescriptorList::iterator closed_iter = m_closed_descriptors.begin();
+  for (; closed_iter != m_closed_descriptors.end(); ++closed_iter) {
+    if (closed_iter->delete_on_close)
+      delete closed_iter->descriptor;
+  }
+  m_closed_descriptors.clear();
+
+  STLDeleteElements(&m_orphaned_descriptors);
+}
+
+
+/*
+ * Return the entry for a fd, creating one if it doesn't exist.
+ */
+EPoller::EPollDescriptor *EPoller::LookupOrCreate(int fd) {
+  EPollDescriptor *epoll_descriptor = STLFindOrNull(m_descriptor_map, fd);
+  if (epoll_descriptor) {
+    // The fd may have been re-used after being closed without being removed.
+    DropStaleRegistrations(epoll_descriptor);
+    epoll_descriptor = STLFindOrNull(m_descriptor_map, fd);
+    if (epoll_descriptor)
+      return epoll_descriptor;
+  }
+
+  epoll_descriptor = new EPollDescriptor();
+  epoll_descriptor->fd = fd;
+  m_descriptor_map[fd] = epoll_descriptor;
+  return epoll_descriptor;
+}
+
+
+/*
+ * Find the entry that holds a descriptor. We try the fd first, if the
+ * descriptor has been closed we have to fall back to a linear search.
+ */
+template <typename DescriptorType>
+EPoller::EPollDescriptor *EPoller::Find(
+    int fd,
+    const DescriptorType *descriptor,
+    DescriptorType *EPollDescriptor::*member) {
+  EPollDescriptor *epoll_descriptor = STLFindOrNull(m_descriptor_map, fd);
+  if (epoll_descriptor && epoll_descriptor->*member == descriptor)
+    return epoll_descriptor;
+
+  DescriptorMap::iterator iter = m_descriptor_map.begin();
+  for (; iter != m_descriptor_map.end(); ++iter) {
+    if (iter->second->*member == descriptor)
+      return iter->second;
+  }
+  return NULL;
+}
+
+
+/*
+ * Add events to the set we're interested in for an entry.
+ * @returns true if the kernel accepted the change, or the fd is one that
+ *   epoll() doesn't support.
+ */
+bool EPoller::AddEvents(EPollDescriptor *epoll_descriptor, uint32_t events) {
+  epoll_event event;
+  event.events = epoll_descriptor->events | events;
+  event.data.ptr = epoll_descriptor;
+  int op = epoll_descriptor->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  if (epoll_descriptor->always_ready) {
+    epoll_descriptor->events = event.events;
+    return true;
+  }
+
+  if (epoll_ctl(m_epoll_fd, op, epoll_descriptor->fd, &event) < 0) {
+    if (errno == EPERM && op == EPOLL_CTL_ADD) {
+      OLA_DEBUG << "fd " << epoll_descriptor->fd
+                << " can't be used with epoll, it'll be polled every loop";
+      epoll_descriptor->always_ready = true;
+      epoll_descriptor->events = event.events;
+      m_always_ready_descriptors.push_back(epoll_descriptor);
+      return true;
+    }
+    OLA_WARN << "Failed to register fd " << epoll_descriptor->fd
+             << " with epoll: " << strerror(errno);
+    if (!epoll_descriptor->events) {
+      // Never made it to the kernel so we can delete it straight away.
+      m_descriptor_map.erase(epoll_descriptor->fd);
+      delete epoll_descriptor;
+    }
+    return false;
+  }
+  epoll_descriptor->events = event.events;
+  return true;
+}
+
+
+/*
+ * Remove events from the set for an entry. If there are no events left the
+ * entry is unregistered and orphaned.
+ */
+void EPoller::RemoveEvents(EPollDescriptor *epoll_descriptor,
+                           uint32_t events) {
+  epoll_descriptor->events &= ~events;
+
+  if (epoll_descriptor->always_ready) {
+    if (!epoll_descriptor->events) {
+      m_always_ready_descriptors.erase(
+          std::remove(m_always_ready_descriptors.begin(),
+                      m_always_ready_descriptors.end(),
+                      epoll_descriptor),
+          m_always_ready_descriptors.end());
+    }
+  } else {
+    epoll_event event;
+    event.events = epoll_descriptor->events;
+    event.data.ptr = epoll_descriptor;
+    int op = epoll_descriptor->events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+
+    // This fails if the descriptor has already been closed, in which case the
+    // kernel has dropped it anyway.
+    if (epoll_ctl(m_epoll_fd, op, epoll_descriptor->fd, &event) < 0)
+      OLA_DEBUG << "epoll_ctl for fd " << epoll_descriptor->fd << " failed: "
+                << strerror(errno);
+  }
+
+  if (!epoll_descriptor->events) {
+    DescriptorMap::iterator iter = m_descriptor_map.find(epoll_descriptor->fd);
+    if (iter != m_descriptor_map.end() && iter->second == epoll_descriptor)
+      m_descriptor_map.erase(iter);
+    m_orphaned_descriptors.push_back(epoll_descriptor);
+  }
+}
+
+
+/*
+ * Drop any registrations where the descriptor no longer refers to the fd we
+ * registered. This happens when a descriptor is closed without being removed
+ * first.
+ */
+void EPoller::DropStaleRegistrations(EPollDescriptor *epoll_descriptor) {
+  int fd = epoll_descriptor->fd;
+
+  if (epoll_descriptor->read_descriptor &&
+      epoll_descriptor->read_descriptor->ReadDescriptor() != fd) {
+    epoll_descriptor->read_descriptor = NULL;
+    SafeDecrement(SelectServer::K_READ_DESCRIPTOR_VAR);
+    OLA_WARN << "Removed a inactive descriptor from the select server";
+    RemoveEvents(epoll_descriptor, EPOLLIN);
+  }
+
+  if (epoll_descriptor->connected_descriptor &&
+      epoll_descriptor->connected_descriptor->ReadDescriptor() != fd)
+    ScheduleClose(epoll_descriptor);
+
+  if (epoll_descriptor->write_descriptor &&
+      epoll_descriptor->write_descriptor->WriteDescriptor() != fd) {
+    epoll_descriptor->write_descriptor = NULL;
+    SafeDecrement(SelectServer::K_WRITE_DESCRIPTOR_VAR);
+    OLA_WARN << "Removed a disconnected descriptor from the select server";
+    RemoveEvents(epoll_descriptor, EPOLLOUT);
+  }
+}
+
+
+/*
+ * Run the handlers for a single event. Handlers may remove descriptors, so we
+ * re-check the entry before each call.
+ */
+void EPoller::HandleEvent(const epoll_event &event) {
+  EPollDescriptor *epoll_descriptor =
+      reinterpret_cast<EPollDescriptor*>(event.data.ptr);
+
+  // Like select(), we report errors & hang ups as readable / writeable and
+  // let the handler find out what happened.
+  if (event.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    if (epoll_descriptor->read_descriptor) {
+      ProfiledCall call(m_profiler, epoll_descriptor->read_source);
+      epoll_descriptor->read_descriptor->PerformRead();
+    } else if (epoll_descriptor->connected_descriptor) {
+      ConnectedDescriptor *descriptor = epoll_descriptor->connected_descriptor;
+      if (descriptor->IsClosed()) {
+        ScheduleClose(epoll_descriptor);
+      } else {
+        {
+          ProfiledCall call(m_profiler, epoll_descriptor->read_source);
+          descriptor->PerformRead();
+        }
+        if (epoll_descriptor->connected_descriptor == descriptor &&
+            !descriptor->ValidReadDescriptor())
+          ScheduleClose(epoll_descriptor);
+      }
+    }
+  }
+
+  if ((event.events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) &&
+      epoll_descriptor->write_descriptor) {
+    ProfiledCall call(m_profiler, epoll_descriptor->write_source);
+    epoll_descriptor->write_descriptor->PerformWrite();
+  }
+}
+
+
+/*
+ * Unregister a ConnectedDescriptor and queue it so the OnClose handler runs
+ * once we've finished with the current batch of events.
+ */
+void EPoller::ScheduleClose(EPollDescriptor *epoll_descriptor) {
+  connected_descriptor_t closed = {
+    epoll_descriptor->connected_descriptor,
+    epoll_descriptor->delete_connected_on_close,
+    epoll_descriptor->close_source
+  };
+  m_closed_descriptors.push_back(closed);
+
+  epoll_descriptor->connected_descriptor = NULL;
+  epoll_descriptor->delete_connected_on_close = false;
+  RemoveEvents(epoll_descriptor, EPOLLIN);
+}
+
+
+/*
+ * Run the OnClose handlers for any closed ConnectedDescriptors.
+ */
+void EPoller::RunCloseHandlers() {
+  while (!m_closed_descriptors.empty()) {
+    // The handlers may close other descriptors, so swap the list out first.
+    ClosedDescriptorList closed_descriptors;
+    closed_descriptors.swap(m_closed_descriptors);
+
+    ClosedDescriptorList::iterator iter = closed_descriptors.begin();
+    for (; iter != closed_descriptors.end(); ++iter) {
+      ConnectedDescriptor::OnCloseCallback *on_close =
+        iter->descriptor->TransferOnClose();
+      if (on_close) {
+        ProfiledCall call(m_profiler, iter->close_source);
+        on_close->Run();
+      }
+      if (iter->delete_on_close)
+        delete iter->descriptor;
+      SafeDecrement(SelectServer::K_CONNECTED_DESCRIPTORS_VAR);
+    }
+  }
+}
+
+
+/*
+ * Walk the registered descriptors looking for ones that were closed without
+ * being removed. This is the only part of the poller that is O(n) in the
+ * number of descriptors, which is why it's rate limited.
+ */
+void EPoller::CheckForClosedDescriptors() {
+  // DropStaleRegistrations may modify the map.
+  vector<EPollDescriptor*> descriptors;
+  descriptors.reserve(m_descriptor_map.size());
+  DescriptorMap::iterator iter = m_descriptor_map.begin();
+  for (; iter != m_descriptor_map.end(); ++iter)
+    descriptors.push_back(iter->second);
+
+  vector<EPollDescriptor*>::iterator descriptor_iter = descriptors.begin();
+  for (; descriptor_iter != descriptors.end(); ++descriptor_iter)
+    DropStaleRegistrations(*descriptor_iter);
+}
+
+
+void EPoller::SafeDecrement(const char *var_name) {
+  if (m_export_map)
+    (*m_export_map->GetIntegerVar(var_name))--;
+}
+}  // namespace io
+}  // namespace ola
@@ -0,0 +1,157 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * EPoller.h
+ * A Poller which uses epoll()
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#ifndef COMMON_IO_EPOLLER_H_
+#define COMMON_IO_EPOLLER_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <ola/Clock.h>
+#include <ola/ExportMap.h>
+#include <ola/io/Descriptor.h>
+#include <map>
+#include <vector>
+
+#include "common/io/LoopProfiler.h"
+#include "common/io/PollerInterface.h"
+
+namespace ola {
+namespace io {
+
+/**
+ * The epoll() based Poller. Descriptors are registered with the kernel once,
+ * when they're added, and Poll() only visits the descriptors that are ready.
+ *
+ * Descriptors that are closed while still registered are dropped by the
+ * kernel, so we can't rely on an event to tell us about them.
+ * ConnectedDescriptors closed from within their own OnData handler are
+ * detected straight away, anything else is picked up by a sweep that runs
+ * once every K_CLOSED_CHECK_INTERVAL_MS.
+ *
+ * epoll() refuses descriptors that can't block, like regular files. select()
+ * always reports these as ready, so we do the same: they're kept out of the
+ * kernel and their handlers are run on every call to Poll().
+ */
+class EPoller : public PollerInterface {
+  public :
+    EPoller(ExportMap *export_map, Clock *clock,
+            LoopProfiler *profiler = NULL);
+    ~EPoller();
+
+    // Returns false if the epoll descriptor couldn't be created.
+    bool Init();
+
+    bool AddReadDescriptor(ReadFileDescriptor *descriptor);
+    bool AddReadDescriptor(ConnectedDescriptor *descriptor,
+                           bool delete_on_close);
+    bool RemoveReadDescriptor(ReadFileDescriptor *descriptor);
+    bool RemoveReadDescriptor(ConnectedDescriptor *descriptor);
+
+    bool AddWriteDescriptor(WriteFileDescriptor *descriptor);
+    bool RemoveWriteDescriptor(WriteFileDescriptor *descriptor);
+
+    const TimeStamp *WakeUpTime() const { return &m_wake_up_time; }
+
+    bool Poll(const TimeInterval &poll_interval);
+
+    void UnregisterAll();
+
+  private:
+    static const unsigned int K_MAX_EVENTS = 64;
+    static const int K_CLOSED_CHECK_INTERVAL_MS = 1000;
+
+    /*
+     * The state for a single fd. The address of this is stored in the kernel
+     * so it must remain valid until Poll() has finished processing the events
+     * for the current batch.
+     */
+    struct EPollDescriptor {
+      EPollDescriptor()
+          : fd(INVALID_DESCRIPTOR),
+            events(0),
+            read_descriptor(NULL),
+            connected_descriptor(NULL),
+            delete_connected_on_close(false),
+            write_descriptor(NULL),
+            always_ready(false),
+            read_source(NULL),
+            write_source(NULL),
+            close_source(NULL) {
+      }
+
+      int fd;
+      uint32_t events;
+      ReadFileDescriptor *read_descriptor;
+      ConnectedDescriptor *connected_descriptor;
+      bool delete_connected_on_close;
+      WriteFileDescriptor *write_descriptor;
+      bool always_ready;  // true if epoll() refused the fd
+      // the profiler sources, looked up when the handlers are registered
+      LoopProfiler::Source *read_source;
+      LoopProfiler::Source *write_source;
+      LoopProfiler::Source *close_source;
+    };
+
+    typedef struct {
+      ConnectedDescriptor *descriptor;
+      bool delete_on_close;
+      LoopProfiler::Source *close_source;
+    } connected_descriptor_t;
+
+    typedef std::map<int, EPollDescriptor*> DescriptorMap;
+    typedef std::vector<EPollDescriptor*> DescriptorList;
+    typedef std::vector<connected_descriptor_t> ClosedDescriptorList;
+
+    ExportMap *m_export_map;
+    Clock *m_clock;
+    LoopProfiler *m_profiler;
+    int m_epoll_fd;
+    TimeStamp m_wake_up_time;
+    TimeStamp m_last_closed_check;
+    DescriptorMap m_descriptor_map;
+    // Entries that have been unregistered, these are freed once the current
+    // batch of events has been processed.
+    DescriptorList m_orphaned_descriptors;
+    // Entries for fds that epoll() won't accept.
+    DescriptorList m_always_ready_descriptors;
+    // ConnectedDescriptors that need their OnClose handler run.
+    ClosedDescriptorList m_closed_descriptors;
+    epoll_event m_events[K_MAX_EVENTS];
+
+    EPollDescriptor *LookupOrCreate(int fd);
+    template <typename DescriptorType>
+    EPollDescriptor *Find(int fd,
+                          const DescriptorType *descriptor,
+                          DescriptorType *EPollDescriptor::*member);
+    bool AddEvents(EPollDescriptor *descriptor, uint32_t events);
+    void RemoveEvents(EPollDescriptor *descriptor, uint32_t events);
+    void DropStaleRegistrations(EPollDescriptor *descriptor);
+    void HandleEvent(const epoll_event &event);
+    void ScheduleClose(EPollDescriptor *descriptor);
+    void RunCloseHandlers();
+    void CheckForClosedDescriptors();
+    void SafeDecrement(const char *var_name);
+
+    EPoller(const EPoller&);
+    EPoller operator=(const EPoller&);
+};
+}  // namespace io
+}  // namespace ola
+#endif  // COMMON_IO_EPOLLER_H_
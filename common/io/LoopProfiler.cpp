@@ -0,0 +1,196 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * LoopProfiler.cpp
+ * Times the callbacks run by the SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <typeinfo>
+
+#include "common/io/LoopProfiler.h"
+#include "ola/Logging.h"
+
+namespace ola {
+namespace io {
+
+using std::string;
+
+// time spent in each callback source, in microseconds
+const char LoopProfiler::K_CALLBACK_TIME_VAR[] = "ss-callback-time-us";
+// callbacks that took longer than the budget
+const char LoopProfiler::K_SLOW_CALLBACKS_VAR[] = "ss-slow-callbacks";
+
+struct LoopSource {
+  string name;
+  Histogram *time;
+  CounterHandle slow;
+};
+
+
+/*
+ * Create a new LoopProfiler.
+ * @param export_map the ExportMap to publish the timings in.
+ * @param clock the clock to time the callbacks with.
+ */
+LoopProfiler::LoopProfiler(ExportMap *export_map, const Clock *clock)
+    : m_clock(clock),
+      m_time_map(export_map->GetHistogramMapVar(K_CALLBACK_TIME_VAR,
+                                                "source")),
+      m_slow_map(export_map->GetUIntMapVar(K_SLOW_CALLBACKS_VAR, "source")) {
+}
+
+
+LoopProfiler::~LoopProfiler() {
+  for (unsigned int i = 0; i <= EXECUTE; i++) {
+    SourceMap::iterator iter = m_sources[i].begin();
+    for (; iter != m_sources[i].end(); ++iter)
+      delete iter->second;
+  }
+}
+
+
+/*
+ * Look up a source, creating it the first time we see the name.
+ * @param kind the kind of event the handler runs for.
+ * @param name the name of the handler.
+ */
+LoopProfiler::Source *LoopProfiler::GetSource(SourceKind kind,
+                                              const string &name) {
+  static const char *const KINDS[] = {
+    "read", "write", "close", "timeout", "loop", "execute"};
+
+  SourceMap &sources = m_sources[kind];
+  SourceMap::iterator iter = sources.find(name);
+  if (iter != sources.end())
+    return iter->second;
+
+  Source *source = new Source();
+  source->name = string(KINDS[kind]) + ":" + name;
+  source->time = &(*m_time_map)[source->name];
+  source->slow = m_slow_map->Handle(source->name);
+  sources[name] = source;
+  return source;
+}
+
+
+/*
+ * Look up a source, naming it after the type of the handler if the name is
+ * empty. This is called each time a timeout or an unnamed descriptor handler
+ * is registered, so the type name is only demangled the first time we see the
+ * type. Execute() closures don't come through here, they're all timed under
+ * the one source the SelectServer looks up when it's created.
+ * @param kind the kind of event the handler runs for.
+ * @param name the name of the handler, may be empty.
+ * @param type the type of the handler, usually the callback.
+ */
+LoopProfiler::Source *LoopProfiler::GetSource(SourceKind kind,
+                                              const string &name,
+                                              const std::type_info &type) {
+  if (!name.empty())
+    return GetSource(kind, name);
+
+  Source *&source = m_type_sources[kind][&type];
+  if (!source)
+    source = GetSource(kind, TypeName(type));
+  return source;
+}
+
+
+LoopProfiler::Source *LoopProfiler::ReadSource(
+    const ReadFileDescriptor *descriptor) {
+  return GetSource(READ, descriptor->ReadHandlerName(),
+                   descriptor->ReadHandlerType());
+}
+
+
+LoopProfiler::Source *LoopProfiler::WriteSource(
+    const WriteFileDescriptor *descriptor) {
+  return GetSource(WRITE, descriptor->WriteHandlerName(),
+                   descriptor->WriteHandlerType());
+}
+
+
+/*
+ * The on close handler can be changed at any time, so this uses the name of
+ * the read handler.
+ */
+LoopProfiler::Source *LoopProfiler::CloseSource(
+    const ConnectedDescriptor *descriptor) {
+  return GetSource(CLOSE, descriptor->ReadHandlerName(),
+                   descriptor->ReadHandlerType());
+}
+
+
+/*
+ * Record the time taken by a callback.
+ * @param source the source of the callback.
+ * @param start the time the callback started.
+ */
+void LoopProfiler::Finish(Source *source, const TimeStamp &start) {
+  TimeStamp end;
+  m_clock->CurrentTime(&end);
+  TimeInterval duration = end - start;
+  int64_t usec = std::max(static_cast<int64_t>(0),
+                          std::min(duration.AsInt(),
+                                   static_cast<int64_t>(UINT_MAX)));
+  source->time->Add(static_cast<unsigned int>(usec));
+
+  if (m_budget != TimeInterval() && duration > m_budget) {
+    source->slow++;
+    OLA_WARN << "Slow callback: " << source->name << " took " << usec <<
+      "us, the budget is " << m_budget.AsInt() << "us";
+  }
+}
+
+
+/*
+ * Work out the name for a handler from its type. Callbacks to methods are
+ * named after the class the method belongs to, which is the first template
+ * argument of the MethodCallback. Other handlers are named after their own
+ * class.
+ */
+string LoopProfiler::TypeName(const std::type_info &type) {
+  string type_name = type.name();
+#ifdef __GNUC__
+  int status;
+  char *demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  if (demangled) {
+    type_name = demangled;
+    free(demangled);
+  }
+#endif
+
+  if (type_name.find("FunctionCallback") != string::npos) {
+    type_name = "function";
+  } else if (type_name.find("MethodCallback") != string::npos) {
+    string::size_type start = type_name.find('<');
+    string::size_type end = type_name.find(',', start);
+    if (start != string::npos && end != string::npos)
+      type_name = type_name.substr(start + 1, end - start - 1);
+  }
+  return type_name;
+}
+}  // namespace io
+}  // namespace ola
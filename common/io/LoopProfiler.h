@@ -0,0 +1,138 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * LoopProfiler.h
+ * Times the callbacks run by the SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Each callback is attributed to a source, which is the kind of event (read,
+ * write, close, timeout, loop or execute) and a name. Descriptors can be given
+ * a name with BidirectionalFileDescriptor::SetName(). Anything without a name
+ * is named after the class that handles it: for callbacks created with
+ * NewCallback(this, &Class::Method) that's the class the method belongs to.
+ * Callbacks to plain functions are grouped together as 'function'.
+ *
+ * The source is looked up once, when the descriptor, timeout or loop callback
+ * is registered, and kept with the registration. Each source has a Histogram,
+ * so the cost per callback is two clock reads.
+ *
+ * Callbacks that take longer than the budget are logged and counted.
+ *
+ * Callbacks passed to SelectServer::Execute() aren't registered, so they're
+ * all timed under one source, as well as together under the read handler of
+ * the SelectServer that runs them.
+ */
+
+#ifndef COMMON_IO_LOOPPROFILER_H_
+#define COMMON_IO_LOOPPROFILER_H_
+
+#include <ola/Clock.h>
+#include <ola/ExportMap.h>
+#include <ola/io/Descriptor.h>
+#include <map>
+#include <string>
+#include <typeinfo>
+
+namespace ola {
+namespace io {
+
+// Opaque to everything other than the LoopProfiler.
+struct LoopSource;
+
+class LoopProfiler {
+  public:
+    enum SourceKind {
+      READ,
+      WRITE,
+      CLOSE,
+      TIMEOUT,
+      LOOP,
+      EXECUTE
+    };
+
+    typedef LoopSource Source;
+
+    LoopProfiler(ExportMap *export_map, const Clock *clock);
+    ~LoopProfiler();
+
+    // A zero budget disables the slow callback reporting.
+    void SetBudget(const TimeInterval &budget) { m_budget = budget; }
+    const TimeInterval &Budget() const { return m_budget; }
+
+    // Look up, or create, a source. These should be called when the handler is
+    // registered, rather than each time it runs. In the second form an empty
+    // name means the source is named after the type of the handler.
+    Source *GetSource(SourceKind kind, const std::string &name);
+    Source *GetSource(SourceKind kind, const std::string &name,
+                      const std::type_info &type);
+
+    // The sources for a descriptor's handlers.
+    Source *ReadSource(const ReadFileDescriptor *descriptor);
+    Source *WriteSource(const WriteFileDescriptor *descriptor);
+    Source *CloseSource(const ConnectedDescriptor *descriptor);
+
+    void Start(TimeStamp *start) const { m_clock->CurrentTime(start); }
+    void Finish(Source *source, const TimeStamp &start);
+
+    static const char K_CALLBACK_TIME_VAR[];
+    static const char K_SLOW_CALLBACKS_VAR[];
+
+  private:
+    typedef std::map<std::string, Source*> SourceMap;
+    typedef std::map<const std::type_info*, Source*> TypeSourceMap;
+
+    const Clock *m_clock;
+    HistogramMap *m_time_map;
+    UIntMap *m_slow_map;
+    TimeInterval m_budget;
+    SourceMap m_sources[EXECUTE + 1];
+    TypeSourceMap m_type_sources[EXECUTE + 1];
+
+    static std::string TypeName(const std::type_info &type);
+
+    LoopProfiler(const LoopProfiler&);
+    LoopProfiler& operator=(const LoopProfiler&);
+};
+
+
+/*
+ * Times a callback for as long as it's in scope. If the profiler or source is
+ * NULL this does nothing.
+ */
+class ProfiledCall {
+  public:
+    ProfiledCall(LoopProfiler *profiler, LoopProfiler::Source *source)
+        : m_profiler(source ? profiler : NULL),
+          m_source(source) {
+      if (m_profiler)
+        m_profiler->Start(&m_start);
+    }
+
+    ~ProfiledCall() {
+      if (m_profiler)
+        m_profiler->Finish(m_source, m_start);
+    }
+
+  private:
+    LoopProfiler *m_profiler;
+    LoopProfiler::Source *m_source;
+    TimeStamp m_start;
+
+    ProfiledCall(const ProfiledCall&);
+    ProfiledCall& operator=(const ProfiledCall&);
+};
+}  // namespace io
+}  // namespace ola
+#endif  // COMMON_IO_LOOPPROFILER_H_
@@ -0,0 +1,74 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * PollerInterface.h
+ * The interface for the classes that wait for I/O events.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * A Poller is the part of the SelectServer that tracks the registered
+ * descriptors, blocks until one or more of them is ready and then runs the
+ * PerformRead() / PerformWrite() / OnClose() handlers. The SelectServer takes
+ * care of timeouts, loop closures & the export map counters.
+ */
+
+#ifndef COMMON_IO_POLLERINTERFACE_H_
+#define COMMON_IO_POLLERINTERFACE_H_
+
+#include <ola/Clock.h>
+#include <ola/io/Descriptor.h>
+
+namespace ola {
+namespace io {
+
+class PollerInterface {
+  public :
+    virtual ~PollerInterface() {}
+
+    /*
+     * The Add / Remove methods return true if the registration changed. The
+     * SelectServer checks that the descriptors are valid before calling
+     * these.
+     */
+    virtual bool AddReadDescriptor(ReadFileDescriptor *descriptor) = 0;
+    virtual bool AddReadDescriptor(ConnectedDescriptor *descriptor,
+                                   bool delete_on_close) = 0;
+    virtual bool RemoveReadDescriptor(ReadFileDescriptor *descriptor) = 0;
+    virtual bool RemoveReadDescriptor(ConnectedDescriptor *descriptor) = 0;
+
+    virtual bool AddWriteDescriptor(WriteFileDescriptor *descriptor) = 0;
+    virtual bool RemoveWriteDescriptor(WriteFileDescriptor *descriptor) = 0;
+
+    /*
+     * The time we last woke up. This is updated when Poll() returns from the
+     * underlying system call and again after the handlers have run.
+     */
+    virtual const TimeStamp *WakeUpTime() const = 0;
+
+    /*
+     * Block for up to poll_interval waiting for I/O, and then run the
+     * handlers for any ready descriptors.
+     * @returns false if there was an error, true otherwise.
+     */
+    virtual bool Poll(const TimeInterval &poll_interval) = 0;
+
+    /*
+     * Drop all registrations, deleting any ConnectedDescriptors that were
+     * added with delete_on_close.
+     */
+    virtual void UnregisterAll() = 0;
+};
+}  // namespace io
+}  // namespace ola
+#endif  // COMMON_IO_POLLERINTERFACE_H_
@@ -0,0 +1,323 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SelectPoller.cpp
+ * A Poller which uses select()
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <set>
+
+#include "common/io/SelectPoller.h"
+#include "ola/Logging.h"
+#include "ola/io/Descriptor.h"
+#include "ola/io/SelectServer.h"
+#include "ola/stl/STLUtils.h"
+
+namespace ola {
+namespace io {
+
+using std::max;
+
+/*
+ * Constructor
+ * @param export_map an ExportMap to update when descriptors are dropped.
+ * @param clock the Clock to use to update the wake up time.
+ * @param profiler the LoopProfiler to time the handlers with, may be NULL.
+ */
+SelectPoller::SelectPoller(ExportMap *export_map, Clock *clock,
+                           LoopProfiler *profiler)
+    : m_export_map(export_map),
+      m_clock(clock),
+      m_profiler(profiler) {
+}
+
+
+SelectPoller::~SelectPoller() {
+  UnregisterAll();
+}
+
+
+bool SelectPoller::AddReadDescriptor(ReadFileDescriptor *descriptor) {
+  if (STLContains(m_read_descriptors, descriptor))
+    return false;
+  m_read_descriptors[descriptor] =
+    m_profiler ? m_profiler->ReadSource(descriptor) : NULL;
+  return true;
+}
+
+
+bool SelectPoller::AddReadDescriptor(ConnectedDescriptor *descriptor,
+                                     bool delete_on_close) {
+  // We make use of the fact that connected_descriptor_t_lt operates on the
+  // descriptor value alone.
+  connected_descriptor_t registered_descriptor = {
+    descriptor, delete_on_close, NULL, NULL};
+  if (STLContains(m_connected_read_descriptors, registered_descriptor))
+    return false;
+  if (m_profiler) {
+    registered_descriptor.read_source = m_profiler->ReadSource(descriptor);
+    registered_descriptor.close_source = m_profiler->CloseSource(descriptor);
+  }
+  m_connected_read_descriptors.insert(registered_descriptor);
+  return true;
+}
+
+
+bool SelectPoller::RemoveReadDescriptor(ReadFileDescriptor *descriptor) {
+  return STLRemove(&m_read_descriptors, descriptor);
+}
+
+
+bool SelectPoller::RemoveReadDescriptor(ConnectedDescriptor *descriptor) {
+  // Comparison is based on descriptor only, so the second value is redundant.
+  connected_descriptor_t registered_descriptor = {descriptor, false, NULL,
+                                                  NULL};
+  return STLRemove(&m_connected_read_descriptors, registered_descriptor);
+}
+
+
+bool SelectPoller::AddWriteDescriptor(WriteFileDescriptor *descriptor) {
+  if (STLContains(m_write_descriptors, descriptor))
+    return false;
+  m_write_descriptors[descriptor] =
+    m_profiler ? m_profiler->WriteSource(descriptor) : NULL;
+  return true;
+}
+
+
+bool SelectPoller::RemoveWriteDescriptor(WriteFileDescriptor *descriptor) {
+  return STLRemove(&m_write_descriptors, descriptor);
+}
+
+
+/*
+ * Wait for I/O and run the handlers.
+ * @return false on error, true on success.
+ */
+bool SelectPoller::Poll(const TimeInterval &poll_interval) {
+  int maxsd = 0;
+  fd_set r_fds, w_fds;
+  TimeInterval sleep_interval = poll_interval;
+  struct timeval tv;
+
+  FD_ZERO(&r_fds);
+  FD_ZERO(&w_fds);
+  bool closed_descriptors = AddDescriptorsToSet(&r_fds, &w_fds, &maxsd);
+
+  // If there are closed descriptors, set the timeout to something very small
+  // (1ms). This ensures we at least make a pass through the descriptors.
+  if (closed_descriptors)
+    sleep_interval = std::min(sleep_interval, TimeInterval(0, 1000));
+
+  sleep_interval.AsTimeval(&tv);
+  switch (select(maxsd + 1, &r_fds, &w_fds, NULL, &tv)) {
+    case 0:
+      // timeout
+      m_clock->CurrentTime(&m_wake_up_time);
+
+      if (closed_descriptors) {
+        // there were closed descriptors before the select() we need to deal
+        // with them.
+        FD_ZERO(&r_fds);
+        FD_ZERO(&w_fds);
+        CheckDescriptors(&r_fds, &w_fds);
+      }
+      return true;
+    case -1:
+      if (errno == EINTR)
+        return true;
+      OLA_WARN << "select() error, " << strerror(errno);
+      return false;
+    default:
+      m_clock->CurrentTime(&m_wake_up_time);
+      CheckDescriptors(&r_fds, &w_fds);
+      m_clock->CurrentTime(&m_wake_up_time);
+  }
+  return true;
+}
+
+
+/*
+ * Remove all registrations.
+ */
+void SelectPoller::UnregisterAll() {
+  ConnectedDescriptorSet::iterator iter = m_connected_read_descriptors.begin();
+  for (; iter != m_connected_read_descriptors.end(); ++iter) {
+    if (iter->delete_on_close) {
+      delete iter->descriptor;
+    }
+  }
+  m_read_descriptors.clear();
+  m_connected_read_descriptors.clear();
+  m_write_descriptors.clear();
+}
+
+
+/*
+ * Add all the descriptors to the FD_SET
+ * @returns true if there are closed descriptors.
+ */
+bool SelectPoller::AddDescriptorsToSet(fd_set *r_set,
+                                       fd_set *w_set,
+                                       int *max_sd) {
+  bool closed_descriptors = false;
+
+  ReadDescriptorMap::iterator iter = m_read_descriptors.begin();
+  while (iter != m_read_descriptors.end()) {
+    ReadDescriptorMap::iterator this_iter = iter;
+    iter++;
+
+    if (this_iter->first->ValidReadDescriptor()) {
+      *max_sd = max(*max_sd, this_iter->first->ReadDescriptor());
+      FD_SET(this_iter->first->ReadDescriptor(), r_set);
+    } else {
+      // The descriptor was probably closed without removing it from the select
+      // server
+      SafeDecrement(SelectServer::K_READ_DESCRIPTOR_VAR);
+      m_read_descriptors.erase(this_iter);
+      OLA_WARN << "Removed a inactive descriptor from the select server";
+    }
+  }
+
+  ConnectedDescriptorSet::iterator con_iter =
+      m_connected_read_descriptors.begin();
+  while (con_iter != m_connected_read_descriptors.end()) {
+    ConnectedDescriptorSet::iterator this_iter = con_iter;
+    con_iter++;
+
+    if (this_iter->descriptor->ValidReadDescriptor()) {
+      *max_sd = max(*max_sd, this_iter->descriptor->ReadDescriptor());
+      FD_SET(this_iter->descriptor->ReadDescriptor(), r_set);
+    } else {
+      closed_descriptors = true;
+    }
+  }
+
+  WriteDescriptorMap::iterator write_iter = m_write_descriptors.begin();
+  while (write_iter != m_write_descriptors.end()) {
+    WriteDescriptorMap::iterator this_iter = write_iter;
+    write_iter++;
+
+    if (this_iter->first->ValidWriteDescriptor()) {
+      *max_sd = max(*max_sd, this_iter->first->WriteDescriptor());
+      FD_SET(this_iter->first->WriteDescriptor(), w_set);
+    } else {
+      // The descriptor was probably closed without removing it from the select
+      // server
+      SafeDecrement(SelectServer::K_WRITE_DESCRIPTOR_VAR);
+      m_write_descriptors.erase(this_iter);
+      OLA_WARN << "Removed a disconnected descriptor from the select server";
+    }
+  }
+  return closed_descriptors;
+}
+
+
+/*
+ * Check all the registered descriptors:
+ *  - Execute the callback for descriptors with data
+ *  - Excute OnClose if a remote end closed the connection
+ */
+void SelectPoller::CheckDescriptors(fd_set *r_set, fd_set *w_set) {
+  // Because the callbacks can add or remove descriptors from the select
+  // server, we have to call them after we've used the iterators.
+  std::queue<ReadDescriptorMap::value_type> read_ready_queue;
+  std::queue<WriteDescriptorMap::value_type> write_ready_queue;
+  std::queue<connected_descriptor_t> closed_queue;
+
+  ReadDescriptorMap::iterator iter = m_read_descriptors.begin();
+  for (; iter != m_read_descriptors.end(); ++iter) {
+    if (FD_ISSET(iter->first->ReadDescriptor(), r_set))
+      read_ready_queue.push(*iter);
+  }
+
+  // check the read sockets
+  ConnectedDescriptorSet::iterator con_iter =
+      m_connected_read_descriptors.begin();
+  while (con_iter != m_connected_read_descriptors.end()) {
+    ConnectedDescriptorSet::iterator this_iter = con_iter;
+    con_iter++;
+    bool closed = false;
+    if (!this_iter->descriptor->ValidReadDescriptor()) {
+      closed = true;
+    } else if (FD_ISSET(this_iter->descriptor->ReadDescriptor(), r_set)) {
+      if (this_iter->descriptor->IsClosed())
+        closed = true;
+      else
+        read_ready_queue.push(ReadDescriptorMap::value_type(
+            this_iter->descriptor, this_iter->read_source));
+    }
+
+    if (closed) {
+      closed_queue.push(*this_iter);
+      m_connected_read_descriptors.erase(this_iter);
+    }
+  }
+
+  // check the write sockets
+  WriteDescriptorMap::iterator write_iter = m_write_descriptors.begin();
+  for (; write_iter != m_write_descriptors.end(); write_iter++) {
+    if (FD_ISSET(write_iter->first->WriteDescriptor(), w_set))
+      write_ready_queue.push(*write_iter);
+  }
+
+  // deal with anything that needs an action
+  while (!read_ready_queue.empty()) {
+    const ReadDescriptorMap::value_type &ready = read_ready_queue.front();
+    {
+      ProfiledCall call(m_profiler, ready.second);
+      ready.first->PerformRead();
+    }
+    read_ready_queue.pop();
+  }
+
+  while (!write_ready_queue.empty()) {
+    const WriteDescriptorMap::value_type &ready = write_ready_queue.front();
+    {
+      ProfiledCall call(m_profiler, ready.second);
+      ready.first->PerformWrite();
+    }
+    write_ready_queue.pop();
+  }
+
+  while (!closed_queue.empty()) {
+    const connected_descriptor_t &connected_descriptor = closed_queue.front();
+    ConnectedDescriptor::OnCloseCallback *on_close =
+      connected_descriptor.descriptor->TransferOnClose();
+    if (on_close) {
+      ProfiledCall call(m_profiler, connected_descriptor.close_source);
+      on_close->Run();
+    }
+    if (connected_descriptor.delete_on_close)
+      delete connected_descriptor.descriptor;
+    SafeDecrement(SelectServer::K_CONNECTED_DESCRIPTORS_VAR);
+    closed_queue.pop();
+  }
+}
+
+
+void SelectPoller::SafeDecrement(const char *var_name) {
+  if (m_export_map)
+    (*m_export_map->GetIntegerVar(var_name))--;
+}
+}  // namespace io
+}  // namespace ola
@@ -0,0 +1,108 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SelectPoller.h
+ * A Poller which uses select()
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#ifndef COMMON_IO_SELECTPOLLER_H_
+#define COMMON_IO_SELECTPOLLER_H_
+
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include <ola/Clock.h>
+#include <ola/ExportMap.h>
+#include <ola/io/Descriptor.h>
+#include <map>
+#include <set>
+
+#include "common/io/LoopProfiler.h"
+#include "common/io/PollerInterface.h"
+
+namespace ola {
+namespace io {
+
+/**
+ * The select() based Poller. This is portable but each call to Poll() walks
+ * every registered descriptor twice and is limited to FD_SETSIZE descriptors.
+ */
+class SelectPoller : public PollerInterface {
+  public :
+    SelectPoller(ExportMap *export_map, Clock *clock,
+                 LoopProfiler *profiler = NULL);
+    ~SelectPoller();
+
+    bool AddReadDescriptor(ReadFileDescriptor *descriptor);
+    bool AddReadDescriptor(ConnectedDescriptor *descriptor,
+                           bool delete_on_close);
+    bool RemoveReadDescriptor(ReadFileDescriptor *descriptor);
+    bool RemoveReadDescriptor(ConnectedDescriptor *descriptor);
+
+    bool AddWriteDescriptor(WriteFileDescriptor *descriptor);
+    bool RemoveWriteDescriptor(WriteFileDescriptor *descriptor);
+
+    const TimeStamp *WakeUpTime() const { return &m_wake_up_time; }
+
+    bool Poll(const TimeInterval &poll_interval);
+
+    void UnregisterAll();
+
+  private:
+    typedef struct {
+      ConnectedDescriptor *descriptor;
+      bool delete_on_close;
+      LoopProfiler::Source *read_source;
+      LoopProfiler::Source *close_source;
+    } connected_descriptor_t;
+
+    struct connected_descriptor_t_lt {
+      bool operator()(const connected_descriptor_t &c1,
+                      const connected_descriptor_t &c2) const {
+        return c1.descriptor->ReadDescriptor() <
+            c2.descriptor->ReadDescriptor();
+      }
+    };
+
+    // Each descriptor maps to the profiler source for its handler.
+    typedef std::map<ReadFileDescriptor*, LoopProfiler::Source*>
+      ReadDescriptorMap;
+    typedef std::map<WriteFileDescriptor*, LoopProfiler::Source*>
+      WriteDescriptorMap;
+    typedef std::set<connected_descriptor_t, connected_descriptor_t_lt>
+      ConnectedDescriptorSet;
+
+    ExportMap *m_export_map;
+    Clock *m_clock;
+    LoopProfiler *m_profiler;
+    TimeStamp m_wake_up_time;
+    ReadDescriptorMap m_read_descriptors;
+    ConnectedDescriptorSet m_connected_read_descriptors;
+    WriteDescriptorMap m_write_descriptors;
+
+    void CheckDescriptors(fd_set *r_set, fd_set *w_set);
+    bool AddDescriptorsToSet(fd_set *r_set, fd_set *w_set, int *max_sd);
+    void SafeDecrement(const char *var_name);
+
+    SelectPoller(const SelectPoller&);
+    SelectPoller operator=(const SelectPoller&);
+};
+}  // namespace io
+}  // namespace ola
+#endif  // COMMON_IO_SELECTPOLLER_H_
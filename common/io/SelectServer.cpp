@@ -18,27 +18,38 @@
  * Copyright (C) 2005-2008 Simon Newton
  */
 
-#ifdef WIN32
-#include <winsock2.h>
-#else
-#include <sys/select.h>
+#if HAVE_CONFIG_H
+#  include <config.h>
 #endif
 
-#include <string.h>
-#include <errno.h>
-
 #include <algorithm>
+#include <map>
 #include <queue>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "common/io/LoopProfiler.h"
+#include "common/io/PollerInterface.h"
+#include "common/io/SelectPoller.h"
+#include "common/io/TimeoutManager.h"
 #include "ola/Logging.h"
+#include "ola/base/Flags.h"
 #include "ola/io/Descriptor.h"
 #include "ola/io/SelectServer.h"
 #include "ola/network/Socket.h"
 #include "ola/stl/STLUtils.h"
 
+#ifdef HAVE_EPOLL
+#include "common/io/EPoller.h"
+
+DEFINE_bool(use_epoll, true, "Disable the use of epoll(), revert to select()");
+#endif
+
+DEFINE_uint32(callback_budget_ms, 100,
+              "Log event loop callbacks that take longer than this, 0 to "
+              "disable.");
+
 
 namespace ola {
 namespace io {
@@ -52,6 +63,8 @@ const char SelectServer::K_CONNECTED_DESCRIPTORS_VAR[] =
     "ss-connected-descriptors";
 // # of timer functions registered
 const char SelectServer::K_TIMER_VAR[] = "ss-timers";
+// # of timer functions cancelled before they ran
+const char SelectServer::K_TIMER_CANCELLED_VAR[] = "ss-timers-cancelled";
 // time spent processing events/timeouts in microseconds
 const char SelectServer::K_LOOP_TIME[] = "ss-loop-time";
 // iterations through the select server
@@ -59,9 +72,7 @@ const char SelectServer::K_LOOP_COUNT[] = "ss-loop-count";
 
 using ola::Callback0;
 using ola::ExportMap;
-using ola::thread::INVALID_TIMEOUT;
 using ola::thread::timeout_id;
-using std::max;
 
 
 /*
@@ -79,25 +90,53 @@ SelectServer::SelectServer(ExportMap *export_map,
       m_loop_iterations(NULL),
       m_loop_time(NULL),
       m_clock(clock),
-      m_free_clock(false) {
+      m_free_clock(false),
+      m_profiler(NULL),
+      m_execute_source(NULL),
+      m_poller(NULL),
+      m_timeout_manager(NULL) {
+
+  if (!m_clock) {
+    m_clock = new Clock;
+    m_free_clock = true;
+  }
 
   if (m_export_map) {
     m_export_map->GetIntegerVar(K_READ_DESCRIPTOR_VAR);
-    m_export_map->GetIntegerVar(K_TIMER_VAR);
     m_loop_time = m_export_map->GetCounterVar(K_LOOP_TIME);
     m_loop_iterations = m_export_map->GetCounterVar(K_LOOP_COUNT);
+    m_profiler = new LoopProfiler(m_export_map, m_clock);
+    m_profiler->SetBudget(
+        TimeInterval(static_cast<int64_t>(FLAGS_callback_budget_ms) * 1000));
+    m_execute_source = m_profiler->GetSource(LoopProfiler::EXECUTE, "queued");
   }
 
-  if (!m_clock) {
-    m_clock = new Clock;
-    m_free_clock = true;
+#ifdef HAVE_EPOLL
+  if (FLAGS_use_epoll) {
+    EPoller *poller = new EPoller(m_export_map, m_clock, m_profiler);
+    if (poller->Init()) {
+      m_poller = poller;
+      OLA_DEBUG << "Using epoll()";
+    } else {
+      OLA_WARN << "Failed to init epoll(), falling back to select()";
+      delete poller;
+    }
   }
+#endif
+
+  if (!m_poller)
+    m_poller = new SelectPoller(m_export_map, m_clock, m_profiler);
+
+  m_timeout_manager = new TimeoutManager(m_export_map, m_clock, m_profiler);
 
   // TODO(simon): this should really be in an Init() method.
   if (!m_incoming_descriptor.Init())
     OLA_FATAL << "Failed to init LoopbackDescriptor, Execute() won't work!";
   m_incoming_descriptor.SetOnData(
       ola::NewCallback(this, &SelectServer::DrainAndExecute));
+  // This isn't counted in the export map.
+  if (m_incoming_descriptor.ValidReadDescriptor())
+    m_poller->AddReadDescriptor(&m_incoming_descriptor, false);
 }
 
 
@@ -106,11 +145,22 @@ SelectServer::SelectServer(ExportMap *export_map,
  */
 SelectServer::~SelectServer() {
   UnregisterAll();
+  delete m_timeout_manager;
+  delete m_poller;
+  delete m_profiler;
   if (m_free_clock)
     delete m_clock;
 }
 
 
+/**
+ * The time when we last woke up.
+ */
+const TimeStamp *SelectServer::WakeUpTime() const {
+  return m_poller->WakeUpTime();
+}
+
+
 /**
  * A thread safe terminate
  */
@@ -171,7 +221,7 @@ bool SelectServer::AddReadDescriptor(ReadFileDescriptor *descriptor) {
     return false;
   }
 
-  if (STLInsertIfNotPresent(&m_read_descriptors, descriptor)) {
+  if (m_poller->AddReadDescriptor(descriptor)) {
     SafeIncrement(K_READ_DESCRIPTOR_VAR);
     return true;
   }
@@ -195,12 +245,7 @@ bool SelectServer::AddReadDescriptor(ConnectedDescriptor *descriptor,
     return false;
   }
 
-  // We make use of the fact that connected_descriptor_t_lt operates on the
-  // descriptor value alone.
-  connected_descriptor_t registered_descriptor = {descriptor, delete_on_close};
-
-  if (STLInsertIfNotPresent(&m_connected_read_descriptors,
-                             registered_descriptor)) {
+  if (m_poller->AddReadDescriptor(descriptor, delete_on_close)) {
     SafeIncrement(K_CONNECTED_DESCRIPTORS_VAR);
     return true;
   }
@@ -217,7 +262,7 @@ bool SelectServer::RemoveReadDescriptor(ReadFileDescriptor *descriptor) {
   if (!descriptor->ValidReadDescriptor())
     OLA_WARN << "Removing an invalid file descriptor";
 
-  if (STLRemove(&m_read_descriptors, descriptor)) {
+  if (m_poller->RemoveReadDescriptor(descriptor)) {
     SafeDecrement(K_READ_DESCRIPTOR_VAR);
     return true;
   }
@@ -234,9 +279,7 @@ bool SelectServer::RemoveReadDescriptor(ConnectedDescriptor *descriptor) {
   if (!descriptor->ValidReadDescriptor())
     OLA_WARN << "Removing an invalid file descriptor";
 
-  // Comparison is based on descriptor only, so the second value is redundant.
-  connected_descriptor_t registered_descriptor = {descriptor, false};
-  if (STLRemove(&m_connected_read_descriptors, registered_descriptor)) {
+  if (m_poller->RemoveReadDescriptor(descriptor)) {
     SafeDecrement(K_CONNECTED_DESCRIPTORS_VAR);
     return true;
   }
@@ -256,7 +299,7 @@ bool SelectServer::AddWriteDescriptor(WriteFileDescriptor *descriptor) {
     return false;
   }
 
-  if (STLInsertIfNotPresent(&m_write_descriptors, descriptor)) {
+  if (m_poller->AddWriteDescriptor(descriptor)) {
     SafeIncrement(K_WRITE_DESCRIPTOR_VAR);
     return true;
   }
@@ -274,7 +317,7 @@ bool SelectServer::RemoveWriteDescriptor(WriteFileDescriptor *descriptor) {
   if (!descriptor->ValidWriteDescriptor())
     OLA_WARN << "Removing a closed descriptor";
 
-  if (STLRemove(&m_write_descriptors, descriptor)) {
+  if (m_poller->RemoveWriteDescriptor(descriptor)) {
     SafeDecrement(K_WRITE_DESCRIPTOR_VAR);
     return true;
   }
@@ -311,14 +354,7 @@ timeout_id SelectServer::RegisterRepeatingTimeout(
 timeout_id SelectServer::RegisterRepeatingTimeout(
     const TimeInterval &interval,
     ola::Callback0<bool> *closure) {
-  if (!closure)
-    return INVALID_TIMEOUT;
-
-  SafeIncrement(K_TIMER_VAR);
-
-  Event *event = new RepeatingEvent(interval, m_clock, closure);
-  m_events.push(event);
-  return event;
+  return m_timeout_manager->RegisterRepeatingTimeout(interval, closure);
 }
 
 
@@ -347,27 +383,17 @@ timeout_id SelectServer::RegisterSingleTimeout(
 timeout_id SelectServer::RegisterSingleTimeout(
     const TimeInterval &interval,
     ola::SingleUseCallback0<void> *closure) {
-  if (!closure)
-    return INVALID_TIMEOUT;
-
-  SafeIncrement(K_TIMER_VAR);
-
-  Event *event = new SingleEvent(interval, m_clock, closure);
-  m_events.push(event);
-  return event;
+  return m_timeout_manager->RegisterSingleTimeout(interval, closure);
 }
 
 
 /*
- * Remove a previously registered timeout
+ * Remove a previously registered timeout. It's safe to call this with the id
+ * of a timeout that has already run.
  * @param timeout_id the id of the timeout
  */
 void SelectServer::RemoveTimeout(timeout_id id) {
-  if (id == INVALID_TIMEOUT)
-    return;
-
-  if (!m_removed_timeouts.insert(id).second)
-    OLA_WARN << "timeout " << id << " already in remove set";
+  m_timeout_manager->CancelTimeout(id);
 }
 
 
@@ -377,7 +403,10 @@ void SelectServer::RemoveTimeout(timeout_id id) {
  * Ownership is transferred to the select server.
  */
 void SelectServer::RunInLoop(Callback0<void> *closure) {
-  m_loop_closures.insert(closure);
+  if (STLContains(m_loop_closures, closure))
+    return;
+  m_loop_closures[closure] = m_profiler ?
+    m_profiler->GetSource(LoopProfiler::LOOP, "", typeid(*closure)) : NULL;
 }
 
 
@@ -402,35 +431,38 @@ void SelectServer::Execute(ola::BaseCallback0<void> *closure) {
 }
 
 
+/**
+ * Set the time a callback can take before it's reported as slow.
+ * @param budget the budget, 0 disables the check.
+ */
+void SelectServer::SetCallbackBudget(const TimeInterval &budget) {
+  if (m_profiler)
+    m_profiler->SetBudget(budget);
+}
+
+
 /*
- * One iteration of the select() loop.
+ * One iteration of the event loop.
  * @return false on error, true on success.
  */
 bool SelectServer::CheckForEvents(const TimeInterval &poll_interval) {
-  int maxsd;
-  fd_set r_fds, w_fds;
   TimeStamp now;
   TimeInterval sleep_interval = poll_interval;
-  struct timeval tv;
 
-  LoopClosureSet::iterator loop_iter;
+  LoopClosureMap::iterator loop_iter;
   for (loop_iter = m_loop_closures.begin(); loop_iter != m_loop_closures.end();
-       ++loop_iter)
-    (*loop_iter)->Run();
+       ++loop_iter) {
+    ProfiledCall call(m_profiler, loop_iter->second);
+    loop_iter->first->Run();
+  }
 
-  maxsd = 0;
-  FD_ZERO(&r_fds);
-  FD_ZERO(&w_fds);
   m_clock->CurrentTime(&now);
   now = CheckTimeouts(now);
 
-  // adding descriptors should be the last thing we do, they may have changed
-  // due to timeouts above.
-  bool closed_descriptors = AddDescriptorsToSet(&r_fds, &w_fds, &maxsd);
-
   // take care of stats accounting
-  if (m_wake_up_time.IsSet()) {
-    TimeInterval loop_time = now - m_wake_up_time;
+  const TimeStamp *wake_up_time = m_poller->WakeUpTime();
+  if (wake_up_time->IsSet()) {
+    TimeInterval loop_time = now - *wake_up_time;
     OLA_DEBUG << "ss process time was " << loop_time.ToString();
     if (m_loop_time)
       (*m_loop_time) += loop_time.AsInt();
@@ -438,222 +470,33 @@ bool SelectServer::CheckForEvents(const TimeInterval &poll_interval) {
       (*m_loop_iterations)++;
   }
 
-  if (!m_events.empty()) {
-    TimeInterval interval = m_events.top()->NextTime() - now;
+  TimeInterval interval;
+  if (m_timeout_manager->NextTimeout(now, &interval))
     sleep_interval = std::min(interval, sleep_interval);
-  }
 
-  // if we've already been told to terminate OR there are closed descriptors,
-  // set the timeout to something
+  // if we've already been told to terminate, set the timeout to something
   // very small (1ms). This ensures we at least make a pass through the
   // descriptors.
-  if (m_terminate || closed_descriptors)
+  if (m_terminate)
     sleep_interval = std::min(sleep_interval, TimeInterval(0, 1000));
 
-  sleep_interval.AsTimeval(&tv);
-  switch (select(maxsd + 1, &r_fds, &w_fds, NULL, &tv)) {
-    case 0:
-      // timeout
-      m_clock->CurrentTime(&m_wake_up_time);
-      CheckTimeouts(m_wake_up_time);
-
-      if (closed_descriptors) {
-        // there were closed descriptors before the select() we need to deal
-        // with them.
-        FD_ZERO(&r_fds);
-        FD_ZERO(&w_fds);
-        CheckDescriptors(&r_fds, &w_fds);
-      }
-      return true;
-    case -1:
-      if (errno == EINTR)
-        return true;
-      OLA_WARN << "select() error, " << strerror(errno);
-      return false;
-    default:
-      m_clock->CurrentTime(&m_wake_up_time);
-      CheckDescriptors(&r_fds, &w_fds);
-      m_clock->CurrentTime(&m_wake_up_time);
-      CheckTimeouts(m_wake_up_time);
-  }
+  // The descriptors may have changed due to the timeouts above, the poller
+  // takes care of that.
+  if (!m_poller->Poll(sleep_interval))
+    return false;
 
+  CheckTimeouts(*m_poller->WakeUpTime());
   return true;
 }
 
 
-/*
- * Add all the descriptors to the FD_SET
- * @returns true if there are closed descriptors.
- */
-bool SelectServer::AddDescriptorsToSet(fd_set *r_set,
-                                       fd_set *w_set,
-                                       int *max_sd) {
-  bool closed_descriptors = false;
-
-  ReadDescriptorSet::iterator iter = m_read_descriptors.begin();
-  while (iter != m_read_descriptors.end()) {
-    ReadDescriptorSet::iterator this_iter = iter;
-    iter++;
-
-    if ((*this_iter)->ValidReadDescriptor()) {
-      *max_sd = max(*max_sd, (*this_iter)->ReadDescriptor());
-      FD_SET((*this_iter)->ReadDescriptor(), r_set);
-    } else {
-      // The descriptor was probably closed without removing it from the select
-      // server
-      SafeDecrement(K_READ_DESCRIPTOR_VAR);
-      m_read_descriptors.erase(this_iter);
-      OLA_WARN << "Removed a inactive descriptor from the select server";
-    }
-  }
-
-  ConnectedDescriptorSet::iterator con_iter =
-      m_connected_read_descriptors.begin();
-  while (con_iter != m_connected_read_descriptors.end()) {
-    ConnectedDescriptorSet::iterator this_iter = con_iter;
-    con_iter++;
-
-    if (this_iter->descriptor->ValidReadDescriptor()) {
-      *max_sd = max(*max_sd, this_iter->descriptor->ReadDescriptor());
-      FD_SET(this_iter->descriptor->ReadDescriptor(), r_set);
-    } else {
-      closed_descriptors = true;
-    }
-  }
-
-  WriteDescriptorSet::iterator write_iter = m_write_descriptors.begin();
-  while (write_iter != m_write_descriptors.end()) {
-    WriteDescriptorSet::iterator this_iter = write_iter;
-    write_iter++;
-
-    if ((*this_iter)->ValidWriteDescriptor()) {
-      *max_sd = max(*max_sd, (*this_iter)->WriteDescriptor());
-      FD_SET((*this_iter)->WriteDescriptor(), w_set);
-    } else {
-      // The descriptor was probably closed without removing it from the select
-      // server
-      SafeDecrement(K_WRITE_DESCRIPTOR_VAR);
-      m_write_descriptors.erase(this_iter);
-      OLA_WARN << "Removed a disconnected descriptor from the select server";
-    }
-  }
-
-  // finally add the loopback descriptor
-  FD_SET(m_incoming_descriptor.ReadDescriptor(), r_set);
-  *max_sd = max(*max_sd, m_incoming_descriptor.ReadDescriptor());
-  return closed_descriptors;
-}
-
-
-/*
- * Check all the registered descriptors:
- *  - Execute the callback for descriptors with data
- *  - Excute OnClose if a remote end closed the connection
- */
-void SelectServer::CheckDescriptors(fd_set *r_set, fd_set *w_set) {
-  // Because the callbacks can add or remove descriptors from the select
-  // server, we have to call them after we've used the iterators.
-  std::queue<ReadFileDescriptor*> read_ready_queue;
-  std::queue<WriteFileDescriptor*> write_ready_queue;
-  std::queue<connected_descriptor_t> closed_queue;
-
-  ReadDescriptorSet::iterator iter = m_read_descriptors.begin();
-  for (; iter != m_read_descriptors.end(); ++iter) {
-    if (FD_ISSET((*iter)->ReadDescriptor(), r_set))
-      read_ready_queue.push(*iter);
-  }
-
-  // check the read sockets
-  ConnectedDescriptorSet::iterator con_iter =
-      m_connected_read_descriptors.begin();
-  while (con_iter != m_connected_read_descriptors.end()) {
-    ConnectedDescriptorSet::iterator this_iter = con_iter;
-    con_iter++;
-    bool closed = false;
-    if (!this_iter->descriptor->ValidReadDescriptor()) {
-      closed = true;
-    } else if (FD_ISSET(this_iter->descriptor->ReadDescriptor(), r_set)) {
-      if (this_iter->descriptor->IsClosed())
-        closed = true;
-      else
-        read_ready_queue.push(this_iter->descriptor);
-    }
-
-    if (closed) {
-      closed_queue.push(*this_iter);
-      m_connected_read_descriptors.erase(this_iter);
-    }
-  }
-
-  // check the write sockets
-  WriteDescriptorSet::iterator write_iter = m_write_descriptors.begin();
-  for (; write_iter != m_write_descriptors.end(); write_iter++) {
-    if (FD_ISSET((*write_iter)->WriteDescriptor(), w_set))
-      write_ready_queue.push(*write_iter);
-  }
-
-  // deal with anything that needs an action
-  while (!read_ready_queue.empty()) {
-    ReadFileDescriptor *descriptor = read_ready_queue.front();
-    descriptor->PerformRead();
-    read_ready_queue.pop();
-  }
-
-  while (!write_ready_queue.empty()) {
-    WriteFileDescriptor *descriptor = write_ready_queue.front();
-    descriptor->PerformWrite();
-    write_ready_queue.pop();
-  }
-
-  while (!closed_queue.empty()) {
-    const connected_descriptor_t &connected_descriptor = closed_queue.front();
-    ConnectedDescriptor::OnCloseCallback *on_close =
-      connected_descriptor.descriptor->TransferOnClose();
-    if (on_close)
-      on_close->Run();
-    if (connected_descriptor.delete_on_close)
-      delete connected_descriptor.descriptor;
-    SafeDecrement(K_CONNECTED_DESCRIPTORS_VAR);
-    closed_queue.pop();
-  }
-
-  if (FD_ISSET(m_incoming_descriptor.ReadDescriptor(), r_set))
-    DrainAndExecute();
-}
-
-
 /*
  * Check for expired timeouts and call them.
  * @returns a struct timeval of the time up to where we checked.
  */
 TimeStamp SelectServer::CheckTimeouts(const TimeStamp &current_time) {
   TimeStamp now = current_time;
-
-  Event *e;
-  if (m_events.empty())
-    return now;
-
-  for (e = m_events.top(); !m_events.empty() && (e->NextTime() < now);
-       e = m_events.top()) {
-    m_events.pop();
-
-    // if this was removed, skip it
-    if (m_removed_timeouts.erase(e)) {
-      delete e;
-      SafeDecrement(K_TIMER_VAR);
-      continue;
-    }
-
-    if (e->Trigger()) {
-      // true implies we need to run this again
-      e->UpdateTime(now);
-      m_events.push(e);
-    } else {
-      delete e;
-      SafeDecrement(K_TIMER_VAR);
-    }
-    m_clock->CurrentTime(&now);
-  }
+  m_timeout_manager->ExecuteTimeouts(&now);
   return now;
 }
 
@@ -662,23 +505,14 @@ TimeStamp SelectServer::CheckTimeouts(const TimeStamp &current_time) {
  * Remove all registrations.
  */
 void SelectServer::UnregisterAll() {
-  ConnectedDescriptorSet::iterator iter = m_connected_read_descriptors.begin();
-  for (; iter != m_connected_read_descriptors.end(); ++iter) {
-    if (iter->delete_on_close) {
-      delete iter->descriptor;
-    }
-  }
-  m_read_descriptors.clear();
-  m_connected_read_descriptors.clear();
-  m_write_descriptors.clear();
-  m_removed_timeouts.clear();
-
-  while (!m_events.empty()) {
-    delete m_events.top();
-    m_events.pop();
-  }
-
-  STLDeleteElements(&m_loop_closures);
+  m_poller->RemoveReadDescriptor(&m_incoming_descriptor);
+  m_poller->UnregisterAll();
+  m_timeout_manager->CancelAll();
+
+  LoopClosureMap::iterator loop_iter = m_loop_closures.begin();
+  for (; loop_iter != m_loop_closures.end(); ++loop_iter)
+    delete loop_iter->first;
+  m_loop_closures.clear();
 }
 
 void SelectServer::DrainAndExecute() {
@@ -699,8 +533,10 @@ void SelectServer::DrainAndExecute() {
       callback = m_incoming_queue.front();
       m_incoming_queue.pop();
     }
-    if (callback)
+    if (callback) {
+      ProfiledCall call(m_profiler, m_execute_source);
       callback->Run();
+    }
   }
 }
 
@@ -18,28 +18,54 @@
  * Copyright (C) 2005-2008 Simon Newton
  */
 
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include <cppunit/extensions/HelperMacros.h>
+#include <stdio.h>
 #include <sstream>
+#include <string>
 
 #include "ola/Callback.h"
 #include "ola/Clock.h"
 #include "ola/ExportMap.h"
 #include "ola/Logging.h"
+#include "ola/base/Flags.h"
 #include "ola/io/SelectServer.h"
 #include "ola/network/Socket.h"
 #include "ola/testing/TestUtils.h"
+#include "common/io/LoopProfiler.h"
+
+#ifdef HAVE_EPOLL
+DECLARE_bool(use_epoll);
+#endif
 
 using ola::ExportMap;
+using ola::HistogramMap;
 using ola::IntegerVariable;
+using ola::MockClock;
+using ola::TimeInterval;
+using ola::UIntMap;
 using ola::io::LoopbackDescriptor;
+using ola::io::PipeDescriptor;
 using ola::io::SelectServer;
+using ola::io::UnmanagedFileDescriptor;
 using ola::network::UDPSocket;
+using std::string;
 
 class SelectServerTest: public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(SelectServerTest);
   CPPUNIT_TEST(testAddRemoveReadDescriptor);
   CPPUNIT_TEST(testTimeout);
   CPPUNIT_TEST(testLoopCallbacks);
+  CPPUNIT_TEST(testCallbackProfiling);
+  CPPUNIT_TEST(testSelectPoller);
+#ifdef HAVE_EPOLL
+  CPPUNIT_TEST(testEPoller);
+  CPPUNIT_TEST(testEPollerRegularFile);
+#endif
+  CPPUNIT_TEST(testRegularFile);
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -48,6 +74,13 @@ class SelectServerTest: public CppUnit::TestFixture {
     void testAddRemoveReadDescriptor();
     void testTimeout();
     void testLoopCallbacks();
+    void testCallbackProfiling();
+    void testSelectPoller();
+    void testEPoller();
+    void testEPollerRegularFile();
+    void testRegularFile();
+    void CheckDataAndClose();
+    void CheckRegularFile();
 
     void FatalTimeout() {
       OLA_FAIL("Fatal Timeout");
@@ -80,9 +113,35 @@ class SelectServerTest: public CppUnit::TestFixture {
 
     void IncrementLoopCounter() { m_loop_counter++; }
 
+    void SlowTerminate(MockClock *clock, SelectServer *ss) {
+      clock->AdvanceTime(0, 5000);
+      ss->Terminate();
+    }
+
+    void ReceiveAndTerminate(PipeDescriptor *descriptor, SelectServer *ss) {
+      uint8_t data[10];
+      unsigned int data_read;
+      descriptor->Receive(data, sizeof(data), data_read);
+      m_bytes_received += data_read;
+      ss->Terminate();
+    }
+
+    void ReadAndTerminate(SelectServer *ss) {
+      m_read_counter++;
+      ss->Terminate();
+    }
+
+    void CloseAndTerminate(SelectServer *ss) {
+      m_close_counter++;
+      ss->Terminate();
+    }
+
   private:
     unsigned int m_timeout_counter;
     unsigned int m_loop_counter;
+    unsigned int m_bytes_received;
+    unsigned int m_read_counter;
+    unsigned int m_close_counter;
     ExportMap *m_map;
     SelectServer *m_ss;
 };
@@ -97,6 +156,9 @@ void SelectServerTest::setUp() {
   m_ss = new SelectServer(m_map);
   m_timeout_counter = 0;
   m_loop_counter = 0;
+  m_bytes_received = 0;
+  m_read_counter = 0;
+  m_close_counter = 0;
 }
 
 
@@ -222,3 +284,153 @@ void SelectServerTest::testLoopCallbacks() {
   // we should have at least 5 calls to IncrementLoopCounter
   OLA_ASSERT_TRUE(m_loop_counter >= 5);
 }
+
+
+/*
+ * Check that callbacks are timed, and that slow ones are counted.
+ */
+void SelectServerTest::testCallbackProfiling() {
+  MockClock clock;
+  ExportMap export_map;
+  SelectServer ss(&export_map, &clock);
+  ss.SetCallbackBudget(TimeInterval(0, 1000));
+
+  ss.RegisterSingleTimeout(
+      10,
+      ola::NewSingleCallback(this, &SelectServerTest::SlowTerminate, &clock,
+                             &ss));
+  ss.Run();
+
+  HistogramMap *times =
+    export_map.GetHistogramMapVar(ola::io::LoopProfiler::K_CALLBACK_TIME_VAR);
+  UIntMap *slow_callbacks =
+    export_map.GetUIntMapVar(ola::io::LoopProfiler::K_SLOW_CALLBACKS_VAR);
+  const string source = "timeout:SelectServerTest";
+  OLA_ASSERT_EQ(1u, (*times)[source].Count());
+  OLA_ASSERT_TRUE((*times)[source].Sum() >= 5000);
+  OLA_ASSERT_EQ(1u, (*slow_callbacks)[source]);
+}
+
+
+/*
+ * Check the select() poller delivers data and close notifications.
+ */
+void SelectServerTest::testSelectPoller() {
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = false;
+#endif
+  CheckDataAndClose();
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = true;
+#endif
+}
+
+
+/*
+ * Check the epoll() poller delivers data and close notifications.
+ */
+void SelectServerTest::testEPoller() {
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = true;
+  CheckDataAndClose();
+#endif
+}
+
+
+/*
+ * Check the select() poller accepts regular files.
+ */
+void SelectServerTest::testRegularFile() {
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = false;
+#endif
+  CheckRegularFile();
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = true;
+#endif
+}
+
+
+/*
+ * Check the epoll() poller accepts regular files, even though epoll() itself
+ * doesn't.
+ */
+void SelectServerTest::testEPollerRegularFile() {
+#ifdef HAVE_EPOLL
+  FLAGS_use_epoll = true;
+  CheckRegularFile();
+#endif
+}
+
+
+/*
+ * Regular files are always readable, so the handler should run straight
+ * away.
+ */
+void SelectServerTest::CheckRegularFile() {
+  FILE *file = tmpfile();
+  OLA_ASSERT_NOT_NULL(file);
+  SelectServer ss;
+  UnmanagedFileDescriptor descriptor(fileno(file));
+  descriptor.SetOnData(
+      ola::NewCallback(this, &SelectServerTest::ReadAndTerminate, &ss));
+  OLA_ASSERT_TRUE(ss.AddReadDescriptor(&descriptor));
+
+  ss.RegisterSingleTimeout(
+      1000,
+      ola::NewSingleCallback(this, &SelectServerTest::FatalTimeout));
+  ss.Run();
+  // Terminate() takes effect on the next loop, so the handler may run twice.
+  OLA_ASSERT_TRUE(m_read_counter > 0);
+
+  OLA_ASSERT_TRUE(ss.RemoveReadDescriptor(&descriptor));
+  OLA_ASSERT_FALSE(ss.RemoveReadDescriptor(&descriptor));
+  fclose(file);
+}
+
+
+/*
+ * Send data across a pipe, and then close the remote end.
+ */
+void SelectServerTest::CheckDataAndClose() {
+  ExportMap export_map;
+  SelectServer ss(&export_map);
+  IntegerVariable *connected_socket_count =
+    export_map.GetIntegerVar(SelectServer::K_CONNECTED_DESCRIPTORS_VAR);
+
+  PipeDescriptor descriptor;
+  OLA_ASSERT_TRUE(descriptor.Init());
+  PipeDescriptor *opposite_end = descriptor.OppositeEnd();
+  descriptor.SetOnData(
+      ola::NewCallback(this, &SelectServerTest::ReceiveAndTerminate,
+                       &descriptor, &ss));
+  descriptor.SetOnClose(
+      ola::NewSingleCallback(this, &SelectServerTest::CloseAndTerminate,
+                             &ss));
+  descriptor.SetName("pipe");
+  OLA_ASSERT_TRUE(ss.AddReadDescriptor(&descriptor));
+  OLA_ASSERT_EQ(1, connected_socket_count->Get());
+
+  HistogramMap *times =
+    export_map.GetHistogramMapVar(ola::io::LoopProfiler::K_CALLBACK_TIME_VAR);
+
+  // An abort timeout, so we don't block forever if something goes wrong.
+  ss.RegisterSingleTimeout(
+      1000,
+      ola::NewSingleCallback(this, &SelectServerTest::FatalTimeout));
+
+  uint8_t data[] = {1, 2, 3, 4};
+  opposite_end->Send(data, sizeof(data));
+  ss.Run();
+  OLA_ASSERT_EQ(static_cast<unsigned int>(sizeof(data)), m_bytes_received);
+  OLA_ASSERT_EQ(0u, m_close_counter);
+  OLA_ASSERT_EQ(1u, (*times)["read:pipe"].Count());
+
+  opposite_end->Close();
+  delete opposite_end;
+  ss.Run();
+  OLA_ASSERT_EQ(1u, m_close_counter);
+  OLA_ASSERT_EQ(1u, (*times)["close:pipe"].Count());
+  OLA_ASSERT_EQ(0, connected_socket_count->Get());
+  OLA_ASSERT_FALSE(ss.RemoveReadDescriptor(&descriptor));
+}
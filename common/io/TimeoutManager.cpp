@@ -0,0 +1,386 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * TimeoutManager.cpp
+ * Manages the timeouts for the SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <algorithm>
+
+#include "common/io/TimeoutManager.h"
+#include "ola/Logging.h"
+#include "ola/io/SelectServer.h"
+#include "ola/stl/STLUtils.h"
+
+namespace ola {
+namespace io {
+
+using ola::thread::INVALID_TIMEOUT;
+
+/*
+ * Constructor
+ * @param export_map an ExportMap to update
+ * @param clock the Clock to use
+ * @param profiler the LoopProfiler to time the timeouts with, may be NULL.
+ */
+TimeoutManager::TimeoutManager(ExportMap *export_map, Clock *clock,
+                               LoopProfiler *profiler)
+    : m_export_map(export_map),
+      m_clock(clock),
+      m_profiler(profiler),
+      m_cancelled_var(NULL),
+      m_current_tick(0),
+      m_next_id(1) {
+  m_clock->CurrentTime(&m_epoch);
+
+  for (unsigned int i = 0; i < K_WHEEL_COUNT; i++) {
+    for (unsigned int j = 0; j < K_WHEEL_SIZE; j++)
+      m_wheels[i][j].wheel = i + 1;
+  }
+  for (unsigned int i = 0; i <= K_WHEEL_COUNT; i++)
+    m_wheel_counts[i] = 0;
+
+  if (m_export_map) {
+    m_export_map->GetIntegerVar(SelectServer::K_TIMER_VAR);
+    m_cancelled_var = m_export_map->GetCounterVar(
+        SelectServer::K_TIMER_CANCELLED_VAR);
+  }
+}
+
+
+TimeoutManager::~TimeoutManager() {
+  CancelAll();
+}
+
+
+/*
+ * Register a repeating timeout.
+ * @param interval the delay between function calls
+ * @param closure the closure to call when the event triggers. Ownership is
+ * transferred.
+ * @returns the identifier for this timeout.
+ */
+timeout_id TimeoutManager::RegisterRepeatingTimeout(
+    const TimeInterval &interval,
+    ola::Callback0<bool> *closure) {
+  if (!closure)
+    return INVALID_TIMEOUT;
+
+  TimeStamp now;
+  m_clock->CurrentTime(&now);
+  return AddEvent(new RepeatingEvent(interval, closure), now,
+                  typeid(*closure));
+}
+
+
+/*
+ * Register a single use timeout.
+ * @param interval the delay before the closure will be run.
+ * @param closure the closure to call when the event triggers. Ownership is
+ * transferred.
+ * @returns the identifier for this timeout.
+ */
+timeout_id TimeoutManager::RegisterSingleTimeout(
+    const TimeInterval &interval,
+    ola::SingleUseCallback0<void> *closure) {
+  if (!closure)
+    return INVALID_TIMEOUT;
+
+  TimeStamp now;
+  m_clock->CurrentTime(&now);
+  return AddEvent(new SingleEvent(interval, closure), now, typeid(*closure));
+}
+
+
+/*
+ * Cancel a timeout. It's safe to call this with the id of a timeout that has
+ * already run.
+ */
+void TimeoutManager::CancelTimeout(timeout_id id) {
+  if (id == INVALID_TIMEOUT)
+    return;
+
+  Event *event = STLFindOrNull(m_events, reinterpret_cast<uintptr_t>(id));
+  if (!event)
+    return;
+
+  if (m_cancelled_var)
+    (*m_cancelled_var)++;
+
+  if (event->running) {
+    // ExecuteTimeouts will clean this up once the callback returns.
+    event->cancelled = true;
+    return;
+  }
+
+  Unlink(event);
+  RemoveEvent(event);
+}
+
+
+bool TimeoutManager::NextTimeout(const TimeStamp &now,
+                                 TimeInterval *interval) const {
+  if (m_events.empty())
+    return false;
+
+  uint64_t next_tick = m_current_tick + (static_cast<uint64_t>(1) << 32);
+  if (m_wheel_counts[0]) {
+    for (unsigned int i = 0; i < K_ROOT_SIZE; i++) {
+      if (m_root[(m_current_tick + i) & K_ROOT_MASK].head) {
+        next_tick = m_current_tick + i;
+        break;
+      }
+    }
+  }
+
+  // For the outer wheels, we need to wake up when the first non-empty slot
+  // is cascaded.
+  for (unsigned int wheel = 1; wheel <= K_WHEEL_COUNT; wheel++) {
+    if (!m_wheel_counts[wheel])
+      continue;
+
+    unsigned int shift = WheelShift(wheel);
+    uint64_t block = m_current_tick >> shift;
+    // If we're at the start of a block, the current slot hasn't been
+    // cascaded yet.
+    bool aligned = (block << shift) == m_current_tick;
+    for (unsigned int i = aligned ? 0 : 1; i <= K_WHEEL_SIZE; i++) {
+      if (m_wheels[wheel - 1][(block + i) & K_WHEEL_MASK].head) {
+        next_tick = std::min(next_tick, (block + i) << shift);
+        break;
+      }
+    }
+  }
+
+  TimeStamp next = m_epoch + TimeInterval(
+      static_cast<int64_t>(next_tick * K_TICK_USEC));
+  if (next > now)
+    *interval = next - now;
+  else
+    *interval = TimeInterval(0, 0);
+  return true;
+}
+
+
+void TimeoutManager::ExecuteTimeouts(TimeStamp *now) {
+  uint64_t target = ToTick(*now, false);
+
+  while (m_current_tick <= target) {
+    if (m_events.empty()) {
+      m_current_tick = target + 1;
+      break;
+    }
+
+    if (!m_wheel_counts[0] && (m_current_tick & K_ROOT_MASK)) {
+      // Nothing in the root wheel, skip ahead to the next cascade.
+      uint64_t next_cascade = (m_current_tick | K_ROOT_MASK) + 1;
+      m_current_tick = std::min(next_cascade, target + 1);
+      continue;
+    }
+    RunTick(*now);
+  }
+  m_clock->CurrentTime(now);
+}
+
+
+void TimeoutManager::CancelAll() {
+  EventMap::iterator iter = m_events.begin();
+  for (; iter != m_events.end(); ++iter)
+    delete iter->second;
+  m_events.clear();
+
+  for (unsigned int i = 0; i < K_ROOT_SIZE; i++)
+    m_root[i].head = m_root[i].tail = NULL;
+  for (unsigned int i = 0; i < K_WHEEL_COUNT; i++) {
+    for (unsigned int j = 0; j < K_WHEEL_SIZE; j++)
+      m_wheels[i][j].head = m_wheels[i][j].tail = NULL;
+  }
+  for (unsigned int i = 0; i <= K_WHEEL_COUNT; i++)
+    m_wheel_counts[i] = 0;
+}
+
+
+/*
+ * Assign an id to an event and add it to the wheel.
+ * @param type the type of the event's closure, used to attribute the time
+ *   taken to run it.
+ */
+timeout_id TimeoutManager::AddEvent(Event *event, const TimeStamp &now,
+                                    const std::type_info &type) {
+  event->id = reinterpret_cast<timeout_id>(m_next_id++);
+  if (m_profiler)
+    event->source = m_profiler->GetSource(LoopProfiler::TIMEOUT, "", type);
+  event->expiry = ToTick(now + event->Interval(), true);
+  m_events[reinterpret_cast<uintptr_t>(event->id)] = event;
+  AddToWheel(event);
+
+  if (m_export_map)
+    (*m_export_map->GetIntegerVar(SelectServer::K_TIMER_VAR))++;
+  return event->id;
+}
+
+
+/*
+ * Put an event into the right slot, based on how far away it is.
+ */
+void TimeoutManager::AddToWheel(Event *event) {
+  uint64_t expiry = std::max(event->expiry, m_current_tick);
+  uint64_t delta = expiry - m_current_tick;
+
+  EventList *slot = NULL;
+  if (delta < K_ROOT_SIZE) {
+    slot = &m_root[expiry & K_ROOT_MASK];
+  } else {
+    unsigned int wheel = 1;
+    while (wheel < K_WHEEL_COUNT &&
+           delta >= (static_cast<uint64_t>(1) << WheelShift(wheel + 1)))
+      wheel++;
+
+    if (wheel == K_WHEEL_COUNT) {
+      // Clamp to the range of the outer wheel, this event will be re-filed
+      // when it's cascaded.
+      uint64_t max_delta = (static_cast<uint64_t>(1) << 32) - 1;
+      if (delta > max_delta)
+        expiry = m_current_tick + max_delta;
+    }
+    slot = &m_wheels[wheel - 1][(expiry >> WheelShift(wheel)) & K_WHEEL_MASK];
+  }
+
+  event->slot = slot;
+  event->next = NULL;
+  event->previous = slot->tail;
+  if (slot->tail)
+    slot->tail->next = event;
+  else
+    slot->head = event;
+  slot->tail = event;
+  m_wheel_counts[slot->wheel]++;
+}
+
+
+/*
+ * Remove an event from the slot it's in.
+ */
+void TimeoutManager::Unlink(Event *event) {
+  EventList *slot = event->slot;
+  if (!slot)
+    return;
+
+  if (event->previous)
+    event->previous->next = event->next;
+  else
+    slot->head = event->next;
+
+  if (event->next)
+    event->next->previous = event->previous;
+  else
+    slot->tail = event->previous;
+
+  event->slot = NULL;
+  event->previous = NULL;
+  event->next = NULL;
+  m_wheel_counts[slot->wheel]--;
+}
+
+
+/*
+ * Move all events in a slot of an outer wheel down to the wheel below.
+ */
+void TimeoutManager::Cascade(unsigned int wheel, unsigned int index) {
+  EventList *slot = &m_wheels[wheel - 1][index];
+  Event *event = slot->head;
+  slot->head = slot->tail = NULL;
+  while (event) {
+    Event *next = event->next;
+    event->slot = NULL;
+    event->previous = NULL;
+    event->next = NULL;
+    m_wheel_counts[wheel]--;
+    AddToWheel(event);
+    event = next;
+  }
+}
+
+
+/*
+ * Run all the events for the current tick and advance it.
+ */
+void TimeoutManager::RunTick(const TimeStamp &now) {
+  if ((m_current_tick & K_ROOT_MASK) == 0) {
+    // Cascade the outer wheels, starting with the inner-most one.
+    for (unsigned int wheel = 1; wheel <= K_WHEEL_COUNT; wheel++) {
+      unsigned int index = (m_current_tick >> WheelShift(wheel)) &
+                           K_WHEEL_MASK;
+      Cascade(wheel, index);
+      if (index)
+        break;
+    }
+  }
+
+  // Callbacks may register new timeouts that are due right away. These are
+  // added to the end of this slot, so we pick them up in this loop.
+  EventList *slot = &m_root[m_current_tick & K_ROOT_MASK];
+  while (slot->head) {
+    Event *event = slot->head;
+    Unlink(event);
+
+    event->running = true;
+    bool repeat;
+    {
+      ProfiledCall call(m_profiler, event->source);
+      repeat = event->Trigger();
+    }
+    event->running = false;
+
+    if (repeat && !event->cancelled) {
+      // Don't let a zero interval spin this loop.
+      event->expiry = std::max(ToTick(now + event->Interval(), true),
+                               m_current_tick + 1);
+      AddToWheel(event);
+    } else {
+      RemoveEvent(event);
+    }
+  }
+  m_current_tick++;
+}
+
+
+/*
+ * Delete an event that is no longer linked into the wheel.
+ */
+void TimeoutManager::RemoveEvent(Event *event) {
+  m_events.erase(reinterpret_cast<uintptr_t>(event->id));
+  delete event;
+
+  if (m_export_map)
+    (*m_export_map->GetIntegerVar(SelectServer::K_TIMER_VAR))--;
+}
+
+
+/*
+ * Convert a time to a tick, either rounding up or down.
+ */
+uint64_t TimeoutManager::ToTick(const TimeStamp &time, bool round_up) const {
+  if (time <= m_epoch)
+    return 0;
+
+  int64_t usecs = (time - m_epoch).AsInt();
+  if (round_up)
+    usecs += K_TICK_USEC - 1;
+  return usecs / K_TICK_USEC;
+}
+}  // namespace io
+}  // namespace ola
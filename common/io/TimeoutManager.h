@@ -0,0 +1,231 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * TimeoutManager.h
+ * Manages the timeouts for the SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Timeouts are stored in a hierarchical timing wheel with a resolution of
+ * 1ms. The root wheel has 256 slots, one per ms, and each of the four outer
+ * wheels has 64 slots, each slot covering 64 times the span of a slot in the
+ * wheel below it. Together they cover 2^32 ms (~49 days), anything longer is
+ * parked in the last slot and re-filed when it's cascaded.
+ *
+ * Registering and cancelling a timeout is O(1), cancelled timeouts are freed
+ * straight away rather than left for the loop to skip over. When the wheel
+ * turns past the start of a slot in one of the outer wheels, the timeouts in
+ * that slot are cascaded down to the wheel below.
+ */
+
+#ifndef COMMON_IO_TIMEOUTMANAGER_H_
+#define COMMON_IO_TIMEOUTMANAGER_H_
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdint.h>
+#include <ola/Callback.h>
+#include <ola/Clock.h>
+#include <ola/ExportMap.h>
+#include <ola/thread/SchedulerInterface.h>
+#include <typeinfo>
+
+#include "common/io/LoopProfiler.h"
+
+#include HASH_MAP_H
+
+namespace ola {
+namespace io {
+
+using ola::thread::timeout_id;
+
+class TimeoutManager {
+  public :
+    TimeoutManager(ExportMap *export_map, Clock *clock,
+                   LoopProfiler *profiler = NULL);
+    ~TimeoutManager();
+
+    timeout_id RegisterRepeatingTimeout(const TimeInterval &interval,
+                                        ola::Callback0<bool> *closure);
+    timeout_id RegisterSingleTimeout(const TimeInterval &interval,
+                                     ola::SingleUseCallback0<void> *closure);
+    void CancelTimeout(timeout_id id);
+
+    // The number of registered timeouts.
+    unsigned int PendingTimeouts() const { return m_events.size(); }
+
+    /*
+     * Get the time until the next timeout needs to be looked at. This may be
+     * earlier than the timeout is due, if it needs to be cascaded first.
+     * @returns false if there are no timeouts.
+     */
+    bool NextTimeout(const TimeStamp &now, TimeInterval *interval) const;
+
+    /*
+     * Run all timeouts that are due at or before now. now is updated with the
+     * current time once we're done.
+     */
+    void ExecuteTimeouts(TimeStamp *now);
+
+    // Cancel all timeouts.
+    void CancelAll();
+
+  private:
+    static const unsigned int K_ROOT_BITS = 8;
+    static const unsigned int K_ROOT_SIZE = 1 << K_ROOT_BITS;
+    static const unsigned int K_ROOT_MASK = K_ROOT_SIZE - 1;
+    static const unsigned int K_WHEEL_BITS = 6;
+    static const unsigned int K_WHEEL_SIZE = 1 << K_WHEEL_BITS;
+    static const unsigned int K_WHEEL_MASK = K_WHEEL_SIZE - 1;
+    // The number of wheels, excluding the root wheel.
+    static const unsigned int K_WHEEL_COUNT = 4;
+    // The number of usecs in a tick.
+    static const int64_t K_TICK_USEC = 1000;
+
+    struct EventList;
+
+    /*
+     * These are timer events, they are used inside the TimeoutManager class.
+     * The links are used to chain the events within a slot.
+     */
+    class Event {
+      public:
+        explicit Event(const TimeInterval &interval)
+            : id(NULL),
+              expiry(0),
+              slot(NULL),
+              previous(NULL),
+              next(NULL),
+              running(false),
+              cancelled(false),
+              source(NULL),
+              m_interval(interval) {
+        }
+        virtual ~Event() {}
+        virtual bool Trigger() = 0;
+
+        const TimeInterval &Interval() const { return m_interval; }
+
+        timeout_id id;
+        // the tick this event is due
+        uint64_t expiry;
+        EventList *slot;
+        Event *previous;
+        Event *next;
+        bool running;
+        bool cancelled;
+        // the profiler source, looked up when the event is registered
+        LoopProfiler::Source *source;
+
+      private:
+        TimeInterval m_interval;
+    };
+
+    // An event that only happens once
+    class SingleEvent: public Event {
+      public:
+        SingleEvent(const TimeInterval &interval,
+                    ola::BaseCallback0<void> *closure):
+          Event(interval),
+          m_closure(closure) {
+        }
+
+        virtual ~SingleEvent() {
+          if (m_closure)
+            delete m_closure;
+        }
+
+        bool Trigger() {
+          if (m_closure) {
+            m_closure->Run();
+            // it's deleted itself at this point
+            m_closure = NULL;
+          }
+          return false;
+        }
+
+      private:
+        ola::BaseCallback0<void> *m_closure;
+    };
+
+    /*
+     * An event that occurs more than once. The closure can return false to
+     * indicate that it should not be called again.
+     */
+    class RepeatingEvent: public Event {
+      public:
+        RepeatingEvent(const TimeInterval &interval,
+                       ola::BaseCallback0<bool> *closure):
+          Event(interval),
+          m_closure(closure) {
+        }
+        ~RepeatingEvent() {
+          delete m_closure;
+        }
+        bool Trigger() {
+          if (!m_closure)
+            return false;
+          return m_closure->Run();
+        }
+
+      private:
+        ola::BaseCallback0<bool> *m_closure;
+    };
+
+    struct EventList {
+      EventList() : head(NULL), tail(NULL), wheel(0) {}
+      Event *head;
+      Event *tail;
+      // the wheel this slot belongs to, 0 is the root
+      unsigned int wheel;
+    };
+
+    typedef HASH_NAMESPACE::HASH_MAP_CLASS<uintptr_t, Event*> EventMap;
+
+    ExportMap *m_export_map;
+    Clock *m_clock;
+    LoopProfiler *m_profiler;
+    CounterVariable *m_cancelled_var;
+    // The time of tick 0.
+    TimeStamp m_epoch;
+    // The next tick to process, everything before this has been run.
+    uint64_t m_current_tick;
+    uintptr_t m_next_id;
+    EventMap m_events;
+    EventList m_root[K_ROOT_SIZE];
+    EventList m_wheels[K_WHEEL_COUNT][K_WHEEL_SIZE];
+    // The number of events in each wheel, so we can skip over empty ones.
+    unsigned int m_wheel_counts[K_WHEEL_COUNT + 1];
+
+    timeout_id AddEvent(Event *event, const TimeStamp &now,
+                        const std::type_info &type);
+    void AddToWheel(Event *event);
+    void Unlink(Event *event);
+    void Cascade(unsigned int wheel, unsigned int index);
+    void RunTick(const TimeStamp &now);
+    void RemoveEvent(Event *event);
+
+    uint64_t ToTick(const TimeStamp &time, bool round_up) const;
+    unsigned int WheelShift(unsigned int wheel) const {
+      return K_ROOT_BITS + (wheel - 1) * K_WHEEL_BITS;
+    }
+
+    TimeoutManager(const TimeoutManager&);
+    TimeoutManager operator=(const TimeoutManager&);
+};
+}  // namespace io
+}  // namespace ola
+#endif  // COMMON_IO_TIMEOUTMANAGER_H_
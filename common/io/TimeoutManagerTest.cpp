@@ -0,0 +1,253 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * TimeoutManagerTest.cpp
+ * Test fixture for the TimeoutManager class.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+
+#include "common/io/TimeoutManager.h"
+#include "ola/Callback.h"
+#include "ola/Clock.h"
+#include "ola/ExportMap.h"
+#include "ola/Logging.h"
+#include "ola/io/SelectServer.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::CounterVariable;
+using ola::ExportMap;
+using ola::IntegerVariable;
+using ola::MockClock;
+using ola::TimeInterval;
+using ola::TimeStamp;
+using ola::io::SelectServer;
+using ola::io::TimeoutManager;
+using ola::thread::timeout_id;
+
+
+class TimeoutManagerTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TimeoutManagerTest);
+  CPPUNIT_TEST(testSingleTimeouts);
+  CPPUNIT_TEST(testRepeatingTimeouts);
+  CPPUNIT_TEST(testCancelTimeouts);
+  CPPUNIT_TEST(testLongTimeouts);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void setUp();
+    void tearDown();
+    void testSingleTimeouts();
+    void testRepeatingTimeouts();
+    void testCancelTimeouts();
+    void testLongTimeouts();
+
+    void IncrementCounter() { m_counter++; }
+
+    bool RepeatingIncrement() {
+      m_counter++;
+      return m_counter < 3;
+    }
+
+    void CancelTimeout(timeout_id *id) {
+      m_manager->CancelTimeout(*id);
+    }
+
+  private:
+    MockClock m_clock;
+    ExportMap *m_map;
+    TimeoutManager *m_manager;
+    unsigned int m_counter;
+
+    void Execute() {
+      TimeStamp now;
+      m_clock.CurrentTime(&now);
+      m_manager->ExecuteTimeouts(&now);
+    }
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TimeoutManagerTest);
+
+
+void TimeoutManagerTest::setUp() {
+  ola::InitLogging(ola::OLA_LOG_INFO, ola::OLA_LOG_STDERR);
+  m_map = new ExportMap();
+  m_manager = new TimeoutManager(m_map, &m_clock);
+  m_counter = 0;
+}
+
+
+void TimeoutManagerTest::tearDown() {
+  delete m_manager;
+  delete m_map;
+}
+
+
+/*
+ * Check single timeouts run once, at the right time.
+ */
+void TimeoutManagerTest::testSingleTimeouts() {
+  IntegerVariable *timer_count =
+    m_map->GetIntegerVar(SelectServer::K_TIMER_VAR);
+  TimeInterval interval;
+  TimeStamp now;
+  m_clock.CurrentTime(&now);
+  OLA_ASSERT_FALSE(m_manager->NextTimeout(now, &interval));
+
+  m_manager->RegisterSingleTimeout(
+      TimeInterval(0, 100000),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+  m_manager->RegisterSingleTimeout(
+      TimeInterval(1, 0),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+  OLA_ASSERT_EQ(2u, m_manager->PendingTimeouts());
+  OLA_ASSERT_EQ(2, timer_count->Get());
+
+  m_clock.CurrentTime(&now);
+  OLA_ASSERT_TRUE(m_manager->NextTimeout(now, &interval));
+  OLA_ASSERT_TRUE(interval <= TimeInterval(0, 101000));
+
+  Execute();
+  OLA_ASSERT_EQ(0u, m_counter);
+
+  // Timeouts have a resolution of 1ms, so allow for that.
+  m_clock.AdvanceTime(0, 101000);
+  Execute();
+  OLA_ASSERT_EQ(1u, m_counter);
+  OLA_ASSERT_EQ(1u, m_manager->PendingTimeouts());
+  OLA_ASSERT_EQ(1, timer_count->Get());
+
+  m_clock.AdvanceTime(0, 500000);
+  Execute();
+  OLA_ASSERT_EQ(1u, m_counter);
+
+  m_clock.AdvanceTime(0, 500000);
+  Execute();
+  OLA_ASSERT_EQ(2u, m_counter);
+  OLA_ASSERT_EQ(0u, m_manager->PendingTimeouts());
+  OLA_ASSERT_EQ(0, timer_count->Get());
+}
+
+
+/*
+ * Check repeating timeouts run until they return false.
+ */
+void TimeoutManagerTest::testRepeatingTimeouts() {
+  m_manager->RegisterRepeatingTimeout(
+      TimeInterval(0, 10000),
+      ola::NewCallback(this, &TimeoutManagerTest::RepeatingIncrement));
+
+  for (unsigned int i = 1; i <= 5; i++) {
+    m_clock.AdvanceTime(0, 11000);
+    Execute();
+    OLA_ASSERT_EQ(std::min(i, 3u), m_counter);
+  }
+  OLA_ASSERT_EQ(0u, m_manager->PendingTimeouts());
+}
+
+
+/*
+ * Check cancelling timeouts.
+ */
+void TimeoutManagerTest::testCancelTimeouts() {
+  CounterVariable *cancelled =
+    m_map->GetCounterVar(SelectServer::K_TIMER_CANCELLED_VAR);
+
+  timeout_id id1 = m_manager->RegisterSingleTimeout(
+      TimeInterval(0, 10000),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+  timeout_id id2 = m_manager->RegisterRepeatingTimeout(
+      TimeInterval(0, 10000),
+      ola::NewCallback(this, &TimeoutManagerTest::RepeatingIncrement));
+  OLA_ASSERT_NE(id1, id2);
+
+  m_manager->CancelTimeout(id1);
+  OLA_ASSERT_EQ(1u, m_manager->PendingTimeouts());
+  OLA_ASSERT_EQ(1u, cancelled->Get());
+
+  // cancelling twice is a noop
+  m_manager->CancelTimeout(id1);
+  OLA_ASSERT_EQ(1u, cancelled->Get());
+
+  m_clock.AdvanceTime(0, 11000);
+  Execute();
+  OLA_ASSERT_EQ(1u, m_counter);
+
+  // A timeout that cancels another
+  timeout_id id3 = m_manager->RegisterSingleTimeout(
+      TimeInterval(0, 1000),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::CancelTimeout, &id2));
+  m_clock.AdvanceTime(0, 2000);
+  Execute();
+  OLA_ASSERT_EQ(0u, m_manager->PendingTimeouts());
+  OLA_ASSERT_EQ(2u, cancelled->Get());
+
+  // Cancelling a timeout that has run is safe
+  m_manager->CancelTimeout(id3);
+  OLA_ASSERT_EQ(2u, cancelled->Get());
+
+  m_clock.AdvanceTime(0, 100000);
+  Execute();
+  OLA_ASSERT_EQ(1u, m_counter);
+}
+
+
+/*
+ * Check timeouts that live in the outer wheels.
+ */
+void TimeoutManagerTest::testLongTimeouts() {
+  // 2 minutes, 1 hour and 60 days.
+  m_manager->RegisterSingleTimeout(
+      TimeInterval(120, 0),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+  m_manager->RegisterSingleTimeout(
+      TimeInterval(3600, 0),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+  m_manager->RegisterSingleTimeout(
+      TimeInterval(60 * 86400, 0),
+      ola::NewSingleCallback(this, &TimeoutManagerTest::IncrementCounter));
+
+  TimeStamp start;
+  m_clock.CurrentTime(&start);
+
+  // Step through in 10s increments, checking we never oversleep.
+  for (unsigned int i = 0; i < 360; i++) {
+    TimeStamp now;
+    TimeInterval interval;
+    m_clock.CurrentTime(&now);
+    OLA_ASSERT_TRUE(m_manager->NextTimeout(now, &interval));
+    if (now - start < TimeInterval(120, 0)) {
+      OLA_ASSERT_TRUE(now + interval <= start + TimeInterval(120, 1000));
+    }
+    m_clock.AdvanceTime(10, 0);
+    Execute();
+  }
+  // Timeouts have a resolution of 1ms, so allow for that.
+  m_clock.AdvanceTime(0, 1000);
+  Execute();
+  OLA_ASSERT_EQ(2u, m_counter);
+
+  m_clock.AdvanceTime(59 * 86400, 0);
+  Execute();
+  OLA_ASSERT_EQ(2u, m_counter);
+
+  m_clock.AdvanceTime(86400, 0);
+  Execute();
+  OLA_ASSERT_EQ(3u, m_counter);
+  OLA_ASSERT_EQ(0u, m_manager->PendingTimeouts());
+}
@@ -19,119 +19,234 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
 #include <google/protobuf/service.h>
 #include <google/protobuf/message.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "common/rpc/Rpc.pb.h"
 #include "common/rpc/SimpleRpcController.h"
 #include "common/rpc/StreamRpcChannel.h"
 #include "ola/Callback.h"
 #include "ola/Logging.h"
+#include "ola/base/Array.h"
+#include "ola/stl/STLUtils.h"
+#include "ola/thread/Trace.h"
+#include "ola/io/MemoryBlock.h"
 
 
 namespace ola {
 namespace rpc {
 
 using google::protobuf::ServiceDescriptor;
+using google::protobuf::io::CodedOutputStream;
+using ola::io::IOQueue;
+using ola::io::MemoryBlock;
+using ola::io::MemoryBlockPool;
 
+const char StreamRpcChannel::K_RPC_LATENCY_VAR[] = "rpc-latency-us";
 const char StreamRpcChannel::K_RPC_RECEIVED_TYPE_VAR[] = "rpc-received-type";
 const char StreamRpcChannel::K_RPC_RECEIVED_VAR[] = "rpc-received";
+const char StreamRpcChannel::K_RPC_MSGS_PER_READ_VAR[] =
+    "rpc-messages-per-read";
 const char StreamRpcChannel::K_RPC_SENT_ERROR_VAR[] = "rpc-send-errors";
 const char StreamRpcChannel::K_RPC_SENT_VAR[] = "rpc-sent";
 const char StreamRpcChannel::STREAMING_NO_RESPONSE[] = "STREAMING_NO_RESPONSE";
 
+/*
+ * The keys in the rpc-received-type map.
+ */
+static const struct {
+  Type type;
+  const char *name;
+} RECEIVED_TYPES[] = {
+  {REQUEST, "request"},
+  {RESPONSE, "response"},
+  {RESPONSE_CANCEL, "cancelled"},
+  {RESPONSE_FAILED, "failed"},
+  {RESPONSE_NOT_IMPLEMENTED, "not-implemented"},
+  {STREAM_REQUEST, "stream_request"},
+};
+
+/*
+ * The keys in the rpc-messages-per-read map.
+ */
+static const char *const MSGS_PER_READ_NAMES[] = {
+  "1", "2", "4", "8", "16", "32", "64"};
+
+/*
+ * A ZeroCopyOutputStream that lets protobuf serialize directly into
+ * MemoryBlocks, which are appended to an IOQueue as they fill up. The blocks
+ * must come from the same pool as the IOQueue uses.
+ */
+class IOQueueOutputStream: public google::protobuf::io::ZeroCopyOutputStream {
+  public:
+    IOQueueOutputStream(IOQueue *queue, MemoryBlockPool *pool)
+        : m_queue(queue),
+          m_pool(pool),
+          m_block(NULL),
+          m_block_used(0),
+          m_byte_count(0) {
+    }
+
+    ~IOQueueOutputStream() {
+      AppendBlock();
+    }
+
+    bool Next(void **data, int *size) {
+      AppendBlock();
+      m_block = m_pool->Allocate();
+      if (!m_block)
+        return false;
+      m_block->SeekFront();
+      m_block_used = m_block->Remaining();
+      m_byte_count += m_block_used;
+      *data = m_block->Tail();
+      *size = static_cast<int>(m_block_used);
+      return true;
+    }
+
+    void BackUp(int count) {
+      m_block_used -= count;
+      m_byte_count -= count;
+    }
+
+    google::protobuf::int64 ByteCount() const { return m_byte_count; }
+
+  private:
+    IOQueue *m_queue;
+    MemoryBlockPool *m_pool;
+    MemoryBlock *m_block;  // the block protobuf is writing to
+    unsigned int m_block_used;
+    google::protobuf::int64 m_byte_count;
+
+    void AppendBlock() {
+      if (!m_block)
+        return;
+      if (m_block_used) {
+        m_block->Extend(m_block_used);
+        m_queue->AppendBlock(m_block);
+      } else {
+        m_pool->Release(m_block);
+      }
+      m_block = NULL;
+    }
+};
+
+
 StreamRpcChannel::StreamRpcChannel(
     Service *service,
     ola::io::ConnectedDescriptor *descriptor,
     ExportMap *export_map)
     : m_service(service),
       m_on_close(NULL),
+      m_on_drain(NULL),
       m_descriptor(descriptor),
       m_seq(0),
       m_buffer(NULL),
       m_buffer_size(0),
-      m_expected_size(0),
-      m_current_size(0),
+      m_read_start(0),
+      m_read_end(0),
+      m_resume_timeout(ola::thread::INVALID_TIMEOUT),
       m_export_map(export_map),
-      m_recv_type_map(NULL) {
+      m_latency_map(NULL),
+      m_ss(NULL),
+      m_output_queue(&m_memory_pool),
+      m_write_registered(false) {
   descriptor->SetOnData(
       ola::NewCallback(this, &StreamRpcChannel::DescriptorReady));
+  descriptor->SetOnWritable(
+      ola::NewCallback(this, &StreamRpcChannel::PerformWrite));
 
   // init the counters
-  const char *vars[] = {
-    K_RPC_RECEIVED_VAR,
-    K_RPC_SENT_ERROR_VAR,
-    K_RPC_SENT_VAR,
-  };
-
   if (m_export_map) {
-    for (unsigned int i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i)
-      m_export_map->GetCounterVar(string(vars[i]));
-    m_recv_type_map = m_export_map->GetUIntMapVar(K_RPC_RECEIVED_TYPE_VAR,
-                                                  "type");
+    m_received_handle = m_export_map->GetCounterVar(
+        K_RPC_RECEIVED_VAR)->Handle();
+    m_sent_error_handle = m_export_map->GetCounterVar(
+        K_RPC_SENT_ERROR_VAR)->Handle();
+    m_sent_handle = m_export_map->GetCounterVar(K_RPC_SENT_VAR)->Handle();
+
+    UIntMap *recv_type_map = m_export_map->GetUIntMapVar(
+        K_RPC_RECEIVED_TYPE_VAR, "type");
+    for (unsigned int i = 0; i < arraysize(RECEIVED_TYPES); ++i) {
+      m_recv_type_handles[RECEIVED_TYPES[i].type] = recv_type_map->Handle(
+          RECEIVED_TYPES[i].name);
+    }
+
+    UIntMap *msgs_per_read_map = m_export_map->GetUIntMapVar(
+        K_RPC_MSGS_PER_READ_VAR, "messages");
+    for (unsigned int i = 0; i < MSGS_PER_READ_BUCKETS; ++i) {
+      m_msgs_per_read_handles[i] = msgs_per_read_map->Handle(
+          MSGS_PER_READ_NAMES[i]);
+    }
+
+    m_latency_map = m_export_map->GetHistogramMapVar(K_RPC_LATENCY_VAR,
+                                                     "method");
   }
 }
 
 
 StreamRpcChannel::~StreamRpcChannel() {
+  if (m_write_registered)
+    m_ss->RemoveWriteDescriptor(m_descriptor);
+  if (m_resume_timeout != ola::thread::INVALID_TIMEOUT)
+    m_ss->RemoveTimeout(m_resume_timeout);
   if (m_on_close)
     delete m_on_close;
+  if (m_on_drain)
+    delete m_on_drain;
   free(m_buffer);
+
+  std::vector<OutstandingRequest*>::iterator request_iter =
+    m_free_requests.begin();
+  for (; request_iter != m_free_requests.end(); ++request_iter) {
+    delete (*request_iter)->controller;
+    delete (*request_iter)->on_complete;
+    delete *request_iter;
+  }
+
+  MessagePoolMap::iterator pool_iter = m_message_pools.begin();
+  for (; pool_iter != m_message_pools.end(); ++pool_iter) {
+    STLDeleteElements(&pool_iter->second.requests);
+    STLDeleteElements(&pool_iter->second.responses);
+  }
 }
 
 
 /*
- * Receive a message for this RPCChannel. Called when data is available on the
+ * Receive messages for this RPCChannel. Called when data is available on the
  * descriptor.
+ *
+ * Rather than reading each header & message separately, we read as much as
+ * the kernel has buffered and then handle all the complete msgs. A busy client
+ * often has dozens of small msgs waiting.
  */
 void StreamRpcChannel::DescriptorReady() {
-  if (!m_expected_size) {
-    // this is a new msg
-    unsigned int version;
-    if (ReadHeader(&version, &m_expected_size) < 0)
-      return;
-
-    if (!m_expected_size)
-      return;
-
-    if (version != PROTOCOL_VERSION) {
-      OLA_WARN << "protocol mismatch " << version << " != " <<
-        PROTOCOL_VERSION;
-      return;
-    }
-    m_current_size = 0;
-    m_buffer_size = AllocateMsgBuffer(m_expected_size);
-
-    if (m_buffer_size < m_expected_size) {
-      OLA_WARN << "buffer size to small " << m_buffer_size << " < " <<
-        m_expected_size;
-      return;
-    }
-  }
-
-  unsigned int data_read;
-  if (m_descriptor->Receive(m_buffer + m_current_size,
-                            m_expected_size - m_current_size,
-                            data_read) < 0) {
-    OLA_WARN << "something went wrong in descriptor recv\n";
+  // Without a SelectServer nothing tells us when the descriptor is writable
+  // again, so use the reply traffic to flush any queued output.
+  if (!m_ss && !m_output_queue.Empty() && !SendQueuedOutput())
     return;
-  }
+  if (ReadIntoBuffer())
+    HandleBufferedMsgs(m_ss ? MAX_MSGS_PER_READ : UINT_MAX);
+}
 
-  m_current_size += data_read;
 
-  if (m_current_size == m_expected_size) {
-    // we've got all of this message so parse it.
-    if (!HandleNewMsg(m_buffer, m_expected_size)) {
-      // this probably means we've messed the framing up, close the channel
-      OLA_WARN << "Errors detected on RPC channel, closing";
-      m_descriptor->Close();
-    }
-    m_expected_size = 0;
+/*
+ * Handle all the msgs that are still buffered.
+ */
+void StreamRpcChannel::HandleRemainingMsgs() {
+  if (m_resume_timeout != ola::thread::INVALID_TIMEOUT) {
+    m_ss->RemoveTimeout(m_resume_timeout);
+    m_resume_timeout = ola::thread::INVALID_TIMEOUT;
   }
-  return;
+  HandleBufferedMsgs(UINT_MAX);
 }
 
 
@@ -148,9 +263,28 @@ void StreamRpcChannel::SetOnClose(SingleUseCallback0<void> *closure) {
 }
 
 
+/*
+ * Set the SelectServer to use to wait for the descriptor to become writable.
+ */
+void StreamRpcChannel::SetSelectServer(ola::io::SelectServerInterface *ss) {
+  if (m_write_registered) {
+    m_ss->RemoveWriteDescriptor(m_descriptor);
+    m_write_registered = false;
+  }
+  if (m_resume_timeout != ola::thread::INVALID_TIMEOUT) {
+    m_ss->RemoveTimeout(m_resume_timeout);
+    m_resume_timeout = ola::thread::INVALID_TIMEOUT;
+  }
+  m_ss = ss;
+  if (m_ss && !m_output_queue.Empty()) {
+    m_ss->AddWriteDescriptor(m_descriptor);
+    m_write_registered = true;
+  }
+}
+
+
 /*
  * Call a method with the given request and reply
- * TODO(simonn): reduce the number of copies here
  */
 void StreamRpcChannel::CallMethod(
     const MethodDescriptor *method,
@@ -158,7 +292,6 @@ void StreamRpcChannel::CallMethod(
     const Message *request,
     Message *reply,
     google::protobuf::Closure *done) {
-  string output;
   RpcMessage message;
   bool is_streaming = false;
 
@@ -177,8 +310,7 @@ void StreamRpcChannel::CallMethod(
   message.set_id(m_seq++);
   message.set_name(method->name());
 
-  request->SerializeToString(&output);
-  message.set_buffer(output);
+  request->SerializeToString(message.mutable_buffer());
   bool r = SendMsg(&message);
 
   if (is_streaming)
@@ -213,9 +345,11 @@ void StreamRpcChannel::CallMethod(
  * Called when a response is ready.
  */
 void StreamRpcChannel::RequestComplete(OutstandingRequest *request) {
-  string output;
   RpcMessage message;
 
+  if (m_latency_map)
+    RecordLatency(request->method, request->start);
+
   if (request->controller->Failed()) {
     SendRequestFailed(request);
     return;
@@ -223,10 +357,9 @@ void StreamRpcChannel::RequestComplete(OutstandingRequest *request) {
 
   message.set_type(RESPONSE);
   message.set_id(request->id);
-  request->response->SerializeToString(&output);
-  message.set_buffer(output);
+  request->response->SerializeToString(message.mutable_buffer());
   SendMsg(&message);
-  DeleteOutstandingRequest(request);
+  ReleaseOutstandingRequest(request);
 }
 
 
@@ -235,6 +368,11 @@ void StreamRpcChannel::RequestComplete(OutstandingRequest *request) {
 
 /*
  * Write an RpcMessage to the write descriptor.
+ *
+ * The header & message are serialized straight into MemoryBlocks and sent
+ * with a single writev(). Anything that can't be written right away is
+ * queued and sent once the descriptor is writable, rather than breaking the
+ * framing.
  */
 bool StreamRpcChannel::SendMsg(RpcMessage *msg) {
   if (!m_descriptor->ValidReadDescriptor()) {
@@ -242,87 +380,274 @@ bool StreamRpcChannel::SendMsg(RpcMessage *msg) {
     return false;
   }
 
-  string output;
-  msg->SerializeToString(&output);
-  int length = output.length();
+  int length = msg->ByteSize();
   uint32_t header;
   StreamRpcHeader::EncodeHeader(&header, PROTOCOL_VERSION, length);
 
-  ssize_t ret = m_descriptor->Send(reinterpret_cast<const uint8_t*>(&header),
-                                   sizeof(header));
-  ret = m_descriptor->Send(reinterpret_cast<const uint8_t*>(output.data()),
-                           length);
-
-  if (ret != length) {
-    if (ret == -1)
-      OLA_WARN << "Send failed " << strerror(errno);
-    else
-      OLA_WARN << "Failed to send full datagram, closing channel";
-    // At the point framing is screwed and we should shut the channel down
-    m_descriptor->Close();
-    if (m_on_close)
-      m_on_close->Run();
-
-    if (m_export_map)
-      (*m_export_map->GetCounterVar(K_RPC_SENT_ERROR_VAR))++;
+  bool ok;
+  {
+    IOQueueOutputStream stream(&m_output_queue, &m_memory_pool);
+    CodedOutputStream output(&stream);
+    output.WriteRaw(&header, sizeof(header));
+    msg->SerializeWithCachedSizes(&output);
+    ok = !output.HadError();
+  }
+
+  if (!ok) {
+    OLA_WARN << "Failed to serialize RPC, closing channel";
+    SendFailed();
+    return false;
+  }
+
+  m_sent_handle++;
+
+  // if we're waiting for the descriptor to be writable, this msg goes out
+  // after the ones already queued.
+  if (m_write_registered)
+    return true;
+  return SendQueuedOutput();
+}
+
+
+/*
+ * Write as much of the queued output as the descriptor will take.
+ * @returns false if the channel was closed.
+ */
+bool StreamRpcChannel::SendQueuedOutput() {
+  ssize_t ret = m_descriptor->Send(&m_output_queue);
+  if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    OLA_WARN << "Send failed " << strerror(errno);
+    SendFailed();
     return false;
   }
 
-  if (m_export_map)
-    (*m_export_map->GetCounterVar(K_RPC_SENT_VAR))++;
+  if (m_output_queue.Empty()) {
+    if (m_write_registered) {
+      m_ss->RemoveWriteDescriptor(m_descriptor);
+      m_write_registered = false;
+    }
+    return true;
+  }
+
+  if (m_output_queue.Size() > MAX_OUTPUT_QUEUE_SIZE) {
+    OLA_WARN << "More than " << MAX_OUTPUT_QUEUE_SIZE << " bytes queued for "
+             << "sending, closing channel";
+    SendFailed();
+    return false;
+  }
+
+  if (m_ss && !m_write_registered) {
+    m_ss->AddWriteDescriptor(m_descriptor);
+    m_write_registered = true;
+  }
   return true;
 }
 
 
 /*
- * Allocate an incomming message buffer
- * @param size the size of the new buffer to allocate
- * @returns the size of the new buffer
+ * Set the callback to run when the queued output has been sent.
+ */
+void StreamRpcChannel::SetOnDrain(Callback0<void> *callback) {
+  if (m_on_drain)
+    delete m_on_drain;
+  m_on_drain = callback;
+}
+
+
+/*
+ * Called when the descriptor is writable.
+ */
+void StreamRpcChannel::PerformWrite() {
+  if (SendQueuedOutput() && m_output_queue.Empty() && m_on_drain)
+    m_on_drain->Run();
+}
+
+
+/*
+ * Called when we can't send on the channel. Since the framing is now broken,
+ * the channel is shut down.
+ */
+void StreamRpcChannel::SendFailed() {
+  if (m_write_registered) {
+    m_ss->RemoveWriteDescriptor(m_descriptor);
+    m_write_registered = false;
+  }
+  m_output_queue.Clear();
+  m_descriptor->Close();
+
+  m_sent_error_handle++;
+
+  // the on close handler may delete this channel, so it's run last
+  if (m_on_close) {
+    SingleUseCallback0<void> *on_close = m_on_close;
+    m_on_close = NULL;
+    on_close->Run();
+  }
+}
+
+
+/*
+ * Read the data available on the descriptor into the buffer.
+ * @returns false if the read failed.
  */
-int StreamRpcChannel::AllocateMsgBuffer(unsigned int size) {
-  unsigned int requested_size = size;
-  uint8_t *new_buffer;
+bool StreamRpcChannel::ReadIntoBuffer() {
+  if (!m_buffer && !GrowBuffer(INITIAL_BUFFER_SIZE))
+    return false;
 
-  if (size < m_buffer_size)
-    return size;
+  // move the start of any partial msg to the front of the buffer
+  if (m_read_start) {
+    memmove(m_buffer, m_buffer + m_read_start, m_read_end - m_read_start);
+    m_read_end -= m_read_start;
+    m_read_start = 0;
+  }
 
-  if (m_buffer_size == 0 && size < INITIAL_BUFFER_SIZE)
-    requested_size = INITIAL_BUFFER_SIZE;
+  // Only ask for what's available, so this works with blocking descriptors.
+  // If the buffer is full of msgs we haven't got to yet, they're handled
+  // first.
+  unsigned int size = std::min(
+      static_cast<unsigned int>(m_descriptor->DataRemaining()),
+      m_buffer_size - m_read_end);
+  if (!size)
+    return true;
 
-  if (requested_size > MAX_BUFFER_SIZE)
-    return m_buffer_size;
+  unsigned int data_read;
+  if (m_descriptor->Receive(m_buffer + m_read_end, size, data_read) < 0) {
+    OLA_WARN << "something went wrong in descriptor recv";
+    return false;
+  }
+  m_read_end += data_read;
+  return true;
+}
 
-  new_buffer = static_cast<uint8_t*>(realloc(m_buffer, requested_size));
+
+/*
+ * Grow the incomming msg buffer.
+ * @param size the new size of the buffer
+ * @returns false if the buffer couldn't be grown.
+ */
+bool StreamRpcChannel::GrowBuffer(unsigned int size) {
+  if (size > MAX_BUFFER_SIZE)
+    return false;
+
+  uint8_t *new_buffer = static_cast<uint8_t*>(realloc(m_buffer, size));
   if (!new_buffer)
-    return m_buffer_size;
+    return false;
 
   m_buffer = new_buffer;
-  m_buffer_size = requested_size;
-  return requested_size;
+  m_buffer_size = size;
+  return true;
 }
 
 
 /*
- * Read 4 bytes and decode the header fields.
- * @returns: -1 if there is no data is available, version and size are 0
+ * Handle the complete msgs in the buffer. If we stop at msg_limit, the rest
+ * are handled once other descriptors have had a turn.
+ * @param msg_limit the most msgs to handle.
  */
-int StreamRpcChannel::ReadHeader(unsigned int *version,
-                                 unsigned int *size) const {
-  uint32_t header;
-  unsigned int data_read = 0;
-  *version = *size = 0;
+void StreamRpcChannel::HandleBufferedMsgs(unsigned int msg_limit) {
+  unsigned int msg_count = 0;
+
+  while (msg_count < msg_limit) {
+    uint32_t header;
+    unsigned int buffered = m_read_end - m_read_start;
+    if (buffered < sizeof(header))
+      break;
+
+    unsigned int version, size;
+    memcpy(&header, m_buffer + m_read_start, sizeof(header));
+    StreamRpcHeader::DecodeHeader(header, &version, &size);
+    if (version != PROTOCOL_VERSION) {
+      OLA_WARN << "protocol mismatch " << version << " != " <<
+        PROTOCOL_VERSION;
+      ReadFailed();
+      return;
+    }
 
-  if (m_descriptor->Receive(reinterpret_cast<uint8_t*>(&header),
-                            sizeof(header), data_read)) {
-    OLA_WARN << "read header error: " << strerror(errno);
-    return -1;
+    unsigned int msg_size = sizeof(header) + size;
+    if (buffered < msg_size) {
+      if (msg_size > m_buffer_size && !GrowBuffer(msg_size)) {
+        OLA_WARN << "buffer size to small " << m_buffer_size << " < " <<
+          msg_size;
+        ReadFailed();
+        return;
+      }
+      break;
+    }
+
+    uint8_t *msg = m_buffer + m_read_start + sizeof(header);
+    m_read_start += msg_size;
+    if (!size)
+      continue;
+
+    msg_count++;
+    if (!HandleNewMsg(msg, size)) {
+      // this probably means we've messed the framing up, close the channel
+      OLA_WARN << "Errors detected on RPC channel, closing";
+      ReadFailed();
+      return;
+    }
   }
 
-  if (!data_read)
-    return 0;
+  if (msg_count)
+    RecordMsgsPerRead(msg_count);
+
+  if (m_read_start == m_read_end) {
+    m_read_start = m_read_end = 0;
+  } else if (msg_count == msg_limit &&
+             m_resume_timeout == ola::thread::INVALID_TIMEOUT) {
+    // there may be more msgs buffered, come back to them once the other
+    // descriptors have been serviced
+    m_resume_timeout = m_ss->RegisterSingleTimeout(
+        0,
+        NewSingleCallback(this, &StreamRpcChannel::ResumeBufferedMsgs));
+  }
+}
+
+
+/*
+ * Called to handle the msgs left over when we hit MAX_MSGS_PER_READ.
+ */
+void StreamRpcChannel::ResumeBufferedMsgs() {
+  m_resume_timeout = ola::thread::INVALID_TIMEOUT;
+  HandleBufferedMsgs(MAX_MSGS_PER_READ);
+}
+
+
+/*
+ * Add the time since a request was dispatched to the latency histogram for
+ * the method.
+ */
+void StreamRpcChannel::RecordLatency(const MethodDescriptor *method,
+                                     const TimeStamp &start) {
+  TimeStamp now;
+  m_clock.CurrentTime(&now);
+  int64_t latency = (now - start).AsInt();
+  latency = std::max(static_cast<int64_t>(0),
+                     std::min(latency, static_cast<int64_t>(UINT_MAX)));
+  m_latency_map->Add(method->name(), static_cast<unsigned int>(latency));
+}
+
+
+/*
+ * Update the distribution of msgs handled per read. The buckets are powers of
+ * two, each counts the reads that handled more than half & up to that many
+ * msgs.
+ */
+void StreamRpcChannel::RecordMsgsPerRead(unsigned int msg_count) {
+  unsigned int bucket = 0;
+  while (bucket + 1 < MSGS_PER_READ_BUCKETS && (1u << bucket) < msg_count)
+    bucket++;
+  m_msgs_per_read_handles[bucket]++;
+}
+
 
-  StreamRpcHeader::DecodeHeader(header, version, size);
-  return 0;
+/*
+ * Called when the incomming data doesn't make sense, we can't recover the
+ * framing so the channel is closed.
+ */
+void StreamRpcChannel::ReadFailed() {
+  m_read_start = m_read_end = 0;
+  m_descriptor->Close();
 }
 
 
@@ -336,38 +661,27 @@ bool StreamRpcChannel::HandleNewMsg(uint8_t *data, unsigned int size) {
     return false;
   }
 
-  if (m_export_map)
-    (*m_export_map->GetCounterVar(K_RPC_RECEIVED_VAR))++;
+  m_received_handle++;
+  if (static_cast<unsigned int>(msg.type()) < MSG_TYPES)
+    m_recv_type_handles[msg.type()]++;
 
   switch (msg.type()) {
     case REQUEST:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["request"]++;
       HandleRequest(&msg);
       break;
     case RESPONSE:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["response"]++;
       HandleResponse(&msg);
       break;
     case RESPONSE_CANCEL:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["cancelled"]++;
       HandleCanceledResponse(&msg);
       break;
     case RESPONSE_FAILED:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["failed"]++;
       HandleFailedResponse(&msg);
       break;
     case RESPONSE_NOT_IMPLEMENTED:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["not-implemented"]++;
       HandleNotImplemented(&msg);
       break;
     case STREAM_REQUEST:
-      if (m_recv_type_map)
-        (*m_recv_type_map)["stream_request"]++;
       HandleStreamRequest(&msg);
       break;
     default:
@@ -399,35 +713,39 @@ void StreamRpcChannel::HandleRequest(RpcMessage *msg) {
     return;
   }
 
-  Message* request_pb = m_service->GetRequestPrototype(method).New();
-  Message* response_pb = m_service->GetResponsePrototype(method).New();
-
-  if (!request_pb || !response_pb) {
-    OLA_WARN << "failed to get request or response objects";
+  if (m_requests.find(msg->id()) != m_requests.end()) {
+    // the service still holds the closure for the first request, so it's
+    // this one that's refused.
+    OLA_WARN << "dup sequence number for request " << msg->id();
+    SendRequestFailed(msg->id(), "Duplicate request id");
     return;
   }
 
+  MessagePool *pool = &m_message_pools[method];
+  Message *request_pb = NewMessage(&pool->requests,
+                                   m_service->GetRequestPrototype(method));
   if (!request_pb->ParseFromString(msg->buffer())) {
     OLA_WARN << "parsing of request pb failed";
+    ReleaseMessage(&pool->requests, request_pb);
     return;
   }
 
-  OutstandingRequest *request = new OutstandingRequest();
+  OutstandingRequest *request = NewOutstandingRequest();
   request->id = msg->id();
-  request->controller = new SimpleRpcController();
-  request->response = response_pb;
-
-  if (m_requests.find(msg->id()) != m_requests.end()) {
-    OLA_WARN << "dup sequence number for request " << msg->id();
-    SendRequestFailed(m_requests[msg->id()]);
-  }
+  request->response = NewMessage(&pool->responses,
+                                 m_service->GetResponsePrototype(method));
+  request->method = method;
+  if (m_latency_map)
+    m_clock.CurrentTime(&request->start);
 
   m_requests[msg->id()] = request;
-  google::protobuf::Closure *callback = NewCallback(
-      this, &StreamRpcChannel::RequestComplete, request);
-  m_service->CallMethod(method, request->controller, request_pb, response_pb,
-                        callback);
-  delete request_pb;
+  {
+    // the descriptor outlives the trace, so the name can be used directly
+    ola::thread::TraceScope trace(method->full_name().c_str());
+    m_service->CallMethod(method, request->controller, request_pb,
+                          request->response, request->on_complete);
+  }
+  ReleaseMessage(&pool->requests, request_pb);
 }
 
 
@@ -458,20 +776,26 @@ void StreamRpcChannel::HandleStreamRequest(RpcMessage *msg) {
     return;
   }
 
-  Message* request_pb = m_service->GetRequestPrototype(method).New();
-
-  if (!request_pb) {
-    OLA_WARN << "failed to get request or response objects";
-    return;
-  }
-
+  std::vector<Message*> *pool = &m_message_pools[method].requests;
+  Message *request_pb = NewMessage(pool,
+                                   m_service->GetRequestPrototype(method));
   if (!request_pb->ParseFromString(msg->buffer())) {
     OLA_WARN << "parsing of request pb failed";
+    ReleaseMessage(pool, request_pb);
     return;
   }
 
-  m_service->CallMethod(method, NULL, request_pb, NULL, NULL);
-  delete request_pb;
+  ola::thread::TraceScope trace(method->full_name().c_str());
+  if (m_latency_map) {
+    // there's no response, so this times the handler itself
+    TimeStamp start;
+    m_clock.CurrentTime(&start);
+    m_service->CallMethod(method, NULL, request_pb, NULL, NULL);
+    RecordLatency(method, start);
+  } else {
+    m_service->CallMethod(method, NULL, request_pb, NULL, NULL);
+  }
+  ReleaseMessage(pool, request_pb);
 }
 
 
@@ -480,12 +804,20 @@ void StreamRpcChannel::HandleStreamRequest(RpcMessage *msg) {
  * Notify the caller that the request failed.
  */
 void StreamRpcChannel::SendRequestFailed(OutstandingRequest *request) {
+  SendRequestFailed(request->id, request->controller->ErrorText());
+  ReleaseOutstandingRequest(request);
+}
+
+
+/*
+ * Send a failure response for a msg id.
+ */
+void StreamRpcChannel::SendRequestFailed(int msg_id, const string &error) {
   RpcMessage message;
   message.set_type(RESPONSE_FAILED);
-  message.set_id(request->id);
-  message.set_buffer(request->controller->ErrorText());
+  message.set_id(msg_id);
+  message.set_buffer(error);
   SendMsg(&message);
-  DeleteOutstandingRequest(request);
 }
 
 
@@ -500,14 +832,72 @@ void StreamRpcChannel::SendNotImplemented(int msg_id) {
 }
 
 
+/*
+ * Get an OutstandingRequest, either an unused one or a new one.
+ */
+OutstandingRequest *StreamRpcChannel::NewOutstandingRequest() {
+  if (!m_free_requests.empty()) {
+    OutstandingRequest *request = m_free_requests.back();
+    m_free_requests.pop_back();
+    request->controller->Reset();
+    return request;
+  }
+
+  OutstandingRequest *request = new OutstandingRequest();
+  request->controller = new SimpleRpcController();
+  // the closure is run once per use, so it can't delete itself
+  request->on_complete = google::protobuf::NewPermanentCallback(
+      this, &StreamRpcChannel::RequestComplete, request);
+  return request;
+}
+
+
 /*
  * Cleanup an outstanding request after the response has been returned
  */
-void StreamRpcChannel::DeleteOutstandingRequest(OutstandingRequest *request) {
+void StreamRpcChannel::ReleaseOutstandingRequest(
+    OutstandingRequest *request) {
   m_requests.erase(request->id);
-  delete request->controller;
-  delete request->response;
-  delete request;
+  ReleaseMessage(&m_message_pools[request->method].responses,
+                 request->response);
+  request->response = NULL;
+
+  if (m_free_requests.size() < MAX_POOL_SIZE) {
+    m_free_requests.push_back(request);
+  } else {
+    delete request->controller;
+    delete request->on_complete;
+    delete request;
+  }
+}
+
+
+/*
+ * Get a message from a pool, or create a new one from the prototype.
+ */
+Message *StreamRpcChannel::NewMessage(std::vector<Message*> *pool,
+                                      const Message &prototype) {
+  if (pool->empty())
+    return prototype.New();
+
+  Message *message = pool->back();
+  pool->pop_back();
+  return message;
+}
+
+
+/*
+ * Return a message to a pool. Clearing the message keeps the memory used by
+ * the string fields, so the next parse can reuse it.
+ */
+void StreamRpcChannel::ReleaseMessage(std::vector<Message*> *pool,
+                                      Message *message) {
+  if (pool->size() < MAX_POOL_SIZE) {
+    message->Clear();
+    pool->push_back(message);
+  } else {
+    delete message;
+  }
 }
 
 
@@ -28,8 +28,14 @@
 #include <stdint.h>
 #include <google/protobuf/service.h>
 #include <ola/Callback.h>
+#include <ola/Clock.h>
 #include <ola/io/Descriptor.h>
+#include <ola/io/IOQueue.h>
+#include <ola/io/MemoryBlockPool.h>
 #include <ola/io/SelectServer.h>
+#include <ola/io/SelectServerInterface.h>
+#include <map>
+#include <vector>
 #include "ola/ExportMap.h"
 
 #include HASH_MAP_H
@@ -47,7 +53,8 @@ class RpcMessage;
 
 class OutstandingRequest {
   /*
-   * These are requests on the server end that haven't completed yet.
+   * These are requests on the server end that haven't completed yet. They're
+   * reused, along with the controller and the completion closure.
    */
   public:
     OutstandingRequest() {}
@@ -56,6 +63,10 @@ class OutstandingRequest {
     int id;
     RpcController *controller;
     Message *response;
+    google::protobuf::Closure *on_complete;
+    const MethodDescriptor *method;
+    // when the request was dispatched to the service
+    TimeStamp start;
 };
 
 class OutstandingResponse {
@@ -113,20 +124,52 @@ class StreamRpcChannel: public RpcChannel {
 
     void RequestComplete(OutstandingRequest *request);
     void SetService(Service *service) { m_service = service; }
+
+    /*
+     * Messages that can't be written in full are queued, and the rest is
+     * sent once the descriptor is writable. If there is no SelectServer the
+     * queued data is sent with the next message.
+     */
+    void SetSelectServer(ola::io::SelectServerInterface *ss);
+
+    // The number of bytes waiting to be sent.
+    unsigned int PendingOutput() const { return m_output_queue.Size(); }
+
+    // Run each time the queued output has been sent in full. Ownership of the
+    // callback is transferred.
+    void SetOnDrain(Callback0<void> *callback);
+
+    // Handle the msgs that have been read but not handled yet. Call this when
+    // the descriptor is closed, since the peer may have sent more msgs than
+    // are handled in a single pass before it closed.
+    void HandleRemainingMsgs();
+
     static const unsigned int PROTOCOL_VERSION = 1;
 
   private:
     bool SendMsg(RpcMessage *msg);
-    int AllocateMsgBuffer(unsigned int size);
-    int ReadHeader(unsigned int *version, unsigned int *size) const;
+    bool SendQueuedOutput();
+    void PerformWrite();
+    void SendFailed();
+    bool ReadIntoBuffer();
+    bool GrowBuffer(unsigned int size);
+    void HandleBufferedMsgs(unsigned int msg_limit);
+    void ResumeBufferedMsgs();
+    void RecordMsgsPerRead(unsigned int msg_count);
+    void ReadFailed();
+    void RecordLatency(const MethodDescriptor *method, const TimeStamp &start);
     bool HandleNewMsg(uint8_t *buffer, unsigned int size);
     void HandleRequest(RpcMessage *msg);
     void HandleStreamRequest(RpcMessage *msg);
 
     // server end
     void SendRequestFailed(OutstandingRequest *request);
+    void SendRequestFailed(int msg_id, const std::string &error);
     void SendNotImplemented(int msg_id);
-    void DeleteOutstandingRequest(OutstandingRequest *request);
+    OutstandingRequest *NewOutstandingRequest();
+    void ReleaseOutstandingRequest(OutstandingRequest *request);
+    Message *NewMessage(std::vector<Message*> *pool, const Message &prototype);
+    void ReleaseMessage(std::vector<Message*> *pool, Message *message);
 
     // client end
     void HandleResponse(RpcMessage *msg);
@@ -138,25 +181,65 @@ class StreamRpcChannel: public RpcChannel {
 
     Service *m_service;  // service to dispatch requests to
     SingleUseCallback0<void> *m_on_close;
+    Callback0<void> *m_on_drain;
     // the descriptor to read/write to.
     class ola::io::ConnectedDescriptor *m_descriptor;
     uint32_t m_seq;  // sequence number
     uint8_t *m_buffer;  // buffer for incomming msgs
     unsigned int m_buffer_size;  // size of the buffer
-    unsigned int m_expected_size;  // the total size of the current msg
-    unsigned int m_current_size;  // the amount of data read for the current msg
+    unsigned int m_read_start;  // offset of the first msg yet to be handled
+    unsigned int m_read_end;  // offset of the end of the data read so far
+    // used to finish handling the buffered msgs if we hit MAX_MSGS_PER_READ
+    ola::thread::timeout_id m_resume_timeout;
     HASH_NAMESPACE::HASH_MAP_CLASS<int, OutstandingRequest*> m_requests;
     HASH_NAMESPACE::HASH_MAP_CLASS<int, OutstandingResponse*> m_responses;
-    ExportMap *m_export_map;
-    UIntMap *m_recv_type_map;
 
+    // Request and response objects are reused, so the high rate methods don't
+    // allocate new ones for each call.
+    struct MessagePool {
+      std::vector<Message*> requests;
+      std::vector<Message*> responses;
+    };
+    typedef std::map<const MethodDescriptor*, MessagePool> MessagePoolMap;
+    MessagePoolMap m_message_pools;
+    std::vector<OutstandingRequest*> m_free_requests;
+    ExportMap *m_export_map;
+    // one more than the largest RpcMessage type
+    static const unsigned int MSG_TYPES = 11;
+    // the reads are counted in powers of two up to MAX_MSGS_PER_READ
+    static const unsigned int MSGS_PER_READ_BUCKETS = 7;
+
+    // The counters updated for each msg are resolved once, these are unbound
+    // if there isn't an ExportMap.
+    CounterHandle m_sent_handle;
+    CounterHandle m_sent_error_handle;
+    CounterHandle m_received_handle;
+    // indexed by RpcMessage type
+    CounterHandle m_recv_type_handles[MSG_TYPES];
+    CounterHandle m_msgs_per_read_handles[MSGS_PER_READ_BUCKETS];
+    HistogramMap *m_latency_map;
+    Clock m_clock;
+    ola::io::SelectServerInterface *m_ss;
+    // outgoing msgs are serialized straight into blocks from this pool
+    ola::io::MemoryBlockPool m_memory_pool;
+    ola::io::IOQueue m_output_queue;
+    bool m_write_registered;
+
+    static const char K_RPC_LATENCY_VAR[];
     static const char K_RPC_RECEIVED_TYPE_VAR[];
     static const char K_RPC_RECEIVED_VAR[];
+    static const char K_RPC_MSGS_PER_READ_VAR[];
     static const char K_RPC_SENT_ERROR_VAR[];
     static const char K_RPC_SENT_VAR[];
     static const char STREAMING_NO_RESPONSE[];
-    static const unsigned int INITIAL_BUFFER_SIZE = 1 << 11;  // 2k
+    static const unsigned int INITIAL_BUFFER_SIZE = 1 << 15;  // 32k
     static const unsigned int MAX_BUFFER_SIZE = 1 << 20;  // 1M
+    // the most msgs to handle before letting the SelectServer run again
+    static const unsigned int MAX_MSGS_PER_READ = 64;
+    // the most data we'll queue for a slow reader before closing the channel
+    static const unsigned int MAX_OUTPUT_QUEUE_SIZE = 1 << 22;  // 4M
+    // the most unused objects of each type to keep for reuse
+    static const unsigned int MAX_POOL_SIZE = 16;
 };
 }  // namespace rpc
 }  // namespace ola
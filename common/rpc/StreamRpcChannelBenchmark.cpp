@@ -0,0 +1,168 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * StreamRpcChannelBenchmark.cpp
+ * Count the allocations & time taken for each RPC over a loopback channel.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <google/protobuf/stubs/common.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "common/rpc/SimpleRpcController.h"
+#include "common/rpc/StreamRpcChannel.h"
+#include "common/rpc/TestService.pb.h"
+#include "ola/Clock.h"
+#include "ola/ExportMap.h"
+#include "ola/base/Flags.h"
+#include "ola/io/Descriptor.h"
+
+using ola::Clock;
+using ola::ExportMap;
+using ola::TimeInterval;
+using ola::TimeStamp;
+using ola::io::LoopbackDescriptor;
+using ola::rpc::EchoReply;
+using ola::rpc::EchoRequest;
+using ola::rpc::STREAMING_NO_RESPONSE;
+using ola::rpc::SimpleRpcController;
+using ola::rpc::StreamRpcChannel;
+using ola::rpc::TestService;
+using ola::rpc::TestService_Stub;
+using std::cout;
+using std::endl;
+using std::string;
+
+DEFINE_s_uint32(iterations, i, 100000, "The number of calls to time");
+
+static uint64_t allocations = 0;
+
+/*
+ * Count every allocation made by the process.
+ */
+void *operator new(size_t size) {
+  allocations++;
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+
+#if __cplusplus >= 201103L
+void operator delete(void *ptr) noexcept {
+#else
+void operator delete(void *ptr) throw() {
+#endif
+  free(ptr);
+}
+
+
+class BenchmarkService: public TestService {
+  public:
+    void Echo(::google::protobuf::RpcController*,
+              const EchoRequest* request,
+              EchoReply* response,
+              ::google::protobuf::Closure* done) {
+      response->set_data(request->data());
+      done->Run();
+    }
+
+    void FailedEcho(::google::protobuf::RpcController* controller,
+                    const EchoRequest*,
+                    EchoReply*,
+                    ::google::protobuf::Closure* done) {
+      controller->SetFailed("Error");
+      done->Run();
+    }
+
+    void Stream(::google::protobuf::RpcController*,
+                const EchoRequest*,
+                STREAMING_NO_RESPONSE*,
+                ::google::protobuf::Closure*) {
+    }
+};
+
+
+void Noop() {}
+
+
+/*
+ * The channel talks to itself over the loopback descriptor, so each call
+ * includes the client end as well as the server end.
+ */
+void RunCalls(const string &name, TestService_Stub *stub,
+              StreamRpcChannel *channel, bool streaming) {
+  Clock clock;
+  SimpleRpcController controller;
+  EchoRequest request;
+  EchoReply reply;
+  // a DMX frame
+  request.set_data(string(512, 'x'));
+  google::protobuf::Closure *done = google::protobuf::NewPermanentCallback(
+      &Noop);
+
+  TimeStamp start, end;
+  uint64_t start_allocations = allocations;
+  clock.CurrentTime(&start);
+  for (uint32_t i = 0; i < FLAGS_iterations; i++) {
+    if (streaming) {
+      stub->Stream(NULL, &request, NULL, NULL);
+      channel->DescriptorReady();
+    } else {
+      controller.Reset();
+      stub->Echo(&controller, &request, &reply, done);
+      // once for the request, once for the response
+      channel->DescriptorReady();
+      channel->DescriptorReady();
+    }
+  }
+  clock.CurrentTime(&end);
+  uint64_t count = allocations - start_allocations;
+  TimeInterval elapsed = end - start;
+  delete done;
+
+  cout << std::setw(6) << name << std::setw(18) << std::fixed
+       << std::setprecision(2)
+       << static_cast<double>(count) / FLAGS_iterations << std::setw(16)
+       << elapsed.AsInt() * 1000.0 / FLAGS_iterations << endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  ola::SetHelpString(
+      "[options]",
+      "Count the allocations made for each RPC call.");
+  ola::ParseFlags(&argc, argv);
+
+  LoopbackDescriptor socket;
+  socket.Init();
+  BenchmarkService service;
+  // olad always has an ExportMap, so include the cost of updating it
+  ExportMap export_map;
+  StreamRpcChannel channel(&service, &socket, &export_map);
+  TestService_Stub stub(&channel);
+
+  cout << "Method  Allocations/call  Time/call (ns)" << endl;
+  // the first call of each method fills the pools
+  RunCalls("Echo", &stub, &channel, false);
+  RunCalls("Stream", &stub, &channel, true);
+  return 0;
+}
@@ -22,6 +22,7 @@
 #include <google/protobuf/stubs/common.h>
 #include <string>
 
+#include "ola/ExportMap.h"
 #include "ola/io/SelectServer.h"
 #include "ola/network/Socket.h"
 #include "common/rpc/StreamRpcChannel.h"
@@ -31,6 +32,9 @@
 
 
 using google::protobuf::NewCallback;
+using ola::ExportMap;
+using ola::HistogramMap;
+using ola::UIntMap;
 using ola::io::LoopbackDescriptor;
 using ola::io::SelectServer;
 using ola::rpc::EchoReply;
@@ -47,7 +51,11 @@ using std::string;
  */
 class TestServiceImpl: public TestService {
   public:
-    explicit TestServiceImpl(SelectServer *ss): m_ss(ss) {}
+    explicit TestServiceImpl(SelectServer *ss)
+        : m_ss(ss),
+          m_stream_requests(0),
+          m_expected_stream_requests(1) {
+    }
     ~TestServiceImpl() {}
 
     void Echo(::google::protobuf::RpcController* controller,
@@ -65,8 +73,16 @@ class TestServiceImpl: public TestService {
                 STREAMING_NO_RESPONSE* response,
                 ::google::protobuf::Closure* done);
 
+    // Terminate the SelectServer after this many stream requests.
+    void ExpectStreamRequests(unsigned int count) {
+      m_expected_stream_requests = count;
+    }
+    unsigned int StreamRequests() const { return m_stream_requests; }
+
   private:
     SelectServer *m_ss;
+    unsigned int m_stream_requests;
+    unsigned int m_expected_stream_requests;
 };
 
 
@@ -75,6 +91,9 @@ class StreamRpcChannelTest: public CppUnit::TestFixture {
   CPPUNIT_TEST(testEcho);
   CPPUNIT_TEST(testFailedEcho);
   CPPUNIT_TEST(testStreamRequest);
+  CPPUNIT_TEST(testLargeEcho);
+  CPPUNIT_TEST(testBufferedRequests);
+  CPPUNIT_TEST(testRemainingRequests);
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -83,14 +102,20 @@ class StreamRpcChannelTest: public CppUnit::TestFixture {
     void testEcho();
     void testFailedEcho();
     void testStreamRequest();
+    void testLargeEcho();
+    void testBufferedRequests();
+    void testRemainingRequests();
     void EchoComplete();
     void FailedEchoComplete();
+    void OutputDrained() { m_drain_count++; }
 
   private:
     SimpleRpcController m_controller;
+    unsigned int m_drain_count;
     EchoRequest m_request;
     EchoReply m_reply;
     TestService_Stub *m_stub;
+    ExportMap m_export_map;
     SelectServer m_ss;
     TestServiceImpl *m_service;
     StreamRpcChannel *m_channel;
@@ -131,7 +156,8 @@ void TestServiceImpl::Stream(::google::protobuf::RpcController* controller,
   OLA_ASSERT_FALSE(done);
   OLA_ASSERT_TRUE(request);
   OLA_ASSERT_EQ(string("foo"), request->data());
-  m_ss->Terminate();
+  if (++m_stream_requests == m_expected_stream_requests)
+    m_ss->Terminate();
 }
 
 
@@ -140,7 +166,7 @@ void StreamRpcChannelTest::setUp() {
   m_socket->Init();
 
   m_service = new TestServiceImpl(&m_ss);
-  m_channel = new StreamRpcChannel(m_service, m_socket);
+  m_channel = new StreamRpcChannel(m_service, m_socket, &m_export_map);
   m_ss.AddReadDescriptor(m_socket);
   m_stub = new TestService_Stub(m_channel);
 }
@@ -179,6 +205,10 @@ void StreamRpcChannelTest::testEcho() {
                NewCallback(this, &StreamRpcChannelTest::EchoComplete));
 
   m_ss.Run();
+
+  // the server end recorded how long the request took
+  HistogramMap *latency = m_export_map.GetHistogramMapVar("rpc-latency-us");
+  OLA_ASSERT_EQ(1u, (*latency)["Echo"].Count());
 }
 
 
@@ -193,6 +223,9 @@ void StreamRpcChannelTest::testFailedEcho() {
       &m_reply,
       NewCallback(this, &StreamRpcChannelTest::FailedEchoComplete));
   m_ss.Run();
+
+  HistogramMap *latency = m_export_map.GetHistogramMapVar("rpc-latency-us");
+  OLA_ASSERT_EQ(1u, (*latency)["FailedEcho"].Count());
 }
 
 /*
@@ -202,4 +235,75 @@ void StreamRpcChannelTest::testStreamRequest() {
   m_request.set_data("foo");
   m_stub->Stream(NULL, &m_request, NULL, NULL);
   m_ss.Run();
+
+  HistogramMap *latency = m_export_map.GetHistogramMapVar("rpc-latency-us");
+  OLA_ASSERT_EQ(1u, (*latency)["Stream"].Count());
+}
+
+
+/*
+ * Check that messages larger than the socket buffer are queued and sent once
+ * the descriptor is writable.
+ */
+void StreamRpcChannelTest::testLargeEcho() {
+  ola::io::ConnectedDescriptor::SetNonBlocking(m_socket->WriteDescriptor());
+  m_channel->SetSelectServer(&m_ss);
+  m_drain_count = 0;
+  m_channel->SetOnDrain(
+      ola::NewCallback(this, &StreamRpcChannelTest::OutputDrained));
+
+  // this spans many MemoryBlocks, and more than a pipe buffer
+  m_request.set_data(string(200000, 'x'));
+  m_stub->Echo(&m_controller,
+               &m_request,
+               &m_reply,
+               NewCallback(this, &StreamRpcChannelTest::EchoComplete));
+  OLA_ASSERT_TRUE(m_channel->PendingOutput() > 0);
+
+  m_ss.Run();
+  OLA_ASSERT_EQ(0u, m_channel->PendingOutput());
+  OLA_ASSERT_TRUE(m_drain_count > 0);
+}
+
+
+/*
+ * Check that all the msgs waiting on the descriptor are handled, but no more
+ * than MAX_MSGS_PER_READ at a time.
+ */
+void StreamRpcChannelTest::testBufferedRequests() {
+  const unsigned int request_count = 100;
+  m_channel->SetSelectServer(&m_ss);
+  m_service->ExpectStreamRequests(request_count);
+
+  m_request.set_data("foo");
+  for (unsigned int i = 0; i < request_count; i++)
+    m_stub->Stream(NULL, &m_request, NULL, NULL);
+  m_ss.Run();
+  OLA_ASSERT_EQ(request_count, m_service->StreamRequests());
+
+  // the first read handles 64 msgs, and the rest are handled on the next
+  // pass through the SelectServer.
+  UIntMap *msgs_per_read = m_export_map.GetUIntMapVar("rpc-messages-per-read");
+  OLA_ASSERT_EQ(2u, (*msgs_per_read)["64"]);
+  OLA_ASSERT_EQ(0u, (*msgs_per_read)["1"]);
+}
+
+
+/*
+ * Check that the msgs left over when we hit MAX_MSGS_PER_READ can be handled
+ * straight away, as happens when the descriptor closes.
+ */
+void StreamRpcChannelTest::testRemainingRequests() {
+  const unsigned int request_count = 100;
+  m_channel->SetSelectServer(&m_ss);
+  m_service->ExpectStreamRequests(request_count + 1);
+
+  m_request.set_data("foo");
+  for (unsigned int i = 0; i < request_count; i++)
+    m_stub->Stream(NULL, &m_request, NULL, NULL);
+  m_channel->DescriptorReady();
+  OLA_ASSERT_EQ(64u, m_service->StreamRequests());
+
+  m_channel->HandleRemainingMsgs();
+  OLA_ASSERT_EQ(request_count, m_service->StreamRequests());
 }
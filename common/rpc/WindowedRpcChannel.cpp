@@ -0,0 +1,240 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * WindowedRpcChannel.cpp
+ * An RpcChannel that limits the number of requests waiting for a response.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <deque>
+#include <string>
+#include "common/rpc/WindowedRpcChannel.h"
+#include "ola/stl/STLUtils.h"
+
+namespace ola {
+namespace rpc {
+
+using google::protobuf::Closure;
+using google::protobuf::Message;
+using google::protobuf::MethodDescriptor;
+using google::protobuf::RpcController;
+using std::string;
+
+const unsigned int WindowedRpcChannel::DEFAULT_MAX_IN_FLIGHT;
+
+
+/*
+ * Create a new WindowedRpcChannel
+ * @param channel the channel to send requests on, ownership is not
+ *   transferred.
+ * @param max_in_flight the most requests to wait on at once, 0 means no
+ *   limit.
+ * @param clock the clock used to time requests, if NULL the system clock is
+ *   used.
+ */
+WindowedRpcChannel::WindowedRpcChannel(google::protobuf::RpcChannel *channel,
+                                       unsigned int max_in_flight,
+                                       const Clock *clock)
+    : m_channel(channel),
+      m_max_in_flight(max_in_flight),
+      m_in_flight(0),
+      m_dispatching(false),
+      m_clock(clock ? clock : &m_default_clock) {
+}
+
+
+/*
+ * Queued requests are dropped without being run, the same as the requests
+ * the underlying channel is waiting on.
+ */
+WindowedRpcChannel::~WindowedRpcChannel() {
+  while (!m_queue.empty()) {
+    PendingCall *call = m_queue.front();
+    m_queue.pop_front();
+    delete call->request;
+    delete call->done;
+    delete call;
+  }
+}
+
+
+/*
+ * Send a request, or queue it if the window is full or there are requests
+ * waiting. Queued requests are copied, so the caller can free the request
+ * once this returns.
+ */
+void WindowedRpcChannel::CallMethod(const MethodDescriptor *method,
+                                    RpcController *controller,
+                                    const Message *request,
+                                    Message *response,
+                                    Closure *done) {
+  bool windowed = !STLContains(m_unwindowed_methods, method->name());
+  if (!windowed && !done) {
+    m_channel->CallMethod(method, controller, request, response, done);
+    return;
+  }
+
+  PendingCall *call = new PendingCall();
+  call->method = method;
+  call->controller = controller;
+  call->request = NULL;
+  call->response = response;
+  call->done = done;
+  // streaming requests don't have a response to wait for
+  call->windowed = windowed && done;
+
+  if (windowed && (!m_queue.empty() || (call->windowed && WindowFull()))) {
+    call->request = request->New();
+    call->request->CopyFrom(*request);
+    m_queue.push_back(call);
+    return;
+  }
+  Dispatch(call, request);
+}
+
+
+/*
+ * Leave a method out of the window.
+ * @param method the name of the method.
+ */
+void WindowedRpcChannel::AddUnwindowedMethod(const string &method) {
+  m_unwindowed_methods.insert(method);
+}
+
+
+/*
+ * Change the size of the window. If it's bigger, queued requests are sent
+ * now.
+ */
+void WindowedRpcChannel::SetMaxInFlight(unsigned int max_in_flight) {
+  m_max_in_flight = max_in_flight;
+  DispatchQueued();
+}
+
+
+/*
+ * Fail all the queued requests.
+ * @returns the number of requests that were cancelled.
+ */
+unsigned int WindowedRpcChannel::CancelQueued() {
+  std::deque<PendingCall*> queue;
+  queue.swap(m_queue);
+  unsigned int count = queue.size();
+  while (!queue.empty()) {
+    PendingCall *call = queue.front();
+    queue.pop_front();
+    FailCall(call);
+  }
+  return count;
+}
+
+
+/*
+ * Send a request on the underlying channel.
+ */
+void WindowedRpcChannel::Dispatch(PendingCall *call, const Message *request) {
+  if (!call->done) {
+    m_channel->CallMethod(call->method, call->controller, request,
+                          call->response, NULL);
+    delete call;
+    return;
+  }
+
+  if (call->windowed)
+    m_in_flight++;
+  m_clock->CurrentTime(&call->sent);
+  // the underlying channel may run the closure before this returns
+  m_channel->CallMethod(
+      call->method, call->controller, request, call->response,
+      google::protobuf::NewCallback(this, &WindowedRpcChannel::CallComplete,
+                                    call));
+}
+
+
+/*
+ * Send queued requests until the window is full. Requests cancelled with
+ * StartCancel() while they were queued are failed rather than sent.
+ */
+void WindowedRpcChannel::DispatchQueued() {
+  // requests that fail straight away complete from within Dispatch(), so
+  // guard against recursing.
+  if (m_dispatching)
+    return;
+
+  m_dispatching = true;
+  while (!m_queue.empty() &&
+         !(m_queue.front()->windowed && WindowFull())) {
+    PendingCall *call = m_queue.front();
+    m_queue.pop_front();
+    if (call->controller && call->controller->IsCanceled()) {
+      FailCall(call);
+      continue;
+    }
+    Message *request = call->request;
+    call->request = NULL;
+    Dispatch(call, request);
+    delete request;
+  }
+  m_dispatching = false;
+}
+
+
+/*
+ * Fail a request that wasn't sent. Streaming requests are just dropped.
+ */
+void WindowedRpcChannel::FailCall(PendingCall *call) {
+  Closure *done = call->done;
+  if (done)
+    call->controller->SetFailed("Cancelled");
+  delete call->request;
+  delete call;
+  if (done)
+    done->Run();
+}
+
+
+/*
+ * Called when a response arrives, or the request fails.
+ */
+void WindowedRpcChannel::CallComplete(PendingCall *call) {
+  if (call->windowed)
+    m_in_flight--;
+
+  TimeStamp now;
+  m_clock->CurrentTime(&now);
+  TimeInterval latency = now - call->sent;
+  MethodStatsMap::iterator iter = m_stats.find(call->method->name());
+  if (iter == m_stats.end()) {
+    MethodStats stats = {0, 0, TimeInterval(), TimeInterval()};
+    iter = m_stats.insert(
+        MethodStatsMap::value_type(call->method->name(), stats)).first;
+  }
+  iter->second.requests++;
+  if (call->controller->Failed())
+    iter->second.failures++;
+  iter->second.total_latency += latency;
+  if (latency > iter->second.max_latency)
+    iter->second.max_latency = latency;
+
+  Closure *done = call->done;
+  delete call;
+  DispatchQueued();
+  // this may delete us, so it's run last
+  done->Run();
+}
+}  // namespace rpc
+}  // namespace ola
@@ -0,0 +1,126 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * WindowedRpcChannel.h
+ * An RpcChannel that limits the number of requests waiting for a response.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Requests are passed straight through to the underlying channel until the
+ * window is full. After that they're queued, and sent in order as responses
+ * come back. This lets a client issue hundreds of requests at once without
+ * flooding the server, while still keeping the connection busy.
+ *
+ * Streaming requests don't have a response, so they don't count towards the
+ * window, but they're queued behind any waiting requests so that everything
+ * is sent in the order it was made.
+ *
+ * Some methods can be left out of the window altogether, these are always
+ * sent straight away. This is used for DMX, which must stay in order and
+ * shouldn't wait behind slow requests like RDM.
+ */
+
+#ifndef COMMON_RPC_WINDOWEDRPCCHANNEL_H_
+#define COMMON_RPC_WINDOWEDRPCCHANNEL_H_
+
+#include <google/protobuf/service.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include "ola/Clock.h"
+
+namespace ola {
+namespace rpc {
+
+class WindowedRpcChannel: public google::protobuf::RpcChannel {
+  public:
+    // The requests that have completed for a method.
+    struct MethodStats {
+      unsigned int requests;
+      unsigned int failures;
+      // from when the request was sent, not including the time it was queued
+      TimeInterval total_latency;
+      TimeInterval max_latency;
+    };
+    typedef std::map<std::string, MethodStats> MethodStatsMap;
+
+    explicit WindowedRpcChannel(
+        google::protobuf::RpcChannel *channel,
+        unsigned int max_in_flight = DEFAULT_MAX_IN_FLIGHT,
+        const Clock *clock = NULL);
+    ~WindowedRpcChannel();
+
+    void CallMethod(const google::protobuf::MethodDescriptor *method,
+                    google::protobuf::RpcController *controller,
+                    const google::protobuf::Message *request,
+                    google::protobuf::Message *response,
+                    google::protobuf::Closure *done);
+
+    // Send requests for this method straight away, without counting them
+    // towards the window.
+    void AddUnwindowedMethod(const std::string &method);
+
+    // 0 means no limit.
+    void SetMaxInFlight(unsigned int max_in_flight);
+    unsigned int MaxInFlight() const { return m_max_in_flight; }
+    unsigned int InFlight() const { return m_in_flight; }
+    unsigned int Queued() const { return m_queue.size(); }
+
+    // Fail all the requests that haven't been sent yet, queued streaming
+    // requests are dropped. Requests that have been sent complete as usual.
+    unsigned int CancelQueued();
+
+    const MethodStatsMap &Stats() const { return m_stats; }
+    void ResetStats() { m_stats.clear(); }
+
+    static const unsigned int DEFAULT_MAX_IN_FLIGHT = 64;
+
+  private:
+    struct PendingCall {
+      const google::protobuf::MethodDescriptor *method;
+      google::protobuf::RpcController *controller;
+      // a copy of the request, only set while the call is queued
+      google::protobuf::Message *request;
+      google::protobuf::Message *response;
+      google::protobuf::Closure *done;
+      // false if the request doesn't count towards the window
+      bool windowed;
+      TimeStamp sent;
+    };
+
+    google::protobuf::RpcChannel *m_channel;
+    unsigned int m_max_in_flight;
+    unsigned int m_in_flight;
+    bool m_dispatching;
+    std::deque<PendingCall*> m_queue;
+    std::set<std::string> m_unwindowed_methods;
+    MethodStatsMap m_stats;
+    Clock m_default_clock;
+    const Clock *m_clock;
+
+    bool WindowFull() const {
+      return m_max_in_flight && m_in_flight >= m_max_in_flight;
+    }
+    void Dispatch(PendingCall *call, const google::protobuf::Message *request);
+    void FailCall(PendingCall *call);
+    void DispatchQueued();
+    void CallComplete(PendingCall *call);
+
+    WindowedRpcChannel(const WindowedRpcChannel&);
+    WindowedRpcChannel& operator=(const WindowedRpcChannel&);
+};
+}  // namespace rpc
+}  // namespace ola
+#endif  // COMMON_RPC_WINDOWEDRPCCHANNEL_H_
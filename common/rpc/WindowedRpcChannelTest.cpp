@@ -0,0 +1,289 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * WindowedRpcChannelTest.cpp
+ * Test fixture for the WindowedRpcChannel class
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/stubs/common.h>
+#include <string>
+#include <vector>
+
+#include "common/rpc/SimpleRpcController.h"
+#include "common/rpc/TestService.pb.h"
+#include "common/rpc/WindowedRpcChannel.h"
+#include "ola/Clock.h"
+#include "ola/testing/TestUtils.h"
+
+
+using google::protobuf::Closure;
+using google::protobuf::Message;
+using google::protobuf::MethodDescriptor;
+using google::protobuf::RpcController;
+using ola::MockClock;
+using ola::rpc::EchoReply;
+using ola::rpc::EchoRequest;
+using ola::rpc::SimpleRpcController;
+using ola::rpc::TestService_Stub;
+using ola::rpc::WindowedRpcChannel;
+using std::string;
+using std::vector;
+
+
+/*
+ * A channel that records the requests, and completes them when told to.
+ */
+class MockRpcChannel: public google::protobuf::RpcChannel {
+  public:
+    ~MockRpcChannel() {
+      for (unsigned int i = 0; i < m_done.size(); i++)
+        delete m_done[i];
+    }
+
+    void CallMethod(const MethodDescriptor*,
+                    RpcController*,
+                    const Message *request,
+                    Message*,
+                    Closure *done) {
+      m_requests.push_back(
+          static_cast<const EchoRequest*>(request)->data());
+      if (done)
+        m_done.push_back(done);
+    }
+
+    void Complete(unsigned int count) {
+      for (unsigned int i = 0; i < count && !m_done.empty(); i++) {
+        Closure *done = m_done.front();
+        m_done.erase(m_done.begin());
+        done->Run();
+      }
+    }
+
+    vector<string> m_requests;
+    vector<Closure*> m_done;
+};
+
+
+class WindowedRpcChannelTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(WindowedRpcChannelTest);
+  CPPUNIT_TEST(testWindow);
+  CPPUNIT_TEST(testCancel);
+  CPPUNIT_TEST(testUnwindowed);
+  CPPUNIT_TEST(testStats);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void setUp() { m_completed = 0; }
+    void testWindow();
+    void testCancel();
+    void testUnwindowed();
+    void testStats();
+
+  private:
+    unsigned int m_completed;
+    SimpleRpcController m_controllers[8];
+    EchoReply m_replies[8];
+
+    void SendEcho(TestService_Stub *stub, unsigned int i,
+                  bool failed_echo = false);
+    void SendStream(TestService_Stub *stub, const string &data);
+    void EchoComplete() { m_completed++; }
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(WindowedRpcChannelTest);
+
+
+/*
+ * Send an Echo, or a FailedEcho, request with data 'a' + i.
+ */
+void WindowedRpcChannelTest::SendEcho(TestService_Stub *stub,
+                                      unsigned int i,
+                                      bool failed_echo) {
+  EchoRequest request;
+  request.set_data(string(1, static_cast<char>('a' + i)));
+  Closure *done = google::protobuf::NewCallback(
+      this, &WindowedRpcChannelTest::EchoComplete);
+  if (failed_echo)
+    stub->FailedEcho(&m_controllers[i], &request, &m_replies[i], done);
+  else
+    stub->Echo(&m_controllers[i], &request, &m_replies[i], done);
+}
+
+
+void WindowedRpcChannelTest::SendStream(TestService_Stub *stub,
+                                        const string &data) {
+  EchoRequest request;
+  request.set_data(data);
+  stub->Stream(NULL, &request, NULL, NULL);
+}
+
+
+/*
+ * Check that requests are queued once the window is full, and sent in order.
+ */
+void WindowedRpcChannelTest::testWindow() {
+  MockRpcChannel mock_channel;
+  WindowedRpcChannel channel(&mock_channel, 2);
+  TestService_Stub stub(&channel);
+
+  for (unsigned int i = 0; i < 4; i++)
+    SendEcho(&stub, i);
+  OLA_ASSERT_EQ(2u, channel.InFlight());
+  OLA_ASSERT_EQ(2u, channel.Queued());
+  OLA_ASSERT_EQ(static_cast<size_t>(2), mock_channel.m_requests.size());
+
+  // streaming requests wait behind the queued requests
+  SendStream(&stub, "s");
+  OLA_ASSERT_EQ(3u, channel.Queued());
+  OLA_ASSERT_EQ(static_cast<size_t>(2), mock_channel.m_requests.size());
+
+  mock_channel.Complete(1);
+  OLA_ASSERT_EQ(1u, m_completed);
+  OLA_ASSERT_EQ(2u, channel.InFlight());
+  OLA_ASSERT_EQ(2u, channel.Queued());
+
+  // opening the window sends the rest, the streaming request doesn't count
+  // towards the window.
+  channel.SetMaxInFlight(0);
+  OLA_ASSERT_EQ(3u, channel.InFlight());
+  OLA_ASSERT_EQ(0u, channel.Queued());
+  mock_channel.Complete(3);
+  OLA_ASSERT_EQ(4u, m_completed);
+  OLA_ASSERT_EQ(0u, channel.InFlight());
+
+  // with nothing queued, streaming requests are sent even if the window is
+  // full
+  channel.SetMaxInFlight(1);
+  SendEcho(&stub, 0);
+  SendStream(&stub, "t");
+  OLA_ASSERT_EQ(0u, channel.Queued());
+  mock_channel.Complete(1);
+
+  const char *expected[] = {"a", "b", "c", "d", "s", "a", "t"};
+  OLA_ASSERT_EQ(static_cast<size_t>(7), mock_channel.m_requests.size());
+  for (unsigned int i = 0; i < 7; i++)
+    OLA_ASSERT_EQ(string(expected[i]), mock_channel.m_requests[i]);
+}
+
+
+/*
+ * Check that queued requests can be cancelled.
+ */
+void WindowedRpcChannelTest::testCancel() {
+  MockRpcChannel mock_channel;
+  WindowedRpcChannel channel(&mock_channel, 1);
+  TestService_Stub stub(&channel);
+
+  for (unsigned int i = 0; i < 4; i++)
+    SendEcho(&stub, i);
+  OLA_ASSERT_EQ(3u, channel.Queued());
+
+  // a single request
+  m_controllers[1].StartCancel();
+  mock_channel.Complete(1);
+  OLA_ASSERT_EQ(2u, m_completed);
+  OLA_ASSERT_TRUE(m_controllers[1].Failed());
+  OLA_ASSERT_EQ(string("Cancelled"), m_controllers[1].ErrorText());
+  OLA_ASSERT_EQ(1u, channel.InFlight());
+  OLA_ASSERT_EQ(1u, channel.Queued());
+
+  // everything that's queued
+  OLA_ASSERT_EQ(1u, channel.CancelQueued());
+  OLA_ASSERT_EQ(3u, m_completed);
+  OLA_ASSERT_TRUE(m_controllers[3].Failed());
+  OLA_ASSERT_FALSE(m_controllers[2].Failed());
+
+  mock_channel.Complete(1);
+  OLA_ASSERT_EQ(4u, m_completed);
+  OLA_ASSERT_EQ(static_cast<size_t>(2), mock_channel.m_requests.size());
+}
+
+
+/*
+ * Check that methods left out of the window, like DMX, are sent straight
+ * away and in order, with a mix of streaming and acknowledged requests.
+ */
+void WindowedRpcChannelTest::testUnwindowed() {
+  MockRpcChannel mock_channel;
+  WindowedRpcChannel channel(&mock_channel, 1);
+  channel.AddUnwindowedMethod("FailedEcho");
+  channel.AddUnwindowedMethod("Stream");
+  TestService_Stub stub(&channel);
+
+  // fill the window and queue a request
+  SendEcho(&stub, 0);
+  SendEcho(&stub, 1);
+  OLA_ASSERT_EQ(1u, channel.InFlight());
+  OLA_ASSERT_EQ(1u, channel.Queued());
+
+  SendEcho(&stub, 2, true);
+  SendStream(&stub, "s");
+  SendEcho(&stub, 3, true);
+  SendStream(&stub, "t");
+  OLA_ASSERT_EQ(1u, channel.InFlight());
+  OLA_ASSERT_EQ(1u, channel.Queued());
+
+  const char *expected[] = {"a", "c", "s", "d", "t"};
+  OLA_ASSERT_EQ(static_cast<size_t>(5), mock_channel.m_requests.size());
+  for (unsigned int i = 0; i < 5; i++)
+    OLA_ASSERT_EQ(string(expected[i]), mock_channel.m_requests[i]);
+
+  // cancelling the queue doesn't touch them
+  OLA_ASSERT_EQ(1u, channel.CancelQueued());
+  OLA_ASSERT_TRUE(m_controllers[1].Failed());
+  mock_channel.Complete(3);
+  OLA_ASSERT_EQ(4u, m_completed);
+  OLA_ASSERT_FALSE(m_controllers[2].Failed());
+  OLA_ASSERT_FALSE(m_controllers[3].Failed());
+  OLA_ASSERT_EQ(0u, channel.InFlight());
+  OLA_ASSERT_EQ(static_cast<size_t>(5), mock_channel.m_requests.size());
+}
+
+
+/*
+ * Check the latency of each method is recorded.
+ */
+void WindowedRpcChannelTest::testStats() {
+  MockClock clock;
+  MockRpcChannel mock_channel;
+  WindowedRpcChannel channel(&mock_channel, 1, &clock);
+  TestService_Stub stub(&channel);
+
+  SendEcho(&stub, 0);
+  SendEcho(&stub, 1);
+  clock.AdvanceTime(5, 0);
+  mock_channel.Complete(1);
+  m_controllers[1].SetFailed("error");
+  clock.AdvanceTime(1, 0);
+  mock_channel.Complete(1);
+
+  const WindowedRpcChannel::MethodStatsMap &stats = channel.Stats();
+  OLA_ASSERT_EQ(static_cast<size_t>(1), stats.size());
+  WindowedRpcChannel::MethodStatsMap::const_iterator iter =
+    stats.find("Echo");
+  OLA_ASSERT_TRUE(iter != stats.end());
+  OLA_ASSERT_EQ(2u, iter->second.requests);
+  OLA_ASSERT_EQ(1u, iter->second.failures);
+  // the second request wasn't sent until the first completed
+  OLA_ASSERT_EQ(static_cast<time_t>(6), iter->second.total_latency.Seconds());
+  OLA_ASSERT_EQ(static_cast<time_t>(5), iter->second.max_latency.Seconds());
+
+  channel.ResetStats();
+  OLA_ASSERT_TRUE(channel.Stats().empty());
+}
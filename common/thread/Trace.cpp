@@ -0,0 +1,306 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Trace.cpp
+ * An in-process trace recorder. See include/ola/thread/Trace.h for details
+ * on how to use it.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Each thread gets a TraceBuffer the first time it records an event. The
+ * owning thread is the only writer, it fills in the next slot and then bumps
+ * the head, so the reader can tell which events are complete. The reader
+ * copies the events out and then checks the head again to find out how many
+ * were overwritten while it was copying.
+ *
+ * Buffers belonging to threads that have exited are reused by new threads.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ola/Logging.h"
+#include "ola/StringUtils.h"
+#include "ola/thread/Mutex.h"
+#include "ola/thread/Trace.h"
+
+namespace ola {
+namespace thread {
+
+using std::string;
+using std::vector;
+
+bool trace_enabled = false;
+
+namespace {
+
+static const unsigned int TRACE_BUFFER_MASK = TRACE_BUFFER_SIZE - 1;
+
+typedef struct {
+  const char *name;
+  uint64_t start;
+  uint32_t duration;
+  unsigned int id;
+} TraceEvent;
+
+typedef struct {
+  unsigned int tid;
+  string name;
+  TraceEvent *events;  // allocated on the first event
+  volatile unsigned int head;
+  volatile bool wrapped;
+  bool in_use;
+} TraceBuffer;
+
+// Protects the list of buffers, and everything in a TraceBuffer other than
+// the events & head.
+Mutex buffer_mutex;
+vector<TraceBuffer*> buffers;
+unsigned int next_tid = 1;
+
+pthread_once_t key_once = PTHREAD_ONCE_INIT;
+pthread_key_t buffer_key;
+
+
+/*
+ * Called when a thread exits, the buffer is kept so it can be dumped, until
+ * another thread needs it.
+ */
+void ReleaseBuffer(void *data) {
+  MutexLocker lock(&buffer_mutex);
+  reinterpret_cast<TraceBuffer*>(data)->in_use = false;
+}
+
+
+void CreateKey() {
+  pthread_key_create(&buffer_key, ReleaseBuffer);
+}
+
+
+/*
+ * Get the buffer for the current thread, creating it if required.
+ * @param allocate_events true if the buffer is needed for recording.
+ */
+TraceBuffer *CurrentBuffer(bool allocate_events) {
+  pthread_once(&key_once, CreateKey);
+  TraceBuffer *buffer = reinterpret_cast<TraceBuffer*>(
+      pthread_getspecific(buffer_key));
+
+  if (buffer && (buffer->events || !allocate_events))
+    return buffer;
+
+  MutexLocker lock(&buffer_mutex);
+  if (!buffer) {
+    vector<TraceBuffer*>::iterator iter = buffers.begin();
+    for (; iter != buffers.end(); ++iter) {
+      if (!(*iter)->in_use) {
+        buffer = *iter;
+        break;
+      }
+    }
+    if (!buffer) {
+      buffer = new TraceBuffer;
+      buffer->events = NULL;
+      buffers.push_back(buffer);
+    }
+    buffer->tid = next_tid++;
+    buffer->name.clear();
+    buffer->head = 0;
+    buffer->wrapped = false;
+    buffer->in_use = true;
+    pthread_setspecific(buffer_key, buffer);
+  }
+  if (allocate_events && !buffer->events)
+    buffer->events = new TraceEvent[TRACE_BUFFER_SIZE];
+  return buffer;
+}
+
+
+/*
+ * Copy the complete events out of a buffer. The slot after the head may be
+ * in the middle of being written, so at most TRACE_BUFFER_SIZE - 1 events are
+ * returned.
+ */
+void CopyEvents(const TraceBuffer *buffer, vector<TraceEvent> *events) {
+  events->clear();
+  if (!buffer->events)
+    return;
+
+  unsigned int head = buffer->head;
+  __sync_synchronize();
+  unsigned int count = (buffer->wrapped || head >= TRACE_BUFFER_SIZE) ?
+      TRACE_BUFFER_SIZE - 1 : head;
+
+  events->reserve(count);
+  for (unsigned int i = head - count; i != head; i++)
+    events->push_back(buffer->events[i & TRACE_BUFFER_MASK]);
+
+  // Every event written while we were copying clobbered the oldest one.
+  __sync_synchronize();
+  unsigned int overwritten = buffer->head - head;
+  if (overwritten >= count) {
+    events->clear();
+  } else if (overwritten) {
+    events->erase(events->begin(), events->begin() + overwritten);
+  }
+}
+}  // namespace
+
+
+/**
+ * Turn tracing on or off. Events already recorded are kept.
+ */
+void EnableTracing(bool enable) {
+  trace_enabled = enable;
+}
+
+
+/**
+ * Set the name of the current thread.
+ */
+void SetTraceThreadName(const string &name) {
+  TraceBuffer *buffer = CurrentBuffer(false);
+  MutexLocker lock(&buffer_mutex);
+  buffer->name = name;
+}
+
+
+/**
+ * Return the current time in microseconds.
+ */
+uint64_t TraceTime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+
+/**
+ * Record an event in the current thread's buffer.
+ * @param name the name of the event, this must outlive the trace.
+ * @param id the id to attach to the event, or TRACE_NO_ID.
+ * @param start the start time, from TraceTime().
+ * @param end the end time, from TraceTime().
+ */
+void RecordTraceEvent(const char *name, unsigned int id, uint64_t start,
+                      uint64_t end) {
+  TraceBuffer *buffer = CurrentBuffer(true);
+  TraceEvent *event = &buffer->events[buffer->head & TRACE_BUFFER_MASK];
+  event->name = name;
+  event->start = start;
+  event->duration = end > start ? static_cast<uint32_t>(end - start) : 0;
+  event->id = id;
+  __sync_synchronize();
+  if (!++buffer->head)
+    buffer->wrapped = true;
+}
+
+
+/**
+ * Append the recorded events to a string, in the Chrome trace event format.
+ */
+void AppendTrace(string *output) {
+  std::ostringstream str;
+  pid_t pid = getpid();
+  bool first = true;
+  vector<TraceEvent> events;
+
+  str << "{\"traceEvents\":[";
+  MutexLocker lock(&buffer_mutex);
+  vector<TraceBuffer*>::const_iterator iter = buffers.begin();
+  for (; iter != buffers.end(); ++iter) {
+    const TraceBuffer *buffer = *iter;
+    if (!buffer->name.empty()) {
+      str << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+          << "\"pid\":" << pid << ",\"tid\":" << buffer->tid
+          << ",\"args\":{\"name\":\"" << EscapeString(buffer->name) << "\"}}";
+      first = false;
+    }
+
+    CopyEvents(buffer, &events);
+    vector<TraceEvent>::const_iterator event = events.begin();
+    for (; event != events.end(); ++event) {
+      str << (first ? "" : ",") << "\n{\"name\":\""
+          << EscapeString(event->name) << "\",\"cat\":\"ola\",\"ph\":\"X\","
+          << "\"ts\":" << event->start << ",\"dur\":" << event->duration
+          << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid;
+      if (event->id != TRACE_NO_ID)
+        str << ",\"args\":{\"id\":" << event->id << "}";
+      str << "}";
+      first = false;
+    }
+  }
+  str << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  output->append(str.str());
+}
+
+
+/**
+ * Write the recorded events to a file. The events are written to a new file
+ * which is then renamed, so we never follow a symlink someone else left at the
+ * path.
+ * @param path the file to write to.
+ * @return true if the file was written, false otherwise.
+ */
+bool WriteTraceFile(const string &path) {
+  string trace;
+  AppendTrace(&trace);
+
+  std::stringstream tmp_str;
+  tmp_str << path << "." << getpid() << ".tmp";
+  const string tmp_path = tmp_str.str();
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,
+                0600);
+  if (fd < 0) {
+    OLA_WARN << "Could not open " << tmp_path << ": " << strerror(errno);
+    return false;
+  }
+
+  const char *data = trace.data();
+  size_t remaining = trace.size();
+  while (remaining) {
+    ssize_t written = write(fd, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      OLA_WARN << "Failed to write the trace to " << tmp_path << ": "
+               << strerror(errno);
+      close(fd);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    data += written;
+    remaining -= written;
+  }
+
+  if (close(fd) || rename(tmp_path.c_str(), path.c_str())) {
+    OLA_WARN << "Failed to write the trace to " << path << ": "
+             << strerror(errno);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  OLA_INFO << "Wrote trace to " << path;
+  return true;
+}
+}  // namespace thread
+}  // namespace ola
@@ -0,0 +1,176 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * TraceTest.cpp
+ * Test fixture for the trace recorder.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "ola/thread/Thread.h"
+#include "ola/thread/Trace.h"
+#include "ola/testing/TestUtils.h"
+
+
+using ola::thread::EnableTracing;
+using ola::thread::SetTraceThreadName;
+using ola::thread::Thread;
+using ola::thread::TraceScope;
+using std::string;
+
+class TraceTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TraceTest);
+  CPPUNIT_TEST(testDisabled);
+  CPPUNIT_TEST(testRecord);
+  CPPUNIT_TEST(testWrap);
+  CPPUNIT_TEST(testWriteFile);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void tearDown() { EnableTracing(false); }
+    void testDisabled();
+    void testRecord();
+    void testWrap();
+    void testWriteFile();
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TraceTest);
+
+
+/*
+ * Records more events than fit in the buffer.
+ */
+class WrapThread: public Thread {
+  public:
+    void *Run() {
+      SetTraceThreadName("wrap-thread");
+      for (unsigned int i = 0; i < ola::thread::TRACE_BUFFER_SIZE + 10; i++)
+        TraceScope trace("wrap-event");
+      return NULL;
+    }
+};
+
+
+/*
+ * Count the number of times needle appears in haystack.
+ */
+static unsigned int CountOf(const string &haystack, const string &needle) {
+  unsigned int count = 0;
+  string::size_type pos = haystack.find(needle);
+  while (pos != string::npos) {
+    count++;
+    pos = haystack.find(needle, pos + needle.size());
+  }
+  return count;
+}
+
+
+/*
+ * Check nothing is recorded while tracing is off.
+ */
+void TraceTest::testDisabled() {
+  OLA_ASSERT_FALSE(ola::thread::TracingEnabled());
+  {
+    TraceScope trace("disabled-event");
+  }
+  string output;
+  ola::thread::AppendTrace(&output);
+  OLA_ASSERT_EQ(0u, CountOf(output, "disabled-event"));
+}
+
+
+/*
+ * Check events are recorded, along with the id and thread name.
+ */
+void TraceTest::testRecord() {
+  EnableTracing(true);
+  SetTraceThreadName("test \"thread\"");
+  {
+    TraceScope trace("test-event", 5);
+  }
+  {
+    TraceScope trace("test-event-without-id");
+  }
+
+  string output;
+  ola::thread::AppendTrace(&output);
+  OLA_ASSERT_EQ(string("{\"traceEvents\":["), output.substr(0, 16));
+  OLA_ASSERT_EQ(
+      1u,
+      CountOf(output, "\"args\":{\"name\":\"test \\\"thread\\\"\"}"));
+  OLA_ASSERT_EQ(
+      1u,
+      CountOf(output, "\"name\":\"test-event\",\"cat\":\"ola\",\"ph\":\"X\""));
+  OLA_ASSERT_EQ(1u, CountOf(output, "\"args\":{\"id\":5}"));
+  OLA_ASSERT_EQ(1u, CountOf(output, "\"name\":\"test-event-without-id\""));
+}
+
+
+/*
+ * Check that only the most recent events are kept.
+ */
+void TraceTest::testWrap() {
+  EnableTracing(true);
+  WrapThread thread;
+  OLA_ASSERT_TRUE(thread.Start());
+  OLA_ASSERT_TRUE(thread.Join());
+
+  string output;
+  ola::thread::AppendTrace(&output);
+  OLA_ASSERT_EQ(1u, CountOf(output, "\"args\":{\"name\":\"wrap-thread\"}"));
+  OLA_ASSERT_EQ(ola::thread::TRACE_BUFFER_SIZE - 1,
+                CountOf(output, "\"name\":\"wrap-event\""));
+}
+
+
+/*
+ * Check the trace replaces a symlink at the path, rather than writing to the
+ * file it points to.
+ */
+void TraceTest::testWriteFile() {
+  char dir[] = "/tmp/ola-trace-test.XXXXXX";
+  OLA_ASSERT_NOT_NULL(mkdtemp(dir));
+  const string path = string(dir) + "/trace.json";
+  const string target = string(dir) + "/target";
+  OLA_ASSERT_EQ(0, symlink(target.c_str(), path.c_str()));
+
+  EnableTracing(true);
+  {
+    TraceScope trace("file-event");
+  }
+  OLA_ASSERT_TRUE(ola::thread::WriteTraceFile(path));
+
+  struct stat stat_buf;
+  OLA_ASSERT_NE(0, lstat(target.c_str(), &stat_buf));
+  OLA_ASSERT_EQ(0, lstat(path.c_str(), &stat_buf));
+  OLA_ASSERT_TRUE(S_ISREG(stat_buf.st_mode));
+  OLA_ASSERT_EQ(0u, static_cast<unsigned int>(stat_buf.st_mode & 077));
+
+  std::ifstream trace_file(path.c_str());
+  std::stringstream output;
+  output << trace_file.rdbuf();
+  OLA_ASSERT_EQ(1u, CountOf(output.str(), "\"name\":\"file-event\""));
+
+  unlink(path.c_str());
+  rmdir(dir);
+}
@@ -23,6 +23,10 @@
  * valid data is returned by calling Size().
  */
 
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
 #include <string.h>
 #include <algorithm>
 #include <iostream>
@@ -33,17 +37,342 @@
 #include "ola/Logging.h"
 #include "ola/StringUtils.h"
 
+/*
+ * The SIMD merge kernels need the target attribute & __builtin_cpu_supports,
+ * which arrived in gcc 4.9.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_X86_MERGE_KERNELS 1
+#include <immintrin.h>
+#endif
+
 namespace ola {
 
 using std::min;
 using std::max;
 using std::vector;
 
+namespace {
+
+typedef void (*MergeKernel)(uint8_t *output,
+                            unsigned int length,
+                            const DmxBuffer *const sources[],
+                            unsigned int count);
+
+/*
+ * HTP merge slots [start, end) of the sources into output. Slots past the
+ * end of a source are treated as 0.
+ */
+void MergeRange(uint8_t *output,
+                unsigned int start,
+                unsigned int end,
+                const DmxBuffer *const sources[],
+                unsigned int count) {
+  if (start >= end)
+    return;
+
+  memset(output + start, 0, end - start);
+  for (unsigned int i = 0; i < count; i++) {
+    const uint8_t *data = sources[i]->GetRaw();
+    unsigned int source_end = min(end, sources[i]->Size());
+    for (unsigned int slot = start; slot < source_end; slot++)
+      output[slot] = max(output[slot], data[slot]);
+  }
+}
+
+
+/*
+ * The portable version.
+ */
+void MergeScalar(uint8_t *output,
+                 unsigned int length,
+                 const DmxBuffer *const sources[],
+                 unsigned int count) {
+  MergeRange(output, 0, length, sources, count);
+}
+
+
+#ifdef HAVE_X86_MERGE_KERNELS
+/*
+ * Merge a block of slots that some of the sources only partially cover.
+ */
+void MergePartialBlock(uint8_t *output,
+                       unsigned int start,
+                       unsigned int end,
+                       const DmxBuffer *const sources[],
+                       unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int size = sources[i]->Size();
+    if (size <= start || size >= end)
+      continue;
+    const uint8_t *data = sources[i]->GetRaw();
+    for (unsigned int slot = start; slot < size; slot++)
+      output[slot] = max(output[slot], data[slot]);
+  }
+}
+
+
+/*
+ * Merge 16 slots at a time with pmaxub.
+ */
+__attribute__((target("sse2")))
+void MergeSSE2(uint8_t *output,
+               unsigned int length,
+               const DmxBuffer *const sources[],
+               unsigned int count) {
+  const unsigned int width = sizeof(__m128i);
+  unsigned int offset = 0;
+  for (; offset + width <= length; offset += width) {
+    __m128i result = _mm_setzero_si128();
+    bool partial = false;
+    for (unsigned int i = 0; i < count; i++) {
+      unsigned int size = sources[i]->Size();
+      if (size >= offset + width) {
+        result = _mm_max_epu8(result, _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(sources[i]->GetRaw() + offset)));
+      } else if (size > offset) {
+        partial = true;
+      }
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + offset), result);
+    if (partial)
+      MergePartialBlock(output, offset, offset + width, sources, count);
+  }
+  MergeRange(output, offset, length, sources, count);
+}
+
+
+/*
+ * Merge 32 slots at a time with vpmaxub.
+ */
+__attribute__((target("avx2")))
+void MergeAVX2(uint8_t *output,
+               unsigned int length,
+               const DmxBuffer *const sources[],
+               unsigned int count) {
+  const unsigned int width = sizeof(__m256i);
+  unsigned int offset = 0;
+  for (; offset + width <= length; offset += width) {
+    __m256i result = _mm256_setzero_si256();
+    bool partial = false;
+    for (unsigned int i = 0; i < count; i++) {
+      unsigned int size = sources[i]->Size();
+      if (size >= offset + width) {
+        result = _mm256_max_epu8(result, _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(sources[i]->GetRaw() + offset)));
+      } else if (size > offset) {
+        partial = true;
+      }
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + offset), result);
+    if (partial)
+      MergePartialBlock(output, offset, offset + width, sources, count);
+  }
+  MergeRange(output, offset, length, sources, count);
+}
+#endif
+
+
+/*
+ * Pick the best kernel for this CPU.
+ */
+MergeKernel ChooseMergeKernel() {
+#ifdef HAVE_X86_MERGE_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return MergeAVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return MergeSSE2;
+#endif
+  return MergeScalar;
+}
+
+const MergeKernel merge_kernel = ChooseMergeKernel();
+
+
+/*
+ * The sources for a per-slot priority merge, see SetFromPriorityMerge().
+ *
+ * The kernels work with a level for each slot rather than the priority. The
+ * level is the priority + 1, and 0 means the source doesn't provide the slot.
+ * This lets a source without slot priorities use priority 0, and keeps
+ * everything in a byte so we can do 16 slots at a time.
+ */
+typedef struct {
+  const DmxBuffer *const *data;
+  const DmxBuffer *const *slot_priorities;
+  const uint8_t *priorities;
+  unsigned int count;
+  bool htp_merge;
+} PriorityMergeSources;
+
+typedef void (*PriorityMergeKernel)(uint8_t *output,
+                                    uint8_t *levels,
+                                    unsigned int length,
+                                    const PriorityMergeSources &sources);
+
+// E1.31 priorities run from 0 to 200, anything higher is treated as 200.
+const uint8_t MAX_SLOT_PRIORITY = 200;
+
+
+/*
+ * The number of slots a source provides. Past the end of either the data or
+ * the slot priorities the source has no effect.
+ */
+unsigned int SourceCoverage(const PriorityMergeSources &sources,
+                            unsigned int source) {
+  unsigned int size = sources.data[source]->Size();
+  if (sources.slot_priorities[source])
+    size = min(size, sources.slot_priorities[source]->Size());
+  return size;
+}
+
+
+/*
+ * Merge slots [start, end) of a single source into output.
+ */
+void PriorityMergeRange(uint8_t *output,
+                        uint8_t *levels,
+                        unsigned int start,
+                        unsigned int end,
+                        const PriorityMergeSources &sources,
+                        unsigned int source) {
+  end = min(end, SourceCoverage(sources, source));
+  const uint8_t *data = sources.data[source]->GetRaw();
+  const DmxBuffer *slot_priorities = sources.slot_priorities[source];
+  const uint8_t frame_level =
+    min(sources.priorities[source], MAX_SLOT_PRIORITY) + 1;
+
+  for (unsigned int slot = start; slot < end; slot++) {
+    uint8_t level = frame_level;
+    if (slot_priorities) {
+      uint8_t priority = slot_priorities->GetRaw()[slot];
+      level = priority ? min(priority, MAX_SLOT_PRIORITY) + 1 : 0;
+    }
+
+    if (!level || level < levels[slot])
+      continue;
+    if (level == levels[slot] && sources.htp_merge)
+      output[slot] = max(output[slot], data[slot]);
+    else
+      output[slot] = data[slot];
+    levels[slot] = level;
+  }
+}
+
+
+/*
+ * The portable version.
+ */
+void PriorityMergeScalar(uint8_t *output,
+                         uint8_t *levels,
+                         unsigned int length,
+                         const PriorityMergeSources &sources) {
+  memset(output, 0, length);
+  memset(levels, 0, length);
+  for (unsigned int i = 0; i < sources.count; i++)
+    PriorityMergeRange(output, levels, 0, length, sources, i);
+}
+
+
+#ifdef HAVE_X86_MERGE_KERNELS
+/*
+ * Merge 16 slots at a time. For each source we work out which slots it beats
+ * the current winner on, and which it ties with, and blend the data in.
+ */
+__attribute__((target("sse2")))
+void PriorityMergeSSE2(uint8_t *output,
+                       uint8_t *levels,
+                       unsigned int length,
+                       const PriorityMergeSources &sources) {
+  const unsigned int width = sizeof(__m128i);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i max_priority = _mm_set1_epi8(MAX_SLOT_PRIORITY);
+  unsigned int offset = 0;
+
+  for (; offset + width <= length; offset += width) {
+    __m128i result = zero;
+    __m128i best = zero;
+    for (unsigned int i = 0; i < sources.count; i++) {
+      unsigned int size = SourceCoverage(sources, i);
+      if (size < offset + width) {
+        if (size > offset) {
+          // this source stops part way through the block
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(output + offset),
+                           result);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + offset), best);
+          PriorityMergeRange(output, levels, offset, size, sources, i);
+          result = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(output + offset));
+          best = _mm_loadu_si128(
+              reinterpret_cast<const __m128i*>(levels + offset));
+        }
+        continue;
+      }
+
+      __m128i level;
+      if (sources.slot_priorities[i]) {
+        __m128i priority = _mm_min_epu8(max_priority, _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(
+              sources.slot_priorities[i]->GetRaw() + offset)));
+        level = _mm_andnot_si128(_mm_cmpeq_epi8(priority, zero),
+                                 _mm_add_epi8(priority, one));
+      } else {
+        level = _mm_set1_epi8(
+            min(sources.priorities[i], MAX_SLOT_PRIORITY) + 1);
+      }
+      __m128i data = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(sources.data[i]->GetRaw() + offset));
+
+      __m128i equal = _mm_cmpeq_epi8(level, best);
+      __m128i higher = _mm_andnot_si128(
+          equal, _mm_cmpeq_epi8(_mm_max_epu8(level, best), level));
+      __m128i tie = _mm_andnot_si128(_mm_cmpeq_epi8(level, zero), equal);
+      __m128i tie_data = sources.htp_merge ? _mm_max_epu8(result, data) : data;
+
+      result = _mm_or_si128(_mm_and_si128(higher, data),
+                            _mm_andnot_si128(higher, result));
+      result = _mm_or_si128(_mm_and_si128(tie, tie_data),
+                            _mm_andnot_si128(tie, result));
+      best = _mm_max_epu8(best, level);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + offset), result);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + offset), best);
+  }
+
+  memset(output + offset, 0, length - offset);
+  memset(levels + offset, 0, length - offset);
+  for (unsigned int i = 0; i < sources.count; i++)
+    PriorityMergeRange(output, levels, offset, length, sources, i);
+}
+#endif
+
+
+/*
+ * Pick the best priority merge kernel for this CPU.
+ */
+PriorityMergeKernel ChoosePriorityMergeKernel() {
+#ifdef HAVE_X86_MERGE_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    return PriorityMergeSSE2;
+#endif
+  return PriorityMergeScalar;
+}
+
+const PriorityMergeKernel priority_merge_kernel = ChoosePriorityMergeKernel();
+}  // namespace
+
 DmxBuffer::DmxBuffer()
     : m_ref_count(NULL),
       m_copy_on_write(false),
       m_data(NULL),
-      m_length(0) {
+      m_length(0),
+      m_changed_start(0),
+      m_changed_end(0) {
 }
 
 
@@ -55,7 +384,9 @@ DmxBuffer::DmxBuffer(const DmxBuffer &other)
     : m_ref_count(NULL),
       m_copy_on_write(false),
       m_data(NULL),
-      m_length(0) {
+      m_length(0),
+      m_changed_start(other.m_changed_start),
+      m_changed_end(other.m_changed_end) {
 
   if (other.m_data && other.m_ref_count) {
     CopyFromOther(other);
@@ -70,7 +401,9 @@ DmxBuffer::DmxBuffer(const uint8_t *data, unsigned int length)
     : m_ref_count(0),
       m_copy_on_write(false),
       m_data(NULL),
-      m_length(0) {
+      m_length(0),
+      m_changed_start(0),
+      m_changed_end(0) {
   Set(data, length);
 }
 
@@ -82,7 +415,9 @@ DmxBuffer::DmxBuffer(const string &data)
     : m_ref_count(0),
       m_copy_on_write(false),
       m_data(NULL),
-      m_length(0) {
+      m_length(0),
+      m_changed_start(0),
+      m_changed_end(0) {
     Set(data);
 }
 
@@ -105,6 +440,8 @@ DmxBuffer& DmxBuffer::operator=(const DmxBuffer &other) {
     if (other.m_data) {
       CopyFromOther(other);
     }
+    m_changed_start = other.m_changed_start;
+    m_changed_end = other.m_changed_end;
   }
   return *this;
 }
@@ -140,19 +477,98 @@ bool DmxBuffer::HTPMerge(const DmxBuffer &other) {
                                   other.m_length);
   unsigned int merge_length = min(m_length, other.m_length);
 
+  unsigned int first_change = merge_length;
+  unsigned int last_change = 0;
   for (unsigned int i = 0; i < merge_length; i++) {
-    m_data[i] = max(m_data[i], other.m_data[i]);
+    if (other.m_data[i] > m_data[i]) {
+      m_data[i] = other.m_data[i];
+      first_change = min(first_change, i);
+      last_change = i + 1;
+    }
   }
+  MarkChanged(first_change, last_change);
 
   if (other_length > m_length) {
     memcpy(m_data + merge_length, other.m_data + merge_length,
            other_length - merge_length);
+    MarkChanged(merge_length, other_length);
     m_length = other_length;
   }
   return true;
 }
 
 
+/*
+ * Set this buffer to the HTP merge of a number of buffers. This is done in a
+ * single pass, and is much faster than calling HTPMerge() for each buffer.
+ * @param sources an array of the buffers to merge, this buffer may be one of
+ *   them.
+ * @param count the number of buffers in the array
+ * @post Size() is the size of the largest buffer
+ */
+bool DmxBuffer::SetFromHTPMerge(const DmxBuffer *const sources[],
+                                unsigned int count) {
+  unsigned int length = 0;
+  for (unsigned int i = 0; i < count; i++)
+    length = max(length, sources[i]->m_length);
+  length = min(length, (unsigned int) DMX_UNIVERSE_SIZE);
+
+  // Merge onto the stack, so the kernel never reads what it's writing and
+  // Set() can work out which slots changed.
+  uint8_t merged[DMX_UNIVERSE_SIZE];
+  merge_kernel(merged, length, sources, count);
+  return Set(merged, length);
+}
+
+
+/*
+ * Set this buffer to the per-slot priority merge of a number of buffers. For
+ * each slot, the sources with the highest priority for that slot win, and
+ * are then either HTP or LTP merged.
+ * @param sources an array of the buffers to merge
+ * @param slot_priorities an array of the per-slot priorities for each source,
+ *   or NULL if a source doesn't have any. A slot priority of 0 means the
+ *   source doesn't provide that slot.
+ * @param priorities the priority used for the sources without slot
+ *   priorities.
+ * @param count the number of sources
+ * @param htp_merge true to HTP merge the winning sources for each slot. If
+ *   false the last source in the array wins, so the sources should be ordered
+ *   oldest first.
+ * @param merged_priorities if not NULL, this is set to the winning priority
+ *   for each slot.
+ * @post Size() is one past the last slot that a source provides
+ */
+bool DmxBuffer::SetFromPriorityMerge(const DmxBuffer *const sources[],
+                                     const DmxBuffer *const slot_priorities[],
+                                     const uint8_t priorities[],
+                                     unsigned int count,
+                                     bool htp_merge,
+                                     DmxBuffer *merged_priorities) {
+  unsigned int length = 0;
+  for (unsigned int i = 0; i < count; i++)
+    length = max(length, sources[i]->m_length);
+  length = min(length, (unsigned int) DMX_UNIVERSE_SIZE);
+
+  uint8_t merged[DMX_UNIVERSE_SIZE];
+  uint8_t levels[DMX_UNIVERSE_SIZE];
+  PriorityMergeSources merge_sources = {
+    sources, slot_priorities, priorities, count, htp_merge};
+  priority_merge_kernel(merged, levels, length, merge_sources);
+
+  // trim the slots at the end that no source provides
+  while (length && !levels[length - 1])
+    length--;
+
+  if (merged_priorities) {
+    for (unsigned int slot = 0; slot < length; slot++)
+      levels[slot] = levels[slot] ? levels[slot] - 1 : 0;
+    merged_priorities->Set(levels, length);
+  }
+  return Set(merged, length);
+}
+
+
 /*
  * Set the contents of this DmxBuffer
  * @post Size() == length
@@ -161,13 +577,18 @@ bool DmxBuffer::Set(const uint8_t *data, unsigned int length) {
   if (!data)
     return false;
 
+  length = min(length, (unsigned int) DMX_UNIVERSE_SIZE);
+  if (data == m_data && length == m_length)
+    return true;
+  MarkDifferences(data, length);
+
   if (m_copy_on_write)
     CleanupMemory();
   if (!m_data) {
     if (!Init())
       return false;
   }
-  m_length = min(length, (unsigned int) DMX_UNIVERSE_SIZE);
+  m_length = length;
   memcpy(m_data, data, m_length);
   return true;
 }
@@ -203,6 +624,7 @@ bool DmxBuffer::SetFromString(const string &input) {
   vector<string> dmx_values;
   vector<string>::const_iterator iter;
 
+  unsigned int old_length = m_length;
   if (m_copy_on_write)
     CleanupMemory();
   if (!m_data)
@@ -210,6 +632,7 @@ bool DmxBuffer::SetFromString(const string &input) {
       return false;
 
   if (input.empty()) {
+    MarkChanged(0, old_length);
     m_length = 0;
     return true;
   }
@@ -218,6 +641,7 @@ bool DmxBuffer::SetFromString(const string &input) {
       iter != dmx_values.end() && i < DMX_UNIVERSE_SIZE; ++iter, ++i) {
     m_data[i] = atoi(iter->data());
   }
+  MarkChanged(0, max(old_length, i));
   m_length = i;
   return true;
 }
@@ -246,6 +670,7 @@ bool DmxBuffer::SetRangeToValue(unsigned int offset,
 
   unsigned int copy_length = min(length, DMX_UNIVERSE_SIZE - offset);
   memset(m_data + offset, value, copy_length);
+  MarkChanged(offset, offset + copy_length);
   m_length = max(m_length, offset + copy_length);
   return true;
 }
@@ -276,6 +701,7 @@ bool DmxBuffer::SetRange(unsigned int offset,
 
   unsigned int copy_length = min(length, DMX_UNIVERSE_SIZE - offset);
   memcpy(m_data + offset, data, copy_length);
+  MarkChanged(offset, offset + copy_length);
   m_length = max(m_length, offset + copy_length);
   return true;
 }
@@ -301,6 +727,8 @@ void DmxBuffer::SetChannel(unsigned int channel, uint8_t data) {
   }
 
   DuplicateIfNeeded();
+  if (channel == m_length || m_data[channel] != data)
+    MarkChanged(channel, channel + 1);
   m_data[channel] = data;
   m_length = max(channel+1, m_length);
 }
@@ -367,6 +795,7 @@ bool DmxBuffer::Blackout() {
       return false;
   memset(m_data, 0, DMX_UNIVERSE_SIZE);
   m_length = DMX_UNIVERSE_SIZE;
+  MarkChanged(0, m_length);
   return true;
 }
 
@@ -376,8 +805,10 @@ bool DmxBuffer::Blackout() {
  * @post Size() == 0
  */
 void DmxBuffer::Reset() {
-  if (m_data)
+  if (m_data) {
+    MarkChanged(0, m_length);
     m_length = 0;
+  }
 }
 
 
@@ -398,6 +829,35 @@ string DmxBuffer::ToString() const {
 }
 
 
+/*
+ * Forget about the changes made so far.
+ */
+void DmxBuffer::Checkpoint() {
+  m_changed_start = 0;
+  m_changed_end = 0;
+}
+
+
+/*
+ * Get the range of slots that changed since the last Checkpoint(). This
+ * includes slots that were added or removed from the end of the buffer.
+ * @param slot set to the first slot that changed
+ * @param length set to the number of slots in the range
+ * @returns false if nothing has changed
+ */
+bool DmxBuffer::GetChangedRange(unsigned int *slot,
+                                unsigned int *length) const {
+  if (!Changed()) {
+    *slot = 0;
+    *length = 0;
+    return false;
+  }
+  *slot = m_changed_start;
+  *length = m_changed_end - m_changed_start;
+  return true;
+}
+
+
 /*
  * Allocate memory
  */
@@ -423,7 +883,8 @@ bool DmxBuffer::DuplicateIfNeeded() {
     unsigned int length = m_length;
     m_copy_on_write = false;
     if (Init()) {
-      Set(original_data, length);
+      memcpy(m_data, original_data, length);
+      m_length = length;
       (*old_ref_count)--;
       return true;
     }
@@ -448,6 +909,43 @@ void DmxBuffer::CopyFromOther(const DmxBuffer &other) {
 }
 
 
+/*
+ * Extend the changed range to cover [start, end)
+ */
+void DmxBuffer::MarkChanged(unsigned int start, unsigned int end) {
+  if (start >= end)
+    return;
+
+  if (Changed()) {
+    m_changed_start = min(m_changed_start, start);
+    m_changed_end = max(m_changed_end, end);
+  } else {
+    m_changed_start = start;
+    m_changed_end = end;
+  }
+}
+
+
+/*
+ * Mark the slots that differ between the current contents and new data.
+ * @pre length <= DMX_UNIVERSE_SIZE
+ */
+void DmxBuffer::MarkDifferences(const uint8_t *data, unsigned int length) {
+  if (length == m_length && (!length || 0 == memcmp(m_data, data, length)))
+    return;
+
+  unsigned int common_length = min(m_length, length);
+  unsigned int start = 0;
+  while (start < common_length && m_data[start] == data[start])
+    start++;
+  unsigned int end = common_length;
+  while (end > start && m_data[end - 1] == data[end - 1])
+    end--;
+  MarkChanged(start, end);
+  MarkChanged(common_length, max(m_length, length));
+}
+
+
 /*
  * Decrement the ref count by one and free the memory if required
  */
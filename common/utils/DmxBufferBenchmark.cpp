@@ -0,0 +1,134 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxBufferBenchmark.cpp
+ * Compares merging buffers one at a time with DmxBuffer::SetFromHTPMerge().
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+
+#include "ola/BaseTypes.h"
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "ola/base/Flags.h"
+
+using ola::Clock;
+using ola::DmxBuffer;
+using ola::TimeInterval;
+using ola::TimeStamp;
+using std::cout;
+using std::endl;
+
+DEFINE_s_uint32(iterations, i, 100000, "The number of merges to time");
+
+static const unsigned int MAX_SOURCES = 8;
+
+// Every other source has per-slot priorities.
+static const DmxBuffer *slot_priorities[MAX_SOURCES];
+static uint8_t priorities[MAX_SOURCES];
+
+
+/*
+ * Merge the buffers one at a time, the way the callers used to.
+ */
+void MergeOneByOne(DmxBuffer *output, const DmxBuffer *const sources[],
+                   unsigned int count) {
+  output->Reset();
+  for (unsigned int i = 0; i < count; i++)
+    output->HTPMerge(*sources[i]);
+}
+
+
+void MergeInOnePass(DmxBuffer *output, const DmxBuffer *const sources[],
+                    unsigned int count) {
+  output->SetFromHTPMerge(sources, count);
+}
+
+
+void MergeWithSlotPriorities(DmxBuffer *output,
+                             const DmxBuffer *const sources[],
+                             unsigned int count) {
+  output->SetFromPriorityMerge(sources, slot_priorities, priorities, count,
+                               true);
+}
+
+
+/*
+ * Time a merge function, returns the average time of a merge in ns.
+ */
+double TimeMerge(void (*merge)(DmxBuffer*, const DmxBuffer *const[],
+                               unsigned int),
+                 const DmxBuffer *const sources[],
+                 unsigned int count) {
+  Clock clock;
+  DmxBuffer output;
+  // Hold a reference, so each merge has to check the copy-on-write state.
+  DmxBuffer reader;
+
+  TimeStamp start, end;
+  clock.CurrentTime(&start);
+  for (uint32_t i = 0; i < FLAGS_iterations; i++) {
+    merge(&output, sources, count);
+    reader = output;
+  }
+  clock.CurrentTime(&end);
+  TimeInterval elapsed = end - start;
+  return elapsed.AsInt() * 1000.0 / FLAGS_iterations;
+}
+
+
+int main(int argc, char *argv[]) {
+  ola::SetHelpString(
+      "[options]",
+      "Benchmark the N-way HTP & per-slot priority merges of full "
+      "universes.");
+  ola::ParseFlags(&argc, argv);
+
+  DmxBuffer buffers[MAX_SOURCES];
+  DmxBuffer priority_buffers[MAX_SOURCES];
+  const DmxBuffer *sources[MAX_SOURCES];
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  srandom(1);
+  for (unsigned int i = 0; i < MAX_SOURCES; i++) {
+    for (unsigned int j = 0; j < DMX_UNIVERSE_SIZE; j++)
+      data[j] = random();
+    buffers[i].Set(data, DMX_UNIVERSE_SIZE);
+    sources[i] = &buffers[i];
+
+    for (unsigned int j = 0; j < DMX_UNIVERSE_SIZE; j++)
+      data[j] = random() % 201;
+    priority_buffers[i].Set(data, DMX_UNIVERSE_SIZE);
+    slot_priorities[i] = i % 2 ? &priority_buffers[i] : NULL;
+    priorities[i] = 100;
+  }
+
+  cout << "Sources  One-by-one (ns)  One pass (ns)  Speedup  Per-slot (ns)"
+       << endl;
+  for (unsigned int count = 2; count <= MAX_SOURCES; count *= 2) {
+    double old_time = TimeMerge(MergeOneByOne, sources, count);
+    double new_time = TimeMerge(MergeInOnePass, sources, count);
+    double slot_time = TimeMerge(MergeWithSlotPriorities, sources, count);
+    cout << std::setw(7) << count << std::setw(18) << std::fixed
+         << std::setprecision(1) << old_time << std::setw(15) << new_time
+         << std::setw(8) << std::setprecision(2)
+         << (new_time > 0 ? old_time / new_time : 0) << "x"
+         << std::setw(15) << std::setprecision(1) << slot_time << endl;
+  }
+  return 0;
+}
@@ -20,6 +20,7 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 
 #include "ola/BaseTypes.h"
@@ -37,12 +38,15 @@ class DmxBufferTest: public CppUnit::TestFixture {
   CPPUNIT_TEST(testAssign);
   CPPUNIT_TEST(testCopy);
   CPPUNIT_TEST(testMerge);
+  CPPUNIT_TEST(testMultiMerge);
+  CPPUNIT_TEST(testPriorityMerge);
   CPPUNIT_TEST(testStringToDmx);
   CPPUNIT_TEST(testCopyOnWrite);
   CPPUNIT_TEST(testSetRange);
   CPPUNIT_TEST(testSetRangeToValue);
   CPPUNIT_TEST(testSetChannel);
   CPPUNIT_TEST(testToString);
+  CPPUNIT_TEST(testChangeTracking);
   CPPUNIT_TEST_SUITE_END();
 
   public:
@@ -52,12 +56,15 @@ class DmxBufferTest: public CppUnit::TestFixture {
     void testStringGetSet();
     void testCopy();
     void testMerge();
+    void testMultiMerge();
+    void testPriorityMerge();
     void testStringToDmx();
     void testCopyOnWrite();
     void testSetRange();
     void testSetRangeToValue();
     void testSetChannel();
     void testToString();
+    void testChangeTracking();
 
   private:
     static const uint8_t TEST_DATA[];
@@ -281,6 +288,171 @@ void DmxBufferTest::testMerge() {
 }
 
 
+
+/*
+ * Check that merging many buffers at once matches merging them one by one.
+ */
+void DmxBufferTest::testMultiMerge() {
+  const unsigned int lengths[] = {0, 3, 15, 16, 17, 31, 33, 100, 511, 512};
+  const unsigned int length_count = sizeof(lengths) / sizeof(lengths[0]);
+
+  DmxBuffer buffers[length_count];
+  const DmxBuffer *sources[length_count];
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  unsigned int seed = 1;
+  for (unsigned int i = 0; i < length_count; i++) {
+    for (unsigned int j = 0; j < lengths[i]; j++) {
+      seed = seed * 1103515245 + 12345;
+      data[j] = seed >> 16;
+    }
+    buffers[i].Set(data, lengths[i]);
+  }
+
+  // merge every window of sources, in both directions
+  for (unsigned int count = 0; count <= length_count; count++) {
+    for (unsigned int start = 0; start + count <= length_count; start++) {
+      for (unsigned int reverse = 0; reverse < 2; reverse++) {
+        DmxBuffer expected, result;
+        for (unsigned int i = 0; i < count; i++) {
+          sources[i] = &buffers[reverse ? start + count - 1 - i : start + i];
+          expected.HTPMerge(*sources[i]);
+        }
+        OLA_ASSERT_TRUE(result.SetFromHTPMerge(sources, count));
+        OLA_ASSERT_EQ(expected.Size(), result.Size());
+        OLA_ASSERT_TRUE(expected == result);
+      }
+    }
+  }
+
+  // the result buffer can be one of the sources
+  DmxBuffer buffer1(TEST_DATA, sizeof(TEST_DATA));
+  DmxBuffer buffer2(TEST_DATA2, sizeof(TEST_DATA2));
+  DmxBuffer buffer3(TEST_DATA3, sizeof(TEST_DATA3));
+  const DmxBuffer *merge_sources[] = {&buffer1, &buffer2, &buffer3};
+  OLA_ASSERT_TRUE(buffer1.SetFromHTPMerge(merge_sources, 3));
+  OLA_ASSERT_TRUE(DmxBuffer(MERGE_RESULT2, sizeof(MERGE_RESULT2)) == buffer1);
+
+  // and copies aren't modified
+  DmxBuffer copy(buffer2);
+  OLA_ASSERT_TRUE(copy.SetFromHTPMerge(merge_sources + 2, 1));
+  OLA_ASSERT_TRUE(DmxBuffer(TEST_DATA2, sizeof(TEST_DATA2)) == buffer2);
+  OLA_ASSERT_TRUE(buffer3 == copy);
+}
+
+
+/*
+ * Check the per-slot priority merge.
+ */
+void DmxBufferTest::testPriorityMerge() {
+  DmxBuffer output, merged_priorities;
+  DmxBuffer backup, primary, partial;
+  backup.SetFromString("10,10,10,10");
+  primary.SetFromString("20,5,20,5");
+  partial.SetFromString("0,0,99");
+  DmxBuffer partial_priorities;
+  // partial only owns slot 2, at a priority above the other sources
+  partial_priorities.SetFromString("0,0,150,150");
+
+  const DmxBuffer *sources[] = {&backup, &primary, &partial};
+  const DmxBuffer *slot_priorities[] = {NULL, NULL, &partial_priorities};
+  const uint8_t priorities[] = {100, 100, 0};
+
+  OLA_ASSERT_TRUE(output.SetFromPriorityMerge(
+      sources, slot_priorities, priorities, 3, true, &merged_priorities));
+  OLA_ASSERT_EQ(string("20,10,99,10"), output.ToString());
+  OLA_ASSERT_EQ(string("100,100,150,100"), merged_priorities.ToString());
+
+  // with LTP the last source wins the ties
+  OLA_ASSERT_TRUE(output.SetFromPriorityMerge(
+      sources, slot_priorities, priorities, 3, false, &merged_priorities));
+  OLA_ASSERT_EQ(string("20,5,99,5"), output.ToString());
+
+  // slot priorities beat a higher frame priority, and a slot priority of 0
+  // means the slot isn't provided
+  DmxBuffer primary_priorities;
+  primary_priorities.SetFromString("50,0,0,0");
+  const DmxBuffer *slot_priorities2[] = {&primary_priorities, NULL, NULL};
+  const uint8_t priorities2[] = {200, 0, 0};
+  OLA_ASSERT_TRUE(output.SetFromPriorityMerge(
+      sources, slot_priorities2, priorities2, 3, true, &merged_priorities));
+  OLA_ASSERT_EQ(string("10,5,99,5"), output.ToString());
+  OLA_ASSERT_EQ(string("50,0,0,0"), merged_priorities.ToString());
+
+  // trailing slots that no source provides are dropped
+  const DmxBuffer *sources3[] = {&partial};
+  OLA_ASSERT_TRUE(output.SetFromPriorityMerge(
+      sources3, slot_priorities + 2, priorities, 1, true, &merged_priorities));
+  OLA_ASSERT_EQ(string("0,0,99"), output.ToString());
+  OLA_ASSERT_EQ(string("0,0,150"), merged_priorities.ToString());
+
+  // Compare against a slot by slot merge, with lengths that cover the partial
+  // blocks.
+  const unsigned int lengths[] = {0, 3, 15, 16, 17, 31, 33, 100, 511, 512};
+  const unsigned int count = sizeof(lengths) / sizeof(lengths[0]);
+  DmxBuffer buffers[count], slot_buffers[count];
+  const DmxBuffer *random_sources[count];
+  const DmxBuffer *random_slot_priorities[count];
+  uint8_t random_priorities[count];
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  unsigned int seed = 1;
+  for (unsigned int i = 0; i < count; i++) {
+    for (unsigned int j = 0; j < lengths[i]; j++) {
+      seed = seed * 1103515245 + 12345;
+      data[j] = seed >> 16;
+    }
+    buffers[i].Set(data, lengths[i]);
+    // use a few priorities so there are plenty of ties
+    for (unsigned int j = 0; j < lengths[count - 1 - i]; j++) {
+      seed = seed * 1103515245 + 12345;
+      data[j] = ((seed >> 16) % 4) * 70;
+    }
+    slot_buffers[i].Set(data, lengths[count - 1 - i]);
+    random_sources[i] = &buffers[i];
+    random_slot_priorities[i] = i % 2 ? &slot_buffers[i] : NULL;
+    random_priorities[i] = (i % 3) * 70;
+  }
+
+  for (unsigned int htp = 0; htp < 2; htp++) {
+    uint8_t expected[DMX_UNIVERSE_SIZE];
+    int expected_priority[DMX_UNIVERSE_SIZE];
+    unsigned int expected_length = 0;
+    for (unsigned int slot = 0; slot < DMX_UNIVERSE_SIZE; slot++) {
+      expected[slot] = 0;
+      expected_priority[slot] = -1;
+      for (unsigned int i = 0; i < count; i++) {
+        if (slot >= buffers[i].Size())
+          continue;
+        int priority = random_priorities[i];
+        if (random_slot_priorities[i]) {
+          if (slot >= slot_buffers[i].Size() || !slot_buffers[i].Get(slot))
+            continue;
+          priority = std::min(slot_buffers[i].Get(slot), (uint8_t) 200);
+        }
+        uint8_t value = buffers[i].Get(slot);
+        if (priority > expected_priority[slot] ||
+            (priority == expected_priority[slot] && !htp)) {
+          expected[slot] = value;
+        } else if (priority == expected_priority[slot]) {
+          expected[slot] = std::max(expected[slot], value);
+        }
+        expected_priority[slot] = std::max(expected_priority[slot], priority);
+      }
+      if (expected_priority[slot] >= 0)
+        expected_length = slot + 1;
+    }
+
+    OLA_ASSERT_TRUE(output.SetFromPriorityMerge(
+        random_sources, random_slot_priorities, random_priorities, count,
+        htp, &merged_priorities));
+    OLA_ASSERT_TRUE(DmxBuffer(expected, expected_length) == output);
+    for (unsigned int slot = 0; slot < expected_length; slot++) {
+      OLA_ASSERT_EQ(std::max(expected_priority[slot], 0),
+                    static_cast<int>(merged_priorities.Get(slot)));
+    }
+  }
+}
+
+
 /*
  * Run the StringToDmxTest
  * @param input the string to parse
@@ -510,3 +682,106 @@ void DmxBufferTest::testToString() {
   buffer.SetRangeToValue(0, 255, 5);
   OLA_ASSERT_EQ(string("255,255,255,255,255"), buffer.ToString());
 }
+
+
+/*
+ * Check that we track which slots changed
+ */
+void DmxBufferTest::testChangeTracking() {
+  unsigned int slot, length;
+  DmxBuffer buffer;
+  OLA_ASSERT_FALSE(buffer.Changed());
+  OLA_ASSERT_FALSE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(0u, length);
+
+  buffer.Set(TEST_DATA2, sizeof(TEST_DATA2));
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(0u, slot);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA2), length);
+
+  // setting the same data again isn't a change
+  buffer.Checkpoint();
+  OLA_ASSERT_FALSE(buffer.Changed());
+  buffer.Set(TEST_DATA2, sizeof(TEST_DATA2));
+  OLA_ASSERT_FALSE(buffer.Changed());
+  DmxBuffer same_data(TEST_DATA2, sizeof(TEST_DATA2));
+  buffer.Set(same_data);
+  OLA_ASSERT_FALSE(buffer.Changed());
+
+  // only the slots that differ are marked
+  uint8_t data[sizeof(TEST_DATA2)];
+  memcpy(data, TEST_DATA2, sizeof(data));
+  data[3] = 100;
+  data[5] = 100;
+  buffer.Set(data, sizeof(data));
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(3u, slot);
+  OLA_ASSERT_EQ(3u, length);
+
+  // ranges accumulate until the next checkpoint
+  buffer.SetChannel(1, 0);
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(1u, slot);
+  OLA_ASSERT_EQ(5u, length);
+
+  // setting a channel to the same value isn't a change
+  buffer.Checkpoint();
+  buffer.SetChannel(1, 0);
+  OLA_ASSERT_FALSE(buffer.Changed());
+
+  // shrinking the buffer changes the slots that were removed
+  data[1] = 0;
+  buffer.Set(data, 4);
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(4u, slot);
+  OLA_ASSERT_EQ((unsigned int) sizeof(data) - 4, length);
+
+  buffer.Checkpoint();
+  buffer.SetRangeToValue(2, 50, 4);
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(2u, slot);
+  OLA_ASSERT_EQ(4u, length);
+
+  buffer.Checkpoint();
+  buffer.SetRange(1, TEST_DATA3, sizeof(TEST_DATA3));
+  OLA_ASSERT_TRUE(buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(1u, slot);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA3), length);
+
+  // copies carry the changed range with them, without sharing it
+  DmxBuffer copy(buffer);
+  OLA_ASSERT_TRUE(copy.Changed());
+  buffer.Checkpoint();
+  OLA_ASSERT_TRUE(copy.Changed());
+  copy = buffer;
+  OLA_ASSERT_FALSE(copy.Changed());
+  copy.SetChannel(0, 200);
+  OLA_ASSERT_TRUE(copy.Changed());
+  OLA_ASSERT_FALSE(buffer.Changed());
+
+  // merges only mark the slots that were raised
+  DmxBuffer merge_buffer(TEST_DATA, sizeof(TEST_DATA));
+  merge_buffer.Checkpoint();
+  merge_buffer.HTPMerge(DmxBuffer(TEST_DATA3, sizeof(TEST_DATA3)));
+  OLA_ASSERT_TRUE(merge_buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(0u, slot);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA3), length);
+
+  DmxBuffer source1(TEST_DATA, sizeof(TEST_DATA));
+  DmxBuffer source2(TEST_DATA3, sizeof(TEST_DATA3));
+  const DmxBuffer *sources[] = {&source1, &source2};
+  merge_buffer.Checkpoint();
+  merge_buffer.SetFromHTPMerge(sources, 2);
+  OLA_ASSERT_FALSE(merge_buffer.Changed());
+  source1.SetChannel(4, 200);
+  merge_buffer.SetFromHTPMerge(sources, 2);
+  OLA_ASSERT_TRUE(merge_buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(4u, slot);
+  OLA_ASSERT_EQ(1u, length);
+
+  merge_buffer.Checkpoint();
+  merge_buffer.Reset();
+  OLA_ASSERT_TRUE(merge_buffer.GetChangedRange(&slot, &length));
+  OLA_ASSERT_EQ(0u, slot);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA), length);
+}
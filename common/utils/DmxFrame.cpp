@@ -0,0 +1,195 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxFrame.cpp
+ * An immutable snapshot of DMX data that can be shared between threads.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
+
+namespace ola {
+
+using std::min;
+
+const unsigned int DmxFrame::K_SLAB_SIZE = 32;
+
+/*
+ * The pool of unused frames. This is only locked when a frame is allocated or
+ * released, never while the data is copied. The slabs are never freed.
+ *
+ * libolautils doesn't link against the thread library, and frames may be
+ * created during static initialization, so this is a statically initialized
+ * pthread mutex rather than an ola::thread::Mutex.
+ */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+DmxFrame::FrameData *DmxFrame::free_frames = NULL;
+
+
+DmxFrame::DmxFrame()
+    : m_frame(NULL) {
+}
+
+
+/*
+ * Take a snapshot of a DmxBuffer.
+ */
+DmxFrame::DmxFrame(const DmxBuffer &buffer)
+    : m_frame(NULL) {
+  Init(buffer.GetRaw(), buffer.Size());
+}
+
+
+DmxFrame::DmxFrame(const uint8_t *data, unsigned int length)
+    : m_frame(NULL) {
+  Init(data, length);
+}
+
+
+/*
+ * Share the data with another frame.
+ */
+DmxFrame::DmxFrame(const DmxFrame &other)
+    : m_frame(other.m_frame) {
+  if (m_frame)
+    __sync_add_and_fetch(&m_frame->ref_count, 1);
+}
+
+
+DmxFrame::~DmxFrame() {
+  Reset();
+}
+
+
+DmxFrame& DmxFrame::operator=(const DmxFrame &other) {
+  if (m_frame != other.m_frame) {
+    if (other.m_frame)
+      __sync_add_and_fetch(&other.m_frame->ref_count, 1);
+    Reset();
+    m_frame = other.m_frame;
+  }
+  return *this;
+}
+
+
+bool DmxFrame::operator==(const DmxFrame &other) const {
+  return (Size() == other.Size() &&
+          (m_frame == other.m_frame ||
+           0 == memcmp(GetRaw(), other.GetRaw(), Size())));
+}
+
+
+bool DmxFrame::operator!=(const DmxFrame &other) const {
+  return !(*this == other);
+}
+
+
+/*
+ * Returns the value of a channel, or 0 if it's out of bounds.
+ */
+uint8_t DmxFrame::Get(unsigned int channel) const {
+  if (channel < Size())
+    return m_frame->data[channel];
+  return 0;
+}
+
+
+/*
+ * Copy the data into a buffer
+ * @param data the buffer to copy into
+ * @param length the size of data, updated with the number of bytes copied
+ */
+void DmxFrame::Get(uint8_t *data, unsigned int *length) const {
+  *length = min(*length, Size());
+  if (*length)
+    memcpy(data, m_frame->data, *length);
+}
+
+
+/*
+ * Copy a range of data starting from a particular slot
+ */
+void DmxFrame::GetRange(unsigned int slot, uint8_t *data,
+                        unsigned int *length) const {
+  if (slot >= Size()) {
+    *length = 0;
+    return;
+  }
+  *length = min(*length, Size() - slot);
+  memcpy(data, m_frame->data + slot, *length);
+}
+
+
+bool DmxFrame::CopyTo(DmxBuffer *buffer) const {
+  if (!m_frame) {
+    buffer->Reset();
+    return true;
+  }
+  return buffer->Set(m_frame->data, m_frame->length);
+}
+
+
+void DmxFrame::Reset() {
+  if (m_frame && __sync_sub_and_fetch(&m_frame->ref_count, 1) == 0)
+    Release(m_frame);
+  m_frame = NULL;
+}
+
+
+/*
+ * Populate a new frame. A NULL data pointer leaves the frame empty.
+ */
+void DmxFrame::Init(const uint8_t *data, unsigned int length) {
+  if (!data)
+    return;
+
+  m_frame = Allocate();
+  m_frame->ref_count = 1;
+  m_frame->length = min(length, (unsigned int) DMX_UNIVERSE_SIZE);
+  memcpy(m_frame->data, data, m_frame->length);
+}
+
+
+/*
+ * Take a frame from the pool, adding a new slab if it's empty.
+ */
+DmxFrame::FrameData *DmxFrame::Allocate() {
+  pthread_mutex_lock(&pool_mutex);
+  if (!free_frames) {
+    FrameData *slab = new FrameData[K_SLAB_SIZE];
+    for (unsigned int i = 0; i < K_SLAB_SIZE - 1; i++)
+      slab[i].next_free = &slab[i + 1];
+    slab[K_SLAB_SIZE - 1].next_free = NULL;
+    free_frames = slab;
+  }
+  FrameData *frame = free_frames;
+  free_frames = frame->next_free;
+  pthread_mutex_unlock(&pool_mutex);
+  return frame;
+}
+
+
+void DmxFrame::Release(FrameData *frame) {
+  pthread_mutex_lock(&pool_mutex);
+  frame->next_free = free_frames;
+  free_frames = frame;
+  pthread_mutex_unlock(&pool_mutex);
+}
+}  // namespace ola
@@ -0,0 +1,200 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxFrameTest.cpp
+ * Unittest for the DmxFrame
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <pthread.h>
+#include <string.h>
+#include <string>
+
+#include "ola/BaseTypes.h"
+#include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::DmxFrame;
+using std::string;
+
+class DmxFrameTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(DmxFrameTest);
+  CPPUNIT_TEST(testSnapshot);
+  CPPUNIT_TEST(testSharing);
+  CPPUNIT_TEST(testGet);
+  CPPUNIT_TEST(testThreads);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void testSnapshot();
+    void testSharing();
+    void testGet();
+    void testThreads();
+
+  private:
+    static const uint8_t TEST_DATA[];
+    static const uint8_t TEST_DATA2[];
+};
+
+const uint8_t DmxFrameTest::TEST_DATA[] = {1, 2, 3, 4, 5};
+const uint8_t DmxFrameTest::TEST_DATA2[] = {9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DmxFrameTest);
+
+
+/*
+ * Check that a frame doesn't change when the buffer it came from does.
+ */
+void DmxFrameTest::testSnapshot() {
+  DmxFrame empty_frame;
+  OLA_ASSERT_EQ(0u, empty_frame.Size());
+  OLA_ASSERT_EQ(static_cast<const uint8_t*>(NULL), empty_frame.GetRaw());
+
+  DmxBuffer uninitialized_buffer;
+  DmxFrame uninitialized_frame(uninitialized_buffer);
+  OLA_ASSERT_EQ(0u, uninitialized_frame.Size());
+  OLA_ASSERT_TRUE(empty_frame == uninitialized_frame);
+
+  DmxBuffer buffer(TEST_DATA, sizeof(TEST_DATA));
+  DmxFrame frame(buffer);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA), frame.Size());
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA, frame.GetRaw(), frame.Size()));
+  OLA_ASSERT_NE(buffer.GetRaw(), frame.GetRaw());
+
+  buffer.Set(TEST_DATA2, sizeof(TEST_DATA2));
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA), frame.Size());
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA, frame.GetRaw(), frame.Size()));
+
+  // data past the end of the universe is dropped
+  uint8_t large_data[DMX_UNIVERSE_SIZE + 10];
+  memset(large_data, 1, sizeof(large_data));
+  DmxFrame large_frame(large_data, sizeof(large_data));
+  OLA_ASSERT_EQ((unsigned int) DMX_UNIVERSE_SIZE, large_frame.Size());
+
+  DmxFrame null_frame(NULL, 10);
+  OLA_ASSERT_EQ(0u, null_frame.Size());
+}
+
+
+/*
+ * Check that copies share the data.
+ */
+void DmxFrameTest::testSharing() {
+  DmxFrame frame1(TEST_DATA, sizeof(TEST_DATA));
+  DmxFrame frame2(frame1);
+  OLA_ASSERT_EQ(frame1.GetRaw(), frame2.GetRaw());
+  OLA_ASSERT_TRUE(frame1 == frame2);
+
+  DmxFrame frame3(TEST_DATA2, sizeof(TEST_DATA2));
+  OLA_ASSERT_TRUE(frame1 != frame3);
+  frame3 = frame1;
+  OLA_ASSERT_EQ(frame1.GetRaw(), frame3.GetRaw());
+
+  // releasing one copy leaves the others alone
+  frame1.Reset();
+  OLA_ASSERT_EQ(0u, frame1.Size());
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA), frame2.Size());
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA, frame3.GetRaw(), frame3.Size()));
+
+  frame2 = frame2;
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA, frame2.GetRaw(), frame2.Size()));
+
+  // a frame with the same contents is equal
+  DmxFrame frame4(DmxBuffer(TEST_DATA, sizeof(TEST_DATA)));
+  OLA_ASSERT_TRUE(frame2 == frame4);
+}
+
+
+/*
+ * Check the accessors match DmxBuffer.
+ */
+void DmxFrameTest::testGet() {
+  DmxBuffer buffer(TEST_DATA2, sizeof(TEST_DATA2));
+  DmxFrame frame(buffer);
+
+  for (unsigned int i = 0; i < buffer.Size() + 2; i++)
+    OLA_ASSERT_EQ(buffer.Get(i), frame.Get(i));
+
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  unsigned int length = 4;
+  frame.Get(data, &length);
+  OLA_ASSERT_EQ(4u, length);
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA2, data, length));
+
+  length = sizeof(data);
+  frame.Get(data, &length);
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA2), length);
+
+  length = sizeof(data);
+  frame.GetRange(6, data, &length);
+  OLA_ASSERT_EQ(3u, length);
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA2 + 6, data, length));
+
+  length = sizeof(data);
+  frame.GetRange(20, data, &length);
+  OLA_ASSERT_EQ(0u, length);
+
+  DmxBuffer output;
+  OLA_ASSERT_TRUE(frame.CopyTo(&output));
+  OLA_ASSERT_TRUE(buffer == output);
+  OLA_ASSERT_TRUE(DmxFrame().CopyTo(&output));
+  OLA_ASSERT_EQ(0u, output.Size());
+}
+
+
+static const unsigned int THREAD_ITERATIONS = 100000;
+
+/*
+ * Copy & release a shared frame, while taking new snapshots.
+ */
+void *ShareFrame(void *arg) {
+  const DmxFrame *shared = reinterpret_cast<const DmxFrame*>(arg);
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  for (unsigned int i = 0; i < THREAD_ITERATIONS; i++) {
+    DmxFrame copy(*shared);
+    memset(data, i, sizeof(data));
+    DmxFrame snapshot(data, sizeof(data));
+    copy = snapshot;
+    if (copy.Get(0) != (i & 0xff) || copy.Get(DMX_UNIVERSE_SIZE - 1) !=
+        (i & 0xff))
+      return arg;
+  }
+  return NULL;
+}
+
+
+/*
+ * Check that frames can be shared between threads.
+ */
+void DmxFrameTest::testThreads() {
+  const unsigned int thread_count = 4;
+  DmxFrame shared(TEST_DATA, sizeof(TEST_DATA));
+  pthread_t threads[thread_count];
+
+  for (unsigned int i = 0; i < thread_count; i++) {
+    OLA_ASSERT_EQ(0, pthread_create(&threads[i], NULL, ShareFrame,
+                                    const_cast<DmxFrame*>(&shared)));
+  }
+  for (unsigned int i = 0; i < thread_count; i++) {
+    void *result;
+    pthread_join(threads[i], &result);
+    OLA_ASSERT_EQ(static_cast<void*>(NULL), result);
+  }
+  OLA_ASSERT_EQ((unsigned int) sizeof(TEST_DATA), shared.Size());
+  OLA_ASSERT_EQ(0, memcmp(TEST_DATA, shared.GetRaw(), shared.Size()));
+}
@@ -0,0 +1,356 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SharedDmxRegion.cpp
+ * A block of shared memory used to pass DMX data from a local client to olad.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SHM_OPEN
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "common/utils/SharedDmxRegion.h"
+#include "ola/Logging.h"
+
+namespace ola {
+
+using std::string;
+
+const char SharedDmxRegion::NAME_PREFIX[] = "/ola-dmx-";
+
+#ifdef HAVE_SHM_OPEN
+/*
+ * Reading past the end of a region that the client has shrunk raises SIGBUS.
+ * While a slot is read, read_recovery points at the place to jump back to.
+ */
+static __thread sigjmp_buf *read_recovery = NULL;
+static struct sigaction previous_sigbus_action;
+static bool sigbus_handler_installed = false;
+
+static void HandleSigBus(int signal, siginfo_t *info, void *context) {
+  if (read_recovery)
+    siglongjmp(*read_recovery, 1);
+
+  // Not from a read, put the old handler back for when the access is retried.
+  sigaction(SIGBUS, &previous_sigbus_action, NULL);
+  (void) signal;
+  (void) info;
+  (void) context;
+}
+
+
+/*
+ * Install the SIGBUS handler. SA_NODEFER means the signal isn't left blocked
+ * when we jump out of the handler, so sigsetjmp() doesn't need to save the
+ * signal mask.
+ */
+static void InstallSigBusHandler() {
+  if (sigbus_handler_installed)
+    return;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = HandleSigBus;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGBUS, &action, &previous_sigbus_action)) {
+    OLA_WARN << "Failed to install SIGBUS handler: " << strerror(errno);
+    return;
+  }
+  sigbus_handler_installed = true;
+}
+#endif
+
+
+SharedDmxRegion::SharedDmxRegion(const string &name,
+                                 uint8_t *region,
+                                 unsigned int size,
+                                 unsigned int slot_count,
+                                 bool owner)
+    : m_name(name),
+      m_region(region),
+      m_size(size),
+      m_slot_count(slot_count),
+      m_owner(owner),
+      m_last_sequence(slot_count, 0) {
+}
+
+
+SharedDmxRegion::~SharedDmxRegion() {
+#ifdef HAVE_SHM_OPEN
+  if (m_owner)
+    Unlink();
+  munmap(m_region, m_size);
+#endif
+}
+
+
+/*
+ * Create a new region.
+ * @param slot_count the number of universes the region can hold.
+ * @returns a new SharedDmxRegion or NULL if the region couldn't be created.
+ */
+SharedDmxRegion *SharedDmxRegion::Create(unsigned int slot_count) {
+#ifdef HAVE_SHM_OPEN
+  static unsigned int counter = 0;
+  if (slot_count == 0 || slot_count > MAX_SLOTS)
+    return NULL;
+
+  string name;
+  int fd = -1;
+  for (unsigned int i = 0; i < MAX_CREATE_ATTEMPTS && fd < 0; i++) {
+    std::stringstream str;
+    str << NAME_PREFIX << getpid() << "-" << counter++;
+    name = str.str();
+    // the server must run as the same user, or root, to map the region
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  }
+
+  if (fd < 0) {
+    OLA_WARN << "Failed to create shared DMX region: " << strerror(errno);
+    return NULL;
+  }
+
+  unsigned int size = RegionSize(slot_count);
+  if (ftruncate(fd, size)) {
+    OLA_WARN << "Failed to size " << name << ": " << strerror(errno);
+    close(fd);
+    shm_unlink(name.c_str());
+    return NULL;
+  }
+
+  void *region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    OLA_WARN << "Failed to map " << name << ": " << strerror(errno);
+    shm_unlink(name.c_str());
+    return NULL;
+  }
+
+  // ftruncate zeros the region, so all the sequence numbers start at 0
+  RegionHeader *header = reinterpret_cast<RegionHeader*>(region);
+  header->magic = REGION_MAGIC;
+  header->version = REGION_VERSION;
+  header->slot_count = slot_count;
+  return new SharedDmxRegion(name, reinterpret_cast<uint8_t*>(region), size,
+                             slot_count, true);
+#else
+  (void) slot_count;
+  return NULL;
+#endif
+}
+
+
+/*
+ * Map a region created by a client. Open() must only be called from one
+ * thread.
+ * @param name the name of the region
+ * @param owner the user the region must belong to, this is the user at the
+ *   other end of the connection.
+ * @returns a new SharedDmxRegion or NULL if the region wasn't valid.
+ */
+SharedDmxRegion *SharedDmxRegion::Open(const string &name, uid_t owner) {
+#ifdef HAVE_SHM_OPEN
+  // only allow regions created by Create()
+  if (name.compare(0, sizeof(NAME_PREFIX) - 1, NAME_PREFIX) ||
+      name.find('/', 1) != string::npos) {
+    OLA_WARN << "Invalid shared DMX region name: " << name;
+    return NULL;
+  }
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    OLA_WARN << "Failed to open " << name << ": " << strerror(errno);
+    return NULL;
+  }
+
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) ||
+      stat_buf.st_size < static_cast<off_t>(sizeof(RegionHeader)) ||
+      stat_buf.st_size > static_cast<off_t>(RegionSize(MAX_SLOTS))) {
+    OLA_WARN << "Invalid size for shared DMX region " << name;
+    close(fd);
+    return NULL;
+  }
+
+  if (stat_buf.st_uid != owner) {
+    OLA_WARN << "Shared DMX region " << name << " belongs to uid " <<
+      stat_buf.st_uid << ", not " << owner;
+    close(fd);
+    return NULL;
+  }
+
+  unsigned int size = static_cast<unsigned int>(stat_buf.st_size);
+  void *region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    OLA_WARN << "Failed to map " << name << ": " << strerror(errno);
+    return NULL;
+  }
+
+  InstallSigBusHandler();
+  const RegionHeader *header = reinterpret_cast<RegionHeader*>(region);
+  unsigned int slot_count = header->slot_count;
+  if (header->magic != REGION_MAGIC || header->version != REGION_VERSION ||
+      slot_count > MAX_SLOTS || RegionSize(slot_count) != size) {
+    OLA_WARN << "Invalid header for shared DMX region " << name;
+    munmap(region, size);
+    return NULL;
+  }
+  return new SharedDmxRegion(name, reinterpret_cast<uint8_t*>(region), size,
+                             slot_count, false);
+#else
+  OLA_WARN << "Shared memory isn't supported, can't open " << name;
+  (void) owner;
+  return NULL;
+#endif
+}
+
+
+/*
+ * Remove the name of the region. The memory remains mapped until both ends
+ * have deleted their SharedDmxRegion.
+ */
+void SharedDmxRegion::Unlink() {
+#ifdef HAVE_SHM_OPEN
+  if (!m_name.empty()) {
+    shm_unlink(m_name.c_str());
+    m_name.clear();
+  }
+#endif
+}
+
+
+/*
+ * Write the data for a universe to a slot.
+ * @returns false if the slot is out of range.
+ */
+bool SharedDmxRegion::Write(unsigned int slot,
+                            unsigned int universe,
+                            const DmxBuffer &data,
+                            bool has_priority,
+                            uint8_t priority) {
+  if (slot >= m_slot_count)
+    return false;
+
+  Slot *dest = SlotAt(slot);
+  uint32_t sequence = dest->sequence;
+  dest->sequence = sequence + 1;
+  __sync_synchronize();
+
+  dest->universe = universe;
+  dest->length = static_cast<uint16_t>(data.Size());
+  dest->flags = has_priority ? HAS_PRIORITY_FLAG : 0;
+  dest->priority = priority;
+  memcpy(dest->data, data.GetRaw(), data.Size());
+
+  __sync_synchronize();
+  dest->sequence = sequence + 2;
+  return true;
+}
+
+
+/*
+ * Read a slot if it's changed since the last call.
+ * @returns true if the slot had new data, false if it was unchanged, invalid
+ *   or in the middle of being written. A slot that's being written will be
+ *   picked up on the next call.
+ */
+bool SharedDmxRegion::ReadIfChanged(unsigned int slot,
+                                    unsigned int *universe,
+                                    DmxBuffer *data,
+                                    bool *has_priority,
+                                    uint8_t *priority) {
+  if (slot >= m_slot_count)
+    return false;
+
+#ifdef HAVE_SHM_OPEN
+  if (!m_owner) {
+    sigjmp_buf recovery;
+    if (sigsetjmp(recovery, 0)) {
+      read_recovery = NULL;
+      OLA_WARN << "Shared DMX region was truncated, ignoring it";
+      m_slot_count = 0;
+      return false;
+    }
+    read_recovery = &recovery;
+    bool ok = ReadSlot(slot, universe, data, has_priority, priority);
+    read_recovery = NULL;
+    return ok;
+  }
+#endif
+  return ReadSlot(slot, universe, data, has_priority, priority);
+}
+
+
+/*
+ * Read a slot, see ReadIfChanged().
+ */
+bool SharedDmxRegion::ReadSlot(unsigned int slot,
+                               unsigned int *universe,
+                               DmxBuffer *data,
+                               bool *has_priority,
+                               uint8_t *priority) {
+  const Slot *source = SlotAt(slot);
+  Slot copy;
+  for (unsigned int i = 0; i < MAX_READ_ATTEMPTS; i++) {
+    uint32_t sequence = source->sequence;
+    if (sequence == m_last_sequence[slot])
+      return false;
+    if (sequence & 1)
+      continue;
+
+    __sync_synchronize();
+    copy.universe = source->universe;
+    copy.length = source->length;
+    copy.flags = source->flags;
+    copy.priority = source->priority;
+    memcpy(copy.data, source->data,
+           std::min(static_cast<unsigned int>(copy.length),
+                    static_cast<unsigned int>(DMX_UNIVERSE_SIZE)));
+    __sync_synchronize();
+
+    if (source->sequence != sequence)
+      continue;
+
+    m_last_sequence[slot] = sequence;
+    if (copy.length > DMX_UNIVERSE_SIZE)
+      return false;
+
+    *universe = copy.universe;
+    data->Set(copy.data, copy.length);
+    *has_priority = copy.flags & HAS_PRIORITY_FLAG;
+    *priority = copy.priority;
+    return true;
+  }
+  return false;
+}
+}  // namespace ola
@@ -0,0 +1,136 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SharedDmxRegion.h
+ * A block of shared memory used to pass DMX data from a local client to olad.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * The region is created by the client, and holds a fixed number of slots,
+ * each of which contains the data for one universe. The server maps the
+ * region read-only. After the client writes to one or more slots, it sends a
+ * small RPC to tell the server to check the slots for changes. The DMX data
+ * itself never goes through the socket.
+ *
+ * Each slot is protected by a sequence counter. The writer makes the counter
+ * odd while the slot is being updated, and even once it's done. The reader
+ * only accepts data if the counter was even and didn't change while it was
+ * copying the slot. The counter also tells the reader which slots have
+ * changed since it last looked.
+ *
+ * The server only maps regions owned by the user at the other end of the
+ * connection. The client can still shrink its region after the server has
+ * mapped it, so reads from the mapping recover from the SIGBUS that causes.
+ */
+
+#ifndef COMMON_UTILS_SHAREDDMXREGION_H_
+#define COMMON_UTILS_SHAREDDMXREGION_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <ola/BaseTypes.h>
+#include <ola/DmxBuffer.h>
+#include <string>
+#include <vector>
+
+namespace ola {
+
+class SharedDmxRegion {
+  public:
+    ~SharedDmxRegion();
+
+    // Create a new region, this is used by the client.
+    static SharedDmxRegion *Create(unsigned int slot_count);
+    // Map an existing region owned by a user, this is used by the server.
+    static SharedDmxRegion *Open(const std::string &name, uid_t owner);
+
+    const std::string &Name() const { return m_name; }
+    unsigned int SlotCount() const { return m_slot_count; }
+
+    // Remove the name, once both ends have mapped the region.
+    void Unlink();
+
+    // Write the data for a universe to a slot, this is used by the client.
+    bool Write(unsigned int slot,
+               unsigned int universe,
+               const DmxBuffer &data,
+               bool has_priority,
+               uint8_t priority);
+
+    // Read a slot, this is used by the server.
+    bool ReadIfChanged(unsigned int slot,
+                       unsigned int *universe,
+                       DmxBuffer *data,
+                       bool *has_priority,
+                       uint8_t *priority);
+
+    static const unsigned int MAX_SLOTS = 4096;
+
+  private:
+    struct RegionHeader {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t slot_count;
+      uint32_t reserved;
+    };
+
+    struct Slot {
+      volatile uint32_t sequence;
+      uint32_t universe;
+      uint16_t length;
+      uint8_t flags;
+      uint8_t priority;
+      uint8_t data[DMX_UNIVERSE_SIZE];
+    };
+
+    std::string m_name;
+    uint8_t *m_region;
+    unsigned int m_size;
+    unsigned int m_slot_count;
+    bool m_owner;
+    // the last sequence number we read from each slot
+    std::vector<uint32_t> m_last_sequence;
+
+    SharedDmxRegion(const std::string &name,
+                    uint8_t *region,
+                    unsigned int size,
+                    unsigned int slot_count,
+                    bool owner);
+
+    bool ReadSlot(unsigned int slot,
+                  unsigned int *universe,
+                  DmxBuffer *data,
+                  bool *has_priority,
+                  uint8_t *priority);
+
+    Slot *SlotAt(unsigned int slot) const {
+      return reinterpret_cast<Slot*>(m_region + sizeof(RegionHeader)) + slot;
+    }
+
+    static unsigned int RegionSize(unsigned int slot_count) {
+      return sizeof(RegionHeader) + slot_count * sizeof(Slot);
+    }
+
+    static const uint32_t REGION_MAGIC = 0x4f4c4144;  // "OLAD"
+    static const uint32_t REGION_VERSION = 1;
+    static const uint8_t HAS_PRIORITY_FLAG = 0x01;
+    static const unsigned int MAX_CREATE_ATTEMPTS = 4;
+    static const unsigned int MAX_READ_ATTEMPTS = 4;
+    static const char NAME_PREFIX[];
+
+    SharedDmxRegion(const SharedDmxRegion&);
+    SharedDmxRegion& operator=(const SharedDmxRegion&);
+};
+}  // namespace ola
+#endif  // COMMON_UTILS_SHAREDDMXREGION_H_
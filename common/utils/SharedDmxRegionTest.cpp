@@ -0,0 +1,176 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * SharedDmxRegionTest.cpp
+ * Test fixture for the SharedDmxRegion class
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SHM_OPEN
+#include <sys/mman.h>
+#endif
+#include <memory>
+#include <string>
+
+#include "common/utils/SharedDmxRegion.h"
+#include "ola/DmxBuffer.h"
+#include "ola/Logging.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::SharedDmxRegion;
+using std::auto_ptr;
+using std::string;
+
+
+class SharedDmxRegionTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(SharedDmxRegionTest);
+#ifdef HAVE_SHM_OPEN
+  CPPUNIT_TEST(testReadWrite);
+  CPPUNIT_TEST(testOpen);
+  CPPUNIT_TEST(testTruncated);
+#endif
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void testReadWrite();
+    void testOpen();
+    void testTruncated();
+
+    void setUp() {
+      ola::InitLogging(ola::OLA_LOG_INFO, ola::OLA_LOG_STDERR);
+    }
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SharedDmxRegionTest);
+
+
+/*
+ * Check that data written by the client can be read by the server.
+ */
+void SharedDmxRegionTest::testReadWrite() {
+  auto_ptr<SharedDmxRegion> writer(SharedDmxRegion::Create(2));
+  OLA_ASSERT_NOT_NULL(writer.get());
+  OLA_ASSERT_EQ(2u, writer->SlotCount());
+  auto_ptr<SharedDmxRegion> reader(SharedDmxRegion::Open(writer->Name(),
+                                                         geteuid()));
+  OLA_ASSERT_NOT_NULL(reader.get());
+  OLA_ASSERT_EQ(2u, reader->SlotCount());
+
+  // once both ends have it mapped, the name can go
+  writer->Unlink();
+  OLA_ASSERT_EQ(string(""), writer->Name());
+
+  unsigned int universe;
+  DmxBuffer data;
+  bool has_priority;
+  uint8_t priority;
+  OLA_ASSERT_FALSE(reader->ReadIfChanged(0, &universe, &data, &has_priority,
+                                         &priority));
+
+  DmxBuffer buffer;
+  buffer.SetFromString("1,2,3,4");
+  OLA_ASSERT_TRUE(writer->Write(1, 10, buffer, true, 150));
+  OLA_ASSERT_FALSE(writer->Write(2, 10, buffer, true, 150));
+
+  OLA_ASSERT_FALSE(reader->ReadIfChanged(0, &universe, &data, &has_priority,
+                                         &priority));
+  OLA_ASSERT_TRUE(reader->ReadIfChanged(1, &universe, &data, &has_priority,
+                                        &priority));
+  OLA_ASSERT_EQ(10u, universe);
+  OLA_ASSERT_TRUE(buffer == data);
+  OLA_ASSERT_TRUE(has_priority);
+  OLA_ASSERT_EQ((uint8_t) 150, priority);
+
+  // nothing has changed since the last read
+  OLA_ASSERT_FALSE(reader->ReadIfChanged(1, &universe, &data, &has_priority,
+                                         &priority));
+
+  // only the latest write is seen
+  DmxBuffer buffer2;
+  buffer2.SetFromString("5,6");
+  OLA_ASSERT_TRUE(writer->Write(1, 11, buffer, false, 0));
+  OLA_ASSERT_TRUE(writer->Write(1, 11, buffer2, false, 0));
+  OLA_ASSERT_TRUE(reader->ReadIfChanged(1, &universe, &data, &has_priority,
+                                        &priority));
+  OLA_ASSERT_EQ(11u, universe);
+  OLA_ASSERT_TRUE(buffer2 == data);
+  OLA_ASSERT_FALSE(has_priority);
+}
+
+
+/*
+ * Check that only valid regions can be opened.
+ */
+void SharedDmxRegionTest::testOpen() {
+  OLA_ASSERT_NULL(SharedDmxRegion::Create(0));
+  OLA_ASSERT_NULL(SharedDmxRegion::Create(SharedDmxRegion::MAX_SLOTS + 1));
+
+  const uid_t uid = geteuid();
+  OLA_ASSERT_NULL(SharedDmxRegion::Open("/ola-dmx-does-not-exist", uid));
+  OLA_ASSERT_NULL(SharedDmxRegion::Open("/tmp-foo", uid));
+  OLA_ASSERT_NULL(SharedDmxRegion::Open("/ola-dmx-../foo", uid));
+
+  // the name is removed when the writer is deleted
+  string name;
+  {
+    auto_ptr<SharedDmxRegion> writer(SharedDmxRegion::Create(1));
+    OLA_ASSERT_NOT_NULL(writer.get());
+    name = writer->Name();
+
+    // regions that belong to another user are refused
+    OLA_ASSERT_NULL(SharedDmxRegion::Open(name, uid + 1));
+  }
+  OLA_ASSERT_NULL(SharedDmxRegion::Open(name, uid));
+}
+
+
+/*
+ * Check the reader survives the client shrinking the region.
+ */
+void SharedDmxRegionTest::testTruncated() {
+  auto_ptr<SharedDmxRegion> writer(SharedDmxRegion::Create(2));
+  OLA_ASSERT_NOT_NULL(writer.get());
+  auto_ptr<SharedDmxRegion> reader(SharedDmxRegion::Open(writer->Name(),
+                                                         geteuid()));
+  OLA_ASSERT_NOT_NULL(reader.get());
+
+  DmxBuffer buffer;
+  buffer.SetFromString("1,2,3,4");
+  OLA_ASSERT_TRUE(writer->Write(1, 10, buffer, false, 0));
+
+  int fd = shm_open(writer->Name().c_str(), O_RDWR, 0);
+  OLA_ASSERT_TRUE(fd >= 0);
+  OLA_ASSERT_EQ(0, ftruncate(fd, 0));
+  close(fd);
+
+  unsigned int universe;
+  DmxBuffer data;
+  bool has_priority;
+  uint8_t priority;
+  OLA_ASSERT_FALSE(reader->ReadIfChanged(1, &universe, &data, &has_priority,
+                                         &priority));
+  // the region is ignored from now on
+  OLA_ASSERT_FALSE(reader->ReadIfChanged(0, &universe, &data, &has_priority,
+                                         &priority));
+}
@@ -21,6 +21,8 @@
 #include <errno.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <ola/Clock.h>
+#include <ola/DmxBatch.h>
 #include <ola/DmxBuffer.h>
 #include <ola/Logging.h>
 #include <ola/StreamingClient.h>
@@ -32,12 +34,17 @@
 using std::cout;
 using std::endl;
 using std::string;
+using ola::DmxBatch;
+using ola::DmxUpdate;
 using ola::StreamingClient;
 
 
 typedef struct {
   unsigned int universe;
+  unsigned int universe_count;
   unsigned int sleep_time;
+  bool batch;
+  bool shared_memory;
   bool help;
 } options;
 
@@ -47,7 +54,10 @@ typedef struct {
  */
 void ParseOptions(int argc, char *argv[], options *opts) {
   static struct option long_options[] = {
+      {"batch", no_argument, 0, 'b'},
+      {"count", required_argument, 0, 'c'},
       {"help", no_argument, 0, 'h'},
+      {"shared-memory", no_argument, 0, 'm'},
       {"sleep", required_argument, 0, 's'},
       {"universe", required_argument, 0, 'u'},
       {0, 0, 0, 0}
@@ -55,13 +65,16 @@ void ParseOptions(int argc, char *argv[], options *opts) {
 
   opts->sleep_time = 40000;
   opts->universe = 1;
+  opts->universe_count = 1;
+  opts->batch = false;
+  opts->shared_memory = false;
   opts->help = false;
 
   int c;
   int option_index = 0;
 
   while (1) {
-    c = getopt_long(argc, argv, "hs:u:", long_options, &option_index);
+    c = getopt_long(argc, argv, "bc:hms:u:", long_options, &option_index);
 
     if (c == -1)
       break;
@@ -69,9 +82,18 @@ void ParseOptions(int argc, char *argv[], options *opts) {
     switch (c) {
       case 0:
         break;
+      case 'b':
+        opts->batch = true;
+        break;
+      case 'c':
+        opts->universe_count = atoi(optarg);
+        break;
       case 'h':
         opts->help = true;
         break;
+      case 'm':
+        opts->shared_memory = true;
+        break;
       case 's':
         opts->sleep_time = atoi(optarg);
         break;
@@ -92,11 +114,16 @@ void ParseOptions(int argc, char *argv[], options *opts) {
  */
 void DisplayHelpAndExit(char arg[]) {
   cout << "Usage: " << arg <<
-  " --dmx <dmx_data> --universe <universe_id>\n"
+  " --universe <universe_id> --count <universes>\n"
   "\n"
-  "Send DMX512 data to OLA. If dmx data isn't provided we read from stdin.\n"
+  "Send DMX512 data to OLA as fast as possible, to load test the server.\n"
   "\n"
+  "  -b, --batch                  Send all the universes in a single message.\n"
+  "  -c, --count <universes>      The number of universes to send, from the\n"
+  "                               one given by --universe.\n"
   "  -h, --help                   Display this help message and exit.\n"
+  "  -m, --shared-memory          Send the data using shared memory, this\n"
+  "                               requires olad to be run with --shared-dmx.\n"
   "  -s, --sleep <time_in_uS>     Time to sleep between frames.\n"
   "  -u, --universe <universe_id> Id of universe to send data for.\n"
   << endl;
@@ -109,7 +136,6 @@ void DisplayHelpAndExit(char arg[]) {
  */
 int main(int argc, char *argv[]) {
   ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
-  StreamingClient ola_client;
   options opts;
 
   ParseOptions(argc, argv, &opts);
@@ -117,20 +143,54 @@ int main(int argc, char *argv[]) {
   if (opts.help)
     DisplayHelpAndExit(argv[0]);
 
+  // Shared memory is used by default, so turn it off unless we're asked for
+  // it, otherwise the socket can't be measured.
+  StreamingClient::Options client_options;
+  client_options.shared_dmx_slots = opts.shared_memory ? opts.universe_count :
+                                    0;
+  StreamingClient ola_client(client_options);
+
   if (!ola_client.Setup()) {
     OLA_FATAL << "Setup failed";
     exit(1);
   }
 
+  ola::DmxBuffer buffer;
+  buffer.Blackout();
+  DmxBatch batch;
+  for (unsigned int i = 0; i < opts.universe_count; i++)
+    batch.push_back(DmxUpdate(opts.universe + i, buffer));
+
+  ola::Clock clock;
+  ola::TimeStamp now, last_report;
+  clock.CurrentTime(&last_report);
+  unsigned int frames = 0;
+
   while (1) {
     usleep(opts.sleep_time);
-    ola::DmxBuffer buffer;
-    buffer.Blackout();
 
-    if (!ola_client.SendDmx(opts.universe, buffer)) {
+    bool ok = true;
+    if (opts.batch) {
+      ok = ola_client.SendDmxBatch(batch);
+    } else {
+      DmxBatch::const_iterator iter = batch.begin();
+      for (; ok && iter != batch.end(); ++iter)
+        ok = ola_client.SendDmx(iter->Universe(), iter->Data());
+    }
+
+    if (!ok) {
       cout << "Send DMX failed" << endl;
       return false;
     }
+
+    frames += batch.size();
+    clock.CurrentTime(&now);
+    if (now - last_report >= ola::TimeInterval(1, 0)) {
+      cout << frames << " universe frames in " << (now - last_report) << "s"
+           << endl;
+      frames = 0;
+      last_report = now;
+    }
   }
   return 0;
 }
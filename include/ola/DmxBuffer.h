@@ -46,6 +46,13 @@ class DmxBuffer {
     unsigned int Size() const { return m_length; }
 
     bool HTPMerge(const DmxBuffer &other);
+    bool SetFromHTPMerge(const DmxBuffer *const sources[], unsigned int count);
+    bool SetFromPriorityMerge(const DmxBuffer *const sources[],
+                              const DmxBuffer *const slot_priorities[],
+                              const uint8_t priorities[],
+                              unsigned int count,
+                              bool htp_merge,
+                              DmxBuffer *merged_priorities = NULL);
     bool Set(const uint8_t *data, unsigned int length);
     bool Set(const string &data);
     bool Set(const DmxBuffer &other);
@@ -65,15 +72,28 @@ class DmxBuffer {
     void Reset();
     string ToString() const;
 
+    /*
+     * The buffer records the range of slots that have been modified since the
+     * last call to Checkpoint(). Set() only records the slots that actually
+     * differ, while copying a buffer also copies the modified range.
+     */
+    void Checkpoint();
+    bool Changed() const { return m_changed_start < m_changed_end; }
+    bool GetChangedRange(unsigned int *slot, unsigned int *length) const;
+
   private:
     bool Init();
     bool DuplicateIfNeeded();
     void CopyFromOther(const DmxBuffer &other);
     void CleanupMemory();
+    void MarkChanged(unsigned int start, unsigned int end);
+    void MarkDifferences(const uint8_t *data, unsigned int length);
     unsigned int *m_ref_count;
     mutable bool m_copy_on_write;
     uint8_t *m_data;
     unsigned int m_length;
+    unsigned int m_changed_start;
+    unsigned int m_changed_end;
 };
 
 std::ostream& operator<<(std::ostream &out, const DmxBuffer &data);
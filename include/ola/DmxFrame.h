@@ -0,0 +1,85 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxFrame.h
+ * An immutable snapshot of DMX data that can be shared between threads.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * A DmxFrame is taken from a DmxBuffer (or raw data) and can't be changed
+ * afterwards. Copying a frame just bumps an atomic reference count, so
+ * frames can be passed between threads without copying the data, as long as
+ * the DmxFrame object itself isn't accessed by two threads at once.
+ *
+ * The frame data comes from a pool, which grows a slab at a time, so taking
+ * a snapshot doesn't hit the heap once the pool has warmed up.
+ */
+
+#ifndef INCLUDE_OLA_DMXFRAME_H_
+#define INCLUDE_OLA_DMXFRAME_H_
+
+#include <stdint.h>
+#include <ola/BaseTypes.h>
+#include <ola/DmxBuffer.h>
+
+namespace ola {
+
+class DmxFrame {
+  public:
+    DmxFrame();
+    explicit DmxFrame(const DmxBuffer &buffer);
+    DmxFrame(const uint8_t *data, unsigned int length);
+    DmxFrame(const DmxFrame &other);
+    ~DmxFrame();
+    DmxFrame& operator=(const DmxFrame &other);
+
+    bool operator==(const DmxFrame &other) const;
+    bool operator!=(const DmxFrame &other) const;
+
+    // These match the read-only methods of DmxBuffer.
+    unsigned int Size() const { return m_frame ? m_frame->length : 0; }
+    const uint8_t *GetRaw() const { return m_frame ? m_frame->data : NULL; }
+    uint8_t Get(unsigned int channel) const;
+    void Get(uint8_t *data, unsigned int *length) const;
+    void GetRange(unsigned int slot, uint8_t *data,
+                  unsigned int *length) const;
+
+    // Copy the data into a DmxBuffer.
+    bool CopyTo(DmxBuffer *buffer) const;
+
+    // Release the data, the frame will be empty.
+    void Reset();
+
+  private:
+    struct FrameData {
+      FrameData *next_free;
+      int ref_count;
+      unsigned int length;
+      uint8_t data[DMX_UNIVERSE_SIZE];
+    };
+
+    FrameData *m_frame;
+
+    void Init(const uint8_t *data, unsigned int length);
+
+    static FrameData *Allocate();
+    static void Release(FrameData *frame);
+
+    // the unused frames, protected by a mutex in DmxFrame.cpp
+    static FrameData *free_frames;
+
+    static const unsigned int K_SLAB_SIZE;
+};
+}  // namespace ola
+#endif  // INCLUDE_OLA_DMXFRAME_H_
@@ -21,6 +21,7 @@
 #ifndef INCLUDE_OLA_EXPORTMAP_H_
 #define INCLUDE_OLA_EXPORTMAP_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <functional>
 #include <map>
@@ -44,8 +45,11 @@ class BaseVariable {
     explicit BaseVariable(const string &name): m_name(name) {}
     virtual ~BaseVariable() {}
 
-    const string Name() const { return m_name; }
+    const string &Name() const { return m_name; }
     virtual const string Value() const = 0;
+    // Append the variable to output in the Prometheus text format. Variables
+    // which aren't numbers, like strings, don't append anything.
+    virtual void AppendPrometheus(string*) const {}
 
   private:
     string m_name;
@@ -73,6 +77,7 @@ class BoolVariable: public BaseVariable {
     void Set(bool value) { m_value = value; }
     bool Get() const { return m_value; }
     const string Value() const { return m_value ? "1" : "0"; }
+    void AppendPrometheus(string *output) const;
 
   private:
     bool m_value;
@@ -118,12 +123,54 @@ class IntegerVariable: public BaseVariable {
       out << m_value;
       return out.str();
     }
+    void AppendPrometheus(string *output) const;
 
   private:
     int m_value;
 };
 
 
+/*
+ * A handle to a single counter, either a CounterVariable or an entry in a
+ * UIntMap. The counter is looked up once when the handle is created, after
+ * that updating it is a single atomic operation, so handles are what hot
+ * paths should use, including ones that run outside the thread that owns the
+ * ExportMap. A default constructed handle isn't bound to anything and ignores
+ * updates, which saves checking if there is an ExportMap each time.
+ *
+ * A handle to a map entry is invalid once the entry is removed from the map.
+ */
+class CounterHandle {
+  public:
+    CounterHandle(): m_value(NULL) {}
+    explicit CounterHandle(unsigned int *value): m_value(value) {}
+
+    bool IsBound() const { return m_value != NULL; }
+    void operator++(int) {
+      if (m_value)
+        __sync_fetch_and_add(m_value, 1);
+    }
+    void operator--(int) {
+      if (m_value)
+        __sync_fetch_and_sub(m_value, 1);
+    }
+    void operator+=(unsigned int value) {
+      if (m_value)
+        __sync_fetch_and_add(m_value, value);
+    }
+    void Set(unsigned int value) {
+      if (m_value)
+        __sync_lock_test_and_set(m_value, value);
+    }
+    unsigned int Get() const {
+      return m_value ? __sync_fetch_and_add(m_value, 0) : 0;
+    }
+
+  private:
+    unsigned int *m_value;
+};
+
+
 /*
  * Represents a counter which can only be added to.
  */
@@ -138,17 +185,55 @@ class CounterVariable: public BaseVariable {
     void operator+=(unsigned int value) { m_value += value; }
     void Reset() { m_value = 0; }
     unsigned int Get() const { return m_value; }
+    CounterHandle Handle() { return CounterHandle(&m_value); }
     const string Value() const {
       stringstream out;
       out << m_value;
       return out.str();
     }
+    void AppendPrometheus(string *output) const;
 
   private:
     unsigned int m_value;
 };
 
 
+/*
+ * A counter which can be added to from many threads at once. Each thread adds
+ * to one of a handful of shards, and each shard has a cache line to itself, so
+ * threads bumping the counter don't fight over the same line. Reading the
+ * counter sums the shards, so it's slower than a CounterVariable to read.
+ */
+class ShardedCounterVariable: public BaseVariable {
+  public:
+    explicit ShardedCounterVariable(const string &name);
+    ~ShardedCounterVariable() {}
+
+    void operator++(int) { *this += 1; }
+    void operator+=(unsigned int value) {
+      __sync_fetch_and_add(&m_shards[ShardIndex()].value, value);
+    }
+    void Reset();
+    unsigned int Get() const;
+    const string Value() const;
+    void AppendPrometheus(string *output) const;
+
+    static const unsigned int SHARDS = 8;
+
+  private:
+    static const unsigned int CACHE_LINE_SIZE = 64;
+
+    struct Shard {
+      unsigned int value;
+      char padding[CACHE_LINE_SIZE - sizeof(unsigned int)];
+    };
+
+    mutable Shard m_shards[SHARDS];
+
+    static unsigned int ShardIndex();
+};
+
+
 /*
  * A Map variable holds string -> type mappings
  */
@@ -164,6 +249,7 @@ class MapVariable: public BaseVariable {
     void Set(const string &key, Type value);
     Type &operator[](const string &key);
     const string Value() const;
+    void AppendPrometheus(string *output) const;
     const string Label() const { return m_label; }
 
   protected:
@@ -203,6 +289,95 @@ class UIntMap: public MapVariable<unsigned int> {
     void Increment(const string &key) {
       m_variables[key]++;
     }
+
+    // Return a handle to the entry for key, creating it if it doesn't exist.
+    CounterHandle Handle(const string &key) {
+      return CounterHandle(&m_variables[key]);
+    }
+};
+
+
+/*
+ * A distribution of unsigned values, usually latencies in microseconds.
+ * Values from 4 up are counted in buckets a quarter of a power of two wide, so
+ * the percentiles are within 25% of the true value.
+ */
+class Histogram {
+  public:
+    Histogram() { Reset(); }
+
+    void Add(unsigned int value);
+    void Reset();
+
+    unsigned int Count() const { return m_count; }
+    unsigned int Max() const { return m_max; }
+    uint64_t Sum() const { return m_sum; }
+    // The smallest value that percent% of the values are less than or equal
+    // to, rounded up to the end of the bucket.
+    unsigned int Percentile(unsigned int percent) const;
+
+    // Append the histogram in the Prometheus text format, with cumulative
+    // buckets at each power of two. If label is empty the samples aren't
+    // labeled, otherwise they're labeled label="key". The caller appends the
+    // TYPE line.
+    void AppendPrometheus(string *output, const string &name,
+                          const string &label, const string &key) const;
+
+    static const unsigned int BUCKETS = 124;
+
+  private:
+    unsigned int m_count;
+    unsigned int m_max;
+    uint64_t m_sum;
+    unsigned int m_buckets[BUCKETS];
+
+    static unsigned int Bucket(unsigned int value);
+    static unsigned int BucketLimit(unsigned int bucket);
+};
+
+
+/*
+ * A single Histogram, for example the time taken to run a callback.
+ */
+class HistogramVariable: public BaseVariable {
+  public:
+    explicit HistogramVariable(const string &name): BaseVariable(name) {}
+    ~HistogramVariable() {}
+
+    void Add(unsigned int value) { m_histogram.Add(value); }
+    void Reset() { m_histogram.Reset(); }
+    const Histogram &Get() const { return m_histogram; }
+    const string Value() const;
+    void AppendPrometheus(string *output) const;
+
+  private:
+    Histogram m_histogram;
+};
+
+
+/*
+ * A map of string -> Histogram, for example the latency of each RPC method.
+ */
+class HistogramMap: public BaseVariable {
+  public:
+    HistogramMap(const string &name, const string &label)
+        : BaseVariable(name),
+          m_label(label) {
+    }
+    ~HistogramMap() {}
+
+    void Add(const string &key, unsigned int value) {
+      m_histograms[key].Add(value);
+    }
+    Histogram &operator[](const string &key) { return m_histograms[key]; }
+    void Remove(const string &key) { m_histograms.erase(key); }
+    const string Value() const;
+    void AppendPrometheus(string *output) const;
+    const string Label() const { return m_label; }
+
+  private:
+    map<string, Histogram> m_histograms;
+    string m_label;
 };
 
 
@@ -243,18 +418,33 @@ void MapVariable<Type>::Remove(const string &key) {
  */
 class ExportMap {
   public:
-    ExportMap() {}
+    // The prefix is added to the name of each variable.
+    explicit ExportMap(const string &prefix = ""): m_prefix(prefix) {}
     ~ExportMap();
     vector<BaseVariable*> AllVariables() const;
+    // Append all the variables in the Prometheus text format.
+    void AppendPrometheus(string *output) const;
+
+    /*
+     * Include the variables of another map in AllVariables() and
+     * AppendPrometheus(). This is used for the maps owned by other threads,
+     * each child should have a prefix so the names don't clash.
+     */
+    void AddChild(const ExportMap *child);
+    void RemoveChild(const ExportMap *child);
 
     BoolVariable *GetBoolVar(const string &name);
     IntegerVariable *GetIntegerVar(const string &name);
     CounterVariable *GetCounterVar(const string &name);
+    ShardedCounterVariable *GetShardedCounterVar(const string &name);
     StringVariable *GetStringVar(const string &name);
+    HistogramVariable *GetHistogramVar(const string &name);
 
     StringMap *GetStringMapVar(const string &name, const string &label="");
     IntMap *GetIntMapVar(const string &name, const string &label="");
     UIntMap *GetUIntMapVar(const string &name, const string &label="");
+    HistogramMap *GetHistogramMapVar(const string &name,
+                                     const string &label="");
 
   private :
     ExportMap(const ExportMap&);
@@ -275,14 +465,24 @@ class ExportMap {
     template<typename Type>
     void DeleteVariables(Type *var_map) const;
 
+    template<typename Type>
+    void AppendPrometheusVariables(string *output,
+                                   const Type &var_map) const;
+
+    const string m_prefix;
+    vector<const ExportMap*> m_children;
+
     map<string, BoolVariable*> m_bool_variables;
     map<string, CounterVariable*> m_counter_variables;
+    map<string, ShardedCounterVariable*> m_sharded_counter_variables;
     map<string, IntegerVariable*> m_int_variables;
     map<string, StringVariable*> m_string_variables;
+    map<string, HistogramVariable*> m_histogram_variables;
 
     map<string, StringMap*> m_str_map_variables;
     map<string, IntMap*> m_int_map_variables;
     map<string, UIntMap*> m_uint_map_variables;
+    map<string, HistogramMap*> m_histogram_map_variables;
 };
 }  // namespace ola
 #endif  // INCLUDE_OLA_EXPORTMAP_H_
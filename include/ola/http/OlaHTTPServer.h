@@ -53,6 +53,8 @@ class OlaHTTPServer {
     ExportMap *m_export_map;
     HTTPServer m_server;
     TimeStamp m_start_time;
+    // reused for each /metrics request
+    string m_metrics;
 
     /**
      * Register a static file to serve
@@ -76,6 +78,8 @@ class OlaHTTPServer {
     }
 
     int DisplayDebug(const HTTPRequest *request, HTTPResponse *response);
+    int DisplayMetrics(const HTTPRequest *request, HTTPResponse *response);
+    int DisplayTrace(const HTTPRequest *request, HTTPResponse *response);
     int DisplayHandlers(const HTTPRequest *request, HTTPResponse *response);
 };
 }  // namespace http
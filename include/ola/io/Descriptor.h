@@ -38,6 +38,8 @@
  *  - PipeDescriptor allows a pair of sockets to be created. Data written to
  *    socket A is available at FileDescriptor B and visa versa.
  *  - UnixSocket, similar to PipeDescriptor but uses unix domain sockets.
+ *    UnixSockets can also be connected to a named socket, which is listened
+ *    on by a UnixAcceptingSocket.
  *  - DeviceDescriptor, this is a generic ConnectedDescriptor. It can be used
  *    with file descriptors to handle local devices.
  */
@@ -50,6 +52,7 @@
 #include <ola/Callback.h>
 #include <ola/io/IOQueue.h>
 #include <string>
+#include <typeinfo>
 
 namespace ola {
 namespace io {
@@ -73,6 +76,14 @@ class ReadFileDescriptor {
 
     // Called when there is data to be read from this fd
     virtual void PerformRead() = 0;
+
+    // The name the time spent in PerformRead() is recorded under. If this is
+    // empty, the type of the object that PerformRead() hands off to is used.
+    // Both are read when the descriptor is registered.
+    virtual std::string ReadHandlerName() const { return ""; }
+    virtual const std::type_info &ReadHandlerType() const {
+      return typeid(*this);
+    }
 };
 
 
@@ -91,6 +102,12 @@ class WriteFileDescriptor {
 
     // This is called when the socket is ready to be written to
     virtual void PerformWrite() = 0;
+
+    // The name and type used to record the time spent in PerformWrite().
+    virtual std::string WriteHandlerName() const { return ""; }
+    virtual const std::type_info &WriteHandlerType() const {
+      return typeid(*this);
+    }
 };
 
 
@@ -127,9 +144,23 @@ class BidirectionalFileDescriptor: public ReadFileDescriptor,
     void PerformRead();
     void PerformWrite();
 
+    // Set the name that the time spent in the handlers is recorded under. This
+    // must be called before the descriptor is registered.
+    void SetName(const std::string &name) { m_name = name; }
+
+    std::string ReadHandlerName() const { return m_name; }
+    std::string WriteHandlerName() const { return m_name; }
+    const std::type_info &ReadHandlerType() const {
+      return m_on_read ? typeid(*m_on_read) : typeid(*this);
+    }
+    const std::type_info &WriteHandlerType() const {
+      return m_on_write ? typeid(*m_on_write) : typeid(*this);
+    }
+
   private:
     ola::Callback0<void> *m_on_read;
     ola::Callback0<void> *m_on_write;
+    std::string m_name;
 };
 
 
@@ -297,7 +328,8 @@ class PipeDescriptor: public ConnectedDescriptor {
 
 
 /*
- * A unix domain socket pair.
+ * A unix domain socket. This is either one end of a socket pair, or a
+ * connection to / from a named socket.
  */
 class UnixSocket: public ConnectedDescriptor {
   public:
@@ -305,10 +337,18 @@ class UnixSocket: public ConnectedDescriptor {
       m_other_end(NULL) {
       m_fd = INVALID_DESCRIPTOR;
     }
+    explicit UnixSocket(int fd):
+      m_other_end(NULL) {
+      m_fd = fd;
+      SetNoSigPipe(fd);
+    }
     ~UnixSocket() { Close(); }
 
     bool Init();
     UnixSocket *OppositeEnd();
+    static UnixSocket *Connect(const std::string &path);
+    // The user id of the process at the other end, if it can be determined.
+    bool PeerUID(uid_t *uid) const;
     int ReadDescriptor() const { return m_fd; }
     int WriteDescriptor() const { return m_fd; }
     bool Close();
@@ -329,6 +369,36 @@ class UnixSocket: public ConnectedDescriptor {
 };
 
 
+/*
+ * A named unix domain socket which accepts new connections.
+ */
+class UnixAcceptingSocket: public ReadFileDescriptor {
+  public:
+    typedef ola::Callback1<void, UnixSocket*> AcceptCallback;
+
+    UnixAcceptingSocket();
+    ~UnixAcceptingSocket();
+
+    bool Listen(const std::string &path, int backlog = 10);
+    int ReadDescriptor() const { return m_fd; }
+    bool Close();
+    void PerformRead();
+
+    // Ownership of the callback is transferred.
+    void SetOnAccept(AcceptCallback *on_accept);
+
+    const std::string &Path() const { return m_path; }
+
+  private:
+    int m_fd;
+    std::string m_path;
+    AcceptCallback *m_on_accept;
+
+    UnixAcceptingSocket(const UnixAcceptingSocket &other);
+    UnixAcceptingSocket& operator=(const UnixAcceptingSocket &other);
+};
+
+
 /*
  * A descriptor which represents a connection to a device
  */
@@ -54,6 +54,14 @@ class MemoryBlock {
       m_last = m_first;
     }
 
+    // Move the insertion point to the start of the block. Blocks returned to
+    // a MemoryBlockPool keep their old insertion point, so call this before
+    // re-using one in append mode.
+    void SeekFront() {
+      m_first = m_data;
+      m_last = m_first;
+    }
+
     // The amount of memory space in this block.
     unsigned int Capacity() const { return m_capacity; }
 
@@ -69,6 +77,24 @@ class MemoryBlock {
     // Pointer to the first byte of valid data in this block.
     uint8_t *Data() const { return m_first; }
 
+    // The amount of free space after the data in this block.
+    unsigned int Remaining() const {
+      return static_cast<unsigned int>(m_data_end - m_last);
+    }
+
+    // Pointer to the free space after the data. Data can be written here
+    // directly, and then added to the block with Extend().
+    uint8_t *Tail() const { return m_last; }
+
+    // Add length bytes of the free space to the data in this block. returns
+    // the number of bytes added, which will be less than length if the block
+    // is now full.
+    unsigned int Extend(unsigned int length) {
+      unsigned int bytes_to_add = std::min(length, Remaining());
+      m_last += bytes_to_add;
+      return bytes_to_add;
+    }
+
     // Attempt to append the data to this block. returns the number of bytes
     // written, which will be less than length if the block is now full.
     unsigned int Append(const uint8_t *data, unsigned int length) {
@@ -29,25 +29,31 @@
 #include <ola/network/Socket.h>
 #include <ola/thread/Thread.h>
 
+#include <map>
 #include <queue>
 #include <set>
 #include <string>
-#include <vector>
 
 namespace ola {
 namespace io {
 
 using ola::ExportMap;
 using ola::thread::timeout_id;
-using std::priority_queue;
 using std::set;
 using std::string;
 
+class LoopProfiler;
+struct LoopSource;
+class PollerInterface;
+class TimeoutManager;
 
 /**
  * This is the core of the event driven system. The SelectServer is responsible
  * for invoking Callbacks when events occur. All methods except Execute() and
  * Terminate() must be called from the thread that Run() was called in.
+ *
+ * Waiting for I/O is delegated to a Poller. On systems with epoll() it's used
+ * by default, pass --nouse-epoll to fall back to select().
  */
 class SelectServer: public SelectServerInterface {
   public :
@@ -58,7 +64,7 @@ class SelectServer: public SelectServerInterface {
     ~SelectServer();
 
     bool IsRunning() const { return !m_terminate; }
-    const TimeStamp *WakeUpTime() const { return &m_wake_up_time; }
+    const TimeStamp *WakeUpTime() const;
 
     void Terminate();
 
@@ -91,136 +97,37 @@ class SelectServer: public SelectServerInterface {
 
     void Execute(ola::BaseCallback0<void> *closure);
 
+    // Callbacks that take longer than this are logged & counted. The default
+    // comes from --callback-budget-ms, 0 disables the check. This does nothing
+    // if there is no ExportMap.
+    void SetCallbackBudget(const TimeInterval &budget);
+
     // these are pubic so that the tests can access them
     static const char K_READ_DESCRIPTOR_VAR[];
     static const char K_WRITE_DESCRIPTOR_VAR[];
     static const char K_CONNECTED_DESCRIPTORS_VAR[];
     static const char K_TIMER_VAR[];
+    static const char K_TIMER_CANCELLED_VAR[];
     static const char K_LOOP_TIME[];
     static const char K_LOOP_COUNT[];
 
   private :
-    /*
-     * These are timer events, they are used inside the SelectServer class
-     */
-    class Event {
-      public:
-        explicit Event(const TimeInterval &interval, const Clock *clock)
-            : m_interval(interval) {
-          TimeStamp now;
-          clock->CurrentTime(&now);
-          m_next = now + m_interval;
-        }
-        virtual ~Event() {}
-        virtual bool Trigger() = 0;
-
-        void UpdateTime(const TimeStamp &now) {
-          m_next = now + m_interval;
-        }
-
-        TimeStamp NextTime() const { return m_next; }
-
-      private:
-        TimeInterval m_interval;
-        TimeStamp m_next;
-    };
-
-    // An event that only happens once
-    class SingleEvent: public Event {
-      public:
-        SingleEvent(const TimeInterval &interval,
-                    const Clock *clock,
-                    ola::BaseCallback0<void> *closure):
-          Event(interval, clock),
-          m_closure(closure) {
-        }
-
-        virtual ~SingleEvent() {
-          if (m_closure)
-            delete m_closure;
-        }
-
-        bool Trigger() {
-          if (m_closure) {
-            m_closure->Run();
-            // it's deleted itself at this point
-            m_closure = NULL;
-          }
-          return false;
-        }
-
-      private:
-        ola::BaseCallback0<void> *m_closure;
-    };
-
-
-    /*
-     * An event that occurs more than once. The closure can return false to
-     * indicate that it should not be called again.
-     */
-    class RepeatingEvent: public Event {
-      public:
-        RepeatingEvent(const TimeInterval &interval,
-                       const Clock *clock,
-                       ola::BaseCallback0<bool> *closure):
-          Event(interval, clock),
-          m_closure(closure) {
-        }
-        ~RepeatingEvent() {
-          delete m_closure;
-        }
-        bool Trigger() {
-          if (!m_closure)
-            return false;
-          return m_closure->Run();
-        }
-
-      private:
-        ola::BaseCallback0<bool> *m_closure;
-    };
-
-    typedef struct {
-      ConnectedDescriptor *descriptor;
-      bool delete_on_close;
-    } connected_descriptor_t;
-
-    struct connected_descriptor_t_lt {
-      bool operator()(const connected_descriptor_t &c1,
-                      const connected_descriptor_t &c2) const {
-        return c1.descriptor->ReadDescriptor() <
-            c2.descriptor->ReadDescriptor();
-      }
-    };
-
-    struct ltevent {
-      bool operator()(Event *e1, Event *e2) const {
-        return e1->NextTime() > e2->NextTime();
-      }
-    };
-
-    typedef set<ReadFileDescriptor*> ReadDescriptorSet;
-    typedef set<WriteFileDescriptor*> WriteDescriptorSet;
-    typedef set<connected_descriptor_t, connected_descriptor_t_lt>
-      ConnectedDescriptorSet;
-    typedef set<ola::Callback0<void>*> LoopClosureSet;
+    // Each closure maps to its profiler source.
+    typedef std::map<ola::Callback0<void>*, LoopSource*> LoopClosureMap;
 
     bool m_terminate, m_is_running;
     TimeInterval m_poll_interval;
-    unsigned int m_next_id;
-    ReadDescriptorSet m_read_descriptors;
-    ConnectedDescriptorSet m_connected_read_descriptors;
-    WriteDescriptorSet m_write_descriptors;
-    set<timeout_id> m_removed_timeouts;
     ExportMap *m_export_map;
-
-    typedef priority_queue<Event*, vector<Event*>, ltevent> event_queue_t;
-    event_queue_t m_events;
     CounterVariable *m_loop_iterations;
     CounterVariable *m_loop_time;
-    TimeStamp m_wake_up_time;
     Clock *m_clock;
     bool m_free_clock;
-    LoopClosureSet m_loop_closures;
+    // only used if there's an ExportMap
+    LoopProfiler *m_profiler;
+    LoopSource *m_execute_source;
+    PollerInterface *m_poller;
+    TimeoutManager *m_timeout_manager;
+    LoopClosureMap m_loop_closures;
     std::queue<ola::BaseCallback0<void>*> m_incoming_queue;
     ola::thread::Mutex m_incoming_mutex;
     LoopbackDescriptor m_incoming_descriptor;
@@ -228,8 +135,6 @@ class SelectServer: public SelectServerInterface {
     SelectServer(const SelectServer&);
     SelectServer operator=(const SelectServer&);
     bool CheckForEvents(const TimeInterval &poll_interval);
-    void CheckDescriptors(fd_set *r_set, fd_set *w_set);
-    bool AddDescriptorsToSet(fd_set *r_set, fd_set *w_set, int *max_sd);
     TimeStamp CheckTimeouts(const TimeStamp &now);
     void UnregisterAll();
     void DrainAndExecute();
@@ -0,0 +1,97 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Trace.h
+ * An in-process trace recorder.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * How to use:
+ *
+ * #include <ola/thread/Trace.h>
+ *
+ * void Foo::Bar() {
+ *   ola::thread::TraceScope trace("Foo::Bar");
+ *   ...
+ * }
+ *
+ * Each thread records into its own ring buffer, so recording doesn't take a
+ * lock. The buffers can be dumped at any time in the Chrome trace format,
+ * which can be loaded into chrome://tracing or Perfetto.
+ *
+ * Tracing is off by default, in which case a TraceScope costs a single
+ * branch. Event names must be string literals, or otherwise outlive the
+ * trace, since only the pointer is stored.
+ */
+
+#ifndef INCLUDE_OLA_THREAD_TRACE_H_
+#define INCLUDE_OLA_THREAD_TRACE_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace ola {
+namespace thread {
+
+// The number of events kept for each thread.
+static const unsigned int TRACE_BUFFER_SIZE = 16384;
+
+// Used when an event isn't tied to a universe, port etc.
+static const unsigned int TRACE_NO_ID = 0xffffffff;
+
+extern bool trace_enabled;
+
+void EnableTracing(bool enable);
+inline bool TracingEnabled() { return trace_enabled; }
+
+// Name the current thread, this shows up in the trace viewer.
+void SetTraceThreadName(const std::string &name);
+
+uint64_t TraceTime();
+void RecordTraceEvent(const char *name, unsigned int id, uint64_t start,
+                      uint64_t end);
+
+// Render the events recorded so far, as Chrome trace JSON.
+void AppendTrace(std::string *output);
+bool WriteTraceFile(const std::string &path);
+
+
+/*
+ * Records an event covering the lifetime of the object. The id is shown as an
+ * argument of the event, and is usually the universe id.
+ */
+class TraceScope {
+  public:
+    explicit TraceScope(const char *name, unsigned int id = TRACE_NO_ID)
+        : m_name(trace_enabled ? name : NULL),
+          m_id(id),
+          m_start(m_name ? TraceTime() : 0) {
+    }
+
+    ~TraceScope() {
+      if (m_name)
+        RecordTraceEvent(m_name, m_id, m_start, TraceTime());
+    }
+
+  private:
+    const char *m_name;
+    unsigned int m_id;
+    uint64_t m_start;
+
+    TraceScope(const TraceScope&);
+    TraceScope& operator=(const TraceScope&);
+};
+}  // namespace thread
+}  // namespace ola
+#endif  // INCLUDE_OLA_THREAD_TRACE_H_
@@ -48,10 +48,21 @@ class DmxSource {
         m_priority(priority) {
     }
 
+    DmxSource(const DmxBuffer &buffer,
+              const TimeStamp &timestamp,
+              uint8_t priority,
+              const DmxBuffer &slot_priorities):
+        m_buffer(buffer),
+        m_timestamp(timestamp),
+        m_priority(priority),
+        m_slot_priorities(slot_priorities) {
+    }
+
     DmxSource(const DmxSource &other) {
       m_buffer = other.m_buffer;
       m_timestamp = other.m_timestamp;
       m_priority = other.m_priority;
+      m_slot_priorities = other.m_slot_priorities;
     }
 
 
@@ -63,6 +74,7 @@ class DmxSource {
         m_buffer = other.m_buffer;
         m_timestamp = other.m_timestamp;
         m_priority = other.m_priority;
+        m_slot_priorities = other.m_slot_priorities;
       }
       return *this;
     }
@@ -74,7 +86,8 @@ class DmxSource {
     bool operator==(const DmxSource &other) const {
       return (m_buffer == other.m_buffer &&
               m_timestamp == other.m_timestamp &&
-              m_priority == other.m_priority);
+              m_priority == other.m_priority &&
+              m_slot_priorities == other.m_slot_priorities);
     }
 
 
@@ -86,6 +99,19 @@ class DmxSource {
       m_buffer = buffer;
       m_timestamp = timestamp;
       m_priority = priority;
+      m_slot_priorities.Reset();
+    }
+
+
+    /*
+     * Update the DmxSource with new data that has per-slot priorities
+     */
+    void UpdateData(const DmxBuffer &buffer, const TimeStamp &timestamp,
+                    uint8_t priority, const DmxBuffer &slot_priorities) {
+      m_buffer = buffer;
+      m_timestamp = timestamp;
+      m_priority = priority;
+      m_slot_priorities = slot_priorities;
     }
 
 
@@ -96,7 +122,8 @@ class DmxSource {
 
 
     /*
-     * Get the timestamp
+     * Get the timestamp, this is when the data arrived. It's used to time out
+     * the source, and to measure the latency until the data is sent.
      */
     const TimeStamp &Timestamp() const { return m_timestamp; }
 
@@ -123,6 +150,20 @@ class DmxSource {
      */
     uint8_t Priority() const { return m_priority; }
 
+
+    /*
+     * Get the per-slot priorities. These override Priority(), a slot priority
+     * of 0 means this source doesn't provide that slot. Slots past the end of
+     * the priorities aren't provided either.
+     */
+    const DmxBuffer &SlotPriorities() const { return m_slot_priorities; }
+
+
+    /*
+     * Check if this source has per-slot priorities
+     */
+    bool HasSlotPriorities() const { return m_slot_priorities.Size() != 0; }
+
     static const uint8_t PRIORITY_MIN;
     static const uint8_t PRIORITY_MAX;
     static const uint8_t PRIORITY_DEFAULT;
@@ -131,6 +172,7 @@ class DmxSource {
     DmxBuffer m_buffer;
     TimeStamp m_timestamp;
     uint8_t m_priority;
+    DmxBuffer m_slot_priorities;
 
     static const TimeInterval TIMEOUT_INTERVAL;
 };
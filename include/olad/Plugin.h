@@ -60,6 +60,9 @@ class AbstractPlugin {
 
     virtual void ConflictsWith(std::set<ola_plugin_id> *conflict_set) = 0;
 
+    // change the PluginAdaptor, this is called before the plugin is started
+    virtual void SetPluginAdaptor(PluginAdaptor *plugin_adaptor) = 0;
+
     // used to sort plugins
     virtual bool operator<(const AbstractPlugin &other) const = 0;
 };
@@ -98,6 +101,10 @@ class Plugin: public AbstractPlugin {
     // by default we don't conflict with any other plugins
     virtual void ConflictsWith(std::set<ola_plugin_id>*) {}
 
+    void SetPluginAdaptor(PluginAdaptor *plugin_adaptor) {
+      m_plugin_adaptor = plugin_adaptor;
+    }
+
     bool operator<(const AbstractPlugin &other) const {
       return Id() < other.Id();
     }
@@ -38,7 +38,9 @@ class PluginAdaptor: public ola::io::SelectServerInterface {
                   ola::io::SelectServerInterface *select_server,
                   ExportMap *export_map,
                   class PreferencesFactory *preferences_factory,
-                  class PortBrokerInterface *port_broker);
+                  class PortBrokerInterface *port_broker,
+                  class EventLoopPool *loop_pool = NULL,
+                  unsigned int loop = 0);
 
     // The following methods are part of the SelectServerInterface
     bool AddReadDescriptor(ola::io::ReadFileDescriptor *descriptor);
@@ -84,6 +86,8 @@ class PluginAdaptor: public ola::io::SelectServerInterface {
     ExportMap *m_export_map;
     class PreferencesFactory *m_preferences_factory;
     class PortBrokerInterface *m_port_broker;
+    class EventLoopPool *m_loop_pool;
+    unsigned int m_loop;
 };
 }  // namespace ola
 #endif  // INCLUDE_OLAD_PLUGINADAPTOR_H_
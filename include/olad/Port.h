@@ -21,9 +21,12 @@
 #ifndef INCLUDE_OLAD_PORT_H_
 #define INCLUDE_OLAD_PORT_H_
 
+#include <ola/Clock.h>
 #include <ola/DmxBuffer.h>
+#include <ola/ExportMap.h>
 #include <ola/rdm/RDMCommand.h>
 #include <ola/rdm/RDMControllerInterface.h>
+#include <ola/thread/Mutex.h>
 #include <ola/timecode/TimeCode.h>
 #include <olad/DmxSource.h>
 #include <olad/PluginAdaptor.h>
@@ -107,6 +110,16 @@ class OutputPort: public Port, ola::rdm::DiscoverableRDMControllerInterface {
     // Write dmx data to this port
     virtual bool WriteDMX(const DmxBuffer &buffer, uint8_t priority) = 0;
 
+    // Write dmx data to this port, input_time is when the data arrived at the
+    // universe, or unset if this is a resend of data that's already gone out.
+    virtual bool WriteTimedDMX(const DmxBuffer &buffer,
+                               uint8_t priority,
+                               const TimeStamp &input_time) = 0;
+
+    // Set the histogram to record the input to output latency in, or NULL to
+    // stop recording.
+    virtual void SetLatencyHistogram(Histogram *histogram) = 0;
+
     // Called if the universe name changes
     virtual void UniverseNameChanged(const string &new_name) = 0;
 
@@ -167,6 +180,9 @@ class BasicInputPort: public InputPort {
       return DmxSource::PRIORITY_MIN;
     }
 
+    // Get the inherited per-slot priorities, or NULL if there aren't any.
+    virtual const DmxBuffer *InheritedSlotPriorities() const { return NULL; }
+
     // override this to cancel the SetUniverse operation.
     virtual bool PreSetUniverse(Universe *, Universe *) { return true; }
 
@@ -222,6 +238,18 @@ class BasicOutputPort: public OutputPort {
       return SupportsPriorities() ? CAPABILITY_FULL : CAPABILITY_NONE;
     }
 
+    // Ports that hand the data off to another thread override this to store
+    // the input time along with the frame, and call RecordLatency from that
+    // thread once the frame has actually been sent.
+    virtual bool WriteTimedDMX(const DmxBuffer &buffer,
+                               uint8_t priority,
+                               const TimeStamp &input_time);
+
+    // These may be called from any thread. Once SetLatencyHistogram returns,
+    // the old histogram won't be touched again.
+    void SetLatencyHistogram(Histogram *histogram);
+    void RecordLatency(const TimeStamp &input_time);
+
     // DiscoverableRDMControllerInterface methods
     virtual void SendRDMRequest(const ola::rdm::RDMRequest *request,
                                 ola::rdm::RDMCallback *callback);
@@ -259,6 +287,11 @@ class BasicOutputPort: public OutputPort {
     Universe *m_universe;  // the universe this port belongs to
     AbstractDevice *m_device;
     bool m_supports_rdm;
+    // protects m_latency & m_last_input_time
+    ola::thread::Mutex m_latency_mutex;
+    Histogram *m_latency;
+    TimeStamp m_last_input_time;
+    Clock m_clock;
 
     BasicOutputPort(const BasicOutputPort&);
     BasicOutputPort& operator=(const BasicOutputPort&);
@@ -43,8 +43,13 @@ using std::set;
 using ola::rdm::RDMDiscoveryCallback;
 
 class Client;
+class DmxSourceFrame;
+class EventLoopPool;
 class InputPort;
+class MergeSource;
 class OutputPort;
+class OutputScheduler;
+class SourceMerger;
 
 class Universe: public ola::rdm::RDMControllerInterface {
   public:
@@ -55,7 +60,8 @@ class Universe: public ola::rdm::RDMControllerInterface {
 
     Universe(unsigned int uid, class UniverseStore *store,
              ExportMap *export_map,
-             Clock *clock);
+             Clock *clock,
+             EventLoopPool *loop_pool = NULL);
     ~Universe();
 
     // Properties for this universe
@@ -92,6 +98,30 @@ class Universe: public ola::rdm::RDMControllerInterface {
       m_rdm_discovery_interval = discovery_interval;
     }
 
+    /**
+     * Return how often unchanged DMX data is resent to the output ports.
+     */
+    const TimeInterval& OutputKeepAlive() const {
+      return m_output_keepalive;
+    }
+
+    /**
+     * Set how often unchanged DMX data is resent to the output ports. A zero
+     * interval sends every update, even if the data hasn't changed.
+     */
+    void SetOutputKeepAlive(const TimeInterval &keepalive) {
+      m_output_keepalive = keepalive;
+    }
+
+    /**
+     * Set the scheduler used to send the DMX data. If this is NULL, the data
+     * is sent every time it changes.
+     */
+    void SetOutputScheduler(OutputScheduler *scheduler);
+
+    // Called by the OutputScheduler to send the DMX data.
+    void RunScheduledOutput();
+
     // Each universe has a DMXBuffer
     bool SetDMX(const DmxBuffer &buffer);
     const DmxBuffer &GetDMX() const { return m_buffer; }
@@ -140,9 +170,12 @@ class Universe: public ola::rdm::RDMControllerInterface {
     static const char K_FPS_VAR[];
     static const char K_MERGE_HTP_STR[];
     static const char K_MERGE_LTP_STR[];
+    static const char K_PORT_OUTPUT_LATENCY_VAR[];
+    static const char K_UNIVERSE_COALESCED_FRAMES_VAR[];
     static const char K_UNIVERSE_INPUT_PORT_VAR[];
     static const char K_UNIVERSE_MODE_VAR[];
     static const char K_UNIVERSE_NAME_VAR[];
+    static const char K_UNIVERSE_OUTPUT_LATENCY_VAR[];
     static const char K_UNIVERSE_OUTPUT_PORT_VAR[];
     static const char K_UNIVERSE_RDM_REQUESTS[];
     static const char K_UNIVERSE_SINK_CLIENTS_VAR[];
@@ -167,13 +200,34 @@ class Universe: public ola::rdm::RDMControllerInterface {
     vector<OutputPort*> m_output_ports;
     set<Client*> m_sink_clients;  // clients that require updates
     set<Client*> m_source_clients;  // clients that provide data
+    // The last data from each input port & source client. We keep our own
+    // copy since the ports & clients may live in a different event loop.
+    // These are owned by m_merger.
+    map<const InputPort*, MergeSource*> m_port_sources;
+    map<const Client*, MergeSource*> m_client_sources;
+    SourceMerger *m_merger;
     class UniverseStore *m_universe_store;
     DmxBuffer m_buffer;
     ExportMap *m_export_map;
+    // unbound if there isn't an ExportMap
+    CounterHandle m_fps_handle;
+    CounterHandle m_coalesced_frames_handle;
+    CounterHandle m_source_clients_handle;
+    CounterHandle m_sink_clients_handle;
+    Histogram *m_output_latency;
     map<UID, OutputPort*> m_output_uids;
     Clock *m_clock;
     TimeInterval m_rdm_discovery_interval;
     TimeStamp m_last_discovery_time;
+    TimeInterval m_output_keepalive;
+    TimeStamp m_last_output_time;
+    uint8_t m_last_output_priority;
+    OutputScheduler *m_output_scheduler;
+    bool m_output_pending;
+    // The arrival time of the oldest input that hasn't been sent yet.
+    TimeStamp m_input_time;
+    bool m_latency_pending;
+    EventLoopPool *m_loop_pool;
 
     Universe(const Universe&);
     Universe& operator=(const Universe&);
@@ -186,12 +240,19 @@ class Universe: public ola::rdm::RDMControllerInterface {
                                   const ola::rdm::RDMResponse *response,
                                   const std::vector<std::string> &packets);
     bool UpdateDependants();
+    bool DataChanged();
+    bool OutputRequired();
+    bool InUniverseLoop() const;
+    void UpdatePortSource(InputPort *port, DmxSource source);
+    void UpdateClientSource(Client *client, DmxSource source);
+    void ReceivePortSource(InputPort *port, DmxSourceFrame frame);
+    void ReceiveClientSource(Client *client, DmxSourceFrame frame);
+    void UpdatePortUIDs(OutputPort *port, ola::rdm::UIDSet uids);
     void UpdateName();
     void UpdateMode();
     bool RemoveClient(Client *client, bool is_source);
     bool AddClient(Client *client, bool is_source);
-    void HTPMergeSources(const vector<DmxSource> &sources);
-    bool MergeAll(const InputPort *port, const Client *client);
+    bool Merge(MergeSource *source, const DmxSource &data);
     void PortDiscoveryComplete(BaseCallback0<void> *on_complete,
                                OutputPort *output_port,
                                const ola::rdm::UIDSet &uids);
@@ -21,25 +21,114 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <ola/AutoStart.h>
 #include <ola/network/IPV4Address.h>
 #include <ola/network/SocketAddress.h>
 #include <ola/Logging.h>
+#include <sstream>
+#include <string>
 
 namespace ola {
 namespace client {
 
+using ola::io::ConnectedDescriptor;
+using ola::io::UnixSocket;
+using std::string;
+
+
+/*
+ * The directory for this user's runtime files, such as the unix socket. This is
+ * under $XDG_RUNTIME_DIR if it's set, otherwise in /tmp. Use CheckRpcSocketDir
+ * before putting anything in it.
+ */
+string RuntimeDir() {
+  std::stringstream str;
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir && *runtime_dir)
+    str << runtime_dir << "/ola";
+  else
+    str << "/tmp/ola-" << geteuid();
+  return str.str();
+}
+
+
+/*
+ * The path of the unix socket the server listens on, in the RuntimeDir().
+ * @param port the TCP port of the server, this allows more than one server to
+ *   run on a host.
+ */
+string RpcSocketPath(unsigned short port) {
+  std::stringstream str;
+  str << RuntimeDir() << "/rpc-" << port << ".sock";
+  return str.str();
+}
+
+
+/*
+ * Check that the directory a socket is in belongs to us, and that no one else
+ * can write to it. Otherwise another user could put their own socket there.
+ * @param socket_path the path of the socket
+ * @param create if true, create the directory if it doesn't exist
+ */
+bool CheckRpcSocketDir(const string &socket_path, bool create) {
+  string::size_type slash = socket_path.rfind('/');
+  if (slash == string::npos || slash == 0)
+    return false;
+  const string dir = socket_path.substr(0, slash);
+
+  if (create && mkdir(dir.c_str(), 0700) && errno != EEXIST) {
+    OLA_WARN << "Failed to create " << dir << ": " << strerror(errno);
+    return false;
+  }
+
+  struct stat stat_buf;
+  if (lstat(dir.c_str(), &stat_buf)) {
+    if (create)
+      OLA_WARN << "Failed to stat " << dir << ": " << strerror(errno);
+    return false;
+  }
+  if (!S_ISDIR(stat_buf.st_mode) || stat_buf.st_uid != geteuid() ||
+      (stat_buf.st_mode & (S_IRWXG | S_IRWXO))) {
+    OLA_WARN << dir << " isn't a directory that only belongs to uid " <<
+      geteuid();
+    return false;
+  }
+  return true;
+}
+
+
+/*
+ * Try the unix socket, and then the TCP port. The socket is only used if it
+ * was created by the same user.
+ */
+static ConnectedDescriptor *Connect(unsigned short port) {
+  const string socket_path = RpcSocketPath(port);
+  struct stat stat_buf;
+  if (lstat(socket_path.c_str(), &stat_buf) == 0 &&
+      stat_buf.st_uid == geteuid() &&
+      CheckRpcSocketDir(socket_path, false)) {
+    UnixSocket *unix_socket = UnixSocket::Connect(socket_path);
+    if (unix_socket)
+      return unix_socket;
+  }
+
+  return TCPSocket::Connect(ola::network::IPV4SocketAddress(
+      ola::network::IPV4Address::Loopback(), port));
+}
+
 
 /*
  * Open a connection to the server.
+ * @param port the TCP port of the server
+ * @param auto_start if true, try to start olad if it isn't running
  */
-TCPSocket *ConnectToServer(unsigned short port) {
-  ola::network::IPV4SocketAddress server_address(
-      ola::network::IPV4Address::Loopback(), port);
-  TCPSocket *socket = TCPSocket::Connect(server_address);
-  if (socket)
+ConnectedDescriptor *ConnectToServer(unsigned short port, bool auto_start) {
+  ConnectedDescriptor *socket = Connect(port);
+  if (socket || !auto_start)
     return socket;
 
   OLA_INFO << "Attempting to start olad";
@@ -69,7 +158,7 @@ TCPSocket *ConnectToServer(unsigned short port) {
 
   // wait a bit here for the server to come up
   sleep(1);
-  return TCPSocket::Connect(server_address);
+  return Connect(port);
 }
 }  // namespace client
 }  // namespace ola
@@ -22,7 +22,9 @@
 #define OLA_AUTOSTART_H_
 
 #include <ola/BaseTypes.h>
+#include <ola/io/Descriptor.h>
 #include <ola/network/TCPSocket.h>
+#include <string>
 
 namespace ola {
 namespace client {
@@ -30,9 +32,27 @@ namespace client {
 using ola::network::TCPSocket;
 
 /*
- * Open a connection to the server.
+ * The directory for this user's sockets and other runtime files.
  */
-TCPSocket *ConnectToServer(unsigned short port);
+std::string RuntimeDir();
+
+/*
+ * The path of the unix socket the server listens on, alongside the TCP port.
+ */
+std::string RpcSocketPath(unsigned short port);
+
+/*
+ * Check the directory of the unix socket is private to this user, optionally
+ * creating it.
+ */
+bool CheckRpcSocketDir(const std::string &socket_path, bool create);
+
+/*
+ * Open a connection to the server. The unix socket is used if the server is
+ * listening on one, otherwise this falls back to TCP.
+ */
+ola::io::ConnectedDescriptor *ConnectToServer(unsigned short port,
+                                              bool auto_start = true);
 }  // namespace client
 }  // namespace ola
 #endif  // OLA_AUTOSTART_H_
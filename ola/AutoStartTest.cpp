@@ -0,0 +1,73 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * AutoStartTest.cpp
+ * Test fixture for the RPC socket path checks.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "ola/AutoStart.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::client::CheckRpcSocketDir;
+using std::string;
+
+
+class AutoStartTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(AutoStartTest);
+  CPPUNIT_TEST(testCheckRpcSocketDir);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void testCheckRpcSocketDir();
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(AutoStartTest);
+
+
+/*
+ * Check the socket directory is only trusted if no one else can write to it.
+ */
+void AutoStartTest::testCheckRpcSocketDir() {
+  char base_dir[] = "/tmp/ola-autostart-XXXXXX";
+  OLA_ASSERT_NOT_NULL(mkdtemp(base_dir));
+  const string dir = string(base_dir) + "/sockets";
+  const string socket_path = dir + "/rpc-9010.sock";
+
+  // missing
+  OLA_ASSERT_FALSE(CheckRpcSocketDir(socket_path, false));
+  OLA_ASSERT_TRUE(CheckRpcSocketDir(socket_path, true));
+  OLA_ASSERT_TRUE(CheckRpcSocketDir(socket_path, false));
+
+  // other users can write to it
+  OLA_ASSERT_EQ(0, chmod(dir.c_str(), 0777));
+  OLA_ASSERT_FALSE(CheckRpcSocketDir(socket_path, false));
+  OLA_ASSERT_FALSE(CheckRpcSocketDir(socket_path, true));
+
+  OLA_ASSERT_EQ(0, chmod(dir.c_str(), 0700));
+  OLA_ASSERT_TRUE(CheckRpcSocketDir(socket_path, false));
+
+  OLA_ASSERT_FALSE(CheckRpcSocketDir("rpc-9010.sock", true));
+
+  rmdir(dir.c_str());
+  rmdir(base_dir);
+}
@@ -0,0 +1,68 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxBatch.h
+ * The DMX data for many universes, sent to the server in a single RPC.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * A controller that drives many universes can send all of them in one
+ * message rather than one per universe. The server either applies the whole
+ * batch or, if any of the universes don't exist, none of it.
+ */
+
+#ifndef OLA_DMXBATCH_H_
+#define OLA_DMXBATCH_H_
+
+#include <stdint.h>
+#include <ola/DmxBuffer.h>
+#include <vector>
+
+namespace ola {
+
+/*
+ * The data for one universe in a batch.
+ */
+class DmxUpdate {
+  public:
+    // Use the server's default priority.
+    DmxUpdate(unsigned int universe, const DmxBuffer &data)
+        : m_universe(universe),
+          m_data(data),
+          m_priority(0),
+          m_has_priority(false) {
+    }
+
+    DmxUpdate(unsigned int universe, const DmxBuffer &data, uint8_t priority)
+        : m_universe(universe),
+          m_data(data),
+          m_priority(priority),
+          m_has_priority(true) {
+    }
+
+    unsigned int Universe() const { return m_universe; }
+    const DmxBuffer &Data() const { return m_data; }
+    uint8_t Priority() const { return m_priority; }
+    bool HasPriority() const { return m_has_priority; }
+
+  private:
+    unsigned int m_universe;
+    DmxBuffer m_data;
+    uint8_t m_priority;
+    bool m_has_priority;
+};
+
+typedef std::vector<DmxUpdate> DmxBatch;
+}  // namespace ola
+#endif  // OLA_DMXBATCH_H_
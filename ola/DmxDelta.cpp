@@ -0,0 +1,151 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxDelta.cpp
+ * Delta encoding of the DmxData messages sent over an RPC connection.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <map>
+
+#include "common/protocol/Ola.pb.h"
+#include "ola/DmxBuffer.h"
+#include "ola/DmxDelta.h"
+
+namespace ola {
+
+using ola::proto::DmxData;
+using ola::proto::DmxSlice;
+
+const unsigned int DmxDeltaEncoder::DEFAULT_KEYFRAME_INTERVAL;
+const unsigned int DmxDeltaEncoder::SLICE_OVERHEAD;
+
+
+/*
+ * Create a new encoder
+ * @param keyframe_interval the most deltas to send for a universe before
+ *   sending a keyframe.
+ */
+DmxDeltaEncoder::DmxDeltaEncoder(unsigned int keyframe_interval)
+    : m_keyframe_interval(keyframe_interval) {
+}
+
+
+/*
+ * Set the data in a DmxData message, either as the full frame or as the
+ * slices that have changed since the last frame for this universe.
+ * @param buffer the new frame
+ * @param data the DmxData to fill in, the universe must already be set.
+ * @returns true if a delta was used, false if it's a keyframe.
+ */
+bool DmxDeltaEncoder::Encode(const DmxBuffer &buffer, DmxData *data) {
+  data->clear_slice();
+  data->clear_delta();
+
+  std::map<unsigned int, UniverseState>::iterator iter =
+    m_universes.find(data->universe());
+  if (iter != m_universes.end() &&
+      iter->second.last.Size() == buffer.Size() &&
+      iter->second.deltas_sent < m_keyframe_interval) {
+    const uint8_t *last = iter->second.last.GetRaw();
+    const uint8_t *current = buffer.GetRaw();
+    unsigned int size = buffer.Size();
+    unsigned int encoded_size = 0;
+    unsigned int i = 0;
+    while (i < size && encoded_size < size) {
+      if (last[i] == current[i]) {
+        i++;
+        continue;
+      }
+
+      // extend the slice until we hit a gap that's worth splitting on
+      unsigned int start = i;
+      unsigned int end = i + 1;
+      for (i = end; i < size; i++) {
+        if (last[i] != current[i])
+          end = i + 1;
+        else if (i - end >= SLICE_OVERHEAD)
+          break;
+      }
+
+      DmxSlice *slice = data->add_slice();
+      slice->set_offset(start);
+      slice->set_data(current + start, end - start);
+      encoded_size += end - start + SLICE_OVERHEAD;
+    }
+
+    if (encoded_size < size) {
+      data->set_data("");
+      data->set_delta(true);
+      iter->second.last = buffer;
+      iter->second.deltas_sent++;
+      return true;
+    }
+    data->clear_slice();
+  }
+
+  data->set_data(buffer.Get());
+  UniverseState &state = m_universes[data->universe()];
+  state.last = buffer;
+  state.deltas_sent = 0;
+  return false;
+}
+
+
+/*
+ * Copy the data from a DmxData message into a DmxBuffer. Deltas are applied
+ * to the last frame for the universe. If the message has slices but isn't a
+ * delta, the other slots are set to 0.
+ * @param data the DmxData message
+ * @param buffer the DmxBuffer to update
+ * @returns false if the message is a delta and we haven't seen a keyframe
+ *   for the universe.
+ */
+bool DmxDeltaDecoder::Decode(const DmxData &data, DmxBuffer *buffer) {
+  if (data.delta()) {
+    std::map<unsigned int, DmxBuffer>::iterator iter =
+      m_frames.find(data.universe());
+    if (iter == m_frames.end())
+      return false;
+    ApplySlices(data, &iter->second);
+    *buffer = iter->second;
+    return true;
+  }
+
+  if (data.slice_size()) {
+    buffer->Blackout();
+    ApplySlices(data, buffer);
+  } else {
+    buffer->Set(data.data());
+  }
+  m_frames[data.universe()] = *buffer;
+  return true;
+}
+
+
+/*
+ * Copy the slices from a DmxData message into a buffer.
+ */
+void DmxDeltaDecoder::ApplySlices(const DmxData &data, DmxBuffer *buffer) {
+  for (int i = 0; i < data.slice_size(); i++) {
+    const DmxSlice &slice = data.slice(i);
+    if (slice.offset() < 0)
+      continue;
+    buffer->SetRange(slice.offset(),
+                     reinterpret_cast<const uint8_t*>(slice.data().data()),
+                     slice.data().size());
+  }
+}
+}  // namespace ola
@@ -0,0 +1,94 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxDelta.h
+ * Delta encoding of the DmxData messages sent over an RPC connection.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Usually only a few slots change from one frame to the next, so rather than
+ * sending the whole universe each time, the sender can send just the spans
+ * that differ from the last frame it sent for that universe. The receiver
+ * applies them to the last frame it received. Since a connection delivers
+ * messages in order, both ends always agree on what the last frame was.
+ *
+ * A full frame (a keyframe) is sent for the first frame of a universe, when
+ * the size changes, when the delta wouldn't be any smaller, and every so
+ * often regardless.
+ */
+
+#ifndef OLA_DMXDELTA_H_
+#define OLA_DMXDELTA_H_
+
+#include <map>
+
+#include "common/protocol/Ola.pb.h"
+#include "ola/DmxBuffer.h"
+
+namespace ola {
+
+class DmxDeltaEncoder {
+  public:
+    explicit DmxDeltaEncoder(
+        unsigned int keyframe_interval = DEFAULT_KEYFRAME_INTERVAL);
+
+    // Set the data in a DmxData message, the universe must already be set.
+    // Returns true if a delta was used.
+    bool Encode(const DmxBuffer &buffer, ola::proto::DmxData *data);
+
+    // Forget the last frames, the next frame for each universe will be a
+    // keyframe.
+    void Reset() { m_universes.clear(); }
+
+    static const unsigned int DEFAULT_KEYFRAME_INTERVAL = 100;
+
+  private:
+    struct UniverseState {
+      DmxBuffer last;
+      unsigned int deltas_sent;
+    };
+
+    unsigned int m_keyframe_interval;
+    std::map<unsigned int, UniverseState> m_universes;
+
+    // The bytes each slice adds on top of the data, unchanged gaps smaller
+    // than this are cheaper to send than to split on.
+    static const unsigned int SLICE_OVERHEAD = 6;
+
+    DmxDeltaEncoder(const DmxDeltaEncoder&);
+    DmxDeltaEncoder& operator=(const DmxDeltaEncoder&);
+};
+
+
+class DmxDeltaDecoder {
+  public:
+    DmxDeltaDecoder() {}
+
+    // Copy the data from a DmxData message into a DmxBuffer. Returns false if
+    // this is a delta for a universe we don't have a keyframe for.
+    bool Decode(const ola::proto::DmxData &data, DmxBuffer *buffer);
+
+    void Reset() { m_frames.clear(); }
+
+  private:
+    std::map<unsigned int, DmxBuffer> m_frames;
+
+    static void ApplySlices(const ola::proto::DmxData &data,
+                            DmxBuffer *buffer);
+
+    DmxDeltaDecoder(const DmxDeltaDecoder&);
+    DmxDeltaDecoder& operator=(const DmxDeltaDecoder&);
+};
+}  // namespace ola
+#endif  // OLA_DMXDELTA_H_
@@ -0,0 +1,168 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxDeltaTest.cpp
+ * Test fixture for the DmxDeltaEncoder and DmxDeltaDecoder classes
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+#include "common/protocol/Ola.pb.h"
+#include "ola/DmxBuffer.h"
+#include "ola/DmxDelta.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::DmxDeltaDecoder;
+using ola::DmxDeltaEncoder;
+using ola::proto::DmxData;
+using std::string;
+
+
+class DmxDeltaTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(DmxDeltaTest);
+  CPPUNIT_TEST(testEncodeDecode);
+  CPPUNIT_TEST(testKeyframes);
+  CPPUNIT_TEST(testMissingKeyframe);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void testEncodeDecode();
+    void testKeyframes();
+    void testMissingKeyframe();
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DmxDeltaTest);
+
+
+/*
+ * Check that deltas are used when a few slots change, and that the decoder
+ * rebuilds the frames.
+ */
+void DmxDeltaTest::testEncodeDecode() {
+  DmxDeltaEncoder encoder;
+  DmxDeltaDecoder decoder;
+  DmxBuffer frame, decoded;
+  frame.Blackout();
+
+  DmxData data;
+  data.set_universe(1);
+  OLA_ASSERT_FALSE(encoder.Encode(frame, &data));
+  OLA_ASSERT_EQ(512, static_cast<int>(data.data().size()));
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  OLA_ASSERT_TRUE(frame == decoded);
+
+  // nothing changed
+  OLA_ASSERT_TRUE(encoder.Encode(frame, &data));
+  OLA_ASSERT_EQ(0, data.slice_size());
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  OLA_ASSERT_TRUE(frame == decoded);
+
+  // changes close together are sent as one slice
+  frame.SetChannel(10, 255);
+  frame.SetChannel(13, 128);
+  frame.SetChannel(400, 1);
+  OLA_ASSERT_TRUE(encoder.Encode(frame, &data));
+  OLA_ASSERT_EQ(string(""), data.data());
+  OLA_ASSERT_EQ(2, data.slice_size());
+  OLA_ASSERT_EQ(10, data.slice(0).offset());
+  OLA_ASSERT_EQ(4, static_cast<int>(data.slice(0).data().size()));
+  OLA_ASSERT_EQ(400, data.slice(1).offset());
+  OLA_ASSERT_EQ(1, static_cast<int>(data.slice(1).data().size()));
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  OLA_ASSERT_TRUE(frame == decoded);
+
+  // a different universe starts with a keyframe
+  data.set_universe(2);
+  OLA_ASSERT_FALSE(encoder.Encode(frame, &data));
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  OLA_ASSERT_TRUE(frame == decoded);
+}
+
+
+/*
+ * Check when keyframes are sent.
+ */
+void DmxDeltaTest::testKeyframes() {
+  DmxDeltaEncoder encoder(2);
+  DmxBuffer frame;
+  frame.Blackout();
+
+  DmxData data;
+  data.set_universe(1);
+  OLA_ASSERT_FALSE(encoder.Encode(frame, &data));
+  OLA_ASSERT_TRUE(encoder.Encode(frame, &data));
+  OLA_ASSERT_TRUE(encoder.Encode(frame, &data));
+  // the interval is up
+  OLA_ASSERT_FALSE(encoder.Encode(frame, &data));
+  OLA_ASSERT_FALSE(data.delta());
+  OLA_ASSERT_EQ(0, data.slice_size());
+
+  // the size changed
+  DmxBuffer short_frame;
+  short_frame.SetFromString("1,2,3");
+  OLA_ASSERT_FALSE(encoder.Encode(short_frame, &data));
+
+  // everything changed, so a delta would be bigger than the frame
+  OLA_ASSERT_TRUE(encoder.Encode(short_frame, &data));
+  short_frame.SetFromString("4,5,6");
+  OLA_ASSERT_FALSE(encoder.Encode(short_frame, &data));
+  OLA_ASSERT_EQ(string("\x04\x05\x06"), data.data());
+
+  // after a reset we start with a keyframe
+  encoder.Reset();
+  OLA_ASSERT_FALSE(encoder.Encode(short_frame, &data));
+}
+
+
+/*
+ * Check that deltas without a keyframe are rejected, and that slices which
+ * aren't deltas leave the other slots as 0.
+ */
+void DmxDeltaTest::testMissingKeyframe() {
+  DmxDeltaDecoder decoder;
+  DmxBuffer decoded;
+
+  DmxData data;
+  data.set_universe(1);
+  data.set_data("");
+  data.set_delta(true);
+  ola::proto::DmxSlice *slice = data.add_slice();
+  slice->set_offset(2);
+  slice->set_data("\x10\x20");
+  OLA_ASSERT_FALSE(decoder.Decode(data, &decoded));
+
+  data.clear_delta();
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  DmxBuffer expected;
+  expected.Blackout();
+  expected.SetChannel(2, 0x10);
+  expected.SetChannel(3, 0x20);
+  OLA_ASSERT_TRUE(expected == decoded);
+
+  // now deltas work
+  data.set_delta(true);
+  slice->set_offset(511);
+  slice->set_data("\x30");
+  OLA_ASSERT_TRUE(decoder.Decode(data, &decoded));
+  expected.SetChannel(511, 0x30);
+  OLA_ASSERT_TRUE(expected == decoded);
+
+  decoder.Reset();
+  OLA_ASSERT_FALSE(decoder.Decode(data, &decoded));
+}
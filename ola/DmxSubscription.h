@@ -0,0 +1,73 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * DmxSubscription.h
+ * Limits the DMX data a client receives for a universe it's registered for.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * By default a client that registers for a universe receives all the slots
+ * every time the universe changes. A client that only cares about a few
+ * slots can ask for just those, and a client that doesn't need every change
+ * can cap the rate. When the rate is capped, the latest data is always sent
+ * once the period is up, so the client never misses the final state.
+ */
+
+#ifndef OLA_DMXSUBSCRIPTION_H_
+#define OLA_DMXSUBSCRIPTION_H_
+
+#include <ola/BaseTypes.h>
+#include <vector>
+
+namespace ola {
+
+class DmxSubscription {
+  public:
+    // A block of slots, the offset is 0 based.
+    struct SlotRange {
+      unsigned int offset;
+      unsigned int length;
+    };
+    typedef std::vector<SlotRange> SlotRanges;
+
+    DmxSubscription() : m_max_rate(0) {}
+
+    // Add a block of slots to receive. Ranges that extend past the end of the
+    // universe are truncated. The client is still given a full universe, with
+    // the other slots set to 0.
+    void AddSlotRange(unsigned int offset, unsigned int length) {
+      if (offset >= DMX_UNIVERSE_SIZE || length == 0)
+        return;
+      SlotRange range = {offset, length};
+      if (length > DMX_UNIVERSE_SIZE - offset)
+        range.length = DMX_UNIVERSE_SIZE - offset;
+      m_slots.push_back(range);
+    }
+
+    // The most updates per second to receive, 0 means every change.
+    void SetMaxRate(unsigned int rate) { m_max_rate = rate; }
+
+    // If there are no ranges, all slots are received.
+    const SlotRanges &Slots() const { return m_slots; }
+    unsigned int MaxRate() const { return m_max_rate; }
+
+    // True if this is the same as not having a subscription at all.
+    bool Unfiltered() const { return m_slots.empty() && m_max_rate == 0; }
+
+  private:
+    SlotRanges m_slots;
+    unsigned int m_max_rate;
+};
+}  // namespace ola
+#endif  // OLA_DMXSUBSCRIPTION_H_
@@ -305,6 +305,20 @@ bool OlaCallbackClient::RegisterUniverse(
 }
 
 
+/*
+ * Register for part of a universe.
+ * @param universe the universe id
+ * @param subscription the slots & rate to receive
+ * @return true on success, false on failure
+ */
+bool OlaCallbackClient::RegisterUniverse(
+    unsigned int universe,
+    const DmxSubscription &subscription,
+    SingleUseCallback1<void, const string&> *callback) {
+  return m_core->RegisterUniverse(universe, subscription, callback);
+}
+
+
 /*
  * Write some dmx data.
  * @param universe universe to send to
@@ -346,6 +360,29 @@ bool OlaCallbackClient::SendDmx(
 }
 
 
+/*
+ * Write the dmx data for many universes.
+ * @param batch the universes & data to send
+ * @param callback the callback to run when the server replies
+ * @return true on success, false on failure
+ */
+bool OlaCallbackClient::SendDmxBatch(
+    const DmxBatch &batch,
+    SingleUseCallback1<void, const string&> *callback) {
+  return m_core->SendDmxBatch(batch, callback);
+}
+
+
+/*
+ * Write the dmx data for many universes using the streaming interface.
+ * @param batch the universes & data to send
+ * @return true on success, false on failure
+ */
+bool OlaCallbackClient::SendDmxBatch(const DmxBatch &batch) {
+  return m_core->SendDmxBatch(batch);
+}
+
+
 /*
  * Read dmx data.
  * @param universe the universe id to get data for
@@ -486,6 +523,22 @@ bool OlaCallbackClient::RDMSet(RDMAPIImplInterface::rdm_callback *callback,
 }
 
 
+/*
+ * Send a batch of RDM Get Commands. They're all sent at once, subject to the
+ * in-flight limit.
+ * @param requests the commands to send
+ * @param on_response the Callback to run as each command completes, ownership
+ *   is transferred.
+ * @param on_complete the Callback to run once all the commands have completed
+ * @return true on success, false on failure
+ */
+bool OlaCallbackClient::RDMGetBatch(const vector<RDMGetRequest> &requests,
+                                    RDMBatchCallback *on_response,
+                                    SingleUseCallback0<void> *on_complete) {
+  return m_core->RDMGetBatch(requests, on_response, on_complete);
+}
+
+
 /**
  * Send TimeCode data.
  * @param callback the Callback to invoke when this completes
@@ -499,6 +552,50 @@ bool OlaCallbackClient::SendTimeCode(
 }
 
 
+/*
+ * Set the most requests to have outstanding with the server at once.
+ * @param max_in_flight the number of requests, 0 means no limit.
+ */
+void OlaCallbackClient::SetMaxInFlightRequests(unsigned int max_in_flight) {
+  m_core->SetMaxInFlightRequests(max_in_flight);
+}
+
+
+/*
+ * Return the number of requests waiting on a response from the server.
+ */
+unsigned int OlaCallbackClient::InFlightRequests() const {
+  return m_core->InFlightRequests();
+}
+
+
+/*
+ * Return the number of requests waiting to be sent.
+ */
+unsigned int OlaCallbackClient::QueuedRequests() const {
+  return m_core->QueuedRequests();
+}
+
+
+/*
+ * Fail the requests that are waiting to be sent. Requests the server already
+ * has complete as usual.
+ * @return the number of requests cancelled.
+ */
+unsigned int OlaCallbackClient::CancelQueuedRequests() {
+  return m_core->CancelQueuedRequests();
+}
+
+
+/*
+ * Get the latency of the requests completed for each RPC method.
+ * @param stats the vector to fill in.
+ */
+void OlaCallbackClient::GetRequestStats(vector<RequestStats> *stats) const {
+  m_core->GetRequestStats(stats);
+}
+
+
 /*
  * Send an RDM Set Command and get the pid it returns
  * @param callback the Callback to invoke when this completes
@@ -23,7 +23,10 @@
 #define OLA_OLACALLBACKCLIENT_H_
 
 #include <ola/Callback.h>
+#include <ola/Clock.h>
+#include <ola/DmxBatch.h>
 #include <ola/DmxBuffer.h>
+#include <ola/DmxSubscription.h>
 #include <ola/OlaDevice.h>
 #include <ola/common.h>
 #include <ola/network/Socket.h>
@@ -53,6 +56,42 @@ class OlaCallbackClient: public ola::rdm::RDMAPIImplInterface {
     typedef SingleUseCallback2<void, const PluginState&, const string&>
       PluginStateCallback;
 
+    // An RDM GET to send with RDMGetBatch()
+    struct RDMGetRequest {
+      RDMGetRequest(unsigned int universe,
+                    const ola::rdm::UID &uid,
+                    uint16_t sub_device,
+                    uint16_t pid,
+                    const string &data = "")
+          : universe(universe),
+            uid(uid),
+            sub_device(sub_device),
+            pid(pid),
+            data(data) {
+      }
+
+      unsigned int universe;
+      ola::rdm::UID uid;
+      uint16_t sub_device;
+      uint16_t pid;
+      string data;
+    };
+
+    // Run with the index of the request in the batch, and the response
+    typedef Callback3<void,
+                      unsigned int,
+                      const ola::rdm::ResponseStatus&,
+                      const string&> RDMBatchCallback;
+
+    // The requests that have completed for a RPC method
+    struct RequestStats {
+      string method;
+      unsigned int requests;
+      unsigned int failures;
+      TimeInterval total_latency;
+      TimeInterval max_latency;
+    };
+
     explicit OlaCallbackClient(ola::io::ConnectedDescriptor *descriptor);
     ~OlaCallbackClient();
 
@@ -146,6 +185,11 @@ class OlaCallbackClient: public ola::rdm::RDMAPIImplInterface {
         unsigned int universe,
         ola::RegisterAction register_action,
         SingleUseCallback1<void, const string&> *callback);
+    // Register for only some of the slots, or at a capped rate.
+    bool RegisterUniverse(
+        unsigned int universe,
+        const DmxSubscription &subscription,
+        SingleUseCallback1<void, const string&> *callback);
     bool SendDmx(
         unsigned int universe,
         const DmxBuffer &data,
@@ -156,6 +200,10 @@ class OlaCallbackClient: public ola::rdm::RDMAPIImplInterface {
         Callback1<void, const string&> *callback);
     // A version of SendDmx that doesn't wait for confirmation
     bool SendDmx(unsigned int universe, const DmxBuffer &data);
+    // Send the data for many universes in a single message
+    bool SendDmxBatch(const DmxBatch &batch,
+                      SingleUseCallback1<void, const string&> *callback);
+    bool SendDmxBatch(const DmxBatch &batch);
 
     bool FetchDmx(
         unsigned int universe,
@@ -205,10 +253,26 @@ class OlaCallbackClient: public ola::rdm::RDMAPIImplInterface {
                 const uint8_t *data,
                 unsigned int data_length);
 
+    // Send many RDM GETs at once. on_response is run as each one completes,
+    // and on_complete once they all have.
+    bool RDMGetBatch(const vector<RDMGetRequest> &requests,
+                     RDMBatchCallback *on_response,
+                     SingleUseCallback0<void> *on_complete);
+
     // timecode
     bool SendTimeCode(ola::SingleUseCallback1<void, const string&> *callback,
                       const ola::timecode::TimeCode &timecode);
 
+    // Requests beyond this many are queued until responses come back. 0 means
+    // no limit.
+    void SetMaxInFlightRequests(unsigned int max_in_flight);
+    unsigned int InFlightRequests() const;
+    unsigned int QueuedRequests() const;
+    // Fail the requests that haven't been sent yet, and return how many there
+    // were.
+    unsigned int CancelQueuedRequests();
+    void GetRequestStats(vector<RequestStats> *stats) const;
+
   private:
     OlaCallbackClient(const OlaCallbackClient&);
     OlaCallbackClient operator=(const OlaCallbackClient&);
@@ -33,6 +33,7 @@
 #include "ola/Logging.h"
 #include "ola/OlaClientCore.h"
 #include "ola/OlaDevice.h"
+#include "ola/base/Array.h"
 #include "ola/network/NetworkUtils.h"
 #include "ola/rdm/RDMEnums.h"
 #include "ola/rdm/RDMAPI.h"
@@ -50,8 +51,11 @@ OlaClientCore::OlaClientCore(ConnectedDescriptor *descriptor)
     : m_descriptor(descriptor),
       m_dmx_callback(NULL),
       m_channel(NULL),
+      m_window(NULL),
+      m_max_in_flight(WindowedRpcChannel::DEFAULT_MAX_IN_FLIGHT),
       m_stub(NULL),
-      m_connected(false) {
+      m_connected(false),
+      m_delta_dmx(false) {
 }
 
 
@@ -78,13 +82,37 @@ bool OlaClientCore::Setup() {
   if (!m_channel) {
     return false;
   }
-  m_stub = new OlaServerService_Stub(m_channel);
+  m_window = new WindowedRpcChannel(m_channel, m_max_in_flight);
+  // DMX is never held back, so it stays in order and doesn't wait for RDM
+  const char *dmx_methods[] = {
+    "UpdateDmxData",
+    "StreamDmxData",
+    "UpdateDmxDataBatch",
+    "StreamDmxDataBatch",
+  };
+  for (unsigned int i = 0; i < arraysize(dmx_methods); i++)
+    m_window->AddUnwindowedMethod(dmx_methods[i]);
+  m_stub = new OlaServerService_Stub(m_window);
 
   if (!m_stub) {
+    delete m_window;
     delete m_channel;
     return false;
   }
   m_connected = true;
+
+  // DMX is sent in full until the server says it can handle deltas
+  m_delta_dmx = false;
+  m_delta_encoder.Reset();
+  m_delta_decoder.Reset();
+  SimpleRpcController *controller = new SimpleRpcController();
+  ola::proto::Features request;
+  ola::proto::Features *reply = new ola::proto::Features();
+  request.set_dmx_delta(true);
+  m_stub->SetFeatures(
+      controller, &request, reply,
+      google::protobuf::NewCallback(this, &ola::OlaClientCore::HandleFeatures,
+                                    controller, reply));
   return true;
 }
 
@@ -96,8 +124,10 @@ bool OlaClientCore::Setup() {
 bool OlaClientCore::Stop() {
   if (m_connected) {
     m_descriptor->Close();
-    delete m_channel;
     delete m_stub;
+    delete m_window;
+    delete m_channel;
+    m_window = NULL;
   }
   m_connected = false;
   return 0;
@@ -536,6 +566,49 @@ bool OlaClientCore::RegisterUniverse(
         ola::proto::UNREGISTER);
   request.set_universe(universe);
   request.set_action(action);
+  // we handle StreamDmxData, so the server doesn't need to wait for Acks
+  request.set_streaming(true);
+
+  google::protobuf::Closure *cb = google::protobuf::NewCallback(
+      this,
+      &ola::OlaClientCore::HandleAck,
+      NewArgs<ack_args>(controller, reply, callback));
+  m_stub->RegisterForDmx(controller, &request, reply, cb);
+  return true;
+}
+
+
+/*
+ * Register for some of the slots in a universe, or at a capped rate.
+ * Unregistering is done with the method above.
+ * @param universe the id of the universe
+ * @param subscription the slots & rate to receive
+ */
+bool OlaClientCore::RegisterUniverse(
+    unsigned int universe,
+    const DmxSubscription &subscription,
+    SingleUseCallback1<void, const string&> *callback) {
+  if (!m_connected) {
+    delete callback;
+    return false;
+  }
+
+  ola::proto::RegisterDmxRequest request;
+  SimpleRpcController *controller = new SimpleRpcController();
+  ola::proto::Ack *reply = new ola::proto::Ack();
+
+  request.set_universe(universe);
+  request.set_action(ola::proto::REGISTER);
+  request.set_streaming(true);
+  const DmxSubscription::SlotRanges &slots = subscription.Slots();
+  DmxSubscription::SlotRanges::const_iterator iter = slots.begin();
+  for (; iter != slots.end(); ++iter) {
+    ola::proto::SlotRange *range = request.add_slots();
+    range->set_offset(iter->offset);
+    range->set_length(iter->length);
+  }
+  if (subscription.MaxRate())
+    request.set_max_rate(subscription.MaxRate());
 
   google::protobuf::Closure *cb = google::protobuf::NewCallback(
       this,
@@ -589,6 +662,70 @@ bool OlaClientCore::SendDmx(unsigned int universe, const DmxBuffer &data) {
 }
 
 
+/*
+ * Write the dmx data for many universes in a single message.
+ * @param batch the universes & data to send
+ * @param callback the callback to run when the server replies
+ * @return true on success, false on failure
+ */
+bool OlaClientCore::SendDmxBatch(
+    const DmxBatch &batch,
+    SingleUseCallback1<void, const string&> *callback) {
+  if (!m_connected) {
+    delete callback;
+    return false;
+  }
+
+  ola::proto::DmxDataBatch request;
+  BatchToProto(batch, &request);
+  SimpleRpcController *controller = new SimpleRpcController();
+  ola::proto::Ack *reply = new ola::proto::Ack();
+  google::protobuf::Closure *cb = google::protobuf::NewCallback(
+      this,
+      &ola::OlaClientCore::HandleDmxAck,
+      NewArgs<ack_args>(controller, reply, callback));
+  m_stub->UpdateDmxDataBatch(controller, &request, reply, cb);
+  return true;
+}
+
+
+/*
+ * Stream the dmx data for many universes in a single message.
+ * @param batch the universes & data to send
+ * @return true on success, false on failure
+ */
+bool OlaClientCore::SendDmxBatch(const DmxBatch &batch) {
+  if (!m_connected)
+    return false;
+
+  ola::proto::DmxDataBatch request;
+  BatchToProto(batch, &request);
+  m_stub->StreamDmxDataBatch(NULL, &request, NULL, NULL);
+  return true;
+}
+
+
+/*
+ * Copy a DmxBatch into the protobuf used to send it.
+ */
+void OlaClientCore::BatchToProto(const DmxBatch &batch,
+                                 ola::proto::DmxDataBatch *request) {
+  DmxBatch::const_iterator iter = batch.begin();
+  for (; iter != batch.end(); ++iter) {
+    ola::proto::DmxData *data = request->add_data();
+    data->set_universe(iter->Universe());
+    if (m_delta_dmx)
+      m_delta_encoder.Encode(iter->Data(), data);
+    else if (iter->Data().Size())
+      data->set_data(iter->Data().GetRaw(), iter->Data().Size());
+    else
+      data->set_data("");
+    if (iter->HasPriority())
+      data->set_priority(iter->Priority());
+  }
+}
+
+
 /*
  * Read dmx data
  * @param universe the universe id to get data for
@@ -800,6 +937,47 @@ bool OlaClientCore::RDMSet(
 }
 
 
+/*
+ * Send a batch of RDM Get Commands
+ * @param requests the commands to send
+ * @param on_response the Callback to run as each command completes
+ * @param on_complete the Callback to run once all the commands have completed
+ * @return true on success, false on failure
+ */
+bool OlaClientCore::RDMGetBatch(
+    const vector<OlaCallbackClient::RDMGetRequest> &requests,
+    OlaCallbackClient::RDMBatchCallback *on_response,
+    SingleUseCallback0<void> *on_complete) {
+  if (!m_connected) {
+    delete on_response;
+    delete on_complete;
+    return false;
+  }
+
+  rdm_batch_args *args = new rdm_batch_args();
+  args->on_response = on_response;
+  args->on_complete = on_complete;
+  // hold a reference until all the commands are sent, since some may fail
+  // straight away.
+  args->outstanding = requests.size() + 1;
+
+  for (unsigned int i = 0; i < requests.size(); i++) {
+    const OlaCallbackClient::RDMGetRequest &request = requests[i];
+    RDMCommand(
+        NewSingleCallback(this, &OlaClientCore::HandleRDMBatch, args, i),
+        false,
+        request.universe,
+        request.uid,
+        request.sub_device,
+        request.pid,
+        reinterpret_cast<const uint8_t*>(request.data.data()),
+        request.data.size());
+  }
+  RDMBatchComplete(args);
+  return true;
+}
+
+
 /**
  * Send TimeCode data.
  * @param callback the Callback to invoke when this completes
@@ -839,6 +1017,67 @@ bool OlaClientCore::SendTimeCode(
 }
 
 
+/*
+ * Set the most requests to have outstanding with the server at once. This
+ * can be called before Setup().
+ * @param max_in_flight the number of requests, 0 means no limit.
+ */
+void OlaClientCore::SetMaxInFlightRequests(unsigned int max_in_flight) {
+  m_max_in_flight = max_in_flight;
+  if (m_window)
+    m_window->SetMaxInFlight(max_in_flight);
+}
+
+
+/*
+ * Return the number of requests waiting on a response from the server.
+ */
+unsigned int OlaClientCore::InFlightRequests() const {
+  return m_window ? m_window->InFlight() : 0;
+}
+
+
+/*
+ * Return the number of requests waiting to be sent.
+ */
+unsigned int OlaClientCore::QueuedRequests() const {
+  return m_window ? m_window->Queued() : 0;
+}
+
+
+/*
+ * Fail the requests waiting to be sent.
+ * @return the number of requests cancelled.
+ */
+unsigned int OlaClientCore::CancelQueuedRequests() {
+  return m_window ? m_window->CancelQueued() : 0;
+}
+
+
+/*
+ * Get the latency of the requests completed for each RPC method.
+ */
+void OlaClientCore::GetRequestStats(
+    vector<OlaCallbackClient::RequestStats> *stats) const {
+  stats->clear();
+  if (!m_window)
+    return;
+
+  const WindowedRpcChannel::MethodStatsMap &method_stats = m_window->Stats();
+  WindowedRpcChannel::MethodStatsMap::const_iterator iter =
+    method_stats.begin();
+  for (; iter != method_stats.end(); ++iter) {
+    OlaCallbackClient::RequestStats request_stats;
+    request_stats.method = iter->first;
+    request_stats.requests = iter->second.requests;
+    request_stats.failures = iter->second.failures;
+    request_stats.total_latency = iter->second.total_latency;
+    request_stats.max_latency = iter->second.max_latency;
+    stats->push_back(request_stats);
+  }
+}
+
+
 /*
  * Called when new DMX data arrives
  */
@@ -847,9 +1086,13 @@ void OlaClientCore::UpdateDmxData(
     const ola::proto::DmxData *request,
     ola::proto::Ack *response,
     ::google::protobuf::Closure *done) {
-  if (m_dmx_callback) {
-    DmxBuffer buffer;
-    buffer.Set(request->data());
+  // deltas are decoded even without a callback, so we stay in step with
+  // the server
+  DmxBuffer buffer;
+  if (!m_delta_decoder.Decode(*request, &buffer)) {
+    OLA_WARN << "Dropping DMX delta for universe " << request->universe()
+             << " without a keyframe";
+  } else if (m_dmx_callback) {
     m_dmx_callback->Run(request->universe(), buffer, "");
   }
   done->Run();
@@ -858,6 +1101,25 @@ void OlaClientCore::UpdateDmxData(
 }
 
 
+/*
+ * Called when new DMX data arrives as a streaming request, there is no
+ * response for these.
+ */
+void OlaClientCore::StreamDmxData(
+    ::google::protobuf::RpcController*,
+    const ola::proto::DmxData *request,
+    ola::proto::STREAMING_NO_RESPONSE*,
+    ::google::protobuf::Closure*) {
+  DmxBuffer buffer;
+  if (!m_delta_decoder.Decode(*request, &buffer)) {
+    OLA_WARN << "Dropping DMX delta for universe " << request->universe()
+             << " without a keyframe";
+  } else if (m_dmx_callback) {
+    m_dmx_callback->Run(request->universe(), buffer, "");
+  }
+}
+
+
 // The following are RPC callbacks
 
 /*
@@ -1049,6 +1311,17 @@ void OlaClientCore::HandleAck(ack_args *args) {
 }
 
 
+/*
+ * Called once UpdateDmxData completes. If it failed, the server may not have
+ * applied the frame, so the next frame for each universe is sent in full.
+ */
+void OlaClientCore::HandleDmxAck(ack_args *args) {
+  if (args->controller->Failed())
+    m_delta_encoder.Reset();
+  HandleAck(args);
+}
+
+
 /*
  * Called once UniverseInfo completes
  */
@@ -1131,6 +1404,23 @@ void OlaClientCore::HandleUniverseInfo(universe_info_args *args) {
 }
 
 
+/*
+ * Called once SetFeatures completes. Old servers don't have this method, in
+ * which case we stick to the original protocol.
+ */
+void OlaClientCore::HandleFeatures(SimpleRpcController *controller,
+                                   ola::proto::Features *reply) {
+  if (controller->Failed()) {
+    OLA_INFO << "Server doesn't support optional features: "
+             << controller->ErrorText();
+  } else {
+    m_delta_dmx = reply->dmx_delta();
+  }
+  delete controller;
+  delete reply;
+}
+
+
 /*
  * Called once GetDmx completes
  */
@@ -1215,6 +1505,33 @@ void OlaClientCore::HandleRDMWithPID(rdm_pid_response_args *args) {
 }
 
 
+/*
+ * Handle the response to one of the commands in a batch
+ */
+void OlaClientCore::HandleRDMBatch(rdm_batch_args *args,
+                                   unsigned int index,
+                                   const ola::rdm::ResponseStatus &status,
+                                   const string &data) {
+  if (args->on_response)
+    args->on_response->Run(index, status, data);
+  RDMBatchComplete(args);
+}
+
+
+/*
+ * Run the completion callback once all the commands in a batch are done.
+ */
+void OlaClientCore::RDMBatchComplete(rdm_batch_args *args) {
+  if (--args->outstanding)
+    return;
+
+  if (args->on_complete)
+    args->on_complete->Run();
+  delete args->on_response;
+  delete args;
+}
+
+
 /**
  * The generic SendDmx method.
  * If callback is null here we stream the data.
@@ -1225,7 +1542,10 @@ bool OlaClientCore::GenericSendDmx(
     BaseCallback1<void, const string&> *callback) {
   ola::proto::DmxData request;
   request.set_universe(universe);
-  request.set_data(data.Get());
+  if (m_delta_dmx)
+    m_delta_encoder.Encode(data, &request);
+  else
+    request.set_data(data.Get());
 
   if (callback) {
     // full request
@@ -1233,7 +1553,7 @@ bool OlaClientCore::GenericSendDmx(
     ola::proto::Ack *reply = new ola::proto::Ack();
     google::protobuf::Closure *cb = google::protobuf::NewCallback(
         this,
-        &ola::OlaClientCore::HandleAck,
+        &ola::OlaClientCore::HandleDmxAck,
         NewArgs<ack_args>(controller, reply, callback));
     m_stub->UpdateDmxData(controller, &request, reply, cb);
   } else {
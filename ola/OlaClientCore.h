@@ -28,8 +28,12 @@
 #include "common/protocol/Ola.pb.h"
 #include "common/rpc/SimpleRpcController.h"
 #include "common/rpc/StreamRpcChannel.h"
+#include "common/rpc/WindowedRpcChannel.h"
 #include "ola/Callback.h"
+#include "ola/DmxBatch.h"
 #include "ola/DmxBuffer.h"
+#include "ola/DmxDelta.h"
+#include "ola/DmxSubscription.h"
 #include "ola/OlaCallbackClient.h"
 #include "ola/OlaDevice.h"
 #include "ola/common.h"
@@ -48,6 +52,7 @@ using std::string;
 using ola::io::ConnectedDescriptor;
 using ola::rpc::SimpleRpcController;
 using ola::rpc::StreamRpcChannel;
+using ola::rpc::WindowedRpcChannel;
 
 class OlaClientCore: public ola::proto::OlaClientService {
   public:
@@ -144,6 +149,10 @@ class OlaClientCore: public ola::proto::OlaClientService {
         unsigned int universe,
         ola::RegisterAction register_action,
         SingleUseCallback1<void, const string&> *callback);
+    bool RegisterUniverse(
+        unsigned int universe,
+        const DmxSubscription &subscription,
+        SingleUseCallback1<void, const string&> *callback);
     bool SendDmx(
         unsigned int universe,
         const DmxBuffer &data,
@@ -153,6 +162,9 @@ class OlaClientCore: public ola::proto::OlaClientService {
         const DmxBuffer &data,
         Callback1<void, const string&> *callback);
     bool SendDmx(unsigned int universe, const DmxBuffer &data);
+    bool SendDmxBatch(const DmxBatch &batch,
+                      SingleUseCallback1<void, const string&> *callback);
+    bool SendDmxBatch(const DmxBatch &batch);
     bool FetchDmx(
         unsigned int universe,
         SingleUseCallback2<void, const DmxBuffer&, const string&> *callback);
@@ -201,10 +213,22 @@ class OlaClientCore: public ola::proto::OlaClientService {
                 const uint8_t *data,
                 unsigned int data_length);
 
+    bool RDMGetBatch(
+        const vector<OlaCallbackClient::RDMGetRequest> &requests,
+        OlaCallbackClient::RDMBatchCallback *on_response,
+        SingleUseCallback0<void> *on_complete);
+
     // timecode
     bool SendTimeCode(ola::SingleUseCallback1<void, const string&> *callback,
                       const ola::timecode::TimeCode &timecode);
 
+    // request window
+    void SetMaxInFlightRequests(unsigned int max_in_flight);
+    unsigned int InFlightRequests() const;
+    unsigned int QueuedRequests() const;
+    unsigned int CancelQueuedRequests();
+    void GetRequestStats(vector<OlaCallbackClient::RequestStats> *stats) const;
+
     /*
      * This is called by the channel when new DMX data turns up
      */
@@ -212,6 +236,10 @@ class OlaClientCore: public ola::proto::OlaClientService {
                        const ola::proto::DmxData* request,
                        ola::proto::Ack* response,
                        ::google::protobuf::Closure* done);
+    void StreamDmxData(::google::protobuf::RpcController* controller,
+                       const ola::proto::DmxData* request,
+                       ola::proto::STREAMING_NO_RESPONSE* response,
+                       ::google::protobuf::Closure* done);
 
     // unfortunately all of these need to be public because they're used in the
     // closures. That's why this class is wrapped in OlaClient or
@@ -267,6 +295,7 @@ class OlaClientCore: public ola::proto::OlaClientService {
     } ack_args;
 
     void HandleAck(ack_args *args);
+    void HandleDmxAck(ack_args *args);
 
     typedef struct {
       SimpleRpcController *controller;
@@ -320,6 +349,18 @@ class OlaClientCore: public ola::proto::OlaClientService {
 
     void HandleRDMWithPID(rdm_pid_response_args *args);
 
+    typedef struct {
+      OlaCallbackClient::RDMBatchCallback *on_response;
+      SingleUseCallback0<void> *on_complete;
+      unsigned int outstanding;
+    } rdm_batch_args;
+
+    void HandleRDMBatch(rdm_batch_args *args,
+                        unsigned int index,
+                        const ola::rdm::ResponseStatus &status,
+                        const string &data);
+    void RDMBatchComplete(rdm_batch_args *args);
+
   private:
     OlaClientCore(const OlaClientCore&);
     OlaClientCore operator=(const OlaClientCore&);
@@ -329,6 +370,11 @@ class OlaClientCore: public ola::proto::OlaClientService {
         const DmxBuffer &data,
         BaseCallback1<void, const string&> *callback);
 
+    void BatchToProto(const DmxBatch &batch,
+                      ola::proto::DmxDataBatch *request);
+    void HandleFeatures(SimpleRpcController *controller,
+                        ola::proto::Features *reply);
+
     bool GenericFetchCandidatePorts(
         unsigned int universe_id,
         bool include_universe,
@@ -380,8 +426,15 @@ class OlaClientCore: public ola::proto::OlaClientService {
     Callback3<void, unsigned int, const DmxBuffer&, const string&>
       *m_dmx_callback;
     StreamRpcChannel *m_channel;
+    // limits the number of requests waiting on the server
+    WindowedRpcChannel *m_window;
+    unsigned int m_max_in_flight;
     ola::proto::OlaServerService_Stub *m_stub;
     int m_connected;
+    // set once the server has said it accepts delta DmxData
+    bool m_delta_dmx;
+    DmxDeltaEncoder m_delta_encoder;
+    DmxDeltaDecoder m_delta_decoder;
 };
 
 
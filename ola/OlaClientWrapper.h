@@ -54,7 +54,7 @@ class BaseClientWrapper {
     void SocketClosed();
 
   protected:
-    auto_ptr<TCPSocket> m_socket;
+    auto_ptr<ola::io::ConnectedDescriptor> m_socket;
 
   private:
     SelectServer m_ss;
@@ -92,13 +92,8 @@ class GenericClientWrapper: public BaseClientWrapper {
     bool StartupClient() { return m_client->Setup(); }
 
     void InitSocket() {
-      if (m_auto_start)
-        m_socket.reset(ola::client::ConnectToServer(OLA_DEFAULT_PORT));
-      else
-        m_socket.reset(TCPSocket::Connect(
-            ola::network::IPV4SocketAddress(
-              ola::network::IPV4Address::Loopback(),
-             OLA_DEFAULT_PORT)));
+      m_socket.reset(ola::client::ConnectToServer(OLA_DEFAULT_PORT,
+                                                  m_auto_start));
     }
 };
 
@@ -23,35 +23,50 @@
 #include <ola/Callback.h>
 #include <ola/DmxBuffer.h>
 #include <ola/Logging.h>
-#include <ola/network/IPV4Address.h>
-#include <ola/network/SocketAddress.h>
 #include <ola/StreamingClient.h>
+#include <memory>
 #include "common/protocol/Ola.pb.h"
+#include "common/rpc/SimpleRpcController.h"
 #include "common/rpc/StreamRpcChannel.h"
+#include "common/utils/SharedDmxRegion.h"
+#include "ola/DmxDelta.h"
 
 namespace ola {
 
+const unsigned int StreamingClient::DEFAULT_SHARED_DMX_SLOTS;
+
+using ola::rpc::SimpleRpcController;
 using ola::rpc::StreamRpcChannel;
 using ola::proto::OlaServerService_Stub;
 
 StreamingClient::StreamingClient(bool auto_start)
     : m_auto_start(auto_start),
       m_server_port(OLA_DEFAULT_PORT),
+      m_shared_dmx_slots(DEFAULT_SHARED_DMX_SLOTS),
+      m_delta_dmx_enabled(true),
       m_socket(NULL),
       m_ss(NULL),
       m_channel(NULL),
       m_stub(NULL),
-      m_socket_closed(false) {
+      m_socket_closed(false),
+      m_shared_dmx(NULL),
+      m_rpc_complete(false),
+      m_delta_encoder(NULL) {
 }
 
 StreamingClient::StreamingClient(const Options &options)
     : m_auto_start(options.auto_start),
       m_server_port(options.server_port),
+      m_shared_dmx_slots(options.shared_dmx_slots),
+      m_delta_dmx_enabled(options.delta_dmx),
       m_socket(NULL),
       m_ss(NULL),
       m_channel(NULL),
       m_stub(NULL),
-      m_socket_closed(false) {
+      m_socket_closed(false),
+      m_shared_dmx(NULL),
+      m_rpc_complete(false),
+      m_delta_encoder(NULL) {
 }
 
 StreamingClient::~StreamingClient() {
@@ -66,12 +81,7 @@ bool StreamingClient::Setup() {
   if (m_socket || m_channel || m_stub)
     return false;
 
-  if (m_auto_start)
-    m_socket = ola::client::ConnectToServer(m_server_port);
-  else
-    m_socket = TCPSocket::Connect(
-      ola::network::IPV4SocketAddress(ola::network::IPV4Address::Loopback(),
-                                      m_server_port));
+  m_socket = ola::client::ConnectToServer(m_server_port, m_auto_start);
 
   if (!m_socket)
     return false;
@@ -102,7 +112,14 @@ bool StreamingClient::Setup() {
   m_channel->SetOnClose(
       NewSingleCallback(this, &StreamingClient::SocketClosed));
 
-  return true;
+  // The server can only check who owns the shared memory over the unix
+  // socket, so don't bother asking over TCP.
+  if (m_shared_dmx_slots &&
+      dynamic_cast<ola::io::UnixSocket*>(m_socket))  // NOLINT(runtime/rtti)
+    SetupSharedDmx();
+  if (m_delta_dmx_enabled && m_stub)
+    SetupDeltaDmx();
+  return m_stub != NULL;
 }
 
 
@@ -110,6 +127,15 @@ bool StreamingClient::Setup() {
  * Close the ola connection.
  */
 void StreamingClient::Stop() {
+  if (m_shared_dmx)
+    delete m_shared_dmx;
+  m_shared_dmx = NULL;
+  m_shared_slots.clear();
+
+  if (m_delta_encoder)
+    delete m_delta_encoder;
+  m_delta_encoder = NULL;
+
   if (m_stub)
     delete m_stub;
 
@@ -136,6 +162,70 @@ void StreamingClient::Stop() {
  */
 bool StreamingClient::SendDmx(unsigned int universe,
                               const DmxBuffer &data) {
+  if (!CheckConnection())
+    return false;
+
+  if (WriteSharedDmx(universe, data, false, 0)) {
+    NotifySharedDmx();
+  } else {
+    ola::proto::DmxData request;
+    request.set_universe(universe);
+    SetDmxData(data, &request);
+    m_stub->StreamDmxData(NULL, &request, NULL, NULL);
+  }
+
+  if (m_socket_closed) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+
+/*
+ * Send the DMX for many universes to the remote OLA server in one message.
+ * @returns True is sent sucessfully, false if the connection to the server has
+ * been closed and Setup() needs to be run again.
+ */
+bool StreamingClient::SendDmxBatch(const DmxBatch &batch) {
+  if (!CheckConnection())
+    return false;
+
+  // anything that doesn't fit in the shared region goes over the socket
+  ola::proto::DmxDataBatch request;
+  bool notify = false;
+  DmxBatch::const_iterator iter = batch.begin();
+  for (; iter != batch.end(); ++iter) {
+    if (WriteSharedDmx(iter->Universe(), iter->Data(), iter->HasPriority(),
+                       iter->Priority())) {
+      notify = true;
+      continue;
+    }
+    ola::proto::DmxData *data = request.add_data();
+    data->set_universe(iter->Universe());
+    SetDmxData(iter->Data(), data);
+    if (iter->HasPriority())
+      data->set_priority(iter->Priority());
+  }
+
+  if (notify)
+    NotifySharedDmx();
+  if (request.data_size())
+    m_stub->StreamDmxDataBatch(NULL, &request, NULL, NULL);
+
+  if (m_socket_closed) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+
+/*
+ * Check the connection to the server is still open.
+ * @returns false if the connection has been closed.
+ */
+bool StreamingClient::CheckConnection() {
   if (!m_stub || !m_socket->ValidReadDescriptor())
     return false;
 
@@ -149,11 +239,89 @@ bool StreamingClient::SendDmx(unsigned int universe,
     Stop();
     return false;
   }
+  return true;
+}
+
+
+/*
+ * Called when the socket is closed
+ */
+void StreamingClient::SocketClosed() {
+  m_socket_closed = true;
+  OLA_WARN << "The RPC socket has been closed, this is more than likely due"
+    << " to a framing error, perhaps you're sending too fast?";
+}
+
+
+/*
+ * Create a shared memory region and ask the server to map it. If this fails
+ * everything is sent over the socket.
+ */
+void StreamingClient::SetupSharedDmx() {
+  std::auto_ptr<SharedDmxRegion> region(
+      SharedDmxRegion::Create(m_shared_dmx_slots));
+  if (!region.get())
+    return;
+
+  SimpleRpcController controller;
+  ola::proto::SharedDmxRequest request;
+  ola::proto::Ack reply;
+  request.set_name(region->Name());
+
+  m_rpc_complete = false;
+  m_socket_closed = false;
+  m_stub->SetupSharedDmx(
+      &controller, &request, &reply,
+      google::protobuf::NewCallback(this, &StreamingClient::RpcComplete));
+  if (!WaitForRpc())
+    return;
+
+  // the server has it mapped now, so the name is no longer needed
+  region->Unlink();
+  if (controller.Failed()) {
+    OLA_INFO << "Shared memory DMX isn't available: "
+             << controller.ErrorText();
+    return;
+  }
+  m_shared_dmx = region.release();
+}
 
-  ola::proto::DmxData request;
-  request.set_universe(universe);
-  request.set_data(data.Get());
-  m_stub->StreamDmxData(NULL, &request, NULL, NULL);
+
+/*
+ * Ask the server if it accepts delta DmxData. Old servers don't know about
+ * SetFeatures, in which case the full frames are sent.
+ */
+void StreamingClient::SetupDeltaDmx() {
+  SimpleRpcController controller;
+  ola::proto::Features request;
+  ola::proto::Features reply;
+
+  m_rpc_complete = false;
+  m_socket_closed = false;
+  m_stub->SetFeatures(
+      &controller, &request, &reply,
+      google::protobuf::NewCallback(this, &StreamingClient::RpcComplete));
+  if (!WaitForRpc())
+    return;
+
+  if (controller.Failed()) {
+    OLA_INFO << "Server doesn't support optional features: "
+             << controller.ErrorText();
+    return;
+  }
+  if (reply.dmx_delta())
+    m_delta_encoder = new DmxDeltaEncoder();
+}
+
+
+/*
+ * Run the SelectServer until the outstanding RPC completes.
+ * @returns false if the connection was closed, in which case the client has
+ *   been stopped.
+ */
+bool StreamingClient::WaitForRpc() {
+  while (!m_rpc_complete && !m_socket_closed)
+    m_ss->RunOnce(1, 0);
 
   if (m_socket_closed) {
     Stop();
@@ -163,12 +331,55 @@ bool StreamingClient::SendDmx(unsigned int universe,
 }
 
 
+void StreamingClient::RpcComplete() {
+  m_rpc_complete = true;
+}
+
+
 /*
- * Called when the socket is closed
+ * Set the data in a DmxData message, as a delta if the server supports them.
  */
-void StreamingClient::SocketClosed() {
-  m_socket_closed = true;
-  OLA_WARN << "The RPC socket has been closed, this is more than likely due"
-    << " to a framing error, perhaps you're sending too fast?";
+void StreamingClient::SetDmxData(const DmxBuffer &buffer,
+                                 ola::proto::DmxData *data) {
+  if (m_delta_encoder)
+    m_delta_encoder->Encode(buffer, data);
+  else
+    data->set_data(buffer.Get());
+}
+
+
+/*
+ * Write the data for a universe to the shared region.
+ * @returns false if there isn't a shared region, or it's full.
+ */
+bool StreamingClient::WriteSharedDmx(unsigned int universe,
+                                     const DmxBuffer &data,
+                                     bool has_priority,
+                                     uint8_t priority) {
+  if (!m_shared_dmx)
+    return false;
+
+  unsigned int slot;
+  std::map<unsigned int, unsigned int>::const_iterator iter =
+    m_shared_slots.find(universe);
+  if (iter == m_shared_slots.end()) {
+    if (m_shared_slots.size() >= m_shared_dmx->SlotCount())
+      return false;
+    slot = m_shared_slots.size();
+    m_shared_slots[universe] = slot;
+  } else {
+    slot = iter->second;
+  }
+  return m_shared_dmx->Write(slot, universe, data, has_priority, priority);
+}
+
+
+/*
+ * Tell the server there is new data in the shared region.
+ */
+void StreamingClient::NotifySharedDmx() {
+  ola::proto::SharedDmxNotify request;
+  request.set_slots(m_shared_slots.size());
+  m_stub->NotifySharedDmx(NULL, &request, NULL, NULL);
 }
 }  // namespace ola
@@ -26,17 +26,23 @@
 #define OLA_STREAMINGCLIENT_H_
 
 #include <ola/BaseTypes.h>
+#include <ola/DmxBatch.h>
 #include <ola/DmxBuffer.h>
 #include <ola/io/SelectServer.h>
 #include <ola/network/TCPSocket.h>
+#include <map>
 
 namespace ola {
 
+class DmxDeltaEncoder;
+class SharedDmxRegion;
+
 namespace rpc {
   class StreamRpcChannel;
 }
 
 namespace proto {
+  class DmxData;
   class OlaServerService_Stub;
 }
 
@@ -48,12 +54,28 @@ using ola::network::TCPSocket;
  */
 class StreamingClient {
   public:
+    // The number of universes sent using shared memory if the options don't
+    // say otherwise.
+    static const unsigned int DEFAULT_SHARED_DMX_SLOTS = 16;
+
     struct Options {
       public:
-        Options() : auto_start(true), server_port(OLA_DEFAULT_PORT) {}
+        Options()
+            : auto_start(true),
+              server_port(OLA_DEFAULT_PORT),
+              shared_dmx_slots(DEFAULT_SHARED_DMX_SLOTS),
+              delta_dmx(true) {
+        }
 
         bool auto_start;
         uint16_t server_port;
+        // The number of universes to send using shared memory rather than
+        // the socket, 0 disables it. Shared memory is only used when we're
+        // connected over the unix socket and olad was run with --shared-dmx,
+        // otherwise everything is sent over the socket.
+        unsigned int shared_dmx_slots;
+        // Only send the slots that have changed, if the server supports it.
+        bool delta_dmx;
     };
 
     explicit StreamingClient(bool auto_start = true);
@@ -64,19 +86,38 @@ class StreamingClient {
     void Stop();
 
     bool SendDmx(unsigned int universe, const DmxBuffer &data);
+    bool SendDmxBatch(const DmxBatch &batch);
     void SocketClosed();
 
   private:
     StreamingClient(const StreamingClient&);
     StreamingClient operator=(const StreamingClient&);
 
+    bool CheckConnection();
+    void SetupSharedDmx();
+    void SetupDeltaDmx();
+    bool WaitForRpc();
+    void RpcComplete();
+    void SetDmxData(const DmxBuffer &buffer, ola::proto::DmxData *data);
+    bool WriteSharedDmx(unsigned int universe, const DmxBuffer &data,
+                        bool has_priority, uint8_t priority);
+    void NotifySharedDmx();
+
     bool m_auto_start;
     uint16_t m_server_port;
-    TCPSocket *m_socket;
+    unsigned int m_shared_dmx_slots;
+    bool m_delta_dmx_enabled;
+    ola::io::ConnectedDescriptor *m_socket;
     SelectServer *m_ss;
     class ola::rpc::StreamRpcChannel *m_channel;
     class ola::proto::OlaServerService_Stub *m_stub;
     bool m_socket_closed;
+    SharedDmxRegion *m_shared_dmx;
+    bool m_rpc_complete;
+    // set if the server accepts delta DmxData
+    DmxDeltaEncoder *m_delta_encoder;
+    // maps universes to slots in the shared region
+    std::map<unsigned int, unsigned int> m_shared_slots;
 };
 }  // namespace ola
 #endif  // OLA_STREAMINGCLIENT_H_
@@ -22,6 +22,7 @@
 #include <string>
 #include <memory>
 
+#include "ola/DmxBatch.h"
 #include "ola/DmxBuffer.h"
 #include "ola/Logging.h"
 #include "ola/StreamingClient.h"
@@ -45,12 +46,14 @@ using std::auto_ptr;
 class StreamingClientTest: public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(StreamingClientTest);
   CPPUNIT_TEST(testSendDMX);
+  CPPUNIT_TEST(testSharedDMX);
   CPPUNIT_TEST_SUITE_END();
 
   public:
     void setUp();
     void tearDown();
     void testSendDMX();
+    void testSharedDMX();
 
   private:
     class OlaServerThread *m_server_thread;
@@ -94,6 +97,10 @@ bool OlaServerThread::Setup() {
   ola_options.http_enable_quit = false;
   ola_options.http_port = 0;
   ola_options.http_data_dir = "";
+  ola_options.event_loops = 1;
+  ola_options.output_keepalive = 0;
+  ola_options.output_rate = 0;
+  ola_options.shared_dmx = true;
 
   // pick an unused port
   auto_ptr<OlaDaemon> olad(new OlaDaemon(ola_options, NULL));
@@ -218,3 +225,30 @@ void StreamingClientTest::testSendDMX() {
 
   OLA_ASSERT_FALSE(ola_client.Setup());
 }
+
+
+/*
+ * Check that sending DMX works with the shared memory transport, including
+ * when there are more universes than slots.
+ */
+void StreamingClientTest::testSharedDMX() {
+  m_server_thread->WaitForStart();
+  GenericSocketAddress server_address = m_server_thread->RPCAddress();
+  StreamingClient::Options options;
+  options.auto_start = false;
+  options.server_port = server_address.V4Addr().Port();
+  options.shared_dmx_slots = 2;
+  StreamingClient ola_client(options);
+
+  ola::DmxBuffer buffer;
+  buffer.Blackout();
+  OLA_ASSERT_TRUE(ola_client.Setup());
+  OLA_ASSERT_TRUE(ola_client.SendDmx(TEST_UNIVERSE, buffer));
+
+  ola::DmxBatch batch;
+  for (unsigned int i = 0; i < 3; i++)
+    batch.push_back(ola::DmxUpdate(TEST_UNIVERSE + i, buffer, 120));
+  OLA_ASSERT_TRUE(ola_client.SendDmxBatch(batch));
+  OLA_ASSERT_TRUE(ola_client.SendDmx(TEST_UNIVERSE + 2, buffer));
+  ola_client.Stop();
+}
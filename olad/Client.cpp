@@ -19,28 +19,158 @@
  */
 
 #include <google/protobuf/stubs/common.h>
+#include <string.h>
+#include <algorithm>
 #include <map>
 #include <utility>
 #include "common/protocol/Ola.pb.h"
+#include "common/rpc/StreamRpcChannel.h"
+#include "ola/Callback.h"
 #include "ola/Logging.h"
 #include "ola/stl/STLUtils.h"
 #include "olad/Client.h"
 
 namespace ola {
 
-using google::protobuf::NewCallback;
 using ola::rpc::SimpleRpcController;
+using std::string;
+
+const char Client::K_CLIENT_DMX_DEFERRED_VAR[] = "client-dmx-deferred";
+const char Client::K_CLIENT_DMX_DROPPED_VAR[] = "client-dmx-dropped";
+const char Client::K_CLIENT_DMX_RATE_LIMITED_VAR[] = "client-dmx-rate-limited";
+const unsigned int Client::MAX_OUTSTANDING_ACKS;
+const unsigned int Client::MAX_PENDING_OUTPUT;
+
+
+/*
+ * Create a new client.
+ * @param client_stub the stub to send requests to the client with
+ * @param channel the channel the stub uses, this is used to check how much
+ *   data is waiting to be sent. May be NULL.
+ * @param export_map the ExportMap to publish the per-client stats to, may be
+ *   NULL.
+ * @param id the key to use for this client in the exported stats, this must be
+ *   unique.
+ */
+Client::Client(OlaClientService_Stub *client_stub,
+               ola::rpc::StreamRpcChannel *channel,
+               ExportMap *export_map,
+               const string &id)
+    : m_client_stub(client_stub),
+      m_channel(channel),
+      m_export_map(export_map),
+      m_id(id),
+      m_streaming_dmx(false),
+      m_outstanding_acks(0),
+      m_delta_dmx(false),
+      m_ss(NULL) {
+  if (m_channel)
+    m_channel->SetOnDrain(NewCallback(this, &Client::SendPendingDMX));
+
+  if (m_export_map) {
+    m_deferred_handle = m_export_map->GetUIntMapVar(
+        K_CLIENT_DMX_DEFERRED_VAR, "client")->Handle(m_id);
+    m_dropped_handle = m_export_map->GetUIntMapVar(
+        K_CLIENT_DMX_DROPPED_VAR, "client")->Handle(m_id);
+    m_rate_limited_handle = m_export_map->GetUIntMapVar(
+        K_CLIENT_DMX_RATE_LIMITED_VAR, "client")->Handle(m_id);
+    m_deferred_handle.Set(0);
+    m_dropped_handle.Set(0);
+    m_rate_limited_handle.Set(0);
+  }
+}
+
 
 Client::~Client() {
   m_data_map.clear();
+  while (!m_subscriptions.empty())
+    RemoveSubscription(m_subscriptions.begin()->first);
+
+  if (m_export_map) {
+    m_export_map->GetUIntMapVar(K_CLIENT_DMX_DEFERRED_VAR, "client")->Remove(
+        m_id);
+    m_export_map->GetUIntMapVar(K_CLIENT_DMX_DROPPED_VAR, "client")->Remove(
+        m_id);
+    m_export_map->GetUIntMapVar(K_CLIENT_DMX_RATE_LIMITED_VAR,
+                                "client")->Remove(m_id);
+  }
+}
+
+
+/*
+ * Limit the data sent to this client for a universe. This replaces any
+ * existing subscription for the universe.
+ * @param universe the universe_id
+ * @param subscription the slots & rate to send
+ */
+void Client::SetSubscription(unsigned int universe,
+                             const DmxSubscription &subscription) {
+  RemoveSubscription(universe);
+  if (subscription.Unfiltered())
+    return;
+
+  Subscription *entry = new Subscription();
+  entry->filter = subscription;
+  if (subscription.MaxRate())
+    entry->period = TimeInterval(0, USEC_IN_SECONDS / subscription.MaxRate());
+  entry->timeout = ola::thread::INVALID_TIMEOUT;
+  entry->has_data = false;
+  entry->held = false;
+  m_subscriptions[universe] = entry;
 }
 
 
 /*
- * Send a DMX Update to this client
+ * Go back to sending all the data for a universe.
+ * @param universe the universe_id
+ */
+void Client::RemoveSubscription(unsigned int universe) {
+  SubscriptionMap::iterator iter = m_subscriptions.find(universe);
+  if (iter == m_subscriptions.end())
+    return;
+
+  if (iter->second->timeout != ola::thread::INVALID_TIMEOUT)
+    m_ss->RemoveTimeout(iter->second->timeout);
+  delete iter->second;
+  m_subscriptions.erase(iter);
+  // the client has the filtered data, so the next delta needs a keyframe
+  m_delta_encoder.Reset();
+}
+
+
+/*
+ * Send DMX data to this client as deltas. This is set once the client says it
+ * can decode them.
+ */
+void Client::SetDeltaDMX(bool delta) {
+  if (delta != m_delta_dmx)
+    m_delta_encoder.Reset();
+  m_delta_dmx = delta;
+}
+
+
+/*
+ * Copy the DMX data sent by this client into a DmxBuffer, applying deltas to
+ * the last frame for the universe.
+ * @returns false if this was a delta and we don't have a keyframe.
+ */
+bool Client::DecodeDMX(const ola::proto::DmxData &data, DmxBuffer *buffer) {
+  if (m_delta_decoder.Decode(data, buffer))
+    return true;
+  OLA_WARN << "Client " << m_id << " sent a DMX delta for universe "
+           << data.universe() << " without a keyframe";
+  return false;
+}
+
+
+/*
+ * Send a DMX Update to this client. If the client is behind, the data is held
+ * back until it catches up, replacing any data already waiting for this
+ * universe.
  * @param universe the universe_id for this data
  * @param buffer the DmxBuffer with the data
- * @return true if the update was sent, false otherwise
+ * @return true if the update was sent, queued or filtered out, false
+ *   otherwise
  */
 bool Client::SendDMX(unsigned int universe, const DmxBuffer &buffer) {
   if (!m_client_stub) {
@@ -48,22 +178,106 @@ bool Client::SendDMX(unsigned int universe, const DmxBuffer &buffer) {
     return false;
   }
 
-  SimpleRpcController *controller = new SimpleRpcController();
-  ola::proto::DmxData dmx_data;
-  ola::proto::Ack *ack = new ola::proto::Ack();
+  Subscription *subscription = STLFindOrNull(m_subscriptions, universe);
+  if (subscription && FilterDMX(universe, subscription, buffer))
+    return true;
 
-  dmx_data.set_universe(universe);
-  dmx_data.set_data(buffer.Get());
+  DeliverDMX(universe, buffer);
+  return true;
+}
 
-  m_client_stub->UpdateDmxData(
-      controller,
-      &dmx_data,
-      ack,
-      NewCallback(this, &ola::Client::SendDMXCallback, controller, ack));
+
+/*
+ * Apply a subscription to an update.
+ * @returns true if the update shouldn't be sent now, either because the
+ *   slots the client wants didn't change, or because of the rate limit.
+ */
+bool Client::FilterDMX(unsigned int universe,
+                       Subscription *subscription,
+                       const DmxBuffer &buffer) {
+  const DmxSubscription::SlotRanges &slots = subscription->filter.Slots();
+  if (!slots.empty() && subscription->has_data) {
+    bool changed = false;
+    DmxSubscription::SlotRanges::const_iterator iter = slots.begin();
+    for (; iter != slots.end() && !changed; ++iter) {
+      const DmxBuffer &old_data = subscription->data;
+      unsigned int old_length = old_data.Size() > iter->offset ?
+          std::min(iter->length, old_data.Size() - iter->offset) : 0;
+      unsigned int new_length = buffer.Size() > iter->offset ?
+          std::min(iter->length, buffer.Size() - iter->offset) : 0;
+      changed = (old_length != new_length ||
+                 memcmp(old_data.GetRaw() + iter->offset,
+                        buffer.GetRaw() + iter->offset, new_length));
+    }
+    if (!changed)
+      return true;
+  }
+  subscription->has_data = true;
+  subscription->data = buffer;
+
+  if (!m_ss || !subscription->filter.MaxRate())
+    return false;
+
+  // while the timer is running, it sends the data
+  if (subscription->timeout != ola::thread::INVALID_TIMEOUT) {
+    if (subscription->held)
+      m_rate_limited_handle++;
+    subscription->held = true;
+    return true;
+  }
+
+  const TimeStamp *now = m_ss->WakeUpTime();
+  if (!subscription->last_sent.IsSet() ||
+      *now - subscription->last_sent >= subscription->period) {
+    subscription->last_sent = *now;
+    return false;
+  }
+
+  subscription->held = true;
+  subscription->timeout = m_ss->RegisterRepeatingTimeout(
+      subscription->period,
+      NewCallback(this, &Client::SendHeldDMX, universe));
   return true;
 }
 
 
+/*
+ * Called by the rate limit timer. The timer keeps running while updates
+ * arrive faster than the rate, and stops once there's nothing left to send.
+ */
+bool Client::SendHeldDMX(unsigned int universe) {
+  Subscription *subscription = STLFindOrNull(m_subscriptions, universe);
+  if (!subscription)
+    return false;
+
+  if (!subscription->held) {
+    subscription->timeout = ola::thread::INVALID_TIMEOUT;
+    return false;
+  }
+  subscription->held = false;
+  subscription->last_sent = *m_ss->WakeUpTime();
+  DeliverDMX(universe, subscription->data);
+  return true;
+}
+
+
+/*
+ * Send an update, or hold it back if the client isn't keeping up.
+ */
+void Client::DeliverDMX(unsigned int universe, const DmxBuffer &buffer) {
+  map<unsigned int, DmxBuffer>::iterator iter = m_pending_dmx.find(universe);
+  if (iter != m_pending_dmx.end()) {
+    iter->second = buffer;
+    m_dropped_handle++;
+  } else if (CanSendDMX()) {
+    SendDMXNow(universe, buffer);
+  } else {
+    m_pending_dmx[universe] = buffer;
+    m_deferred_handle++;
+  }
+}
+
+
 /*
  * Called when UpdateDmxData completes
  */
@@ -71,6 +285,9 @@ void Client::SendDMXCallback(SimpleRpcController *controller,
                              ola::proto::Ack *reply) {
   delete controller;
   delete reply;
+  if (m_outstanding_acks)
+    m_outstanding_acks--;
+  SendPendingDMX();
 }
 
 
@@ -99,4 +316,69 @@ const DmxSource Client::SourceData(unsigned int universe) const {
     return source;
   }
 }
+
+
+/*
+ * Check if the client is keeping up with the data we've sent it.
+ */
+bool Client::CanSendDMX() const {
+  if (m_channel && m_channel->PendingOutput() >= MAX_PENDING_OUTPUT)
+    return false;
+  return m_streaming_dmx || m_outstanding_acks < MAX_OUTSTANDING_ACKS;
+}
+
+
+void Client::SendDMXNow(unsigned int universe, const DmxBuffer &buffer) {
+  ola::proto::DmxData dmx_data;
+  dmx_data.set_universe(universe);
+
+  const Subscription *subscription = STLFindOrNull(m_subscriptions, universe);
+  if (subscription && !subscription->filter.Slots().empty()) {
+    dmx_data.set_data("");
+    const DmxSubscription::SlotRanges &slots = subscription->filter.Slots();
+    DmxSubscription::SlotRanges::const_iterator iter = slots.begin();
+    for (; iter != slots.end(); ++iter) {
+      if (iter->offset >= buffer.Size())
+        continue;
+      ola::proto::DmxSlice *slice = dmx_data.add_slice();
+      slice->set_offset(iter->offset);
+      slice->set_data(buffer.GetRaw() + iter->offset,
+                      std::min(iter->length, buffer.Size() - iter->offset));
+    }
+  } else if (m_delta_dmx) {
+    m_delta_encoder.Encode(buffer, &dmx_data);
+  } else {
+    dmx_data.set_data(buffer.Get());
+  }
+
+  if (m_streaming_dmx) {
+    m_client_stub->StreamDmxData(NULL, &dmx_data, NULL, NULL);
+    return;
+  }
+
+  SimpleRpcController *controller = new SimpleRpcController();
+  ola::proto::Ack *ack = new ola::proto::Ack();
+  m_outstanding_acks++;
+  m_client_stub->UpdateDmxData(
+      controller,
+      &dmx_data,
+      ack,
+      google::protobuf::NewCallback(this, &ola::Client::SendDMXCallback,
+                                    controller, ack));
+}
+
+
+/*
+ * Send the data that was held back, this is called once the client catches
+ * up.
+ */
+void Client::SendPendingDMX() {
+  while (!m_pending_dmx.empty() && CanSendDMX()) {
+    map<unsigned int, DmxBuffer>::iterator iter = m_pending_dmx.begin();
+    unsigned int universe = iter->first;
+    DmxBuffer buffer = iter->second;
+    m_pending_dmx.erase(iter);
+    SendDMXNow(universe, buffer);
+  }
+}
 }  // namespace ola
@@ -22,13 +22,24 @@
 #define OLAD_CLIENT_H_
 
 #include <map>
+#include <string>
 #include "common/rpc/SimpleRpcController.h"
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "ola/DmxDelta.h"
+#include "ola/DmxSubscription.h"
+#include "ola/ExportMap.h"
+#include "ola/io/SelectServerInterface.h"
 #include "olad/DmxSource.h"
 
 namespace ola {
 namespace proto {
   class OlaClientService_Stub;
   class Ack;
+  class DmxData;
+}
+namespace rpc {
+  class StreamRpcChannel;
 }
 }
 
@@ -37,25 +48,109 @@ namespace ola {
 using std::map;
 using ola::proto::OlaClientService_Stub;
 
+/*
+ * A connected client.
+ *
+ * DMX data for the universes a client has registered for is sent as it
+ * changes. A client that can't keep up mustn't slow down the rest of the
+ * daemon, so once too much data is waiting to be sent to it, the latest frame
+ * for each universe is held back and sent when the client catches up. Frames
+ * that are replaced before they're sent are dropped.
+ *
+ * A client can also limit what it receives for a universe with a
+ * DmxSubscription. Only the slots it asked for are sent, and nothing is sent
+ * if they haven't changed. If the rate is capped, updates that arrive too
+ * soon are held back and the latest one is sent once the period is up.
+ *
+ * Clients that support it are sent just the slots that changed since the last
+ * frame, rather than the whole universe.
+ */
 class Client {
   public :
-    explicit Client(OlaClientService_Stub *client_stub):
-      m_client_stub(client_stub) {}
+    explicit Client(OlaClientService_Stub *client_stub,
+                    ola::rpc::StreamRpcChannel *channel = NULL,
+                    ExportMap *export_map = NULL,
+                    const std::string &id = "");
     virtual ~Client();
     virtual bool SendDMX(unsigned int universe_id, const DmxBuffer &buffer);
 
+    // Send DMX data as StreamDmxData requests, rather than UpdateDmxData
+    // requests which need an Ack.
+    void SetStreamingDMX(bool streaming) { m_streaming_dmx = streaming; }
+    bool StreamingDMX() const { return m_streaming_dmx; }
+
+    // The SelectServer is needed to cap the rate of a subscription, without
+    // one the rate isn't limited.
+    void SetSelectServer(ola::io::SelectServerInterface *ss) { m_ss = ss; }
+
+    void SetSubscription(unsigned int universe,
+                         const DmxSubscription &subscription);
+    void RemoveSubscription(unsigned int universe);
+
+    // Deltas are agreed per connection with SetFeatures.
+    void SetDeltaDMX(bool delta);
+    bool DeltaDMX() const { return m_delta_dmx; }
+    bool DecodeDMX(const ola::proto::DmxData &data, DmxBuffer *buffer);
+
     void SendDMXCallback(ola::rpc::SimpleRpcController *controller,
                          ola::proto::Ack *ack);
     void DMXRecieved(unsigned int universe, const DmxSource &source);
     const DmxSource SourceData(unsigned int universe) const;
     class OlaClientService_Stub *Stub() const { return m_client_stub; }
 
+    static const char K_CLIENT_DMX_DEFERRED_VAR[];
+    static const char K_CLIENT_DMX_DROPPED_VAR[];
+    static const char K_CLIENT_DMX_RATE_LIMITED_VAR[];
+
+    // The most Acks we'll wait for before holding data back.
+    static const unsigned int MAX_OUTSTANDING_ACKS = 4;
+    // The most bytes queued on the channel before holding data back.
+    static const unsigned int MAX_PENDING_OUTPUT = 1 << 16;  // 64k
+
   private:
+    struct Subscription {
+      DmxSubscription filter;
+      TimeInterval period;
+      TimeStamp last_sent;
+      ola::thread::timeout_id timeout;
+      // the last data passed on, used to skip updates that don't change the
+      // slots we send
+      bool has_data;
+      DmxBuffer data;
+      // set if the data is waiting for the rate limit timer
+      bool held;
+    };
+    typedef map<unsigned int, Subscription*> SubscriptionMap;
+
     Client(const Client&);
     Client& operator=(const Client&);
 
     class OlaClientService_Stub *m_client_stub;
+    ola::rpc::StreamRpcChannel *m_channel;
+    ExportMap *m_export_map;
+    std::string m_id;
+    // unbound if there isn't an ExportMap
+    CounterHandle m_deferred_handle;
+    CounterHandle m_dropped_handle;
+    CounterHandle m_rate_limited_handle;
+    bool m_streaming_dmx;
+    unsigned int m_outstanding_acks;
+    bool m_delta_dmx;
+    DmxDeltaEncoder m_delta_encoder;
+    DmxDeltaDecoder m_delta_decoder;
     map<unsigned int, DmxSource> m_data_map;
+    // the latest frame for each universe that's waiting to be sent
+    map<unsigned int, DmxBuffer> m_pending_dmx;
+    ola::io::SelectServerInterface *m_ss;
+    SubscriptionMap m_subscriptions;
+
+    bool FilterDMX(unsigned int universe, Subscription *subscription,
+                   const DmxBuffer &buffer);
+    bool SendHeldDMX(unsigned int universe);
+    void DeliverDMX(unsigned int universe, const DmxBuffer &buffer);
+    bool CanSendDMX() const;
+    void SendDMXNow(unsigned int universe, const DmxBuffer &buffer);
+    void SendPendingDMX();
 };
 }  // namespace ola
 #endif  // OLAD_CLIENT_H_
@@ -20,11 +20,15 @@
 
 #include <cppunit/extensions/HelperMacros.h>
 #include <string>
+#include <vector>
 
 #include "ola/Clock.h"
 #include "ola/DmxBuffer.h"
+#include "ola/DmxSubscription.h"
+#include "ola/ExportMap.h"
 #include "olad/DmxSource.h"
 #include "olad/Client.h"
+#include "olad/TestCommon.h"
 #include "common/protocol/Ola.pb.h"
 #include "ola/testing/TestUtils.h"
 
@@ -37,18 +41,33 @@ static const char TEST_DATA2[] = "another set of test data";
 
 using ola::Client;
 using ola::DmxBuffer;
+using ola::DmxSubscription;
+using ola::ExportMap;
+using ola::TimeInterval;
+using ola::TimeStamp;
 using std::string;
+using std::vector;
 
 
 class ClientTest: public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(ClientTest);
   CPPUNIT_TEST(testSendDMX);
   CPPUNIT_TEST(testGetSetDMX);
+  CPPUNIT_TEST(testSlowClient);
+  CPPUNIT_TEST(testStreamingDMX);
+  CPPUNIT_TEST(testSlotSubscription);
+  CPPUNIT_TEST(testRateSubscription);
+  CPPUNIT_TEST(testDeltaDMX);
   CPPUNIT_TEST_SUITE_END();
 
   public:
     void testSendDMX();
     void testGetSetDMX();
+    void testSlowClient();
+    void testStreamingDMX();
+    void testSlotSubscription();
+    void testRateSubscription();
+    void testDeltaDMX();
 
   private:
     ola::Clock m_clock;
@@ -87,6 +106,48 @@ void MockClientStub::UpdateDmxData(
 }
 
 
+/*
+ * A ClientStub that records the DMX data sent, and only completes the
+ * UpdateDmxData requests when told to.
+ */
+class RecordingClientStub: public ola::proto::OlaClientService_Stub {
+  public:
+    RecordingClientStub()
+        : ola::proto::OlaClientService_Stub(NULL),
+          m_streaming_count(0) {
+    }
+    ~RecordingClientStub() { CompleteRequests(m_done.size()); }
+
+    void UpdateDmxData(::google::protobuf::RpcController*,
+                       const ::ola::proto::DmxData* request,
+                       ::ola::proto::Ack*,
+                       ::google::protobuf::Closure* done) {
+      m_data.push_back(*request);
+      m_done.push_back(done);
+    }
+
+    void StreamDmxData(::google::protobuf::RpcController*,
+                       const ::ola::proto::DmxData* request,
+                       ::ola::proto::STREAMING_NO_RESPONSE*,
+                       ::google::protobuf::Closure*) {
+      m_data.push_back(*request);
+      m_streaming_count++;
+    }
+
+    void CompleteRequests(unsigned int count) {
+      for (unsigned int i = 0; i < count && !m_done.empty(); i++) {
+        google::protobuf::Closure *done = m_done.front();
+        m_done.erase(m_done.begin());
+        done->Run();
+      }
+    }
+
+    vector<ola::proto::DmxData> m_data;
+    vector<google::protobuf::Closure*> m_done;
+    unsigned int m_streaming_count;
+};
+
+
 /*
  * Check that the SendDMX method works correctly.
  */
@@ -145,3 +206,218 @@ void ClientTest::testGetSetDMX() {
   OLA_ASSERT_FALSE(source4.IsSet());
   OLA_ASSERT(empty == source4.Data());
 }
+
+
+/*
+ * Check that a client which doesn't Ack the data gets the latest frame for
+ * each universe once it catches up.
+ */
+void ClientTest::testSlowClient() {
+  ExportMap export_map;
+  RecordingClientStub client_stub;
+  Client client(&client_stub, NULL, &export_map, "1");
+  ola::UIntMap *deferred = export_map.GetUIntMapVar(
+      Client::K_CLIENT_DMX_DEFERRED_VAR);
+  ola::UIntMap *dropped = export_map.GetUIntMapVar(
+      Client::K_CLIENT_DMX_DROPPED_VAR);
+
+  const DmxBuffer buffer(TEST_DATA);
+  const DmxBuffer buffer2(TEST_DATA2);
+  for (unsigned int i = 0; i < Client::MAX_OUTSTANDING_ACKS; i++)
+    OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(Client::MAX_OUTSTANDING_ACKS,
+                static_cast<unsigned int>(client_stub.m_data.size()));
+
+  // these are held back, and the later frame replaces the earlier one
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE2, buffer));
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer2));
+  OLA_ASSERT_EQ(Client::MAX_OUTSTANDING_ACKS,
+                static_cast<unsigned int>(client_stub.m_data.size()));
+  OLA_ASSERT_EQ(2u, (*deferred)["1"]);
+  OLA_ASSERT_EQ(1u, (*dropped)["1"]);
+
+  // each Ack lets another frame through
+  client_stub.CompleteRequests(1);
+  OLA_ASSERT_EQ(Client::MAX_OUTSTANDING_ACKS + 1,
+                static_cast<unsigned int>(client_stub.m_data.size()));
+  const ola::proto::DmxData &data = client_stub.m_data.back();
+  OLA_ASSERT_EQ(TEST_UNIVERSE, static_cast<unsigned int>(data.universe()));
+  OLA_ASSERT_EQ(string(TEST_DATA2), data.data());
+
+  client_stub.CompleteRequests(1);
+  OLA_ASSERT_EQ(Client::MAX_OUTSTANDING_ACKS + 2,
+                static_cast<unsigned int>(client_stub.m_data.size()));
+  OLA_ASSERT_EQ(
+      TEST_UNIVERSE2,
+      static_cast<unsigned int>(client_stub.m_data.back().universe()));
+
+  // once it's caught up, data is sent right away
+  client_stub.CompleteRequests(Client::MAX_OUTSTANDING_ACKS);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(Client::MAX_OUTSTANDING_ACKS + 3,
+                static_cast<unsigned int>(client_stub.m_data.size()));
+  OLA_ASSERT_EQ(2u, (*deferred)["1"]);
+}
+
+
+/*
+ * Check that streaming clients don't need to Ack the data.
+ */
+void ClientTest::testStreamingDMX() {
+  RecordingClientStub client_stub;
+  Client client(&client_stub);
+  client.SetStreamingDMX(true);
+
+  const DmxBuffer buffer(TEST_DATA);
+  for (unsigned int i = 0; i < 2 * Client::MAX_OUTSTANDING_ACKS; i++)
+    OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(2 * Client::MAX_OUTSTANDING_ACKS,
+                client_stub.m_streaming_count);
+  OLA_ASSERT_TRUE(client_stub.m_done.empty());
+}
+
+
+/*
+ * Check that only the slots a client subscribed to are sent, and only when
+ * they change.
+ */
+void ClientTest::testSlotSubscription() {
+  RecordingClientStub client_stub;
+  Client client(&client_stub);
+  client.SetStreamingDMX(true);
+
+  DmxSubscription subscription;
+  subscription.AddSlotRange(1, 2);
+  subscription.AddSlotRange(5, 1);
+  subscription.AddSlotRange(600, 1);  // ignored
+  subscription.AddSlotRange(510, 10);  // truncated
+  OLA_ASSERT_EQ(static_cast<size_t>(3), subscription.Slots().size());
+  OLA_ASSERT_EQ(2u, subscription.Slots()[2].length);
+  client.SetSubscription(TEST_UNIVERSE, subscription);
+
+  DmxBuffer buffer;
+  buffer.SetFromString("0,1,2,3,4,5,6");
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(1), client_stub.m_data.size());
+  const ola::proto::DmxData &data = client_stub.m_data.back();
+  OLA_ASSERT_EQ(string(""), data.data());
+  OLA_ASSERT_EQ(2, data.slice_size());
+  OLA_ASSERT_EQ(1, data.slice(0).offset());
+  OLA_ASSERT_EQ(string("\001\002"), data.slice(0).data());
+  OLA_ASSERT_EQ(5, data.slice(1).offset());
+  OLA_ASSERT_EQ(string("\005"), data.slice(1).data());
+
+  // changes to the other slots aren't sent
+  buffer.SetChannel(0, 10);
+  buffer.SetChannel(6, 10);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(1), client_stub.m_data.size());
+
+  buffer.SetChannel(5, 10);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(2), client_stub.m_data.size());
+  OLA_ASSERT_EQ(string("\012"), client_stub.m_data.back().slice(1).data());
+
+  // other universes aren't affected
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE2, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(3), client_stub.m_data.size());
+  OLA_ASSERT_EQ(buffer.Get(), client_stub.m_data.back().data());
+
+  // once the subscription is removed, everything is sent
+  client.RemoveSubscription(TEST_UNIVERSE);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(4), client_stub.m_data.size());
+  OLA_ASSERT_EQ(buffer.Get(), client_stub.m_data.back().data());
+  OLA_ASSERT_EQ(0, client_stub.m_data.back().slice_size());
+}
+
+
+/*
+ * Check that the rate of updates is capped, and the latest data is sent once
+ * the period is up.
+ */
+void ClientTest::testRateSubscription() {
+  TimeStamp wake_up;
+  m_clock.CurrentTime(&wake_up);
+  MockSelectServer ss(&wake_up);
+  ExportMap export_map;
+  RecordingClientStub client_stub;
+  Client client(&client_stub, NULL, &export_map, "1");
+  client.SetStreamingDMX(true);
+  client.SetSelectServer(&ss);
+
+  DmxSubscription subscription;
+  subscription.SetMaxRate(10);
+  client.SetSubscription(TEST_UNIVERSE, subscription);
+
+  const DmxBuffer buffer1(TEST_DATA);
+  const DmxBuffer buffer2(TEST_DATA2);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer1));
+  OLA_ASSERT_EQ(static_cast<size_t>(1), client_stub.m_data.size());
+
+  // updates within the period are held back, and only the last is sent
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer1));
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer2));
+  OLA_ASSERT_EQ(static_cast<size_t>(1), client_stub.m_data.size());
+  OLA_ASSERT_EQ(1u, ss.RepeatingTimeoutCount());
+  OLA_ASSERT_EQ(
+      1u,
+      (*export_map.GetUIntMapVar(Client::K_CLIENT_DMX_RATE_LIMITED_VAR))["1"]);
+
+  wake_up += TimeInterval(0, 100000);
+  ss.RunRepeatingTimeouts();
+  OLA_ASSERT_EQ(static_cast<size_t>(2), client_stub.m_data.size());
+  OLA_ASSERT_EQ(string(TEST_DATA2), client_stub.m_data.back().data());
+
+  // the timer stops once there's nothing left to send
+  ss.RunRepeatingTimeouts();
+  OLA_ASSERT_EQ(0u, ss.RepeatingTimeoutCount());
+  OLA_ASSERT_EQ(static_cast<size_t>(2), client_stub.m_data.size());
+
+  // and once the period is up, data is sent right away
+  wake_up += TimeInterval(0, 100000);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer1));
+  OLA_ASSERT_EQ(static_cast<size_t>(3), client_stub.m_data.size());
+
+  // removing the subscription stops the timer
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer2));
+  OLA_ASSERT_EQ(1u, ss.RepeatingTimeoutCount());
+  client.RemoveSubscription(TEST_UNIVERSE);
+  OLA_ASSERT_EQ(0u, ss.RepeatingTimeoutCount());
+}
+
+
+/*
+ * Check that once a client supports deltas, only the changes are sent, and
+ * that deltas from the client are decoded.
+ */
+void ClientTest::testDeltaDMX() {
+  RecordingClientStub client_stub;
+  Client client(&client_stub);
+  client.SetStreamingDMX(true);
+  client.SetDeltaDMX(true);
+
+  DmxBuffer buffer;
+  buffer.Blackout();
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  buffer.SetChannel(100, 255);
+  OLA_ASSERT_TRUE(client.SendDMX(TEST_UNIVERSE, buffer));
+  OLA_ASSERT_EQ(static_cast<size_t>(2), client_stub.m_data.size());
+  OLA_ASSERT_FALSE(client_stub.m_data[0].delta());
+  OLA_ASSERT_TRUE(client_stub.m_data[1].delta());
+  OLA_ASSERT_EQ(1, client_stub.m_data[1].slice_size());
+
+  // the client end rebuilds the frame
+  ola::DmxDeltaDecoder decoder;
+  DmxBuffer decoded;
+  OLA_ASSERT_TRUE(decoder.Decode(client_stub.m_data[0], &decoded));
+  OLA_ASSERT_TRUE(decoder.Decode(client_stub.m_data[1], &decoded));
+  OLA_ASSERT_TRUE(buffer == decoded);
+
+  // a delta from the client before a keyframe is rejected
+  OLA_ASSERT_FALSE(client.DecodeDMX(client_stub.m_data[1], &decoded));
+  OLA_ASSERT_TRUE(client.DecodeDMX(client_stub.m_data[0], &decoded));
+  OLA_ASSERT_TRUE(client.DecodeDMX(client_stub.m_data[1], &decoded));
+  OLA_ASSERT_TRUE(buffer == decoded);
+}
@@ -0,0 +1,810 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * EventLoopPool.cpp
+ * Runs olad across more than one SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <google/protobuf/service.h>
+#include <pthread.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ola/Logging.h"
+#include "ola/stl/STLUtils.h"
+#include "ola/thread/Trace.h"
+#include "olad/Client.h"
+#include "olad/Device.h"
+#include "olad/EventLoopPool.h"
+#include "olad/Port.h"
+#include "olad/Universe.h"
+
+namespace ola {
+
+using ola::io::SelectServer;
+using ola::rdm::RDMCallback;
+using ola::rdm::RDMDiscoveryCallback;
+using ola::thread::MutexLocker;
+using ola::thread::TraceScope;
+using std::string;
+using std::vector;
+
+const char EventLoopPool::K_LOOP_COUNT_VAR[] = "event-loops";
+const char EventLoopPool::K_LOOP_UTILISATION_VAR[] = "event-loop-utilisation";
+const unsigned int EventLoopPool::K_STATS_INTERVAL_MS = 1000;
+
+
+/*
+ * The id to trace port writes with, this is the universe the port is patched
+ * to.
+ */
+static unsigned int TraceId(const OutputPort *port) {
+  const Universe *universe = port->GetUniverse();
+  return universe ? universe->UniverseId() : ola::thread::TRACE_NO_ID;
+}
+
+
+/*
+ * A source that has never been set is handed off as an empty one.
+ */
+DmxSourceFrame::DmxSourceFrame(const DmxSource &source)
+    : m_priority(DmxSource::PRIORITY_MIN) {
+  if (!source.IsSet())
+    return;
+  m_data = DmxFrame(source.Data());
+  if (source.HasSlotPriorities())
+    m_slot_priorities = DmxFrame(source.SlotPriorities());
+  m_timestamp = source.Timestamp();
+  m_priority = source.Priority();
+}
+
+
+DmxSourceFrame::DmxSourceFrame(const DmxBuffer &buffer,
+                               const TimeStamp &timestamp,
+                               uint8_t priority)
+    : m_data(buffer),
+      m_timestamp(timestamp),
+      m_priority(priority) {
+}
+
+
+/*
+ * The DmxBuffers are filled from the frames, so they don't share anything
+ * with the sending loop.
+ */
+DmxSource DmxSourceFrame::ToSource() const {
+  DmxBuffer data, slot_priorities;
+  m_data.CopyTo(&data);
+  m_slot_priorities.CopyTo(&slot_priorities);
+  return DmxSource(data, m_timestamp, m_priority, slot_priorities);
+}
+
+
+/*
+ * The prefix for the variables in a worker's ExportMap.
+ */
+static string LoopPrefix(unsigned int loop) {
+  std::ostringstream str;
+  str << "loop-" << loop << ".";
+  return str.str();
+}
+
+
+/*
+ * A worker loop. Each worker has its own ExportMap since they aren't thread
+ * safe, these are added to the main map as children.
+ */
+class EventLoopPool::Worker: public ola::thread::Thread {
+  public:
+    Worker(EventLoopPool *pool, unsigned int loop)
+        : loop(loop),
+          export_map(LoopPrefix(loop)),
+          select_server(&export_map),
+          started(false),
+          exited(false),
+          blocked(false),
+          paused_generation(0),
+          m_pool(pool) {
+    }
+
+    const unsigned int loop;
+    ExportMap export_map;
+    SelectServer select_server;
+    // The rest of these are protected by the pool's mutex.
+    ola::thread::ThreadId thread_id;
+    bool started;
+    bool exited;
+    // true if we're waiting in RunOnMain()
+    bool blocked;
+    // the last pause that we've stopped for
+    unsigned int paused_generation;
+
+  protected:
+    void *Run() {
+      std::ostringstream str;
+      str << "event-loop-" << loop;
+      ola::thread::SetTraceThreadName(str.str());
+      m_pool->WorkerStarted(this);
+      select_server.Run();
+      m_pool->WorkerExited(this);
+      return NULL;
+    }
+
+  private:
+    EventLoopPool *m_pool;
+};
+
+
+/*
+ * Create a new EventLoopPool
+ * @param main_ss the main SelectServer, this is loop 0.
+ * @param export_map the ExportMap to publish the stats in.
+ * @param loop_count the total number of loops, including the main one.
+ */
+EventLoopPool::EventLoopPool(SelectServer *main_ss,
+                             ExportMap *export_map,
+                             unsigned int loop_count)
+    : m_main_ss(main_ss),
+      m_export_map(export_map),
+      m_main_thread(ola::thread::Thread::Self()),
+      m_running(false),
+      m_stats_timeout(ola::thread::INVALID_TIMEOUT),
+      m_pause_depth(0),
+      m_workers_paused(false),
+      m_paused(false),
+      m_generation(0) {
+  for (unsigned int i = 1; i < loop_count; i++) {
+    m_workers.push_back(new Worker(this, i));
+    if (m_export_map)
+      m_export_map->AddChild(&m_workers.back()->export_map);
+  }
+
+  loop_stats stats;
+  stats.loop_time = NULL;
+  stats.last_loop_time = 0;
+  stats.utilisation = 0;
+  for (unsigned int i = 0; i < LoopCount(); i++) {
+    ExportMap *map = GetExportMap(i);
+    stats.loop_time = map ? map->GetCounterVar(SelectServer::K_LOOP_TIME) :
+                      NULL;
+    m_stats.push_back(stats);
+  }
+
+  if (m_export_map)
+    m_export_map->GetIntegerVar(K_LOOP_COUNT_VAR)->Set(LoopCount());
+}
+
+
+EventLoopPool::~EventLoopPool() {
+  Stop();
+  if (m_export_map) {
+    vector<Worker*>::iterator iter = m_workers.begin();
+    for (; iter != m_workers.end(); ++iter)
+      m_export_map->RemoveChild(&(*iter)->export_map);
+  }
+  STLDeleteElements(&m_workers);
+}
+
+
+/*
+ * Start the worker threads.
+ */
+bool EventLoopPool::Start() {
+  if (m_running)
+    return false;
+
+  bool ok = true;
+  vector<Worker*>::iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    (*iter)->select_server.RegisterRepeatingTimeout(
+        K_STATS_INTERVAL_MS,
+        NewCallback(this, &EventLoopPool::SampleWorker, (*iter)->loop));
+    if (!(*iter)->Start()) {
+      OLA_WARN << "Failed to start event loop " << (*iter)->loop;
+      ok = false;
+      break;
+    }
+  }
+  vector<Worker*>::iterator end = iter;
+
+  // Wait for the workers to record their thread ids, so InLoop() doesn't
+  // need to lock.
+  {
+    MutexLocker lock(&m_mutex);
+    for (iter = m_workers.begin(); iter != end; ++iter) {
+      while (!(*iter)->started)
+        m_condition.Wait(&m_mutex);
+    }
+  }
+  m_running = true;
+
+  if (!ok) {
+    Stop();
+    return false;
+  }
+
+  m_stats_timeout = m_main_ss->RegisterRepeatingTimeout(
+      K_STATS_INTERVAL_MS,
+      NewCallback(this, &EventLoopPool::UpdateStats));
+  OLA_INFO << "Running with " << LoopCount() << " event loops";
+  return true;
+}
+
+
+/*
+ * Stop the worker threads and wait for them to exit. Once this returns
+ * everything runs in the main thread.
+ */
+void EventLoopPool::Stop() {
+  if (!m_running)
+    return;
+
+  if (m_stats_timeout != ola::thread::INVALID_TIMEOUT) {
+    m_main_ss->RemoveTimeout(m_stats_timeout);
+    m_stats_timeout = ola::thread::INVALID_TIMEOUT;
+  }
+
+  vector<Worker*>::iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    // Terminate() has to be called from within the loop, otherwise it's a
+    // noop if the loop hasn't started yet.
+    (*iter)->select_server.Execute(
+        NewSingleCallback(&(*iter)->select_server, &SelectServer::Terminate));
+  }
+
+  // A worker may be blocked in RunOnMain(), so keep serving requests until
+  // they've all exited.
+  m_mutex.Lock();
+  while (!AllExited()) {
+    if (!m_requests.empty() && AllStopped()) {
+      main_request *request = m_requests.front();
+      m_requests.pop_front();
+      m_mutex.Unlock();
+      request->closure->Run();
+      m_mutex.Lock();
+      request->done = true;
+      m_condition.Broadcast();
+      continue;
+    }
+    m_condition.Wait(&m_mutex);
+  }
+  m_mutex.Unlock();
+
+  for (iter = m_workers.begin(); iter != m_workers.end(); ++iter) {
+    if ((*iter)->started)
+      (*iter)->Join();
+  }
+  m_running = false;
+}
+
+
+/*
+ * Return the SelectServer for a loop.
+ */
+SelectServer *EventLoopPool::GetSelectServer(unsigned int loop) {
+  if (loop == 0 || loop > m_workers.size())
+    return m_main_ss;
+  return &m_workers[loop - 1]->select_server;
+}
+
+
+/*
+ * Return the ExportMap for a loop. Variables in a worker's map should only be
+ * changed from that worker, or from the main loop while the workers are
+ * paused.
+ */
+ExportMap *EventLoopPool::GetExportMap(unsigned int loop) {
+  if (loop == 0 || loop > m_workers.size())
+    return m_export_map;
+  return &m_workers[loop - 1]->export_map;
+}
+
+
+/*
+ * Check if we're running in the thread for a loop.
+ */
+bool EventLoopPool::InLoop(unsigned int loop) const {
+  ola::thread::ThreadId self = ola::thread::Thread::Self();
+  if (loop == 0 || loop > m_workers.size())
+    return pthread_equal(self, m_main_thread);
+  return m_running && pthread_equal(self, m_workers[loop - 1]->thread_id);
+}
+
+
+/*
+ * Pause the workers. Each worker is sent a closure which blocks until
+ * ResumeWorkers() is called.
+ */
+void EventLoopPool::PauseWorkers() {
+  if (m_pause_depth++ || !m_running)
+    return;
+
+  {
+    MutexLocker lock(&m_mutex);
+    m_paused = true;
+    m_generation++;
+  }
+
+  vector<Worker*>::iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    (*iter)->select_server.Execute(
+        NewSingleCallback(this, &EventLoopPool::Park, *iter));
+  }
+
+  // Once everyone has stopped, run any requests from workers that are
+  // blocked in RunOnMain().
+  m_mutex.Lock();
+  while (true) {
+    if (!AllStopped()) {
+      m_condition.Wait(&m_mutex);
+      continue;
+    }
+    if (m_requests.empty())
+      break;
+
+    main_request *request = m_requests.front();
+    m_requests.pop_front();
+    m_mutex.Unlock();
+    request->closure->Run();
+    m_mutex.Lock();
+    request->done = true;
+    m_condition.Broadcast();
+  }
+  m_mutex.Unlock();
+  m_workers_paused = true;
+}
+
+
+/*
+ * Resume the workers.
+ */
+void EventLoopPool::ResumeWorkers() {
+  if (!m_pause_depth) {
+    OLA_WARN << "ResumeWorkers() called without a matching PauseWorkers()";
+    return;
+  }
+
+  if (--m_pause_depth || !m_workers_paused)
+    return;
+
+  MutexLocker lock(&m_mutex);
+  m_paused = false;
+  m_workers_paused = false;
+  m_condition.Broadcast();
+}
+
+
+void EventLoopPool::RunOnMain(BaseCallback0<void> *closure) {
+  Worker *worker = CurrentWorker();
+  if (!worker) {
+    WorkerPause pause(this);
+    closure->Run();
+    return;
+  }
+
+  main_request request = {closure, false};
+  {
+    MutexLocker lock(&m_mutex);
+    m_requests.push_back(&request);
+    worker->blocked = true;
+    m_condition.Broadcast();
+  }
+  m_main_ss->Execute(NewSingleCallback(this, &EventLoopPool::ServeRequests));
+
+  // We stay blocked until the main loop resumes the workers.
+  MutexLocker lock(&m_mutex);
+  while (!request.done || m_paused)
+    m_condition.Wait(&m_mutex);
+  worker->blocked = false;
+}
+
+
+void EventLoopPool::ExecuteOnMain(BaseCallback0<void> *closure,
+                                  const Universe *universe) {
+  m_main_ss->Execute(
+      NewSingleCallback(this, &EventLoopPool::RunPaused, closure, universe));
+}
+
+
+void EventLoopPool::ExecuteInUniverseLoop(const Universe *universe,
+                                          BaseCallback0<void> *closure) {
+  SelectServer *ss = GetSelectServer(
+      LoopForUniverse(universe->UniverseId()));
+  ss->Execute(NewSingleCallback(this, &EventLoopPool::RunIfUniverseLive,
+                                universe, closure));
+}
+
+
+void EventLoopPool::AddUniverse(const Universe *universe) {
+  MutexLocker lock(&m_mutex);
+  m_universes.insert(universe);
+}
+
+
+void EventLoopPool::RemoveUniverse(const Universe *universe) {
+  MutexLocker lock(&m_mutex);
+  m_universes.erase(universe);
+}
+
+
+void EventLoopPool::AddClient(const Client *client) {
+  MutexLocker lock(&m_mutex);
+  m_clients.insert(client);
+}
+
+
+void EventLoopPool::RemoveClient(const Client *client) {
+  MutexLocker lock(&m_mutex);
+  m_clients.erase(client);
+}
+
+
+bool EventLoopPool::IsLiveClient(const Client *client) {
+  MutexLocker lock(&m_mutex);
+  return STLContains(m_clients, client);
+}
+
+
+void EventLoopPool::AddDevice(const AbstractDevice *device,
+                              unsigned int loop) {
+  MutexLocker lock(&m_mutex);
+  STLReplace(&m_devices, device, loop);
+}
+
+
+void EventLoopPool::RemoveDevice(const AbstractDevice *device) {
+  MutexLocker lock(&m_mutex);
+  m_devices.erase(device);
+}
+
+
+/*
+ * Record an output port that's been patched. The port runs in the same loop
+ * as the device it belongs to.
+ */
+void EventLoopPool::AddOutputPort(OutputPort *port) {
+  const AbstractDevice *device = port->GetDevice();
+  MutexLocker lock(&m_mutex);
+  std::map<const AbstractDevice*, unsigned int>::const_iterator iter =
+    m_devices.find(device);
+  STLReplace(&m_output_ports, port,
+             iter == m_devices.end() ? 0 : iter->second);
+}
+
+
+void EventLoopPool::RemoveOutputPort(OutputPort *port) {
+  MutexLocker lock(&m_mutex);
+  m_output_ports.erase(port);
+}
+
+
+/*
+ * Write DMX data to an output port. If the port belongs to a different loop
+ * the data is handed off as a DmxFrame.
+ */
+void EventLoopPool::WriteDMX(OutputPort *port, const DmxBuffer &buffer,
+                             uint8_t priority, const TimeStamp &input_time) {
+  unsigned int loop;
+  {
+    MutexLocker lock(&m_mutex);
+    std::map<const OutputPort*, unsigned int>::const_iterator iter =
+      m_output_ports.find(port);
+    if (iter == m_output_ports.end())
+      return;
+    loop = iter->second;
+  }
+
+  if (InLoop(loop)) {
+    TraceScope trace("OutputPort::WriteDMX", TraceId(port));
+    port->WriteTimedDMX(buffer, priority, input_time);
+  } else {
+    GetSelectServer(loop)->Execute(NewSingleCallback(
+        this, &EventLoopPool::WritePortDMX, port,
+        DmxSourceFrame(buffer, input_time, priority)));
+  }
+}
+
+
+/*
+ * Send DMX data to a client. Clients always live in the main loop.
+ */
+void EventLoopPool::SendDMX(Client *client, unsigned int universe_id,
+                            const DmxBuffer &buffer) {
+  if (InLoop(0)) {
+    client->SendDMX(universe_id, buffer);
+  } else {
+    m_main_ss->Execute(NewSingleCallback(
+        this, &EventLoopPool::SendClientDMX, client, universe_id,
+        DmxFrame(buffer)));
+  }
+}
+
+
+RDMCallback *EventLoopPool::WrapRDMCallback(RDMCallback *callback) {
+  return NewSingleCallback(this, &EventLoopPool::CompleteRDMRequest,
+                           callback);
+}
+
+
+RDMDiscoveryCallback *EventLoopPool::WrapDiscoveryCallback(
+    RDMDiscoveryCallback *callback) {
+  if (!callback)
+    return NULL;
+  return NewSingleCallback(this, &EventLoopPool::CompleteDiscovery, callback);
+}
+
+
+google::protobuf::Closure *EventLoopPool::WrapClosure(
+    google::protobuf::Closure *closure) {
+  if (!closure)
+    return NULL;
+  return google::protobuf::NewCallback(this, &EventLoopPool::CompleteClosure,
+                                       closure);
+}
+
+
+// Private Methods
+//-----------------------------------------------------------------------------
+
+/*
+ * True if every worker is paused or waiting on the main loop.
+ * @pre m_mutex is held.
+ */
+bool EventLoopPool::AllStopped() const {
+  vector<Worker*>::const_iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    const Worker *worker = *iter;
+    if (!(worker->exited || worker->blocked ||
+          (m_paused && worker->paused_generation == m_generation)))
+      return false;
+  }
+  return true;
+}
+
+
+/*
+ * @pre m_mutex is held.
+ */
+bool EventLoopPool::AllExited() const {
+  vector<Worker*>::const_iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    if ((*iter)->started && !(*iter)->exited)
+      return false;
+  }
+  return true;
+}
+
+
+/*
+ * Return the worker for the current thread, or NULL if this isn't a worker
+ * thread.
+ */
+EventLoopPool::Worker *EventLoopPool::CurrentWorker() const {
+  if (!m_running)
+    return NULL;
+  ola::thread::ThreadId self = ola::thread::Thread::Self();
+  vector<Worker*>::const_iterator iter = m_workers.begin();
+  for (; iter != m_workers.end(); ++iter) {
+    if (pthread_equal(self, (*iter)->thread_id))
+      return *iter;
+  }
+  return NULL;
+}
+
+
+void EventLoopPool::WorkerStarted(Worker *worker) {
+  MutexLocker lock(&m_mutex);
+  worker->thread_id = ola::thread::Thread::Self();
+  worker->started = true;
+  m_condition.Broadcast();
+}
+
+
+void EventLoopPool::WorkerExited(Worker *worker) {
+  MutexLocker lock(&m_mutex);
+  worker->exited = true;
+  m_condition.Broadcast();
+}
+
+
+/*
+ * Run in a worker, this blocks until the workers are resumed. If the pause
+ * this was sent for has already finished it returns right away.
+ */
+void EventLoopPool::Park(Worker *worker) {
+  MutexLocker lock(&m_mutex);
+  while (m_paused) {
+    if (worker->paused_generation != m_generation) {
+      worker->paused_generation = m_generation;
+      m_condition.Broadcast();
+    }
+    m_condition.Wait(&m_mutex);
+  }
+}
+
+
+/*
+ * Called in the main loop when a worker is waiting in RunOnMain().
+ * PauseWorkers() takes care of running the request.
+ */
+void EventLoopPool::ServeRequests() {
+  WorkerPause pause(this);
+}
+
+
+void EventLoopPool::RunPaused(BaseCallback0<void> *closure,
+                              const Universe *universe) {
+  WorkerPause pause(this);
+  if (universe && !IsLiveUniverse(universe)) {
+    delete closure;
+    return;
+  }
+  closure->Run();
+}
+
+
+/*
+ * Run the closure if the universe still exists. Universes are only deleted
+ * from the main loop while the workers are paused, so it can't go away once
+ * we've checked.
+ */
+void EventLoopPool::RunIfUniverseLive(const Universe *universe,
+                                      BaseCallback0<void> *closure) {
+  if (IsLiveUniverse(universe))
+    closure->Run();
+  else
+    delete closure;
+}
+
+
+bool EventLoopPool::IsLiveUniverse(const Universe *universe) {
+  MutexLocker lock(&m_mutex);
+  return STLContains(m_universes, universe);
+}
+
+
+void EventLoopPool::WritePortDMX(OutputPort *port, DmxSourceFrame frame) {
+  {
+    MutexLocker lock(&m_mutex);
+    if (!STLContains(m_output_ports, port))
+      return;
+  }
+  TraceScope trace("OutputPort::WriteDMX", TraceId(port));
+  DmxSource source = frame.ToSource();
+  port->WriteTimedDMX(source.Data(), source.Priority(), source.Timestamp());
+}
+
+
+void EventLoopPool::SendClientDMX(Client *client, unsigned int universe_id,
+                                  DmxFrame frame) {
+  if (!IsLiveClient(client))
+    return;
+  DmxBuffer buffer;
+  frame.CopyTo(&buffer);
+  client->SendDMX(universe_id, buffer);
+}
+
+
+void EventLoopPool::CompleteRDMRequest(RDMCallback *callback,
+                                       ola::rdm::rdm_response_code code,
+                                       const ola::rdm::RDMResponse *response,
+                                       const vector<string> &packets) {
+  if (InLoop(0)) {
+    WorkerPause pause(this);
+    callback->Run(code, response, packets);
+  } else {
+    ExecuteOnMain(NewSingleCallback(this, &EventLoopPool::RunRDMCallback,
+                                    callback, code, response, packets));
+  }
+}
+
+
+void EventLoopPool::RunRDMCallback(RDMCallback *callback,
+                                   ola::rdm::rdm_response_code code,
+                                   const ola::rdm::RDMResponse *response,
+                                   vector<string> packets) {
+  callback->Run(code, response, packets);
+}
+
+
+void EventLoopPool::CompleteDiscovery(RDMDiscoveryCallback *callback,
+                                      const ola::rdm::UIDSet &uids) {
+  if (InLoop(0)) {
+    WorkerPause pause(this);
+    callback->Run(uids);
+  } else {
+    ExecuteOnMain(NewSingleCallback(
+        this, &EventLoopPool::RunDiscoveryCallback, callback, uids));
+  }
+}
+
+
+void EventLoopPool::RunDiscoveryCallback(RDMDiscoveryCallback *callback,
+                                         ola::rdm::UIDSet uids) {
+  callback->Run(uids);
+}
+
+
+void EventLoopPool::CompleteClosure(google::protobuf::Closure *closure) {
+  if (InLoop(0)) {
+    WorkerPause pause(this);
+    closure->Run();
+  } else {
+    ExecuteOnMain(NewSingleCallback(this, &EventLoopPool::RunClosure,
+                                    closure));
+  }
+}
+
+
+void EventLoopPool::RunClosure(google::protobuf::Closure *closure) {
+  closure->Run();
+}
+
+
+/*
+ * Work out what percentage of the time since the last sample this loop spent
+ * processing events. Only the loop itself touches its stats, apart from the
+ * utilisation which is read by the main loop.
+ */
+void EventLoopPool::SampleUtilisation(unsigned int loop) {
+  loop_stats &stats = m_stats[loop];
+  TimeStamp now;
+  m_clock.CurrentTime(&now);
+  unsigned int loop_time = stats.loop_time ? stats.loop_time->Get() : 0;
+
+  unsigned int utilisation = 0;
+  if (stats.last_sample.IsSet() && now > stats.last_sample) {
+    int64_t elapsed = (now - stats.last_sample).AsInt();
+    // the counter wraps, so do the subtraction unsigned
+    uint64_t busy = loop_time - stats.last_loop_time;
+    utilisation = static_cast<unsigned int>(busy * 100 / elapsed);
+    utilisation = std::min(utilisation, 100u);
+  }
+  stats.last_loop_time = loop_time;
+  stats.last_sample = now;
+
+  MutexLocker lock(&m_mutex);
+  stats.utilisation = utilisation;
+}
+
+
+bool EventLoopPool::SampleWorker(unsigned int loop) {
+  SampleUtilisation(loop);
+  return true;
+}
+
+
+/*
+ * Publish the utilisation of each loop.
+ */
+bool EventLoopPool::UpdateStats() {
+  SampleUtilisation(0);
+  if (!m_export_map)
+    return true;
+
+  UIntMap *utilisation = m_export_map->GetUIntMapVar(
+      K_LOOP_UTILISATION_VAR, "loop");
+  MutexLocker lock(&m_mutex);
+  for (unsigned int i = 0; i < m_stats.size(); i++) {
+    std::stringstream str;
+    str << i;
+    (*utilisation)[str.str()] = m_stats[i].utilisation;
+  }
+  return true;
+}
+}  // namespace ola
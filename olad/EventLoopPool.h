@@ -0,0 +1,274 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * EventLoopPool.h
+ * Runs olad across more than one SelectServer.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Loop 0 is the main SelectServer, which handles the RPC clients and the
+ * rest of the control plane. Loops 1 to N-1 each run in their own thread.
+ * Plugins are pinned to one of the worker loops, and each universe runs its
+ * merge & output on the loop given by LoopForUniverse().
+ *
+ * DMX data moves between the loops with SelectServer::Execute(). It's handed
+ * off as a DmxFrame, since a DmxBuffer's reference count isn't thread safe.
+ * Anything else (RPCs, patching, RDM, device registration) runs on the main
+ * loop with the workers paused, so it's free to touch plugin & universe state
+ * just like it did when everything ran in the one thread.
+ *
+ * Universes, clients and output ports can be deleted while a hand-off is
+ * queued, so the pool keeps track of the ones that are live and drops any
+ * hand-off for an object that has gone away.
+ */
+
+#ifndef OLAD_EVENTLOOPPOOL_H_
+#define OLAD_EVENTLOOPPOOL_H_
+
+#include <google/protobuf/service.h>
+#include <stdint.h>
+#include <ola/Callback.h>
+#include <ola/Clock.h>
+#include <ola/DmxBuffer.h>
+#include <ola/DmxFrame.h>
+#include <ola/ExportMap.h>
+#include <ola/io/SelectServer.h>
+#include <ola/rdm/RDMCommand.h>
+#include <ola/rdm/RDMControllerInterface.h>
+#include <ola/rdm/UIDSet.h>
+#include <ola/thread/Mutex.h>
+#include <ola/thread/Thread.h>
+#include <olad/DmxSource.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ola {
+
+class AbstractDevice;
+class Client;
+class OutputPort;
+class Universe;
+
+/*
+ * A DmxSource that can be handed to another loop. The data is held in
+ * DmxFrames, so the sending loop can release its copy while the receiving
+ * loop is still using it.
+ */
+class DmxSourceFrame {
+  public:
+    DmxSourceFrame()
+        : m_priority(DmxSource::PRIORITY_MIN) {
+    }
+    explicit DmxSourceFrame(const DmxSource &source);
+    DmxSourceFrame(const DmxBuffer &buffer, const TimeStamp &timestamp,
+                   uint8_t priority);
+
+    // Build a DmxSource that the receiving loop owns.
+    DmxSource ToSource() const;
+
+  private:
+    DmxFrame m_data;
+    DmxFrame m_slot_priorities;
+    TimeStamp m_timestamp;
+    uint8_t m_priority;
+};
+
+
+class EventLoopPool {
+  public:
+    EventLoopPool(ola::io::SelectServer *main_ss,
+                  ExportMap *export_map,
+                  unsigned int loop_count);
+    ~EventLoopPool();
+
+    bool Start();
+    void Stop();
+
+    unsigned int LoopCount() const { return m_workers.size() + 1; }
+    ola::io::SelectServer *GetSelectServer(unsigned int loop);
+    ExportMap *GetExportMap(unsigned int loop);
+
+    // true if we're running in the thread for this loop
+    bool InLoop(unsigned int loop) const;
+
+    unsigned int LoopForUniverse(unsigned int universe_id) const {
+      return universe_id % LoopCount();
+    }
+
+    /*
+     * Pause all the workers. This must be called from the main loop, and
+     * may be nested. Any requests from the workers are run while they're
+     * paused.
+     */
+    void PauseWorkers();
+    void ResumeWorkers();
+
+    /*
+     * Run a closure on the main loop, with the workers paused, and wait for
+     * it to complete. If we're already in the main loop it's run right away.
+     */
+    void RunOnMain(BaseCallback0<void> *closure);
+
+    /*
+     * Queue a closure to run on the main loop, with the workers paused. If a
+     * universe is provided, the closure is dropped if the universe no longer
+     * exists by the time it's run.
+     */
+    void ExecuteOnMain(BaseCallback0<void> *closure,
+                       const Universe *universe = NULL);
+
+    // Queue a closure to run in a universe's loop.
+    void ExecuteInUniverseLoop(const Universe *universe,
+                               BaseCallback0<void> *closure);
+
+    // The objects that hand-offs may refer to.
+    void AddUniverse(const Universe *universe);
+    void RemoveUniverse(const Universe *universe);
+    void AddClient(const Client *client);
+    void RemoveClient(const Client *client);
+    bool IsLiveClient(const Client *client);
+    void AddDevice(const AbstractDevice *device, unsigned int loop);
+    void RemoveDevice(const AbstractDevice *device);
+    void AddOutputPort(OutputPort *port);
+    void RemoveOutputPort(OutputPort *port);
+
+    // Send DMX to an output port or a client, from any loop. input_time is
+    // when the data arrived, it's unset if the data has already been sent.
+    void WriteDMX(OutputPort *port, const DmxBuffer &buffer, uint8_t priority,
+                  const TimeStamp &input_time = TimeStamp());
+    void SendDMX(Client *client, unsigned int universe_id,
+                 const DmxBuffer &buffer);
+
+    /*
+     * Wrap callbacks that are passed to plugins, so that they always complete
+     * on the main loop.
+     */
+    ola::rdm::RDMCallback *WrapRDMCallback(ola::rdm::RDMCallback *callback);
+    ola::rdm::RDMDiscoveryCallback *WrapDiscoveryCallback(
+        ola::rdm::RDMDiscoveryCallback *callback);
+    google::protobuf::Closure *WrapClosure(google::protobuf::Closure *closure);
+
+    /*
+     * Pauses the workers for the lifetime of the object. This is a no-op if
+     * the pool is NULL.
+     */
+    class WorkerPause {
+      public:
+        explicit WorkerPause(EventLoopPool *pool)
+            : m_pool(pool) {
+          if (m_pool)
+            m_pool->PauseWorkers();
+        }
+        ~WorkerPause() {
+          if (m_pool)
+            m_pool->ResumeWorkers();
+        }
+
+      private:
+        EventLoopPool *m_pool;
+
+        WorkerPause(const WorkerPause&);
+        WorkerPause& operator=(const WorkerPause&);
+    };
+
+    static const char K_LOOP_COUNT_VAR[];
+    static const char K_LOOP_UTILISATION_VAR[];
+
+  private:
+    class Worker;
+
+    // A request from a worker that's waiting in RunOnMain().
+    typedef struct {
+      BaseCallback0<void> *closure;
+      bool done;
+    } main_request;
+
+    // The processing time for a loop when we last sampled it.
+    typedef struct {
+      CounterVariable *loop_time;
+      unsigned int last_loop_time;
+      TimeStamp last_sample;
+      unsigned int utilisation;
+    } loop_stats;
+
+    ola::io::SelectServer *m_main_ss;
+    ExportMap *m_export_map;
+    std::vector<Worker*> m_workers;
+    std::vector<loop_stats> m_stats;
+    ola::thread::ThreadId m_main_thread;
+    Clock m_clock;
+    bool m_running;
+    ola::thread::timeout_id m_stats_timeout;
+
+    // These are only used by the main loop.
+    unsigned int m_pause_depth;
+    bool m_workers_paused;
+
+    // Protects everything below.
+    ola::thread::Mutex m_mutex;
+    ola::thread::ConditionVariable m_condition;
+    bool m_paused;
+    unsigned int m_generation;
+    std::deque<main_request*> m_requests;
+    std::set<const Universe*> m_universes;
+    std::set<const Client*> m_clients;
+    std::map<const AbstractDevice*, unsigned int> m_devices;
+    std::map<const OutputPort*, unsigned int> m_output_ports;
+
+    bool AllStopped() const;
+    bool AllExited() const;
+    Worker *CurrentWorker() const;
+    void WorkerStarted(Worker *worker);
+    void WorkerExited(Worker *worker);
+    void Park(Worker *worker);
+    void ServeRequests();
+    void RunPaused(BaseCallback0<void> *closure, const Universe *universe);
+    void RunIfUniverseLive(const Universe *universe,
+                           BaseCallback0<void> *closure);
+    bool IsLiveUniverse(const Universe *universe);
+
+    void WritePortDMX(OutputPort *port, DmxSourceFrame frame);
+    void SendClientDMX(Client *client, unsigned int universe_id,
+                       DmxFrame frame);
+
+    void CompleteRDMRequest(ola::rdm::RDMCallback *callback,
+                            ola::rdm::rdm_response_code code,
+                            const ola::rdm::RDMResponse *response,
+                            const std::vector<std::string> &packets);
+    void RunRDMCallback(ola::rdm::RDMCallback *callback,
+                        ola::rdm::rdm_response_code code,
+                        const ola::rdm::RDMResponse *response,
+                        std::vector<std::string> packets);
+    void CompleteDiscovery(ola::rdm::RDMDiscoveryCallback *callback,
+                           const ola::rdm::UIDSet &uids);
+    void RunDiscoveryCallback(ola::rdm::RDMDiscoveryCallback *callback,
+                              ola::rdm::UIDSet uids);
+    void CompleteClosure(google::protobuf::Closure *closure);
+    void RunClosure(google::protobuf::Closure *closure);
+
+    void SampleUtilisation(unsigned int loop);
+    bool SampleWorker(unsigned int loop);
+    bool UpdateStats();
+
+    static const unsigned int K_STATS_INTERVAL_MS;
+
+    EventLoopPool(const EventLoopPool&);
+    EventLoopPool& operator=(const EventLoopPool&);
+};
+}  // namespace ola
+#endif  // OLAD_EVENTLOOPPOOL_H_
@@ -0,0 +1,257 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * EventLoopPoolTest.cpp
+ * Test fixture for the EventLoopPool class.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string.h>
+#include <string>
+
+#include "ola/BaseTypes.h"
+#include "ola/Callback.h"
+#include "ola/DmxBuffer.h"
+#include "ola/ExportMap.h"
+#include "ola/Logging.h"
+#include "ola/io/SelectServer.h"
+#include "olad/EventLoopPool.h"
+#include "olad/TestCommon.h"
+#include "olad/Universe.h"
+#include "olad/UniverseStore.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::EventLoopPool;
+using ola::ExportMap;
+using ola::NewSingleCallback;
+using ola::OutputPort;
+using ola::Universe;
+using ola::UniverseStore;
+using ola::io::SelectServer;
+using std::string;
+
+static const char TEST_DATA[] = "this is some test data";
+
+
+/*
+ * Each frame has different data & size, so a frame that's freed too early
+ * is likely to show up.
+ */
+static DmxBuffer FrameData(unsigned int frame) {
+  uint8_t data[DMX_UNIVERSE_SIZE];
+  memset(data, frame % 256, sizeof(data));
+  return DmxBuffer(data, frame % DMX_UNIVERSE_SIZE + 1);
+}
+
+
+class EventLoopPoolTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(EventLoopPoolTest);
+  CPPUNIT_TEST(testStartStop);
+  CPPUNIT_TEST(testWriteDMX);
+  CPPUNIT_TEST(testWriteManyFrames);
+  CPPUNIT_TEST(testRunOnMain);
+  CPPUNIT_TEST(testUniverseExportMap);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void setUp();
+    void tearDown();
+    void testStartStop();
+    void testWriteDMX();
+    void testWriteManyFrames();
+    void testRunOnMain();
+    void testUniverseExportMap();
+
+    void WriteFrames(OutputPort *port) {
+      for (unsigned int i = 0; i < FRAME_COUNT; i++)
+        m_pool->WriteDMX(port, FrameData(i), 100);
+      m_pool->RunOnMain(
+          NewSingleCallback(this, &EventLoopPoolTest::RecordMainLoop));
+    }
+
+    void CallRunOnMain() {
+      m_worker_ran = m_pool->InLoop(1);
+      m_pool->RunOnMain(
+          NewSingleCallback(this, &EventLoopPoolTest::RecordMainLoop));
+    }
+
+    void RecordMainLoop() {
+      m_main_ran = m_pool->InLoop(0);
+      m_ss->Terminate();
+    }
+
+  private:
+    static const unsigned int FRAME_COUNT = 10000;
+
+    ExportMap *m_export_map;
+    SelectServer *m_ss;
+    EventLoopPool *m_pool;
+    bool m_worker_ran;
+    bool m_main_ran;
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EventLoopPoolTest);
+
+
+void EventLoopPoolTest::setUp() {
+  ola::InitLogging(ola::OLA_LOG_INFO, ola::OLA_LOG_STDERR);
+  m_export_map = new ExportMap();
+  m_ss = new SelectServer(m_export_map);
+  m_pool = new EventLoopPool(m_ss, m_export_map, 3);
+  m_worker_ran = false;
+  m_main_ran = false;
+}
+
+
+void EventLoopPoolTest::tearDown() {
+  delete m_pool;
+  delete m_ss;
+  delete m_export_map;
+}
+
+
+/*
+ * Check the pool starts & stops.
+ */
+void EventLoopPoolTest::testStartStop() {
+  OLA_ASSERT_EQ(3u, m_pool->LoopCount());
+  OLA_ASSERT_EQ(
+      3, m_export_map->GetIntegerVar(EventLoopPool::K_LOOP_COUNT_VAR)->Get());
+  OLA_ASSERT_EQ(m_ss, m_pool->GetSelectServer(0));
+  OLA_ASSERT_NE(m_ss, m_pool->GetSelectServer(1));
+  OLA_ASSERT_EQ(1u, m_pool->LoopForUniverse(4));
+
+  OLA_ASSERT_TRUE(m_pool->Start());
+  OLA_ASSERT_FALSE(m_pool->Start());
+  OLA_ASSERT_TRUE(m_pool->InLoop(0));
+  OLA_ASSERT_FALSE(m_pool->InLoop(1));
+
+  // pausing nests
+  m_pool->PauseWorkers();
+  m_pool->PauseWorkers();
+  m_pool->ResumeWorkers();
+  m_pool->ResumeWorkers();
+  m_pool->Stop();
+
+  // a pause with no workers running is a noop
+  EventLoopPool::WorkerPause pause(m_pool);
+}
+
+
+/*
+ * Check DMX data is handed off to the loop that the port belongs to.
+ */
+void EventLoopPoolTest::testWriteDMX() {
+  MockDevice device(NULL, "test device");
+  TestMockOutputPort port(&device, 1);
+  TestMockOutputPort unregistered_port(&device, 2);
+  DmxBuffer buffer(TEST_DATA);
+
+  OLA_ASSERT_TRUE(m_pool->Start());
+  m_pool->AddDevice(&device, 2);
+  m_pool->AddOutputPort(&port);
+  m_pool->WriteDMX(&port, buffer, 100);
+  m_pool->WriteDMX(&unregistered_port, buffer, 100);
+
+  {
+    // The write was queued before the pause, so it's done by the time the
+    // workers have stopped.
+    EventLoopPool::WorkerPause pause(m_pool);
+    OLA_ASSERT_EQ(string(TEST_DATA), port.ReadDMX().Get());
+    OLA_ASSERT_EQ(0u, unregistered_port.ReadDMX().Size());
+  }
+
+  // Writes to removed ports are dropped.
+  m_pool->RemoveOutputPort(&port);
+  m_pool->WriteDMX(&port, DmxBuffer(), 100);
+  {
+    EventLoopPool::WorkerPause pause(m_pool);
+    OLA_ASSERT_EQ(string(TEST_DATA), port.ReadDMX().Get());
+  }
+  m_pool->Stop();
+}
+
+
+/*
+ * Hand off lots of frames, from the main loop and from another worker, to
+ * check the data isn't released while the receiving loop is using it.
+ */
+void EventLoopPoolTest::testWriteManyFrames() {
+  MockDevice device(NULL, "test device");
+  TestMockOutputPort port(&device, 1);
+
+  OLA_ASSERT_TRUE(m_pool->Start());
+  m_pool->AddDevice(&device, 2);
+  m_pool->AddOutputPort(&port);
+
+  for (unsigned int i = 0; i < FRAME_COUNT; i++)
+    m_pool->WriteDMX(&port, FrameData(i), 100);
+  {
+    EventLoopPool::WorkerPause pause(m_pool);
+    OLA_ASSERT_EQ(FrameData(FRAME_COUNT - 1), port.ReadDMX());
+  }
+
+  m_pool->GetSelectServer(1)->Execute(
+      NewSingleCallback(this, &EventLoopPoolTest::WriteFrames,
+                        static_cast<OutputPort*>(&port)));
+  m_ss->Run();
+  OLA_ASSERT_TRUE(m_main_ran);
+  {
+    EventLoopPool::WorkerPause pause(m_pool);
+    OLA_ASSERT_EQ(FrameData(FRAME_COUNT - 1), port.ReadDMX());
+  }
+  m_pool->Stop();
+}
+
+
+/*
+ * Check that a worker can run a closure on the main loop.
+ */
+void EventLoopPoolTest::testRunOnMain() {
+  OLA_ASSERT_TRUE(m_pool->Start());
+  m_pool->GetSelectServer(1)->Execute(
+      NewSingleCallback(this, &EventLoopPoolTest::CallRunOnMain));
+  m_ss->Run();
+
+  OLA_ASSERT_TRUE(m_worker_ran);
+  OLA_ASSERT_TRUE(m_main_ran);
+  m_pool->Stop();
+
+  // Once stopped, closures are run right away.
+  m_main_ran = false;
+  m_pool->RunOnMain(
+      NewSingleCallback(this, &EventLoopPoolTest::RecordMainLoop));
+  OLA_ASSERT_TRUE(m_main_ran);
+}
+
+
+/*
+ * Check that universes publish their variables to the map of their loop.
+ */
+void EventLoopPoolTest::testUniverseExportMap() {
+  UniverseStore store(NULL, m_export_map, m_pool);
+  // universe 4 runs in loop 1
+  OLA_ASSERT_NOT_NULL(store.GetUniverseOrCreate(4));
+  ola::StringMap *loop_names = m_pool->GetExportMap(1)->GetStringMapVar(
+      Universe::K_UNIVERSE_NAME_VAR);
+  ola::StringMap *main_names = m_export_map->GetStringMapVar(
+      Universe::K_UNIVERSE_NAME_VAR);
+  OLA_ASSERT_EQ(string("Universe 4"), (*loop_names)["4"]);
+  OLA_ASSERT_EQ(string(""), (*main_names)["4"]);
+  store.DeleteAll();
+}
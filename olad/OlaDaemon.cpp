@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 
+#include "ola/AutoStart.h"
 #include "ola/ExportMap.h"
 #include "ola/Logging.h"
 #include "ola/base/Credentials.h"
@@ -43,16 +44,22 @@
 DEFINE_s_string(config_dir, c, "", "Path to the config directory");
 DEFINE_s_uint16(rpc_port, r, ola::OlaDaemon::DEFAULT_RPC_PORT,
                 "Port to listen for RPCs on");
+DEFINE_string(rpc_socket, "",
+              "Path of the unix socket to listen for RPCs on, defaults to "
+              "$XDG_RUNTIME_DIR/ola/rpc-<rpc-port>.sock or "
+              "/tmp/ola-<uid>/rpc-<rpc-port>.sock");
 
 namespace ola {
 
 using ola::io::SelectServer;
+using ola::io::UnixAcceptingSocket;
 using ola::network::IPV4Address;
 using ola::network::IPV4SocketAddress;
 using ola::network::TCPAcceptingSocket;
 using ola::thread::MutexLocker;
 
 const char OlaDaemon::K_RPC_PORT_VAR[] = "rpc-port";
+const char OlaDaemon::K_RPC_SOCKET_VAR[] = "rpc-socket";
 const char OlaDaemon::OLA_CONFIG_DIR[] = ".ola";
 
 /*
@@ -118,13 +125,38 @@ bool OlaDaemon::Init() {
     return false;
   }
 
+  // Local clients prefer the unix socket. If we can't listen on the default
+  // path they fall back to TCP, but a path given with --rpc-socket must work.
+  string socket_path = FLAGS_rpc_socket;
+  auto_ptr<UnixAcceptingSocket> unix_socket(new UnixAcceptingSocket());
+  if (socket_path.empty()) {
+    socket_path = ola::client::RpcSocketPath(
+        accepting_socket->GetLocalAddress().V4Addr().Port());
+    if (!ola::client::CheckRpcSocketDir(socket_path, true) ||
+        !unix_socket->Listen(socket_path)) {
+      OLA_WARN << "Could not listen on " << socket_path
+               << ", local clients will use TCP. Check the directory "
+               << "belongs to this user and has mode 0700";
+      unix_socket.reset();
+    }
+  } else if (!unix_socket->Listen(socket_path)) {
+    OLA_FATAL << "Could not listen on " << socket_path;
+    return false;
+  }
+  if (unix_socket.get())
+    OLA_INFO << "Listening for RPCs on " << socket_path;
+  if (m_export_map)
+    m_export_map->GetStringVar(K_RPC_SOCKET_VAR)->Set(
+        unix_socket.get() ? socket_path : "");
+
   // Order is important here as we won't load the same plugin twice.
   m_plugin_loaders.push_back(new DynamicPluginLoader());
 
   auto_ptr<OlaServer> server(
       new OlaServer(service_factory.get(), m_plugin_loaders,
                     preferences_factory.get(), &m_ss, m_options,
-                    accepting_socket.get(), m_export_map));
+                    accepting_socket.get(), m_export_map,
+                    unix_socket.get()));
 
   bool ok = server->Init();
   if (ok) {
@@ -132,6 +164,7 @@ bool OlaDaemon::Init() {
     m_preferences_factory.reset(preferences_factory.release());
     m_service_factory.reset(service_factory.release());
     m_accepting_socket.reset(accepting_socket.release());
+    m_unix_socket.reset(unix_socket.release());
     m_server.reset(server.release());
   } else {
     STLDeleteElements(&m_plugin_loaders);
@@ -147,6 +180,7 @@ void OlaDaemon::Shutdown() {
   m_service_factory.reset();
   m_preferences_factory.reset();
   m_accepting_socket.reset();
+  m_unix_socket.reset();
   STLDeleteElements(&m_plugin_loaders);
 }
 
@@ -168,6 +202,15 @@ ola::network::GenericSocketAddress OlaDaemon::RPCAddress() const {
   }
 }
 
+
+/**
+ * Return the path of the unix socket the RPC server is listening on, or an
+ * empty string if there isn't one.
+ */
+string OlaDaemon::RPCSocketPath() const {
+  return m_unix_socket.get() ? m_unix_socket->Path() : "";
+}
+
 /**
  * Return the home directory for the current user
  */
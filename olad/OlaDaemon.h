@@ -26,6 +26,7 @@
 #include <vector>
 #include "ola/BaseTypes.h"
 #include "ola/ExportMap.h"
+#include "ola/io/Descriptor.h"
 #include "ola/io/SelectServer.h"
 #include "ola/network/Socket.h"
 #include "ola/network/SocketAddress.h"
@@ -50,6 +51,7 @@ class OlaDaemon {
     void Run();
 
     ola::network::GenericSocketAddress RPCAddress() const;
+    string RPCSocketPath() const;
     SelectServer* GetSelectServer() { return &m_ss; }
     OlaServer *GetOlaServer() const { return m_server.get(); }
 
@@ -64,6 +66,7 @@ class OlaDaemon {
     auto_ptr<class PreferencesFactory> m_preferences_factory;
     auto_ptr<class OlaClientServiceFactory> m_service_factory;
     auto_ptr<TCPAcceptingSocket> m_accepting_socket;
+    auto_ptr<ola::io::UnixAcceptingSocket> m_unix_socket;
     auto_ptr<OlaServer> m_server;
 
     string DefaultConfigDir();
@@ -73,6 +76,7 @@ class OlaDaemon {
     OlaDaemon& operator=(const OlaDaemon&);
 
     static const char K_RPC_PORT_VAR[];
+    static const char K_RPC_SOCKET_VAR[];
     static const char OLA_CONFIG_DIR[];
 };
 }  // namespace ola
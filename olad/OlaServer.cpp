@@ -35,8 +35,10 @@
 #include "common/protocol/Ola.pb.h"
 #include "common/rpc/StreamRpcChannel.h"
 #include "ola/BaseTypes.h"
+#include "ola/Clock.h"
 #include "ola/ExportMap.h"
 #include "ola/Logging.h"
+#include "ola/StringUtils.h"
 #include "ola/network/InterfacePicker.h"
 #include "ola/rdm/PidStore.h"
 #include "ola/rdm/UID.h"
@@ -44,8 +46,10 @@
 #include "olad/Client.h"
 #include "olad/DeviceManager.h"
 #include "olad/ClientBroker.h"
+#include "olad/EventLoopPool.h"
 #include "olad/OlaServer.h"
 #include "olad/OlaServerServiceImpl.h"
+#include "olad/OutputScheduler.h"
 #include "olad/Plugin.h"
 #include "olad/PluginAdaptor.h"
 #include "olad/PluginManager.h"
@@ -78,6 +82,8 @@ const unsigned int OlaServer::K_HOUSEKEEPING_TIMEOUT_MS = 10000;
  * @param factory the factory to use to create OlaService objects
  * @param m_plugin_loader the loader to use for the plugins
  * @param socket the socket to listen on for new connections
+ * @param export_map the ExportMap to use for variables
+ * @param unix_socket the unix socket to listen on for new local connections
  */
 OlaServer::OlaServer(OlaClientServiceFactory *factory,
                      const vector<PluginLoader*> &plugin_loaders,
@@ -85,17 +91,20 @@ OlaServer::OlaServer(OlaClientServiceFactory *factory,
                      ola::io::SelectServer *select_server,
                      const Options &ola_options,
                      ola::network::TCPAcceptingSocket *socket,
-                     ExportMap *export_map)
+                     ExportMap *export_map,
+                     ola::io::UnixAcceptingSocket *unix_socket)
     : m_service_factory(factory),
       m_plugin_loaders(plugin_loaders),
       m_ss(select_server),
       m_tcp_socket_factory(
           ola::NewCallback(this, &OlaServer::NewTCPConnection)),
       m_accepting_socket(socket),
+      m_unix_socket(unix_socket),
       m_export_map(export_map),
       m_preferences_factory(preferences_factory),
       m_universe_preferences(NULL),
       m_housekeeping_timeout(ola::thread::INVALID_TIMEOUT),
+      m_next_client_id(0),
       m_options(ola_options),
       m_default_uid(OPEN_LIGHTING_ESTA_CODE, 0) {
   if (!m_export_map) {
@@ -118,6 +127,10 @@ OlaServer::~OlaServer() {
   }
 #endif
 
+  // From here on everything runs in this thread.
+  if (m_loop_pool.get())
+    m_loop_pool->Stop();
+
   if (m_housekeeping_timeout != ola::thread::INVALID_TIMEOUT)
     m_ss->RemoveTimeout(m_housekeeping_timeout);
 
@@ -139,10 +152,14 @@ OlaServer::~OlaServer() {
   if (m_accepting_socket && m_accepting_socket->ValidReadDescriptor())
     m_ss->RemoveReadDescriptor(m_accepting_socket);
 
+  if (m_unix_socket && m_unix_socket->ValidReadDescriptor())
+    m_ss->RemoveReadDescriptor(m_unix_socket);
+
   if (m_universe_store.get()) {
     m_universe_store->DeleteAll();
     m_universe_store.reset();
   }
+  STLDeleteElements(&m_output_schedulers);
 
   if (m_universe_preferences) {
     m_universe_preferences->Save();
@@ -152,7 +169,9 @@ OlaServer::~OlaServer() {
   m_plugin_adaptor.reset();
   m_device_manager.reset();
   m_plugin_manager.reset();
+  STLDeleteElements(&m_worker_adaptors);
   m_service_impl.reset();
+  m_loop_pool.reset();
 }
 
 
@@ -183,6 +202,12 @@ bool OlaServer::Init() {
     m_ss->AddReadDescriptor(m_accepting_socket);
   }
 
+  if (m_unix_socket) {
+    m_unix_socket->SetOnAccept(
+        ola::NewCallback(this, &OlaServer::NewUnixConnection));
+    m_ss->AddReadDescriptor(m_unix_socket);
+  }
+
 #ifndef WIN32
   signal(SIGPIPE, SIG_IGN);
 #endif
@@ -206,8 +231,38 @@ bool OlaServer::Init() {
   m_universe_preferences = m_preferences_factory->NewPreference(
       UNIVERSE_PREFERENCES);
   m_universe_preferences->Load();
+
+  if (m_options.event_loops > 1) {
+    m_loop_pool.reset(
+        new EventLoopPool(m_ss, m_export_map, m_options.event_loops));
+    if (!m_loop_pool->Start()) {
+      OLA_WARN << "Failed to start the event loops, only using one";
+      m_loop_pool.reset();
+    }
+  }
+
   m_universe_store.reset(
-      new UniverseStore(m_universe_preferences, m_export_map));
+      new UniverseStore(m_universe_preferences, m_export_map,
+                        m_loop_pool.get()));
+  m_universe_store->SetOutputKeepAlive(
+      TimeInterval(m_options.output_keepalive / ONE_THOUSAND,
+                   (m_options.output_keepalive % ONE_THOUSAND) * ONE_THOUSAND));
+
+  if (m_options.output_rate) {
+    // one scheduler per loop, so each runs in the loop it sends from
+    if (m_loop_pool.get()) {
+      for (unsigned int i = 0; i < m_loop_pool->LoopCount(); i++) {
+        m_output_schedulers.push_back(
+            new OutputScheduler(m_loop_pool->GetSelectServer(i), &m_clock,
+                                m_options.output_rate, m_export_map, i));
+      }
+    } else {
+      m_output_schedulers.push_back(
+          new OutputScheduler(m_ss, &m_clock, m_options.output_rate,
+                              m_export_map));
+    }
+    m_universe_store->SetOutputSchedulers(m_output_schedulers);
+  }
 
   m_port_broker.reset(new PortBroker());
   m_port_manager.reset(
@@ -219,10 +274,25 @@ bool OlaServer::Init() {
       new DeviceManager(m_preferences_factory, m_port_manager.get()));
   m_plugin_adaptor.reset(
       new PluginAdaptor(m_device_manager.get(), m_ss, m_export_map,
-                        m_preferences_factory, m_port_broker.get()));
+                        m_preferences_factory, m_port_broker.get(),
+                        m_loop_pool.get()));
+
+  // Plugins are spread across the worker loops, each worker has its own
+  // ExportMap.
+  if (m_loop_pool.get()) {
+    for (unsigned int i = 1; i < m_loop_pool->LoopCount(); i++) {
+      m_worker_adaptors.push_back(
+          new PluginAdaptor(m_device_manager.get(),
+                            m_loop_pool->GetSelectServer(i),
+                            m_loop_pool->GetExportMap(i),
+                            m_preferences_factory, m_port_broker.get(),
+                            m_loop_pool.get(), i));
+    }
+  }
 
   m_plugin_manager.reset(
-    new PluginManager(m_plugin_loaders, m_plugin_adaptor.get()));
+    new PluginManager(m_plugin_loaders, m_plugin_adaptor.get(),
+                      m_worker_adaptors));
   m_service_impl.reset(new OlaServerServiceImpl(
       m_universe_store.get(),
       m_device_manager.get(),
@@ -231,11 +301,12 @@ bool OlaServer::Init() {
       m_port_manager.get(),
       m_broker.get(),
       m_ss->WakeUpTime(),
-      m_default_uid));
+      m_default_uid,
+      m_loop_pool.get(),
+      m_options.shared_dmx));
 
   // The plugin load procedure can take a while so we run it in the main loop.
-  m_ss->Execute(
-      ola::NewSingleCallback(m_plugin_manager.get(), &PluginManager::LoadAll));
+  m_ss->Execute(ola::NewSingleCallback(this, &OlaServer::LoadPlugins));
 
 #ifdef HAVE_LIBMICROHTTPD
   if (!StartHttpServer(iface))
@@ -296,15 +367,40 @@ void OlaServer::NewTCPConnection(ola::network::TCPSocket *socket) {
 }
 
 
+/*
+ * Add a new local connection to this Server.
+ * @param socket the new UnixSocket
+ */
+void OlaServer::NewUnixConnection(ola::io::UnixSocket *socket) {
+  if (!socket)
+    return;
+  uid_t uid;
+  bool has_uid = socket->PeerUID(&uid);
+  OlaClientService *service = InternalNewConnection(socket);
+  if (has_uid)
+    service->SetPeerUID(uid);
+}
+
+
 /*
  * Called when a socket is closed
+ * @param sd the descriptor the socket had when the client connected. The
+ *   socket may have already been closed by the RPC channel, in which case it
+ *   no longer knows its descriptor.
+ * @param socket the socket that was closed
  */
-void OlaServer::SocketClosed(ola::io::ConnectedDescriptor *socket) {
-  ClientEntry client_entry;
-  bool removed = STLLookupAndRemove(&m_sd_to_service, socket->ReadDescriptor(),
-                                    &client_entry);
-  if (removed) {
+void OlaServer::SocketClosed(int sd, ola::io::ConnectedDescriptor *socket) {
+  ClientMap::iterator iter = m_sd_to_service.find(sd);
+  // the descriptor number may have been reused by a newer client
+  if (iter != m_sd_to_service.end() &&
+      iter->second.client_descriptor == socket) {
+    ClientEntry client_entry = iter->second;
+    m_sd_to_service.erase(iter);
     (*m_export_map->GetIntegerVar(K_CLIENT_VAR))--;
+    // the client may have sent more before closing than we've handled yet
+    StreamRpcChannel *channel = static_cast<StreamRpcChannel*>(
+        client_entry.client_service->GetClient()->Stub()->channel());
+    channel->HandleRemainingMsgs();
     CleanupConnection(client_entry.client_service);
   } else {
     OLA_WARN << "A socket was closed but we didn't find the client";
@@ -316,6 +412,7 @@ void OlaServer::SocketClosed(ola::io::ConnectedDescriptor *socket) {
  * Run the garbage collector
  */
 bool OlaServer::RunHousekeeping() {
+  EventLoopPool::WorkerPause pause(m_loop_pool.get());
   OLA_DEBUG << "Garbage collecting";
   m_universe_store->GarbageCollectUniverses();
 
@@ -379,6 +476,15 @@ bool OlaServer::StartHttpServer(const ola::network::Interface &iface) {
 #endif
 
 
+/*
+ * Load and start all the plugins
+ */
+void OlaServer::LoadPlugins() {
+  EventLoopPool::WorkerPause pause(m_loop_pool.get());
+  m_plugin_manager->LoadAll();
+}
+
+
 /*
  * Stop and unload all the plugins
  */
@@ -399,29 +505,43 @@ void OlaServer::StopPlugins() {
  * Add a new ConnectedDescriptor to this Server.
  * @param socket the new ConnectedDescriptor
  */
-void OlaServer::InternalNewConnection(
+OlaClientService *OlaServer::InternalNewConnection(
     ola::io::ConnectedDescriptor *socket) {
   StreamRpcChannel *channel = new StreamRpcChannel(NULL, socket, m_export_map);
+  // slow clients get their data queued rather than blocking the server
+  socket->SetReadNonBlocking();
+  channel->SetSelectServer(m_ss);
   socket->SetOnClose(
-      NewSingleCallback(this, &OlaServer::SocketClosed, socket));
+      NewSingleCallback(this, &OlaServer::SocketClosed,
+                        socket->ReadDescriptor(), socket));
   OlaClientService_Stub *stub = new OlaClientService_Stub(channel);
-  Client *client = new Client(stub);
+  Client *client = new Client(stub, channel, m_export_map,
+                              IntToString(m_next_client_id++));
+  client->SetSelectServer(m_ss);
   OlaClientService *service = m_service_factory->New(
       client, m_service_impl.get());
   m_broker->AddClient(client);
+  if (m_loop_pool.get())
+    m_loop_pool->AddClient(client);
   channel->SetService(service);
 
   ClientEntry client_entry = {socket, service};
-  bool replaced = STLReplace(&m_sd_to_service, socket->ReadDescriptor(),
-                             client_entry);
+  ClientEntry old_entry;
+  bool replaced = STLLookupAndRemove(&m_sd_to_service,
+                                     socket->ReadDescriptor(), &old_entry);
   if (replaced) {
+    // The RPC channel closed the old socket and the descriptor was reused
+    // before the select server noticed.
     OLA_WARN << "New socket but the client already exists!";
+    CleanupConnection(old_entry.client_service);
   } else {
     (*m_export_map->GetIntegerVar(K_CLIENT_VAR))++;
   }
+  m_sd_to_service[socket->ReadDescriptor()] = client_entry;
 
   // This hands off socket ownership to the select server
   m_ss->AddReadDescriptor(socket, true);
+  return service;
 }
 
 
@@ -429,8 +549,11 @@ void OlaServer::InternalNewConnection(
  * Cleanup everything related to a client connection
  */
 void OlaServer::CleanupConnection(OlaClientService *service) {
+  EventLoopPool::WorkerPause pause(m_loop_pool.get());
   Client *client = service->GetClient();
   m_broker->RemoveClient(client);
+  if (m_loop_pool.get())
+    m_loop_pool->RemoveClient(client);
 
   vector<Universe*> universe_list;
   m_universe_store->GetList(&universe_list);
@@ -454,6 +577,7 @@ void OlaServer::CleanupConnection(OlaClientService *service) {
  */
 void OlaServer::ReloadPluginsInternal() {
   OLA_INFO << "Reloading plugins";
+  EventLoopPool::WorkerPause pause(m_loop_pool.get());
   StopPlugins();
   m_plugin_manager->LoadAll();
 }
@@ -30,7 +30,9 @@
 #include <string>
 #include <vector>
 
+#include "ola/Clock.h"
 #include "ola/ExportMap.h"
+#include "ola/io/Descriptor.h"
 #include "ola/io/SelectServer.h"
 #include "ola/network/InterfacePicker.h"
 #include "ola/network/Socket.h"
@@ -64,6 +66,12 @@ class OlaServer {
       string http_data_dir;  // directory that contains the static content
       string interface;
       string pid_data_dir;  // directory with the pid definitions.
+      unsigned int event_loops;  // the number of event loops to run
+      // ms between resends of unchanged DMX data, 0 sends every update
+      unsigned int output_keepalive;
+      // the rate in Hz to send DMX data, 0 sends every change
+      unsigned int output_rate;
+      bool shared_dmx;  // allow clients to send DMX using shared memory
     };
 
 
@@ -73,7 +81,8 @@ class OlaServer {
               ola::io::SelectServer *ss,
               const Options &ola_options,
               ola::network::TCPAcceptingSocket *socket = NULL,
-              ExportMap *export_map = NULL);
+              ExportMap *export_map = NULL,
+              ola::io::UnixAcceptingSocket *unix_socket = NULL);
     ~OlaServer();
 
     bool Init();
@@ -85,7 +94,8 @@ class OlaServer {
     void StopServer() { m_ss->Terminate(); }
     void NewConnection(ola::io::ConnectedDescriptor *descriptor);
     void NewTCPConnection(ola::network::TCPSocket *socket);
-    void SocketClosed(ola::io::ConnectedDescriptor *socket);
+    void NewUnixConnection(ola::io::UnixSocket *socket);
+    void SocketClosed(int sd, ola::io::ConnectedDescriptor *socket);
     bool RunHousekeeping();
 
     static const unsigned int DEFAULT_HTTP_PORT = 9090;
@@ -103,6 +113,7 @@ class OlaServer {
     ola::io::SelectServer *m_ss;
     ola::network::TCPSocketFactory m_tcp_socket_factory;
     ola::network::TCPAcceptingSocket *m_accepting_socket;
+    ola::io::UnixAcceptingSocket *m_unix_socket;
 
     auto_ptr<class ExportMap> m_our_export_map;
     class ExportMap *m_export_map;
@@ -118,9 +129,15 @@ class OlaServer {
     auto_ptr<class ClientBroker> m_broker;
     auto_ptr<class PortBroker> m_port_broker;
     auto_ptr<const RootPidStore> m_pid_store;
+    auto_ptr<class EventLoopPool> m_loop_pool;
+    vector<class PluginAdaptor*> m_worker_adaptors;
+    vector<class OutputScheduler*> m_output_schedulers;
+    Clock m_clock;
 
     ola::thread::timeout_id m_housekeeping_timeout;
     ClientMap m_sd_to_service;
+    // the id for the next client, descriptors are reused so we can't use them
+    unsigned int m_next_client_id;
     auto_ptr<OladHTTPServer_t> m_httpd;
     const Options m_options;
     ola::rdm::UID m_default_uid;
@@ -128,8 +145,10 @@ class OlaServer {
 #ifdef HAVE_LIBMICROHTTPD
     bool StartHttpServer(const ola::network::Interface &interface);
 #endif
+    void LoadPlugins();
     void StopPlugins();
-    void InternalNewConnection(ola::io::ConnectedDescriptor *descriptor);
+    class OlaClientService *InternalNewConnection(
+        ola::io::ConnectedDescriptor *descriptor);
     void CleanupConnection(class OlaClientService *service);
     void ReloadPluginsInternal();
     void UpdatePidStore(const RootPidStore *pid_store);
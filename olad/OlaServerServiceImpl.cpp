@@ -31,12 +31,14 @@
 #include "ola/Logging.h"
 #include "ola/rdm/UIDSet.h"
 #include "ola/rdm/RDMCommand.h"
+#include "common/utils/SharedDmxRegion.h"
 #include "ola/timecode/TimeCode.h"
 #include "ola/timecode/TimeCodeEnums.h"
 #include "olad/Client.h"
 #include "olad/Device.h"
 #include "olad/DeviceManager.h"
 #include "olad/DmxSource.h"
+#include "olad/EventLoopPool.h"
 #include "olad/OlaServerServiceImpl.h"
 #include "olad/Plugin.h"
 #include "olad/PluginManager.h"
@@ -55,6 +57,7 @@ using ola::proto::DeviceInfo;
 using ola::proto::DeviceInfoReply;
 using ola::proto::DeviceInfoRequest;
 using ola::proto::DmxData;
+using ola::proto::DmxDataBatch;
 using ola::proto::MergeModeRequest;
 using ola::proto::OptionalUniverseRequest;
 using ola::proto::PatchPortRequest;
@@ -117,9 +120,17 @@ void OlaServerServiceImpl::RegisterForDmx(
     return MissingUniverseError(controller);
 
   if (request->action() == ola::proto::REGISTER) {
+    if (client) {
+      if (request->has_streaming())
+        client->SetStreamingDMX(request->streaming());
+      client->SetSubscription(universe->UniverseId(),
+                              SubscriptionFromRequest(*request));
+    }
     universe->AddSinkClient(client);
   } else {
     universe->RemoveSinkClient(client);
+    if (client)
+      client->RemoveSubscription(universe->UniverseId());
   }
 }
 
@@ -134,24 +145,21 @@ void OlaServerServiceImpl::UpdateDmxData(
     google::protobuf::Closure* done,
     Client *client) {
   ClosureRunner runner(done);
+  // deltas are decoded first, so we stay in step with the client even if the
+  // universe doesn't exist
+  DmxBuffer buffer;
+  if (client && !client->DecodeDMX(*request, &buffer)) {
+    controller->SetFailed("DMX delta without a keyframe");
+    return;
+  }
+
   Universe *universe = m_universe_store->GetUniverse(request->universe());
   if (!universe)
     return MissingUniverseError(controller);
 
-  if (client) {
-    DmxBuffer buffer;
-    buffer.Set(request->data());
-
-    uint8_t priority = DmxSource::PRIORITY_DEFAULT;
-    if (request->has_priority()) {
-      priority = request->priority();
-      priority = std::max(DmxSource::PRIORITY_MIN, priority);
-      priority = std::min(DmxSource::PRIORITY_MAX, priority);
-    }
-    DmxSource source(buffer, *m_wake_up_time, priority);
-    client->DMXRecieved(request->universe(), source);
-    universe->SourceClientDataChanged(client);
-  }
+  if (client)
+    SetClientDmx(universe, buffer, request->has_priority(),
+                 request->priority(), client);
 }
 
 
@@ -164,25 +172,72 @@ void OlaServerServiceImpl::StreamDmxData(
     ::ola::proto::STREAMING_NO_RESPONSE*,
     ::google::protobuf::Closure*,
     Client *client) {
+  DmxBuffer buffer;
+  if (!client || !client->DecodeDMX(*request, &buffer))
+    return;
 
   Universe *universe = m_universe_store->GetUniverse(request->universe());
 
   if (!universe)
     return;
 
-  if (client) {
-    DmxBuffer buffer;
-    buffer.Set(request->data());
+  SetClientDmx(universe, buffer, request->has_priority(), request->priority(),
+               client);
+}
 
-    uint8_t priority = DmxSource::PRIORITY_DEFAULT;
-    if (request->has_priority()) {
-      priority = request->priority();
-      priority = std::max(DmxSource::PRIORITY_MIN, priority);
-      priority = std::min(DmxSource::PRIORITY_MAX, priority);
-    }
-    DmxSource source(buffer, *m_wake_up_time, priority);
-    client->DMXRecieved(request->universe(), source);
-    universe->SourceClientDataChanged(client);
+
+/*
+ * Update the DMX values for many universes. If any of the universes don't
+ * exist, none of them are updated.
+ */
+void OlaServerServiceImpl::UpdateDmxDataBatch(
+    RpcController* controller,
+    const DmxDataBatch* request,
+    Ack*,
+    google::protobuf::Closure* done,
+    Client *client) {
+  ClosureRunner runner(done);
+  if (!ApplyDmxDataBatch(request, client))
+    return MissingUniverseError(controller);
+}
+
+
+/*
+ * Handle a streaming DMX update for many universes, we don't send responses
+ * for this.
+ */
+void OlaServerServiceImpl::StreamDmxDataBatch(
+    RpcController*,
+    const ::ola::proto::DmxDataBatch* request,
+    ::ola::proto::STREAMING_NO_RESPONSE*,
+    ::google::protobuf::Closure*,
+    Client *client) {
+  ApplyDmxDataBatch(request, client);
+}
+
+
+/*
+ * Apply the data a client has written to its shared memory region. Slots that
+ * haven't changed, or are for universes that don't exist, are skipped.
+ * @param region the client's SharedDmxRegion
+ * @param slots the number of slots the client is using
+ * @param client the client the data is from
+ */
+void OlaServerServiceImpl::UpdateSharedDmx(SharedDmxRegion *region,
+                                           unsigned int slots,
+                                           Client *client) {
+  unsigned int universe_id;
+  DmxBuffer buffer;
+  bool has_priority;
+  uint8_t priority;
+  slots = std::min(slots, region->SlotCount());
+  for (unsigned int i = 0; i < slots; i++) {
+    if (!region->ReadIfChanged(i, &universe_id, &buffer, &has_priority,
+                               &priority))
+      continue;
+    Universe *universe = m_universe_store->GetUniverse(universe_id);
+    if (universe)
+      SetClientDmx(universe, buffer, has_priority, priority, client);
   }
 }
 
@@ -879,6 +934,79 @@ void OlaServerServiceImpl::RDMDiscoveryComplete(
 }
 
 
+/*
+ * Apply a batch of DMX updates from a client. All the universes are looked up
+ * first, so the batch is either applied in full, or not at all. The updates
+ * are applied back to back, so with an OutputScheduler they go out on the
+ * same tick.
+ * @returns false if any of the universes don't exist.
+ */
+bool OlaServerServiceImpl::ApplyDmxDataBatch(const DmxDataBatch *request,
+                                             Client *client) {
+  // deltas are decoded even if the batch isn't applied
+  m_batch_buffers.resize(request->data_size());
+  for (int i = 0; client && i < request->data_size(); ++i) {
+    if (!client->DecodeDMX(request->data(i), &m_batch_buffers[i]))
+      m_batch_buffers[i].Reset();
+  }
+
+  m_batch_universes.clear();
+  for (int i = 0; i < request->data_size(); ++i) {
+    Universe *universe = m_universe_store->GetUniverse(
+        request->data(i).universe());
+    if (!universe)
+      return false;
+    m_batch_universes.push_back(universe);
+  }
+
+  for (int i = 0; client && i < request->data_size(); ++i) {
+    const DmxData &data = request->data(i);
+    // skip the deltas we couldn't decode
+    if (data.delta() && !m_batch_buffers[i].Size())
+      continue;
+    SetClientDmx(m_batch_universes[i], m_batch_buffers[i], data.has_priority(),
+                 data.priority(), client);
+  }
+  return true;
+}
+
+
+/*
+ * Store the data from a client and update the universe.
+ */
+void OlaServerServiceImpl::SetClientDmx(Universe *universe,
+                                        const DmxBuffer &buffer,
+                                        bool has_priority,
+                                        uint8_t priority,
+                                        Client *client) {
+  uint8_t source_priority = DmxSource::PRIORITY_DEFAULT;
+  if (has_priority) {
+    source_priority = std::max(DmxSource::PRIORITY_MIN, priority);
+    source_priority = std::min(DmxSource::PRIORITY_MAX, source_priority);
+  }
+  DmxSource source(buffer, *m_wake_up_time, source_priority);
+  client->DMXRecieved(universe->UniverseId(), source);
+  universe->SourceClientDataChanged(client);
+}
+
+
+/*
+ * Build the DmxSubscription from a RegisterForDmx request. Invalid ranges are
+ * ignored.
+ */
+DmxSubscription OlaServerServiceImpl::SubscriptionFromRequest(
+    const ola::proto::RegisterDmxRequest &request) {
+  DmxSubscription subscription;
+  for (int i = 0; i < request.slots_size(); i++) {
+    const ola::proto::SlotRange &range = request.slots(i);
+    if (range.offset() >= 0 && range.length() > 0)
+      subscription.AddSlotRange(range.offset(), range.length());
+  }
+  subscription.SetMaxRate(request.max_rate());
+  return subscription;
+}
+
+
 void OlaServerServiceImpl::MissingUniverseError(RpcController* controller) {
   controller->SetFailed("Universe doesn't exist");
 }
@@ -970,9 +1098,62 @@ void OlaServerServiceImpl::PopulatePort(const PortClass &port,
 
 // OlaClientService
 // ----------------------------------------------------------------------------
+OlaClientService::OlaClientService(Client *client,
+                                   OlaServerServiceImpl *impl)
+    : m_client(client),
+      m_impl(impl),
+      m_uid(NULL),
+      m_has_peer_uid(false),
+      m_peer_uid(0),
+      m_shared_dmx(NULL) {
+  const google::protobuf::ServiceDescriptor *service = descriptor();
+  m_dmx_methods[0] = service->FindMethodByName("UpdateDmxData");
+  m_dmx_methods[1] = service->FindMethodByName("StreamDmxData");
+  m_dmx_methods[2] = service->FindMethodByName("UpdateDmxDataBatch");
+  m_dmx_methods[3] = service->FindMethodByName("StreamDmxDataBatch");
+  m_dmx_methods[4] = service->FindMethodByName("NotifySharedDmx");
+}
+
+
 OlaClientService::~OlaClientService() {
   if (m_uid)
     delete m_uid;
+  if (m_shared_dmx)
+    delete m_shared_dmx;
+}
+
+
+/*
+ * When there is more than one event loop, everything other than the DMX
+ * updates runs with the workers paused, since it may touch plugin or universe
+ * state. Plugins may complete the request from their own loop, so the done
+ * closure is wrapped as well. The DMX methods are matched by descriptor, which
+ * is looked up once when the client connects.
+ */
+void OlaClientService::CallMethod(
+    const google::protobuf::MethodDescriptor *method,
+    RpcController *controller,
+    const google::protobuf::Message *request,
+    google::protobuf::Message *response,
+    google::protobuf::Closure *done) {
+  EventLoopPool *loop_pool = m_impl->GetEventLoopPool();
+  bool dmx_method = false;
+  for (unsigned int i = 0; i < sizeof(m_dmx_methods) / sizeof(*m_dmx_methods);
+       ++i) {
+    if (method == m_dmx_methods[i]) {
+      dmx_method = true;
+      break;
+    }
+  }
+
+  if (!loop_pool || dmx_method) {
+    OlaServerService::CallMethod(method, controller, request, response, done);
+    return;
+  }
+
+  EventLoopPool::WorkerPause pause(loop_pool);
+  OlaServerService::CallMethod(method, controller, request, response,
+                               loop_pool->WrapClosure(done));
 }
 
 
@@ -996,6 +1177,69 @@ void OlaClientService::SetSourceUID(
 }
 
 
+/*
+ * Map the shared memory region this client will write DMX data to.
+ */
+void OlaClientService::SetupSharedDmx(
+    RpcController* controller,
+    const ::ola::proto::SharedDmxRequest* request,
+    ola::proto::Ack*,
+    google::protobuf::Closure* done) {
+  ClosureRunner runner(done);
+  if (!m_impl->SharedDmxEnabled()) {
+    controller->SetFailed("Shared memory DMX is disabled");
+    return;
+  }
+
+  // Only map regions that belong to the client, otherwise a client could use
+  // another client's region as its own source.
+  if (!m_has_peer_uid) {
+    controller->SetFailed("Shared memory DMX needs a local connection");
+    return;
+  }
+
+  SharedDmxRegion *region = SharedDmxRegion::Open(request->name(), m_peer_uid);
+  if (!region) {
+    controller->SetFailed("Failed to map " + request->name());
+    return;
+  }
+
+  if (m_shared_dmx)
+    delete m_shared_dmx;
+  m_shared_dmx = region;
+}
+
+
+/*
+ * The client has written new data to its shared memory region. This is a
+ * streaming request so we don't send a response.
+ */
+void OlaClientService::NotifySharedDmx(
+    RpcController*,
+    const ::ola::proto::SharedDmxNotify* request,
+    ::ola::proto::STREAMING_NO_RESPONSE*,
+    ::google::protobuf::Closure*) {
+  if (m_shared_dmx)
+    m_impl->UpdateSharedDmx(m_shared_dmx, request->slots(), m_client);
+}
+
+
+/*
+ * Agree on the optional protocol features to use with this client. We send
+ * delta DmxData if the client can decode it, and always accept it.
+ */
+void OlaClientService::SetFeatures(
+    RpcController*,
+    const ::ola::proto::Features* request,
+    ::ola::proto::Features* response,
+    ::google::protobuf::Closure* done) {
+  ClosureRunner runner(done);
+  if (m_client)
+    m_client->SetDeltaDMX(request->dmx_delta());
+  response->set_dmx_delta(true);
+}
+
+
 // OlaServerServiceImplFactory
 // ----------------------------------------------------------------------------
 OlaClientService *OlaClientServiceFactory::New(
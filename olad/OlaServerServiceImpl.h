@@ -21,6 +21,8 @@
 #include <vector>
 #include <string>
 #include "common/protocol/Ola.pb.h"
+#include "ola/DmxBuffer.h"
+#include "ola/DmxSubscription.h"
 #include "ola/rdm/UID.h"
 #include "ola/rdm/RDMCommand.h"
 #include "olad/ClientBroker.h"
@@ -50,7 +52,9 @@ class OlaServerServiceImpl {
                          class PortManager *port_manager,
                          class ClientBroker *broker,
                          const class TimeStamp *wake_up_time,
-                         const ola::rdm::UID &uid):
+                         const ola::rdm::UID &uid,
+                         class EventLoopPool *loop_pool = NULL,
+                         bool enable_shared_dmx = false):
       m_universe_store(universe_store),
       m_device_manager(device_manager),
       m_plugin_manager(plugin_manager),
@@ -58,9 +62,14 @@ class OlaServerServiceImpl {
       m_port_manager(port_manager),
       m_broker(broker),
       m_wake_up_time(wake_up_time),
-      m_uid(uid) {}
+      m_uid(uid),
+      m_loop_pool(loop_pool),
+      m_enable_shared_dmx(enable_shared_dmx) {}
     ~OlaServerServiceImpl();
 
+    class EventLoopPool *GetEventLoopPool() const { return m_loop_pool; }
+    bool SharedDmxEnabled() const { return m_enable_shared_dmx; }
+
     void GetDmx(RpcController* controller,
                 const ola::proto::UniverseRequest* request,
                 ola::proto::DmxData* response,
@@ -80,6 +89,19 @@ class OlaServerServiceImpl {
                        ::ola::proto::STREAMING_NO_RESPONSE* response,
                        ::google::protobuf::Closure* done,
                        class Client *client);
+    void UpdateDmxDataBatch(RpcController* controller,
+                            const ola::proto::DmxDataBatch* request,
+                            Ack* response,
+                            google::protobuf::Closure* done,
+                            class Client *client);
+    void StreamDmxDataBatch(RpcController* controller,
+                            const ::ola::proto::DmxDataBatch* request,
+                            ::ola::proto::STREAMING_NO_RESPONSE* response,
+                            ::google::protobuf::Closure* done,
+                            class Client *client);
+    void UpdateSharedDmx(class SharedDmxRegion *region,
+                         unsigned int slots,
+                         class Client *client);
     void SetUniverseName(RpcController* controller,
                          const ola::proto::UniverseNameRequest* request,
                          Ack* response,
@@ -168,6 +190,17 @@ class OlaServerServiceImpl {
                               ola::proto::UIDListReply *response,
                               const ola::rdm::UIDSet &uids);
 
+    bool ApplyDmxDataBatch(const ola::proto::DmxDataBatch *request,
+                           class Client *client);
+    void SetClientDmx(class Universe *universe,
+                      const DmxBuffer &buffer,
+                      bool has_priority,
+                      uint8_t priority,
+                      class Client *client);
+
+    static DmxSubscription SubscriptionFromRequest(
+        const ola::proto::RegisterDmxRequest &request);
+
     void MissingUniverseError(RpcController* controller);
     void MissingPluginError(RpcController* controller);
     void MissingDeviceError(RpcController* controller);
@@ -191,6 +224,11 @@ class OlaServerServiceImpl {
     class ClientBroker *m_broker;
     const class TimeStamp *m_wake_up_time;
     ola::rdm::UID m_uid;
+    class EventLoopPool *m_loop_pool;
+    bool m_enable_shared_dmx;
+    // the universes in the batch being applied
+    std::vector<class Universe*> m_batch_universes;
+    std::vector<DmxBuffer> m_batch_buffers;
 };
 
 
@@ -203,13 +241,21 @@ class OlaServerServiceImpl {
 class OlaClientService: public ola::proto::OlaServerService {
   public:
     OlaClientService(class Client *client,
-                     OlaServerServiceImpl *impl):
-      m_client(client),
-      m_impl(impl),
-      m_uid(NULL) {
-    }
+                     OlaServerServiceImpl *impl);
     ~OlaClientService();
 
+    // The user that the client runs as, this is only known for local clients.
+    void SetPeerUID(uid_t uid) {
+      m_has_peer_uid = true;
+      m_peer_uid = uid;
+    }
+
+    void CallMethod(const google::protobuf::MethodDescriptor *method,
+                    RpcController *controller,
+                    const google::protobuf::Message *request,
+                    google::protobuf::Message *response,
+                    google::protobuf::Closure *done);
+
     void GetDmx(RpcController* controller,
                 const ola::proto::UniverseRequest* request,
                 ola::proto::DmxData* response,
@@ -238,6 +284,22 @@ class OlaClientService: public ola::proto::OlaServerService {
       m_impl->StreamDmxData(controller, request, response, done, m_client);
     }
 
+    void UpdateDmxDataBatch(RpcController* controller,
+                            const ola::proto::DmxDataBatch* request,
+                            Ack* response,
+                            google::protobuf::Closure* done) {
+      m_impl->UpdateDmxDataBatch(controller, request, response, done,
+                                 m_client);
+    }
+
+    void StreamDmxDataBatch(RpcController* controller,
+                            const ::ola::proto::DmxDataBatch* request,
+                            ::ola::proto::STREAMING_NO_RESPONSE* response,
+                            ::google::protobuf::Closure* done) {
+      m_impl->StreamDmxDataBatch(controller, request, response, done,
+                                 m_client);
+    }
+
     void SetUniverseName(RpcController* controller,
                          const ola::proto::UniverseNameRequest* request,
                          Ack* response,
@@ -351,6 +413,21 @@ class OlaClientService: public ola::proto::OlaServerService {
                       ola::proto::Ack* response,
                       google::protobuf::Closure* done);
 
+    void SetupSharedDmx(RpcController* controller,
+                        const ::ola::proto::SharedDmxRequest* request,
+                        ola::proto::Ack* response,
+                        google::protobuf::Closure* done);
+
+    void NotifySharedDmx(RpcController* controller,
+                         const ::ola::proto::SharedDmxNotify* request,
+                         ::ola::proto::STREAMING_NO_RESPONSE* response,
+                         ::google::protobuf::Closure* done);
+
+    void SetFeatures(RpcController* controller,
+                     const ::ola::proto::Features* request,
+                     ::ola::proto::Features* response,
+                     ::google::protobuf::Closure* done);
+
     void SendTimeCode(RpcController* controller,
                       const ::ola::proto::TimeCode* request,
                       ::ola::proto::Ack* response,
@@ -364,6 +441,11 @@ class OlaClientService: public ola::proto::OlaServerService {
     class Client *m_client;
     OlaServerServiceImpl *m_impl;
     ola::rdm::UID *m_uid;
+    bool m_has_peer_uid;
+    uid_t m_peer_uid;
+    class SharedDmxRegion *m_shared_dmx;
+    // the methods that don't need the workers paused, see CallMethod
+    const google::protobuf::MethodDescriptor *m_dmx_methods[5];
 };
 
 
@@ -35,6 +35,7 @@
 #include "ola/rdm/UID.h"
 #include "olad/Client.h"
 #include "olad/DeviceManager.h"
+#include "olad/DmxSource.h"
 #include "olad/OlaServerServiceImpl.h"
 #include "olad/PluginLoader.h"
 #include "olad/Universe.h"
@@ -58,6 +59,7 @@ class OlaServerServiceImplTest: public CppUnit::TestFixture {
   CPPUNIT_TEST(testGetDmx);
   CPPUNIT_TEST(testRegisterForDmx);
   CPPUNIT_TEST(testUpdateDmxData);
+  CPPUNIT_TEST(testUpdateDmxDataBatch);
   CPPUNIT_TEST(testSetUniverseName);
   CPPUNIT_TEST(testSetMergeMode);
   CPPUNIT_TEST_SUITE_END();
@@ -74,6 +76,7 @@ class OlaServerServiceImplTest: public CppUnit::TestFixture {
     void testGetDmx();
     void testRegisterForDmx();
     void testUpdateDmxData();
+    void testUpdateDmxDataBatch();
     void testSetUniverseName();
     void testSetMergeMode();
 
@@ -92,6 +95,9 @@ class OlaServerServiceImplTest: public CppUnit::TestFixture {
                            int universe_id,
                            const DmxBuffer &data,
                            class UpdateDmxDataCheck &check);
+    void CallUpdateDmxDataBatch(OlaClientService *service,
+                                const ola::proto::DmxDataBatch &batch,
+                                class UpdateDmxDataCheck &check);
     void CallSetUniverseName(OlaClientService *service,
                              int universe_id,
                              const string &name,
@@ -428,6 +434,59 @@ void OlaServerServiceImplTest::testUpdateDmxData() {
 }
 
 
+/*
+ * Check the UpdateDmxDataBatch method works
+ */
+void OlaServerServiceImplTest::testUpdateDmxDataBatch() {
+  UniverseStore store(NULL, NULL);
+  ola::TimeStamp time1;
+  ola::Client client(NULL);
+  OlaServerServiceImpl impl(&store,
+                            NULL,
+                            NULL,
+                            NULL,
+                            NULL,
+                            NULL,
+                            &time1,
+                            m_uid);
+  OlaClientService service(&client, &impl);
+
+  GenericMissingUniverseCheck<UpdateDmxDataCheck, ola::proto::Ack>
+    missing_universe_check;
+  GenericAckCheck<UpdateDmxDataCheck> ack_check;
+  DmxBuffer dmx_data("this is a test");
+  DmxBuffer dmx_data2("different data hmm");
+
+  ola::proto::DmxDataBatch batch;
+  ola::proto::DmxData *data = batch.add_data();
+  data->set_universe(1);
+  data->set_data(dmx_data.Get());
+  data = batch.add_data();
+  data->set_universe(2);
+  data->set_data(dmx_data2.Get());
+  data->set_priority(150);
+
+  // if one of the universes doesn't exist, nothing is updated
+  m_clock.CurrentTime(&time1);
+  Universe *universe1 = store.GetUniverseOrCreate(1);
+  CallUpdateDmxDataBatch(&service, batch, missing_universe_check);
+  OLA_ASSERT_EQ(0u, universe1->GetDMX().Size());
+
+  // once it does, both are updated
+  Universe *universe2 = store.GetUniverseOrCreate(2);
+  CallUpdateDmxDataBatch(&service, batch, ack_check);
+  OLA_ASSERT(dmx_data == universe1->GetDMX());
+  OLA_ASSERT(dmx_data2 == universe2->GetDMX());
+  OLA_ASSERT_EQ(ola::DmxSource::PRIORITY_DEFAULT,
+                universe1->ActivePriority());
+  OLA_ASSERT_EQ((uint8_t) 150, universe2->ActivePriority());
+
+  // an empty batch is fine
+  ola::proto::DmxDataBatch empty_batch;
+  CallUpdateDmxDataBatch(&service, empty_batch, ack_check);
+}
+
+
 /*
  * Call the UpdateDmxDataCheck method
  * @param impl the OlaServerServiceImpl to use
@@ -459,6 +518,30 @@ void OlaServerServiceImplTest::CallUpdateDmxData(
 }
 
 
+/*
+ * Call the UpdateDmxDataBatch method
+ * @param service the OlaClientService to use
+ * @param batch the DmxDataBatch to send
+ * @param check the UpdateDmxDataCheck to use for the callback check
+ */
+void OlaServerServiceImplTest::CallUpdateDmxDataBatch(
+    OlaClientService *service,
+    const ola::proto::DmxDataBatch &batch,
+    UpdateDmxDataCheck &check) {
+  SimpleRpcController *controller = new SimpleRpcController();
+  ola::proto::Ack *response = new ola::proto::Ack();
+  Closure *closure = NewCallback(
+      &check,
+      &UpdateDmxDataCheck::Check,
+      controller,
+      response);
+
+  service->UpdateDmxDataBatch(controller, &batch, response, closure);
+  delete controller;
+  delete response;
+}
+
+
 /*
  * Check the SetUniverseName method works
  */
@@ -31,22 +31,28 @@
 
 #include <iostream>
 #include <memory>
+#include <string>
 
+#include "ola/AutoStart.h"
 #include "ola/Logging.h"
 #include "ola/base/Credentials.h"
 #include "ola/base/Flags.h"
 #include "ola/base/Init.h"
 #include "ola/base/SysExits.h"
 #include "ola/thread/SignalThread.h"
+#include "ola/thread/Trace.h"
 #include "olad/OlaDaemon.h"
 
 using ola::OlaDaemon;
 using ola::thread::SignalThread;
 using std::cout;
 using std::endl;
+using std::string;
 
 DEFINE_bool(http, true, "Disable the HTTP server");
 DEFINE_bool(http_quit, true, "Disable the HTTP /quit hanlder");
+DEFINE_bool(shared_dmx, false,
+            "Allow local clients to send DMX data using shared memory");
 DEFINE_s_bool(daemon, f, false, "Fork and run in the background");
 DEFINE_s_bool(version, v, false, "Print version information");
 DEFINE_s_string(http_data_dir, d, "", "Path to the static www content");
@@ -57,6 +63,20 @@ DEFINE_string(pid_location, PID_DATA_DIR,
               "The directory containing the PID definitions");
 DEFINE_s_uint16(http_port, p, ola::OlaServer::DEFAULT_HTTP_PORT,
                 "Port to run the http server on");
+DEFINE_uint16(event_loops, 1,
+              "The number of event loops to run, 1 runs everything in the "
+              "main thread");
+DEFINE_uint16(output_keepalive, 1000,
+              "The number of ms between resending unchanged DMX data to the "
+              "output ports, 0 sends every update");
+DEFINE_uint16(output_rate, 0,
+              "The rate in Hz to send DMX data to the output ports & clients, "
+              "changes in between are coalesced. 0 sends every change.");
+DEFINE_bool(trace, false,
+            "Record trace events for each DMX frame, see /trace or SIGUSR2");
+DEFINE_string(trace_file, "",
+              "The file to write the trace to when SIGUSR2 is received, "
+              "defaults to olad-trace.json in the per-user runtime directory");
 
 
 /**
@@ -70,6 +90,20 @@ void StartSignalThread(ola::SelectServer *ss, SignalThread *signal_thread) {
 }
 
 
+/**
+ * Called on SIGUSR2.
+ */
+void DumpTrace() {
+  string path = FLAGS_trace_file.str();
+  if (path.empty()) {
+    path = ola::client::RuntimeDir() + "/olad-trace.json";
+    if (!ola::client::CheckRpcSocketDir(path, true))
+      return;
+  }
+  ola::thread::WriteTraceFile(path);
+}
+
+
 /*
  * Main
  */
@@ -108,6 +142,10 @@ int main(int argc, char *argv[]) {
   signal_thread.InstallSignalHandler(SIGHUP, NULL);
   signal_thread.InstallSignalHandler(
       SIGUSR1, ola::NewCallback(&ola::IncrementLogLevel));
+  signal_thread.InstallSignalHandler(SIGUSR2, ola::NewCallback(&DumpTrace));
+
+  ola::thread::EnableTracing(FLAGS_trace);
+  ola::thread::SetTraceThreadName("olad");
 
   ola::OlaServer::Options options;
   options.http_enable = FLAGS_http;
@@ -116,6 +154,10 @@ int main(int argc, char *argv[]) {
   options.http_data_dir = FLAGS_http_data_dir.str();
   options.interface = FLAGS_interface.str();
   options.pid_data_dir = FLAGS_pid_location.str();
+  options.event_loops = FLAGS_event_loops;
+  options.output_keepalive = FLAGS_output_keepalive;
+  options.output_rate = FLAGS_output_rate;
+  options.shared_dmx = FLAGS_shared_dmx;
 
   std::auto_ptr<OlaDaemon> olad(new OlaDaemon(options, &export_map));
   if (!olad.get()) {
@@ -0,0 +1,166 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * OutputScheduler.cpp
+ * Sends the DMX for universes at a fixed rate.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ola/Callback.h"
+#include "olad/OutputScheduler.h"
+#include "olad/Universe.h"
+
+namespace ola {
+
+const char OutputScheduler::K_OUTPUT_TICKS_VAR[] = "output-ticks";
+const char OutputScheduler::K_OUTPUT_JITTER_VAR[] = "output-jitter-us";
+const char OutputScheduler::K_OUTPUT_MAX_JITTER_VAR[] = "output-max-jitter-us";
+
+
+/*
+ * Create a new scheduler.
+ * @param ss the SelectServer to run the timer on
+ * @param clock the clock to use to measure the jitter
+ * @param rate the number of ticks per second
+ * @param export_map the ExportMap to publish the stats to, may be NULL
+ * @param loop the event loop this scheduler is for, used as the key for the
+ *   exported stats.
+ */
+OutputScheduler::OutputScheduler(ola::io::SelectServerInterface *ss,
+                                 Clock *clock,
+                                 unsigned int rate,
+                                 ExportMap *export_map,
+                                 unsigned int loop)
+    : m_ss(ss),
+      m_clock(clock),
+      m_period(0, USEC_IN_SECONDS / std::max(rate, 1u)),
+      m_rate(std::max(rate, 1u)),
+      m_ticks(NULL),
+      m_timeout(ola::thread::INVALID_TIMEOUT),
+      m_idle_ticks(0),
+      m_jitter_samples(0),
+      m_total_jitter(0),
+      m_max_jitter(0) {
+  if (export_map) {
+    m_ticks = export_map->GetShardedCounterVar(K_OUTPUT_TICKS_VAR);
+    std::stringstream str;
+    str << loop;
+    const std::string loop_str = str.str();
+    m_jitter_handle = export_map->GetUIntMapVar(
+        K_OUTPUT_JITTER_VAR, "loop")->Handle(loop_str);
+    m_max_jitter_handle = export_map->GetUIntMapVar(
+        K_OUTPUT_MAX_JITTER_VAR, "loop")->Handle(loop_str);
+  }
+}
+
+
+OutputScheduler::~OutputScheduler() {
+  if (m_timeout != ola::thread::INVALID_TIMEOUT)
+    m_ss->RemoveTimeout(m_timeout);
+}
+
+
+/*
+ * Queue a universe for output on the next tick. The universe makes sure it's
+ * only queued once.
+ */
+void OutputScheduler::Schedule(Universe *universe) {
+  m_pending.push_back(universe);
+  m_idle_ticks = 0;
+  if (m_timeout == ola::thread::INVALID_TIMEOUT) {
+    m_clock->CurrentTime(&m_last_tick);
+    m_timeout = m_ss->RegisterRepeatingTimeout(
+        m_period,
+        NewCallback(this, &OutputScheduler::Tick));
+  }
+}
+
+
+/*
+ * Remove a universe from the queue, this is called when a universe with
+ * pending output is deleted.
+ */
+void OutputScheduler::Cancel(Universe *universe) {
+  m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), universe),
+                  m_pending.end());
+  std::replace(m_running.begin(), m_running.end(), universe,
+               static_cast<Universe*>(NULL));
+}
+
+
+/*
+ * Output all the universes that have changed since the last tick.
+ */
+bool OutputScheduler::Tick() {
+  TimeStamp now;
+  m_clock->CurrentTime(&now);
+  RecordJitter(now);
+
+  if (m_ticks)
+    (*m_ticks)++;
+
+  if (m_pending.empty()) {
+    // Keep the timer running for a second, so inputs that arrive at about
+    // the same rate as the ticks don't keep restarting it.
+    if (++m_idle_ticks >= m_rate) {
+      m_timeout = ola::thread::INVALID_TIMEOUT;
+      return false;
+    }
+    return true;
+  }
+
+  m_running.swap(m_pending);
+  for (unsigned int i = 0; i < m_running.size(); i++) {
+    if (m_running[i])
+      m_running[i]->RunScheduledOutput();
+  }
+  m_running.clear();
+  return true;
+}
+
+
+/*
+ * Record how far the time since the last tick was from the period.
+ */
+void OutputScheduler::RecordJitter(const TimeStamp &now) {
+  int64_t jitter = (now - m_last_tick).AsInt() - m_period.AsInt();
+  m_last_tick = now;
+  unsigned int abs_jitter = static_cast<unsigned int>(
+      jitter < 0 ? -jitter : jitter);
+
+  m_total_jitter += abs_jitter;
+  m_max_jitter = std::max(m_max_jitter, abs_jitter);
+  if (++m_jitter_samples >= m_rate)
+    PublishJitter();
+}
+
+
+/*
+ * Publish the mean & max jitter, and start a new sample.
+ */
+void OutputScheduler::PublishJitter() {
+  m_jitter_handle.Set(
+      static_cast<unsigned int>(m_total_jitter / m_jitter_samples));
+  m_max_jitter_handle.Set(m_max_jitter);
+  m_jitter_samples = 0;
+  m_total_jitter = 0;
+  m_max_jitter = 0;
+}
+}  // namespace ola
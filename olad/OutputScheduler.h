@@ -0,0 +1,99 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * OutputScheduler.h
+ * Sends the DMX for universes at a fixed rate.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * Without a scheduler, a universe writes to its output ports & sink clients
+ * every time one of its sources changes. With several sources at 44fps each
+ * that's several writes per output period.
+ *
+ * With a scheduler, a universe that changes asks to be output on the next
+ * tick, and any further changes before then are coalesced into that one
+ * output. There is one scheduler per event loop, so all the universes in a
+ * loop are output together. The timer only runs while there is something to
+ * send.
+ *
+ * The scheduler also records how late each tick was, which is exported as
+ * the mean and maximum jitter over the last second.
+ */
+
+#ifndef OLAD_OUTPUTSCHEDULER_H_
+#define OLAD_OUTPUTSCHEDULER_H_
+
+#include <stdint.h>
+#include <ola/Clock.h>
+#include <ola/ExportMap.h>
+#include <ola/io/SelectServerInterface.h>
+#include <vector>
+
+namespace ola {
+
+class Universe;
+
+class OutputScheduler {
+  public:
+    OutputScheduler(ola::io::SelectServerInterface *ss,
+                    Clock *clock,
+                    unsigned int rate,
+                    ExportMap *export_map = NULL,
+                    unsigned int loop = 0);
+    ~OutputScheduler();
+
+    const TimeInterval &Period() const { return m_period; }
+
+    // Output a universe on the next tick. This must be called from the loop
+    // the scheduler belongs to.
+    void Schedule(Universe *universe);
+    void Cancel(Universe *universe);
+
+    static const char K_OUTPUT_TICKS_VAR[];
+    static const char K_OUTPUT_JITTER_VAR[];
+    static const char K_OUTPUT_MAX_JITTER_VAR[];
+
+  private:
+    ola::io::SelectServerInterface *m_ss;
+    Clock *m_clock;
+    TimeInterval m_period;
+    unsigned int m_rate;
+    // Every loop's scheduler adds to the same tick count, so it's sharded.
+    // This is NULL if there isn't an ExportMap.
+    ShardedCounterVariable *m_ticks;
+    // Looked up once, since the scheduler may run in a worker loop. These are
+    // unbound if there isn't an ExportMap.
+    CounterHandle m_jitter_handle;
+    CounterHandle m_max_jitter_handle;
+    ola::thread::timeout_id m_timeout;
+    std::vector<Universe*> m_pending;
+    std::vector<Universe*> m_running;
+
+    // The time of the last tick, used to work out the jitter.
+    TimeStamp m_last_tick;
+    unsigned int m_idle_ticks;
+    // The jitter since the stats were last published, in microseconds.
+    unsigned int m_jitter_samples;
+    uint64_t m_total_jitter;
+    unsigned int m_max_jitter;
+
+    bool Tick();
+    void RecordJitter(const TimeStamp &now);
+    void PublishJitter();
+
+    OutputScheduler(const OutputScheduler&);
+    OutputScheduler& operator=(const OutputScheduler&);
+};
+}  // namespace ola
+#endif  // OLAD_OUTPUTSCHEDULER_H_
@@ -0,0 +1,205 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * OutputSchedulerTest.cpp
+ * Test fixture for the OutputScheduler class.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "ola/ExportMap.h"
+#include "olad/OutputScheduler.h"
+#include "olad/TestCommon.h"
+#include "olad/Universe.h"
+#include "olad/UniverseStore.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::ExportMap;
+using ola::MockClock;
+using ola::OutputScheduler;
+using ola::TimeStamp;
+using ola::Universe;
+using std::string;
+
+static const unsigned int TEST_UNIVERSE = 1;
+static const unsigned int TEST_RATE = 40;
+
+
+class OutputSchedulerTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(OutputSchedulerTest);
+  CPPUNIT_TEST(testCoalescing);
+  CPPUNIT_TEST(testIdle);
+  CPPUNIT_TEST(testJitter);
+  CPPUNIT_TEST(testRemoveUniverse);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    OutputSchedulerTest()
+        : m_ss(&m_wake_up) {
+    }
+
+    void setUp();
+    void testCoalescing();
+    void testIdle();
+    void testJitter();
+    void testRemoveUniverse();
+
+  private:
+    TimeStamp m_wake_up;
+    MockSelectServer m_ss;
+    MockClock m_clock;
+    ExportMap m_export_map;
+    DmxBuffer m_buffer1, m_buffer2;
+
+    unsigned int UIntVar(const string &name, const string &key) {
+      return (*m_export_map.GetUIntMapVar(name))[key];
+    }
+
+    unsigned int Ticks() {
+      return m_export_map.GetShardedCounterVar(
+          OutputScheduler::K_OUTPUT_TICKS_VAR)->Get();
+    }
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(OutputSchedulerTest);
+
+
+void OutputSchedulerTest::setUp() {
+  m_buffer1.SetFromString("1,2,3,4");
+  m_buffer2.SetFromString("5,6,7,8");
+}
+
+
+/*
+ * Check that changes between ticks are sent once, on the next tick.
+ */
+void OutputSchedulerTest::testCoalescing() {
+  OutputScheduler scheduler(&m_ss, &m_clock, TEST_RATE, &m_export_map);
+  OLA_ASSERT_EQ(25000, static_cast<int>(scheduler.Period().AsInt()));
+
+  ola::UniverseStore store(NULL, NULL);
+  Universe universe(TEST_UNIVERSE, &store, &m_export_map, &m_clock);
+  universe.SetOutputScheduler(&scheduler);
+  TestMockOutputPort port(NULL, 1);
+  universe.AddPort(&port);
+  OLA_ASSERT_EQ(0u, m_ss.RepeatingTimeoutCount());
+
+  // nothing is sent until the tick
+  OLA_ASSERT(universe.SetDMX(m_buffer1));
+  OLA_ASSERT(universe.SetDMX(m_buffer2));
+  OLA_ASSERT_EQ(1u, m_ss.RepeatingTimeoutCount());
+  OLA_ASSERT_EQ(0u, port.ReadDMX().Size());
+  OLA_ASSERT_TRUE(m_buffer2 == universe.GetDMX());
+
+  m_ss.RunRepeatingTimeouts();
+  OLA_ASSERT_TRUE(m_buffer2 == port.ReadDMX());
+  OLA_ASSERT_EQ(1u, UIntVar(Universe::K_UNIVERSE_COALESCED_FRAMES_VAR, "1"));
+  OLA_ASSERT_EQ(1u, Ticks());
+  OLA_ASSERT_EQ(1u, UIntVar(Universe::K_FPS_VAR, "1"));
+
+  // a tick with no changes doesn't send anything
+  port.WriteDMX(DmxBuffer(), 0);
+  m_ss.RunRepeatingTimeouts();
+  OLA_ASSERT_EQ(0u, port.ReadDMX().Size());
+  OLA_ASSERT_EQ(2u, Ticks());
+
+  // without a scheduler, changes are sent right away
+  universe.SetOutputScheduler(NULL);
+  OLA_ASSERT(universe.SetDMX(m_buffer1));
+  OLA_ASSERT_TRUE(m_buffer1 == port.ReadDMX());
+  universe.RemovePort(&port);
+}
+
+
+/*
+ * Check the timer stops once there has been nothing to send for a second.
+ */
+void OutputSchedulerTest::testIdle() {
+  OutputScheduler scheduler(&m_ss, &m_clock, TEST_RATE);
+  ola::UniverseStore store(NULL, NULL);
+  Universe universe(TEST_UNIVERSE, &store, NULL, &m_clock);
+  universe.SetOutputScheduler(&scheduler);
+
+  OLA_ASSERT(universe.SetDMX(m_buffer1));
+  m_ss.RunRepeatingTimeouts();
+  OLA_ASSERT_TRUE(m_buffer1 == universe.GetDMX());
+
+  for (unsigned int i = 0; i < TEST_RATE - 1; i++) {
+    m_ss.RunRepeatingTimeouts();
+    OLA_ASSERT_EQ(1u, m_ss.RepeatingTimeoutCount());
+  }
+  m_ss.RunRepeatingTimeouts();
+  OLA_ASSERT_EQ(0u, m_ss.RepeatingTimeoutCount());
+
+  // and starts again on the next change
+  OLA_ASSERT(universe.SetDMX(m_buffer2));
+  OLA_ASSERT_EQ(1u, m_ss.RepeatingTimeoutCount());
+}
+
+
+/*
+ * Check the jitter is published once a second.
+ */
+void OutputSchedulerTest::testJitter() {
+  OutputScheduler scheduler(&m_ss, &m_clock, TEST_RATE, &m_export_map);
+  ola::UniverseStore store(NULL, NULL);
+  Universe universe(TEST_UNIVERSE, &store, NULL, &m_clock);
+  universe.SetOutputScheduler(&scheduler);
+  OLA_ASSERT(universe.SetDMX(m_buffer1));
+
+  // every tick is 5ms late, plus however long the test takes to run
+  for (unsigned int i = 0; i < TEST_RATE; i++) {
+    m_clock.AdvanceTime(0, 30000);
+    m_ss.RunRepeatingTimeouts();
+  }
+
+  const unsigned int tolerance = 2000;
+  unsigned int jitter = UIntVar(OutputScheduler::K_OUTPUT_JITTER_VAR, "0");
+  unsigned int max_jitter = UIntVar(OutputScheduler::K_OUTPUT_MAX_JITTER_VAR,
+                                    "0");
+  OLA_ASSERT_TRUE(jitter >= 5000);
+  OLA_ASSERT_TRUE(jitter < 5000 + tolerance);
+  OLA_ASSERT_TRUE(max_jitter >= jitter);
+  OLA_ASSERT_TRUE(max_jitter < 5000 + tolerance);
+}
+
+
+/*
+ * Check that a universe with pending output can be deleted.
+ */
+void OutputSchedulerTest::testRemoveUniverse() {
+  OutputScheduler scheduler(&m_ss, &m_clock, TEST_RATE);
+  ola::UniverseStore store(NULL, NULL);
+  Universe *universe = new Universe(TEST_UNIVERSE, &store, NULL, &m_clock);
+  universe->SetOutputScheduler(&scheduler);
+  Universe other_universe(TEST_UNIVERSE + 1, &store, NULL, &m_clock);
+  other_universe.SetOutputScheduler(&scheduler);
+  TestMockOutputPort port(NULL, 1);
+  other_universe.AddPort(&port);
+
+  OLA_ASSERT(universe->SetDMX(m_buffer1));
+  OLA_ASSERT(other_universe.SetDMX(m_buffer2));
+  delete universe;
+
+  m_ss.RunRepeatingTimeouts();
+  OLA_ASSERT_TRUE(m_buffer2 == port.ReadDMX());
+  other_universe.RemovePort(&port);
+}
@@ -22,6 +22,7 @@
 #include <string>
 #include "ola/Callback.h"
 #include "olad/DeviceManager.h"
+#include "olad/EventLoopPool.h"
 #include "olad/PluginAdaptor.h"
 #include "olad/PortBroker.h"
 #include "olad/Preferences.h"
@@ -30,22 +31,53 @@ namespace ola {
 
 using ola::io::SelectServerInterface;
 
+
+/*
+ * These are used to run the DeviceManager & PreferencesFactory calls in the
+ * main loop.
+ */
+static void RunRegisterDevice(DeviceManager *device_manager,
+                              AbstractDevice *device,
+                              bool *result) {
+  *result = device_manager->RegisterDevice(device);
+}
+
+
+static void RunUnregisterDevice(DeviceManager *device_manager,
+                                AbstractDevice *device,
+                                bool *result) {
+  *result = device_manager->UnregisterDevice(device);
+}
+
+
+static void RunNewPreference(PreferencesFactory *preferences_factory,
+                             const string *name,
+                             Preferences **preferences) {
+  *preferences = preferences_factory->NewPreference(*name);
+}
+
 /*
  * Create a new PluginAdaptor
  * @param device_manager  pointer to a DeviceManager object
  * @param select_server pointer to the SelectServer object
  * @param preferences_factory pointer to the PreferencesFactory object
+ * @param loop_pool the EventLoopPool, or NULL if there is only one loop.
+ * @param loop the loop that select_server belongs to.
  */
 PluginAdaptor::PluginAdaptor(DeviceManager *device_manager,
                              SelectServerInterface *select_server,
                              ExportMap *export_map,
                              PreferencesFactory *preferences_factory,
-                             PortBrokerInterface *port_broker):
+                             PortBrokerInterface *port_broker,
+                             EventLoopPool *loop_pool,
+                             unsigned int loop):
   m_device_manager(device_manager),
   m_ss(select_server),
   m_export_map(export_map),
   m_preferences_factory(preferences_factory),
-  m_port_broker(port_broker) {
+  m_port_broker(port_broker),
+  m_loop_pool(loop_pool),
+  m_loop(loop) {
 }
 
 
@@ -183,7 +215,18 @@ void PluginAdaptor::Execute(ola::BaseCallback0<void> *closure) {
  * @return true on success, false on error
  */
 bool PluginAdaptor::RegisterDevice(AbstractDevice *device) const {
-  return m_device_manager->RegisterDevice(device);
+  if (!m_loop_pool)
+    return m_device_manager->RegisterDevice(device);
+
+  // The device's ports run in our loop.
+  m_loop_pool->AddDevice(device, m_loop);
+  bool result = false;
+  m_loop_pool->RunOnMain(
+      NewSingleCallback(&RunRegisterDevice, m_device_manager, device,
+                        &result));
+  if (!result)
+    m_loop_pool->RemoveDevice(device);
+  return result;
 }
 
 
@@ -193,7 +236,15 @@ bool PluginAdaptor::RegisterDevice(AbstractDevice *device) const {
  * @return true on success, false on error
  */
 bool PluginAdaptor::UnregisterDevice(AbstractDevice *device) const {
-  return m_device_manager->UnregisterDevice(device);
+  if (!m_loop_pool)
+    return m_device_manager->UnregisterDevice(device);
+
+  bool result = false;
+  m_loop_pool->RunOnMain(
+      NewSingleCallback(&RunUnregisterDevice, m_device_manager, device,
+                        &result));
+  m_loop_pool->RemoveDevice(device);
+  return result;
 }
 
 
@@ -202,7 +253,14 @@ bool PluginAdaptor::UnregisterDevice(AbstractDevice *device) const {
  * @return a Preferences object
  */
 Preferences *PluginAdaptor::NewPreference(const string &name) const {
-  return m_preferences_factory->NewPreference(name);
+  if (!m_loop_pool)
+    return m_preferences_factory->NewPreference(name);
+
+  Preferences *preferences = NULL;
+  m_loop_pool->RunOnMain(
+      NewSingleCallback(&RunNewPreference, m_preferences_factory, &name,
+                        &preferences));
+  return preferences;
 }
 
 
@@ -33,9 +33,12 @@ using std::vector;
 using std::set;
 
 PluginManager::PluginManager(const vector<PluginLoader*> &plugin_loaders,
-                             class PluginAdaptor *plugin_adaptor)
+                             class PluginAdaptor *plugin_adaptor,
+                             const vector<PluginAdaptor*> &worker_adaptors)
     : m_plugin_loaders(plugin_loaders),
-      m_plugin_adaptor(plugin_adaptor) {
+      m_plugin_adaptor(plugin_adaptor),
+      m_worker_adaptors(worker_adaptors),
+      m_next_worker(0) {
 }
 
 
@@ -105,6 +108,11 @@ void PluginManager::LoadAll() {
     if (conflict)
       continue;
 
+    if (!m_worker_adaptors.empty()) {
+      plugin->SetPluginAdaptor(
+          m_worker_adaptors[m_next_worker++ % m_worker_adaptors.size()]);
+    }
+
     OLA_INFO << "Trying to start " << plugin->Name();
     if (!plugin->Start())
       OLA_WARN << "Failed to start " << plugin->Name();
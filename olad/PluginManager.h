@@ -34,8 +34,14 @@ class AbstractPlugin;
 
 class PluginManager {
   public:
+    /*
+     * If worker_adaptors is not empty, each plugin is pinned to one of them
+     * before it's started.
+     */
     PluginManager(const vector<PluginLoader*> &plugin_loaders,
-                  PluginAdaptor *plugin_adaptor);
+                  PluginAdaptor *plugin_adaptor,
+                  const vector<PluginAdaptor*> &worker_adaptors =
+                      vector<PluginAdaptor*>());
     ~PluginManager();
 
     void LoadAll();
@@ -70,6 +76,8 @@ class PluginManager {
     PluginMap m_loaded_plugins;  // plugins that are loaded
     PluginMap m_active_plugins;  // active plugins
     PluginAdaptor *m_plugin_adaptor;
+    vector<PluginAdaptor*> m_worker_adaptors;
+    unsigned int m_next_worker;
 };
 }  // namespace ola
 #endif  // OLAD_PLUGINMANAGER_H_
@@ -89,11 +89,18 @@ bool BasicInputPort::SetPriority(uint8_t priority) {
 void BasicInputPort::DmxChanged() {
   if (GetUniverse()) {
     const DmxBuffer &buffer = ReadDMX();
-    uint8_t priority = (PriorityCapability() == CAPABILITY_FULL &&
-                        GetPriorityMode() == PRIORITY_MODE_INHERIT ?
-                        InheritedPriority() :
-                        GetPriority());
-    m_dmx_source.UpdateData(buffer, *m_plugin_adaptor->WakeUpTime(), priority);
+    bool inherit = (PriorityCapability() == CAPABILITY_FULL &&
+                    GetPriorityMode() == PRIORITY_MODE_INHERIT);
+    uint8_t priority = inherit ? InheritedPriority() : GetPriority();
+    const DmxBuffer *slot_priorities = (inherit ? InheritedSlotPriorities() :
+                                        NULL);
+    if (slot_priorities && slot_priorities->Size()) {
+      m_dmx_source.UpdateData(buffer, *m_plugin_adaptor->WakeUpTime(),
+                              priority, *slot_priorities);
+    } else {
+      m_dmx_source.UpdateData(buffer, *m_plugin_adaptor->WakeUpTime(),
+                              priority);
+    }
     GetUniverse()->PortDataChanged(this);
   }
 }
@@ -148,7 +155,9 @@ BasicOutputPort::BasicOutputPort(AbstractDevice *parent,
     m_port_string(""),
     m_universe(NULL),
     m_device(parent),
-    m_supports_rdm(supports_rdm) {
+    m_supports_rdm(supports_rdm),
+    m_latency(NULL),
+    m_last_input_time() {
 }
 
 
@@ -180,6 +189,48 @@ string BasicOutputPort::UniqueId() const {
 }
 
 
+/*
+ * Write the data and record the latency. This is used by ports that send the
+ * data before returning.
+ */
+bool BasicOutputPort::WriteTimedDMX(const DmxBuffer &buffer,
+                                    uint8_t priority,
+                                    const TimeStamp &input_time) {
+  bool ok = WriteDMX(buffer, priority);
+  if (ok)
+    RecordLatency(input_time);
+  return ok;
+}
+
+
+/*
+ * Set the histogram to record the latency in.
+ * @param histogram the histogram to use, or NULL to stop recording.
+ */
+void BasicOutputPort::SetLatencyHistogram(Histogram *histogram) {
+  ola::thread::MutexLocker locker(&m_latency_mutex);
+  m_latency = histogram;
+}
+
+
+/*
+ * Record the time from when the data arrived until now. Threaded ports may
+ * send the same frame many times, only the first send is counted.
+ * @param input_time the time the data arrived, from WriteTimedDMX
+ */
+void BasicOutputPort::RecordLatency(const TimeStamp &input_time) {
+  ola::thread::MutexLocker locker(&m_latency_mutex);
+  if (!m_latency || !input_time.IsSet() || input_time == m_last_input_time)
+    return;
+  m_last_input_time = input_time;
+
+  TimeStamp now;
+  m_clock.CurrentTime(&now);
+  m_latency->Add(now > input_time ?
+      static_cast<unsigned int>((now - input_time).AsInt()) : 0);
+}
+
+
 bool BasicOutputPort::SetPriority(uint8_t priority) {
   if (priority > DmxSource::PRIORITY_MAX)
     return false;
@@ -37,6 +37,7 @@
 #include "ola/StringUtils.h"
 #include "ola/stl/STLUtils.h"
 #include "ola/thread/Thread.h"
+#include "ola/thread/Trace.h"
 #include "olad/Preferences.h"
 
 namespace ola {
@@ -292,6 +293,7 @@ void FilePreferenceSaverThread::SavePreferences(
  * Called by the new thread.
  */
 void *FilePreferenceSaverThread::Run() {
+  ola::thread::SetTraceThreadName("preferences");
   m_ss.Run();
   return NULL;
 }
@@ -330,6 +332,7 @@ void FilePreferenceSaverThread::Syncronize() {
 void FilePreferenceSaverThread::SaveToFile(
     const string *filename_ptr,
     const PreferencesMap *pref_map_ptr) {
+  ola::thread::TraceScope trace("FilePreferenceSaverThread::SaveToFile");
   std::auto_ptr<const string> filename(filename_ptr);
   std::auto_ptr<const PreferencesMap> pref_map(pref_map_ptr);
 
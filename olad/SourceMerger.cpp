@@ -0,0 +1,293 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * SourceMerger.cpp
+ * Merges the DmxSources for a universe.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "olad/DmxSource.h"
+#include "olad/SourceMerger.h"
+
+namespace ola {
+
+using std::set;
+using std::vector;
+
+class MergeSource {
+  public:
+    explicit MergeSource(const DmxSource &source)
+        : data(source),
+          previous(NULL),
+          next(NULL),
+          linked(false) {
+    }
+
+    DmxSource data;
+    MergeSource *previous;
+    MergeSource *next;
+    bool linked;
+
+    // true if this source can take part in a merge
+    bool IsLive() const {
+      return data.IsSet() && data.Data().Size();
+    }
+
+    // the list this source belongs in
+    uint8_t Priority() const {
+      return std::min(data.Priority(), DmxSource::PRIORITY_MAX);
+    }
+};
+
+
+/*
+ * Used to order sources oldest first for a LTP merge.
+ */
+static bool IsOlderSource(const MergeSource *source1,
+                          const MergeSource *source2) {
+  return source1->data.Timestamp() < source2->data.Timestamp();
+}
+
+
+SourceMerger::SourceMerger()
+    : m_sources(DmxSource::PRIORITY_MAX + 1,
+                static_cast<MergeSource*>(NULL)),
+      m_top_priority(DmxSource::PRIORITY_MIN),
+      m_active_priority(DmxSource::PRIORITY_MIN),
+      m_slot_priority_sources(0) {
+}
+
+
+SourceMerger::~SourceMerger() {
+  set<MergeSource*>::iterator iter = m_all_sources.begin();
+  for (; iter != m_all_sources.end(); ++iter)
+    delete *iter;
+}
+
+
+/*
+ * Add a new source. This doesn't change the merged data, the source will be
+ * taken into account the next time any source is updated.
+ * @param data the initial data for the source
+ * @returns the new source, which is owned by the SourceMerger
+ */
+MergeSource *SourceMerger::AddSource(const DmxSource &data) {
+  MergeSource *source = new MergeSource(data);
+  m_all_sources.insert(source);
+  if (source->IsLive())
+    Link(source);
+  return source;
+}
+
+
+/*
+ * Remove a source. Like AddSource() this doesn't change the merged data.
+ */
+void SourceMerger::RemoveSource(MergeSource *source) {
+  if (!m_all_sources.erase(source))
+    return;
+  Unlink(source);
+  delete source;
+}
+
+
+/*
+ * Update a source and merge.
+ * @param source the source that changed
+ * @param data the new data for the source
+ * @param now the current time
+ * @param htp_merge true to HTP merge the winning sources, false to use LTP
+ * @param output the buffer to store the result of the merge in
+ * @returns true if output was updated, false if this source didn't have any
+ *   effect.
+ */
+bool SourceMerger::UpdateSource(MergeSource *source,
+                                const DmxSource &data,
+                                const TimeStamp &now,
+                                bool htp_merge,
+                                DmxBuffer *output) {
+  Unlink(source);
+  source->data = data;
+  if (!source->IsLive() || !data.IsActive(now))
+    return false;
+  Link(source);
+
+  if (m_slot_priority_sources)
+    return MergeSlots(now, htp_merge, output);
+
+  // If there is a live source at a higher priority, this one loses.
+  uint8_t priority = source->Priority();
+  for (; m_top_priority > priority; m_top_priority--) {
+    if (HasLiveSource(m_top_priority, now))
+      return false;
+  }
+  return MergePriority(source, now, htp_merge, output);
+}
+
+
+/*
+ * Add a source to the list for its priority.
+ */
+void SourceMerger::Link(MergeSource *source) {
+  uint8_t priority = source->Priority();
+  source->previous = NULL;
+  source->next = m_sources[priority];
+  if (source->next)
+    source->next->previous = source;
+  m_sources[priority] = source;
+  source->linked = true;
+  if (source->data.HasSlotPriorities())
+    m_slot_priority_sources++;
+
+  if (priority > m_top_priority)
+    m_top_priority = priority;
+}
+
+
+/*
+ * Remove a source from the list for its priority.
+ */
+void SourceMerger::Unlink(MergeSource *source) {
+  if (!source->linked)
+    return;
+
+  if (source->previous) {
+    source->previous->next = source->next;
+  } else {
+    m_sources[source->Priority()] = source->next;
+  }
+  if (source->next)
+    source->next->previous = source->previous;
+
+  source->previous = NULL;
+  source->next = NULL;
+  source->linked = false;
+  if (source->data.HasSlotPriorities())
+    m_slot_priority_sources--;
+}
+
+
+/*
+ * Check if any source at a priority is still live, dropping the ones that
+ * have timed out.
+ */
+bool SourceMerger::HasLiveSource(uint8_t priority, const TimeStamp &now) {
+  MergeSource *source = m_sources[priority];
+  while (source) {
+    if (source->data.IsActive(now))
+      return true;
+    MergeSource *next = source->next;
+    Unlink(source);
+    source = next;
+  }
+  return false;
+}
+
+
+/*
+ * Merge the sources at the priority of the source that changed, which is the
+ * highest live priority.
+ */
+bool SourceMerger::MergePriority(MergeSource *changed_source,
+                                 const TimeStamp &now,
+                                 bool htp_merge,
+                                 DmxBuffer *output) {
+  const DmxSource &changed_data = changed_source->data;
+  m_merge_buffers.clear();
+
+  MergeSource *source = m_sources[m_top_priority];
+  while (source) {
+    MergeSource *next = source->next;
+    if (!source->data.IsActive(now)) {
+      Unlink(source);
+    } else {
+      // with LTP, the newest source wins
+      if (!htp_merge && changed_data.Timestamp() < source->data.Timestamp())
+        return false;
+      m_merge_buffers.push_back(&source->data.Data());
+    }
+    source = next;
+  }
+
+  if (htp_merge && m_merge_buffers.size() > 1)
+    output->SetFromHTPMerge(&m_merge_buffers[0], m_merge_buffers.size());
+  else
+    output->Set(changed_data.Data());
+  m_active_priority = m_top_priority;
+  return true;
+}
+
+
+/*
+ * Merge every live source slot by slot. This is used when any of the sources
+ * have per-slot priorities, since then a source with a lower priority can
+ * still win some of the slots.
+ */
+bool SourceMerger::MergeSlots(const TimeStamp &now,
+                              bool htp_merge,
+                              DmxBuffer *output) {
+  m_merge_sources.clear();
+  for (int priority = m_top_priority; priority >= DmxSource::PRIORITY_MIN;
+       priority--) {
+    MergeSource *source = m_sources[priority];
+    while (source) {
+      MergeSource *next = source->next;
+      if (source->data.IsActive(now))
+        m_merge_sources.push_back(source);
+      else
+        Unlink(source);
+      source = next;
+    }
+  }
+
+  while (m_top_priority > DmxSource::PRIORITY_MIN &&
+         !m_sources[m_top_priority])
+    m_top_priority--;
+
+  // with LTP, the newest source wins each slot
+  if (!htp_merge) {
+    std::stable_sort(m_merge_sources.begin(), m_merge_sources.end(),
+                     IsOlderSource);
+  }
+
+  m_merge_buffers.clear();
+  m_merge_slot_priorities.clear();
+  m_merge_priorities.clear();
+  vector<MergeSource*>::const_iterator iter = m_merge_sources.begin();
+  for (; iter != m_merge_sources.end(); ++iter) {
+    const DmxSource &data = (*iter)->data;
+    m_merge_buffers.push_back(&data.Data());
+    m_merge_slot_priorities.push_back(
+        data.HasSlotPriorities() ? &data.SlotPriorities() : NULL);
+    m_merge_priorities.push_back(data.Priority());
+  }
+
+  if (m_merge_sources.empty())
+    return false;
+  output->SetFromPriorityMerge(&m_merge_buffers[0],
+                               &m_merge_slot_priorities[0],
+                               &m_merge_priorities[0],
+                               m_merge_buffers.size(),
+                               htp_merge);
+  m_active_priority = m_top_priority;
+  return true;
+}
+}  // namespace ola
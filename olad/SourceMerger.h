@@ -0,0 +1,97 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * SourceMerger.h
+ * Merges the DmxSources for a universe.
+ * Copyright (C) 2013 Simon Newton
+ *
+ * This implements the merge documented at
+ * http://opendmx.net/index.php/OLA_Merging_Algorithms, incrementally.
+ *
+ * Each live source is kept in a list for its priority, and we track an upper
+ * bound on the highest priority with a live source. When a source changes
+ * only the sources at the winning priority are looked at, the lower ones
+ * aren't touched. Sources that have timed out are dropped from their list
+ * when we come across them, and go back in once they send data again.
+ *
+ * Memory is only allocated when a source is added, or the number of sources
+ * at the winning priority grows past what it's been before.
+ *
+ * Sources may also have per-slot priorities (E1.31 start code 0xDD). While any
+ * live source has them, each update merges every live source slot by slot:
+ * the highest priority for each slot wins, and ties are HTP or LTP merged.
+ */
+
+#ifndef OLAD_SOURCEMERGER_H_
+#define OLAD_SOURCEMERGER_H_
+
+#include <stdint.h>
+#include <ola/Clock.h>
+#include <ola/DmxBuffer.h>
+#include <olad/DmxSource.h>
+#include <set>
+#include <vector>
+
+namespace ola {
+
+// The merge state for a source, this is opaque outside of the SourceMerger.
+class MergeSource;
+
+class SourceMerger {
+  public:
+    SourceMerger();
+    ~SourceMerger();
+
+    MergeSource *AddSource(const DmxSource &data);
+    void RemoveSource(MergeSource *source);
+
+    bool UpdateSource(MergeSource *source,
+                      const DmxSource &data,
+                      const TimeStamp &now,
+                      bool htp_merge,
+                      DmxBuffer *output);
+
+    // The priority of the sources that produced the last merge
+    uint8_t ActivePriority() const { return m_active_priority; }
+    unsigned int SourceCount() const { return m_all_sources.size(); }
+
+  private:
+    std::set<MergeSource*> m_all_sources;
+    // The live sources at each priority, as doubly linked lists.
+    std::vector<MergeSource*> m_sources;
+    // No live source has a priority greater than this.
+    uint8_t m_top_priority;
+    uint8_t m_active_priority;
+    // The number of live sources with per-slot priorities.
+    unsigned int m_slot_priority_sources;
+    std::vector<MergeSource*> m_merge_sources;
+    std::vector<const DmxBuffer*> m_merge_buffers;
+    std::vector<const DmxBuffer*> m_merge_slot_priorities;
+    std::vector<uint8_t> m_merge_priorities;
+
+    void Link(MergeSource *source);
+    void Unlink(MergeSource *source);
+    bool HasLiveSource(uint8_t priority, const TimeStamp &now);
+    bool MergePriority(MergeSource *changed_source,
+                       const TimeStamp &now,
+                       bool htp_merge,
+                       DmxBuffer *output);
+    bool MergeSlots(const TimeStamp &now, bool htp_merge, DmxBuffer *output);
+
+    SourceMerger(const SourceMerger&);
+    SourceMerger& operator=(const SourceMerger&);
+};
+}  // namespace ola
+#endif  // OLAD_SOURCEMERGER_H_
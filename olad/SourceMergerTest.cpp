@@ -0,0 +1,284 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * SourceMergerTest.cpp
+ * Test fixture for the SourceMerger class.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "olad/DmxSource.h"
+#include "olad/SourceMerger.h"
+#include "ola/testing/TestUtils.h"
+
+using ola::DmxBuffer;
+using ola::DmxSource;
+using ola::MergeSource;
+using ola::SourceMerger;
+using ola::TimeInterval;
+using ola::TimeStamp;
+using std::string;
+
+
+class SourceMergerTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(SourceMergerTest);
+  CPPUNIT_TEST(testPriority);
+  CPPUNIT_TEST(testHTPMerge);
+  CPPUNIT_TEST(testLTPMerge);
+  CPPUNIT_TEST(testTimeout);
+  CPPUNIT_TEST(testAddRemove);
+  CPPUNIT_TEST(testSlotPriorities);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void setUp();
+    void testPriority();
+    void testHTPMerge();
+    void testLTPMerge();
+    void testTimeout();
+    void testAddRemove();
+    void testSlotPriorities();
+
+  private:
+    TimeStamp m_now;
+    DmxBuffer m_buffer1, m_buffer2, m_htp_buffer;
+};
+
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SourceMergerTest);
+
+
+void SourceMergerTest::setUp() {
+  ola::Clock clock;
+  clock.CurrentTime(&m_now);
+  m_buffer1.SetFromString("1,20,3,40");
+  m_buffer2.SetFromString("10,2,30,4,5");
+  m_htp_buffer.SetFromString("10,20,30,40,5");
+}
+
+
+/*
+ * Check that the highest priority wins.
+ */
+void SourceMergerTest::testPriority() {
+  SourceMerger merger;
+  DmxBuffer output;
+  MergeSource *source1 = merger.AddSource(DmxSource());
+  MergeSource *source2 = merger.AddSource(DmxSource());
+  OLA_ASSERT_EQ(2u, merger.SourceCount());
+
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+  OLA_ASSERT_EQ((uint8_t) 100, merger.ActivePriority());
+
+  // a lower priority source has no effect
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 99), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+
+  // a higher one takes over
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 150), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+  OLA_ASSERT_EQ((uint8_t) 150, merger.ActivePriority());
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, true, &output));
+
+  // if it drops its priority, the other source wins on its next update
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 0), m_now, true, &output));
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+  OLA_ASSERT_EQ((uint8_t) 100, merger.ActivePriority());
+
+  // sources without data don't count
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source1, DmxSource(DmxBuffer(), m_now, 200), m_now, true, &output));
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 0), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+}
+
+
+/*
+ * Check the sources at the same priority are HTP merged.
+ */
+void SourceMergerTest::testHTPMerge() {
+  SourceMerger merger;
+  DmxBuffer output;
+  MergeSource *source1 = merger.AddSource(DmxSource());
+  MergeSource *source2 = merger.AddSource(DmxSource());
+  MergeSource *source3 = merger.AddSource(DmxSource());
+
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_htp_buffer == output);
+
+  // a lower priority source doesn't get merged
+  DmxBuffer full_buffer;
+  full_buffer.SetRangeToValue(0, 255, 10);
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source3, DmxSource(full_buffer, m_now, 50), m_now, true, &output));
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_htp_buffer == output);
+}
+
+
+/*
+ * Check the newest source wins in LTP mode.
+ */
+void SourceMergerTest::testLTPMerge() {
+  SourceMerger merger;
+  DmxBuffer output;
+  MergeSource *source1 = merger.AddSource(DmxSource());
+  MergeSource *source2 = merger.AddSource(DmxSource());
+  TimeStamp later = m_now + TimeInterval(0, 10000);
+
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), m_now, false, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, later, 100), later, false, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+
+  // data with an older timestamp loses
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 100), later, false, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, later, 100), later, false, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+}
+
+
+/*
+ * Check that sources time out.
+ */
+void SourceMergerTest::testTimeout() {
+  SourceMerger merger;
+  DmxBuffer output;
+  MergeSource *source1 = merger.AddSource(DmxSource());
+  MergeSource *source2 = merger.AddSource(DmxSource());
+  TimeStamp later = m_now + TimeInterval(10, 0);
+
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 150), m_now, true, &output));
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 150), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_htp_buffer == output);
+
+  // once source1 has timed out, source2 is the only one left
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, later, 150), later, true, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+
+  // and data that has already timed out is ignored
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, m_now, 200), later, true, &output));
+
+  // a lower priority source takes over once the higher ones time out
+  TimeStamp much_later = later + TimeInterval(10, 0);
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source1, DmxSource(m_buffer1, much_later, 100), much_later, true,
+      &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+  OLA_ASSERT_EQ((uint8_t) 100, merger.ActivePriority());
+}
+
+
+/*
+ * Check that adding & removing sources works.
+ */
+void SourceMergerTest::testAddRemove() {
+  SourceMerger merger;
+  DmxBuffer output;
+
+  // sources added with data take part in the next merge
+  MergeSource *source1 = merger.AddSource(DmxSource(m_buffer1, m_now, 150));
+  MergeSource *source2 = merger.AddSource(DmxSource());
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 100), m_now, true, &output));
+
+  merger.RemoveSource(source1);
+  OLA_ASSERT_EQ(1u, merger.SourceCount());
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      source2, DmxSource(m_buffer2, m_now, 100), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer2 == output);
+
+  // removing a source twice is a noop
+  merger.RemoveSource(source1);
+  OLA_ASSERT_EQ(1u, merger.SourceCount());
+}
+
+
+/*
+ * Check that sources with per-slot priorities are merged slot by slot.
+ */
+void SourceMergerTest::testSlotPriorities() {
+  SourceMerger merger;
+  DmxBuffer output;
+  MergeSource *primary = merger.AddSource(DmxSource());
+  MergeSource *backup = merger.AddSource(DmxSource());
+
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      primary, DmxSource(m_buffer1, m_now, 150), m_now, true, &output));
+  OLA_ASSERT_TRUE(m_buffer1 == output);
+
+  // the backup only owns slot 2, but at a higher priority
+  DmxBuffer slot_priorities;
+  slot_priorities.SetFromString("0,0,200");
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      backup, DmxSource(m_buffer2, m_now, 100, slot_priorities), m_now, true,
+      &output));
+  OLA_ASSERT_EQ(string("1,20,30,40"), output.ToString());
+  OLA_ASSERT_EQ((uint8_t) 150, merger.ActivePriority());
+
+  // updates from the primary keep the backup's slot
+  DmxBuffer primary_data;
+  primary_data.SetFromString("5,6,7,8");
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      primary, DmxSource(primary_data, m_now, 150), m_now, true, &output));
+  OLA_ASSERT_EQ(string("5,6,30,8"), output.ToString());
+
+  // slots at the same priority are HTP merged
+  slot_priorities.SetFromString("150,150,150,150,150");
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      backup, DmxSource(m_buffer2, m_now, 100, slot_priorities), m_now, true,
+      &output));
+  OLA_ASSERT_EQ(string("10,6,30,8,5"), output.ToString());
+
+  // and LTP merged, newest first
+  TimeStamp later = m_now + TimeInterval(0, 10000);
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      primary, DmxSource(primary_data, later, 150), later, false, &output));
+  OLA_ASSERT_EQ(string("5,6,7,8,5"), output.ToString());
+
+  // once the backup drops its slot priorities, it loses to the primary
+  OLA_ASSERT_FALSE(merger.UpdateSource(
+      backup, DmxSource(m_buffer2, later, 100), later, true, &output));
+  OLA_ASSERT_TRUE(merger.UpdateSource(
+      primary, DmxSource(primary_data, later, 150), later, true, &output));
+  OLA_ASSERT_TRUE(primary_data == output);
+}
@@ -273,13 +273,19 @@ class TestMockPlugin: public ola::Plugin {
 /**
  * We mock this out so we can manipulate the wake up time. It was either this
  * or the mocking the plugin adaptor.
+ *
+ * Repeating timeouts are only run when RunRepeatingTimeouts() is called.
  */
 class MockSelectServer: public ola::io::SelectServerInterface {
   public:
     explicit MockSelectServer(const TimeStamp *wake_up):
       SelectServerInterface(),
       m_wake_up(wake_up) {}
-    ~MockSelectServer() {}
+    ~MockSelectServer() {
+      set<ola::Callback0<bool>*>::iterator iter = m_repeating.begin();
+      for (; iter != m_repeating.end(); ++iter)
+        delete *iter;
+    }
 
     bool AddReadDescriptor(ola::io::ReadFileDescriptor *descriptor) {
       (void) descriptor;
@@ -315,13 +321,15 @@ class MockSelectServer: public ola::io::SelectServerInterface {
 
     ola::thread::timeout_id RegisterRepeatingTimeout(
         unsigned int,
-        ola::Callback0<bool> *) {
-      return ola::thread::INVALID_TIMEOUT;
+        ola::Callback0<bool> *closure) {
+      m_repeating.insert(closure);
+      return closure;
     }
     ola::thread::timeout_id RegisterRepeatingTimeout(
         const ola::TimeInterval&,
-        ola::Callback0<bool>*) {
-      return ola::thread::INVALID_TIMEOUT;
+        ola::Callback0<bool> *closure) {
+      m_repeating.insert(closure);
+      return closure;
     }
     ola::thread::timeout_id RegisterSingleTimeout(
         unsigned int,
@@ -333,15 +341,33 @@ class MockSelectServer: public ola::io::SelectServerInterface {
         ola::SingleUseCallback0<void> *) {
       return ola::thread::INVALID_TIMEOUT;
     }
-    void RemoveTimeout(ola::thread::timeout_id id) { (void) id; }
+    void RemoveTimeout(ola::thread::timeout_id id) {
+      ola::Callback0<bool> *closure = static_cast<ola::Callback0<bool>*>(id);
+      if (m_repeating.erase(closure))
+        delete closure;
+    }
     const TimeStamp *WakeUpTime() const { return m_wake_up; }
 
     void Execute(ola::BaseCallback0<void> *callback) {
       callback->Run();
     }
 
+    // Run each of the repeating timeouts once.
+    void RunRepeatingTimeouts() {
+      set<ola::Callback0<bool>*> timeouts = m_repeating;
+      set<ola::Callback0<bool>*>::iterator iter = timeouts.begin();
+      for (; iter != timeouts.end(); ++iter) {
+        if (m_repeating.count(*iter) && !(*iter)->Run()) {
+          m_repeating.erase(*iter);
+          delete *iter;
+        }
+      }
+    }
+
+    unsigned int RepeatingTimeoutCount() const { return m_repeating.size(); }
 
   private:
     const TimeStamp *m_wake_up;
+    set<ola::Callback0<bool>*> m_repeating;
 };
 #endif  // OLAD_TESTCOMMON_H_
@@ -42,9 +42,13 @@
 #include "ola/rdm/RDMCommand.h"
 #include "ola/rdm/RDMEnums.h"
 #include "ola/MultiCallback.h"
+#include "ola/thread/Trace.h"
 #include "olad/Client.h"
+#include "olad/EventLoopPool.h"
+#include "olad/OutputScheduler.h"
 #include "olad/UniverseStore.h"
 #include "olad/Port.h"
+#include "olad/SourceMerger.h"
 #include "olad/Universe.h"
 
 namespace ola {
@@ -53,33 +57,59 @@ const char Universe::K_UNIVERSE_UID_COUNT_VAR[] = "universe-uids";
 const char Universe::K_FPS_VAR[] = "universe-dmx-frames";
 const char Universe::K_MERGE_HTP_STR[] = "htp";
 const char Universe::K_MERGE_LTP_STR[] = "ltp";
+const char Universe::K_PORT_OUTPUT_LATENCY_VAR[] = "port-output-latency-us";
+const char Universe::K_UNIVERSE_COALESCED_FRAMES_VAR[] =
+    "universe-coalesced-frames";
 const char Universe::K_UNIVERSE_INPUT_PORT_VAR[] = "universe-input-ports";
 const char Universe::K_UNIVERSE_MODE_VAR[] = "universe-mode";
 const char Universe::K_UNIVERSE_NAME_VAR[] = "universe-name";
+const char Universe::K_UNIVERSE_OUTPUT_LATENCY_VAR[] =
+    "universe-output-latency-us";
 const char Universe::K_UNIVERSE_OUTPUT_PORT_VAR[] = "universe-output-ports";
 const char Universe::K_UNIVERSE_RDM_REQUESTS[] = "universe-rdm-requests";
 const char Universe::K_UNIVERSE_SINK_CLIENTS_VAR[] = "universe-sink-clients";
 const char Universe::K_UNIVERSE_SOURCE_CLIENTS_VAR[] =
     "universe-source-clients";
 
+
+/*
+ * Make a copy of a DmxSource that doesn't share the buffer with the port it
+ * came from, since the port may be written to from another loop.
+ */
+static DmxSource CopySource(const DmxSource &source) {
+  return DmxSourceFrame(source).ToSource();
+}
+
 /*
  * Create a new universe
  * @param uid  the universe id of this universe
  * @param store the store this universe came from
  * @param export_map the ExportMap that we update
+ * @param loop_pool the EventLoopPool, or NULL if there is only one loop.
  */
 Universe::Universe(unsigned int universe_id, UniverseStore *store,
                    ExportMap *export_map,
-                   Clock *clock)
+                   Clock *clock,
+                   EventLoopPool *loop_pool)
     : m_universe_name(""),
       m_universe_id(universe_id),
       m_active_priority(DmxSource::PRIORITY_MIN),
       m_merge_mode(Universe::MERGE_LTP),
+      m_merger(new SourceMerger()),
       m_universe_store(store),
       m_export_map(export_map),
+      m_output_latency(NULL),
       m_clock(clock),
       m_rdm_discovery_interval(),
-      m_last_discovery_time() {
+      m_last_discovery_time(),
+      m_output_keepalive(),
+      m_last_output_time(),
+      m_last_output_priority(DmxSource::PRIORITY_MIN),
+      m_output_scheduler(NULL),
+      m_output_pending(false),
+      m_input_time(),
+      m_latency_pending(false),
+      m_loop_pool(loop_pool) {
   stringstream universe_id_str, universe_name_str;
   universe_id_str << universe_id;
   m_universe_id_str = universe_id_str.str();
@@ -91,6 +121,7 @@ Universe::Universe(unsigned int universe_id, UniverseStore *store,
 
   const char *vars[] = {
     K_FPS_VAR,
+    K_UNIVERSE_COALESCED_FRAMES_VAR,
     K_UNIVERSE_INPUT_PORT_VAR,
     K_UNIVERSE_OUTPUT_PORT_VAR,
     K_UNIVERSE_RDM_REQUESTS,
@@ -102,11 +133,27 @@ Universe::Universe(unsigned int universe_id, UniverseStore *store,
   if (m_export_map) {
     for (unsigned int i = 0; i < arraysize(vars); ++i)
       (*m_export_map->GetUIntMapVar(vars[i]))[m_universe_id_str] = 0;
+
+    // these are bumped for every frame, or from the universe's loop, so look
+    // them up once while we're in the main loop
+    m_fps_handle = m_export_map->GetUIntMapVar(K_FPS_VAR)->Handle(
+        m_universe_id_str);
+    m_coalesced_frames_handle = m_export_map->GetUIntMapVar(
+        K_UNIVERSE_COALESCED_FRAMES_VAR)->Handle(m_universe_id_str);
+    m_source_clients_handle = m_export_map->GetUIntMapVar(
+        K_UNIVERSE_SOURCE_CLIENTS_VAR)->Handle(m_universe_id_str);
+    m_sink_clients_handle = m_export_map->GetUIntMapVar(
+        K_UNIVERSE_SINK_CLIENTS_VAR)->Handle(m_universe_id_str);
+    m_output_latency = &(*m_export_map->GetHistogramMapVar(
+        K_UNIVERSE_OUTPUT_LATENCY_VAR, "universe"))[m_universe_id_str];
   }
 
   // we set the last discovery time to now, since most ports will trigger
   // discovery when they are patched.
   clock->CurrentTime(&m_last_discovery_time);
+
+  if (m_loop_pool)
+    m_loop_pool->AddUniverse(this);
 }
 
 
@@ -121,6 +168,7 @@ Universe::~Universe() {
 
   const char *uint_vars[] = {
     K_FPS_VAR,
+    K_UNIVERSE_COALESCED_FRAMES_VAR,
     K_UNIVERSE_INPUT_PORT_VAR,
     K_UNIVERSE_OUTPUT_PORT_VAR,
     K_UNIVERSE_RDM_REQUESTS,
@@ -134,7 +182,19 @@ Universe::~Universe() {
       m_export_map->GetStringMapVar(string_vars[i])->Remove(m_universe_id_str);
     for (unsigned int i = 0; i < arraysize(uint_vars); ++i)
       m_export_map->GetUIntMapVar(uint_vars[i])->Remove(m_universe_id_str);
+    m_export_map->GetHistogramMapVar(K_UNIVERSE_OUTPUT_LATENCY_VAR,
+                                     "universe")->Remove(m_universe_id_str);
+  }
+
+  if (m_loop_pool) {
+    m_loop_pool->RemoveUniverse(this);
+    vector<OutputPort*>::iterator iter = m_output_ports.begin();
+    for (; iter != m_output_ports.end(); ++iter)
+      m_loop_pool->RemoveOutputPort(*iter);
   }
+  if (m_output_pending)
+    m_output_scheduler->Cancel(this);
+  delete m_merger;
 }
 
 
@@ -154,6 +214,30 @@ void Universe::SetName(const string &name) {
 }
 
 
+/*
+ * Set the scheduler used to send the data to the output ports & sink clients.
+ * @param scheduler the OutputScheduler, or NULL to send on every change.
+ */
+void Universe::SetOutputScheduler(OutputScheduler *scheduler) {
+  if (m_output_pending) {
+    m_output_scheduler->Cancel(this);
+    m_output_pending = false;
+    UpdateDependants();
+  }
+  m_output_scheduler = scheduler;
+}
+
+
+/*
+ * Send the data, this is called by the OutputScheduler on the tick after the
+ * data changed.
+ */
+void Universe::RunScheduledOutput() {
+  m_output_pending = false;
+  UpdateDependants();
+}
+
+
 /*
  * Set the universe merge mode
  * @param merge_mode the new merge_mode
@@ -169,6 +253,8 @@ void Universe::SetMergeMode(enum merge_mode merge_mode) {
  * @param port the port to add
  */
 bool Universe::AddPort(InputPort *port) {
+  if (!ContainsPort(port))
+    m_port_sources[port] = m_merger->AddSource(CopySource(port->SourceData()));
   return GenericAddPort(port, &m_input_ports);
 }
 
@@ -178,6 +264,15 @@ bool Universe::AddPort(InputPort *port) {
  * @param port the port to add
  */
 bool Universe::AddPort(OutputPort *port) {
+  if (m_loop_pool)
+    m_loop_pool->AddOutputPort(port);
+  if (m_export_map && !port->UniqueId().empty()) {
+    HistogramMap *latency = m_export_map->GetHistogramMapVar(
+        K_PORT_OUTPUT_LATENCY_VAR, "port");
+    port->SetLatencyHistogram(&(*latency)[port->UniqueId()]);
+  }
+  // make sure the new port gets the next update
+  m_last_output_time = TimeStamp();
   return GenericAddPort(port, &m_output_ports);
 }
 
@@ -188,6 +283,12 @@ bool Universe::AddPort(OutputPort *port) {
  * @return true if the port was removed, false if it didn't exist
  */
 bool Universe::RemovePort(InputPort *port) {
+  map<const InputPort*, MergeSource*>::iterator iter =
+    m_port_sources.find(port);
+  if (iter != m_port_sources.end()) {
+    m_merger->RemoveSource(iter->second);
+    m_port_sources.erase(iter);
+  }
   return GenericRemovePort(port, &m_input_ports);
 }
 
@@ -198,6 +299,13 @@ bool Universe::RemovePort(InputPort *port) {
  * @return true if the port was removed, false if it didn't exist
  */
 bool Universe::RemovePort(OutputPort *port) {
+  if (m_loop_pool && ContainsPort(port))
+    m_loop_pool->RemoveOutputPort(port);
+  // Once this returns the port's threads are done with the histogram.
+  port->SetLatencyHistogram(NULL);
+  if (m_export_map && !port->UniqueId().empty())
+    m_export_map->GetHistogramMapVar(K_PORT_OUTPUT_LATENCY_VAR, "port")->Remove(
+        port->UniqueId());
   bool ret = GenericRemovePort(port, &m_output_ports, &m_output_uids);
 
   if (m_export_map)
@@ -265,6 +373,12 @@ bool Universe::AddSourceClient(Client *client) {
  * @param client the client to remove
  */
 bool Universe::RemoveSourceClient(Client *client) {
+  map<const Client*, MergeSource*>::iterator iter =
+    m_client_sources.find(client);
+  if (iter != m_client_sources.end()) {
+    m_merger->RemoveSource(iter->second);
+    m_client_sources.erase(iter);
+  }
   return RemoveClient(client, true);
 }
 
@@ -323,12 +437,14 @@ bool Universe::SetDMX(const DmxBuffer &buffer) {
     return true;
   }
   m_buffer.Set(buffer);
-  return UpdateDependants();
+  return DataChanged();
 }
 
 
 /*
- * Call this when the dmx in a port that is part of this universe changes
+ * Call this when the dmx in a port that is part of this universe changes.
+ * This can be called from any loop, if the port is in a different loop to
+ * us the data is handed off.
  * @param port the port that has changed
  */
 bool Universe::PortDataChanged(InputPort *port) {
@@ -337,8 +453,15 @@ bool Universe::PortDataChanged(InputPort *port) {
       << UniverseId();
     return false;
   }
-  if (MergeAll(port, NULL))
-    UpdateDependants();
+
+  if (InUniverseLoop()) {
+    UpdatePortSource(port, port->SourceData());
+  } else {
+    m_loop_pool->ExecuteInUniverseLoop(
+        this,
+        NewSingleCallback(this, &Universe::ReceivePortSource, port,
+                          DmxSourceFrame(port->SourceData())));
+  }
   return true;
 }
 
@@ -350,9 +473,14 @@ bool Universe::SourceClientDataChanged(Client *client) {
   if (!client)
     return false;
 
-  AddSourceClient(client);   // always add since this may be the first call
-  if (MergeAll(NULL, client))
-    UpdateDependants();
+  if (InUniverseLoop()) {
+    UpdateClientSource(client, client->SourceData(UniverseId()));
+  } else {
+    m_loop_pool->ExecuteInUniverseLoop(
+        this,
+        NewSingleCallback(this, &Universe::ReceiveClientSource, client,
+                          DmxSourceFrame(client->SourceData(UniverseId()))));
+  }
   return true;
 }
 
@@ -364,6 +492,14 @@ bool Universe::SourceClientDataChanged(Client *client) {
  */
 void Universe::SendRDMRequest(const ola::rdm::RDMRequest *request,
                               ola::rdm::RDMCallback *callback) {
+  if (m_loop_pool && !m_loop_pool->InLoop(0)) {
+    // RDM is handled in the main loop.
+    m_loop_pool->ExecuteOnMain(
+        NewSingleCallback(this, &Universe::SendRDMRequest, request, callback),
+        this);
+    return;
+  }
+
   OLA_INFO << "Universe " << UniverseId() << ", RDM request to " <<
     request->DestinationUID() << ", CC " << std::hex << request->CommandClass()
     << ", PID 0x" << std::hex << request->ParamId() << ", PDL: " << std::dec <<
@@ -391,17 +527,18 @@ void Universe::SendRDMRequest(const ola::rdm::RDMRequest *request,
     for (port_iter = m_output_ports.begin(); port_iter != m_output_ports.end();
          ++port_iter) {
       // because each port deletes the request, we need to copy it here
+      ola::rdm::RDMCallback *port_callback;
       if (is_dub) {
-        (*port_iter)->SendRDMRequest(
-            request->Duplicate(),
-            NewSingleCallback(this,
-                              &Universe::HandleBroadcastDiscovery,
-                              tracker));
+        port_callback = NewSingleCallback(this,
+                                          &Universe::HandleBroadcastDiscovery,
+                                          tracker);
       } else  {
-        (*port_iter)->SendRDMRequest(
-            request->Duplicate(),
-            NewSingleCallback(this, &Universe::HandleBroadcastAck, tracker));
+        port_callback = NewSingleCallback(this, &Universe::HandleBroadcastAck,
+                                          tracker);
       }
+      if (m_loop_pool)
+        port_callback = m_loop_pool->WrapRDMCallback(port_callback);
+      (*port_iter)->SendRDMRequest(request->Duplicate(), port_callback);
     }
     delete request;
   } else {
@@ -415,6 +552,8 @@ void Universe::SendRDMRequest(const ola::rdm::RDMRequest *request,
       callback->Run(ola::rdm::RDM_UNKNOWN_UID, NULL, packets);
       delete request;
     } else {
+      if (m_loop_pool)
+        callback = m_loop_pool->WrapRDMCallback(callback);
       iter->second->SendRDMRequest(request, callback);
     }
   }
@@ -425,6 +564,13 @@ void Universe::SendRDMRequest(const ola::rdm::RDMRequest *request,
  * Trigger RDM discovery for this universe
  */
 void Universe::RunRDMDiscovery(RDMDiscoveryCallback *on_complete, bool full) {
+  if (m_loop_pool && !m_loop_pool->InLoop(0)) {
+    m_loop_pool->ExecuteOnMain(
+        NewSingleCallback(this, &Universe::RunRDMDiscovery, on_complete, full),
+        this);
+    return;
+  }
+
   if (full)
     OLA_INFO << "Full RDM discovery triggered for universe " << m_universe_id;
   else
@@ -448,19 +594,18 @@ void Universe::RunRDMDiscovery(RDMDiscoveryCallback *on_complete, bool full) {
   // will trigger, running the DiscoveryCallback.
   vector<OutputPort*>::iterator iter;
   for (iter = output_ports.begin(); iter != output_ports.end(); ++iter) {
-    if (full) {
-      (*iter)->RunFullDiscovery(
-          NewSingleCallback(this,
-                            &Universe::PortDiscoveryComplete,
-                            discovery_complete,
-                            *iter));
-    } else {
-      (*iter)->RunIncrementalDiscovery(
-          NewSingleCallback(this,
-                            &Universe::PortDiscoveryComplete,
-                            discovery_complete,
-                            *iter));
-    }
+    RDMDiscoveryCallback *port_callback = NewSingleCallback(
+        this,
+        &Universe::PortDiscoveryComplete,
+        discovery_complete,
+        *iter);
+    if (m_loop_pool)
+      port_callback = m_loop_pool->WrapDiscoveryCallback(port_callback);
+
+    if (full)
+      (*iter)->RunFullDiscovery(port_callback);
+    else
+      (*iter)->RunIncrementalDiscovery(port_callback);
   }
 }
 
@@ -469,6 +614,13 @@ void Universe::RunRDMDiscovery(RDMDiscoveryCallback *on_complete, bool full) {
  * Update the UID : port mapping with this new data
  */
 void Universe::NewUIDList(OutputPort *port, const ola::rdm::UIDSet &uids) {
+  if (m_loop_pool && !m_loop_pool->InLoop(0)) {
+    m_loop_pool->ExecuteOnMain(
+        NewSingleCallback(this, &Universe::UpdatePortUIDs, port, uids),
+        this);
+    return;
+  }
+
   map<UID, OutputPort*>::iterator iter = m_output_uids.begin();
   while (iter != m_output_uids.end()) {
     if (iter->second == port && !uids.Contains(iter->first))
@@ -525,32 +677,162 @@ bool Universe::IsActive() const {
 //-----------------------------------------------------------------------------
 
 
+/*
+ * Called when the data for this universe changes. If there is an
+ * OutputScheduler the data is sent on the next tick, otherwise it's sent
+ * right away.
+ */
+bool Universe::DataChanged() {
+  if (!m_output_scheduler)
+    return UpdateDependants();
+
+  if (m_output_pending) {
+    // this frame replaces one that hasn't been sent yet
+    m_coalesced_frames_handle++;
+  } else {
+    m_output_pending = true;
+    m_output_scheduler->Schedule(this);
+  }
+  return true;
+}
+
+
 /*
  * Called when the dmx data for this universe changes,
  * updates everyone who needs to know (patched ports and network clients)
  */
 bool Universe::UpdateDependants() {
+  ola::thread::TraceScope trace("Universe::UpdateDependants", m_universe_id);
   vector<OutputPort*>::const_iterator iter;
   set<Client*>::const_iterator client_iter;
 
+  // Only new data is timed, resending the same frame doesn't count.
+  TimeStamp input_time;
+  if (m_latency_pending) {
+    input_time = m_input_time;
+    m_latency_pending = false;
+    if (m_output_latency) {
+      TimeStamp now;
+      m_clock->CurrentTime(&now);
+      m_output_latency->Add(now > input_time ?
+          static_cast<unsigned int>((now - input_time).AsInt()) : 0);
+    }
+  }
+
   // write to all ports assigned to this universe
-  for (iter = m_output_ports.begin(); iter != m_output_ports.end(); ++iter) {
-    (*iter)->WriteDMX(m_buffer, m_active_priority);
+  if (!m_output_ports.empty() && OutputRequired()) {
+    for (iter = m_output_ports.begin(); iter != m_output_ports.end(); ++iter) {
+      if (m_loop_pool) {
+        m_loop_pool->WriteDMX(*iter, m_buffer, m_active_priority, input_time);
+      } else {
+        ola::thread::TraceScope write_trace("OutputPort::WriteDMX",
+                                            m_universe_id);
+        (*iter)->WriteTimedDMX(m_buffer, m_active_priority, input_time);
+      }
+    }
   }
 
   // write to all clients
   for (client_iter = m_sink_clients.begin();
        client_iter != m_sink_clients.end();
        ++client_iter) {
-    (*client_iter)->SendDMX(m_universe_id, m_buffer);
+    if (m_loop_pool)
+      m_loop_pool->SendDMX(*client_iter, m_universe_id, m_buffer);
+    else
+      (*client_iter)->SendDMX(m_universe_id, m_buffer);
   }
 
-  if (m_export_map)
-    (*m_export_map->GetUIntMapVar(K_FPS_VAR))[m_universe_id_str]++;
+  m_fps_handle++;
+  m_buffer.Checkpoint();
   return true;
 }
 
 
+/*
+ * Check if the output ports need the current data. If the output keep alive
+ * is set, data that matches what was last sent is held back until the keep
+ * alive interval has passed.
+ */
+bool Universe::OutputRequired() {
+  if (m_output_keepalive == TimeInterval())
+    return true;
+
+  TimeStamp now;
+  m_clock->CurrentTime(&now);
+  if (m_buffer.Changed() ||
+      m_active_priority != m_last_output_priority ||
+      !m_last_output_time.IsSet() ||
+      now - m_last_output_time >= m_output_keepalive) {
+    m_last_output_time = now;
+    m_last_output_priority = m_active_priority;
+    return true;
+  }
+  return false;
+}
+
+
+/*
+ * Return true if we're running in the loop for this universe.
+ */
+bool Universe::InUniverseLoop() const {
+  return !m_loop_pool ||
+         m_loop_pool->InLoop(m_loop_pool->LoopForUniverse(m_universe_id));
+}
+
+
+/*
+ * Store the new data for a port & merge. This runs in the universe's loop.
+ */
+void Universe::UpdatePortSource(InputPort *port, DmxSource source) {
+  // the port may have been removed while this was queued
+  map<const InputPort*, MergeSource*>::iterator iter =
+    m_port_sources.find(port);
+  if (iter == m_port_sources.end())
+    return;
+
+  if (Merge(iter->second, source))
+    DataChanged();
+}
+
+
+/*
+ * Store the new data for a client & merge. This runs in the universe's loop.
+ */
+void Universe::UpdateClientSource(Client *client, DmxSource source) {
+  if (m_loop_pool && !m_loop_pool->IsLiveClient(client))
+    return;
+
+  AddSourceClient(client);   // always add since this may be the first call
+  MergeSource *&merge_source = m_client_sources[client];
+  if (!merge_source)
+    merge_source = m_merger->AddSource(DmxSource());
+  if (Merge(merge_source, source))
+    DataChanged();
+}
+
+
+/*
+ * Called when the data for a port or client was handed off from another loop.
+ */
+void Universe::ReceivePortSource(InputPort *port, DmxSourceFrame frame) {
+  UpdatePortSource(port, frame.ToSource());
+}
+
+
+void Universe::ReceiveClientSource(Client *client, DmxSourceFrame frame) {
+  UpdateClientSource(client, frame.ToSource());
+}
+
+
+/*
+ * Update the UIDs for a port, if it's still part of this universe.
+ */
+void Universe::UpdatePortUIDs(OutputPort *port, ola::rdm::UIDSet uids) {
+  if (ContainsPort(port))
+    NewUIDList(port, uids);
+}
+
+
 /*
  * Update the name in the export map.
  */
@@ -585,11 +867,10 @@ bool Universe::AddClient(Client *client, bool is_source) {
   OLA_INFO << "Added " << (is_source ? "source" : "sink") << " client, " <<
     client << " to universe " << m_universe_id;
 
-  if (m_export_map) {
-    const string &map_name = is_source ? K_UNIVERSE_SOURCE_CLIENTS_VAR :
-      K_UNIVERSE_SINK_CLIENTS_VAR;
-    (*m_export_map->GetUIntMapVar(map_name))[m_universe_id_str]++;
-  }
+  if (is_source)
+    m_source_clients_handle++;
+  else
+    m_sink_clients_handle++;
   return true;
 }
 
@@ -608,11 +889,10 @@ bool Universe::RemoveClient(Client *client, bool is_source) {
     return false;
 
   clients.erase(iter);
-  if (m_export_map) {
-    const string &map_name = is_source ? K_UNIVERSE_SOURCE_CLIENTS_VAR :
-      K_UNIVERSE_SINK_CLIENTS_VAR;
-    (*m_export_map->GetUIntMapVar(map_name))[m_universe_id_str]--;
-  }
+  if (is_source)
+    m_source_clients_handle--;
+  else
+    m_sink_clients_handle--;
   OLA_INFO << "Client " << client << " has been removed from uni " <<
     m_universe_id;
 
@@ -624,114 +904,24 @@ bool Universe::RemoveClient(Client *client, bool is_source) {
 
 
 /*
- * HTP Merge all sources (clients/ports)
- * @pre sources.size >= 2
- * @param sources the list of DmxSources to merge
- */
-void Universe::HTPMergeSources(const vector<DmxSource> &sources) {
-  vector<DmxSource>::const_iterator iter;
-  m_buffer.Reset();
-
-  for (iter = sources.begin(); iter != sources.end(); ++iter) {
-    m_buffer.HTPMerge(iter->Data());
-  }
-}
-
-
-/*
- * Merge all port/client sources.
- * This does a priority based merge as documented at:
- * http://opendmx.net/index.php/OLA_Merging_Algorithms
- * @param port the input port that changed or NULL
- * @param client the client that changed or NULL
+ * Update the data for a source and merge. This does a priority based merge as
+ * documented at: http://opendmx.net/index.php/OLA_Merging_Algorithms
+ * @param source the source that changed
+ * @param data the new data for the source
  * @returns true if the data for this universe changed, false otherwise
  */
-bool Universe::MergeAll(const InputPort *port, const Client *client) {
-  vector<DmxSource> active_sources;
-
-  vector<InputPort*>::const_iterator iter;
-  set<Client*>::const_iterator client_iter;
-
-  m_active_priority = DmxSource::PRIORITY_MIN;
+bool Universe::Merge(MergeSource *source, const DmxSource &data) {
+  ola::thread::TraceScope trace("Universe::Merge", m_universe_id);
   TimeStamp now;
   m_clock->CurrentTime(&now);
-  bool changed_source_is_active = false;
-
-  // Find the highest active ports
-  for (iter = m_input_ports.begin(); iter != m_input_ports.end(); ++iter) {
-    DmxSource source = (*iter)->SourceData();
-    if (!source.IsSet() || !source.IsActive(now) || !source.Data().Size())
-      continue;
-
-    if (source.Priority() > m_active_priority) {
-      changed_source_is_active = false;
-      active_sources.clear();
-      m_active_priority = source.Priority();
-    }
-
-    if (source.Priority() == m_active_priority) {
-      active_sources.push_back(source);
-      if (*iter == port)
-        changed_source_is_active = true;
-    }
-  }
-
-  // find the highest active clients
-  for (client_iter = m_source_clients.begin();
-       client_iter != m_source_clients.end();
-       ++client_iter) {
-    const DmxSource &source = (*client_iter)->SourceData(UniverseId());
-
-    if (!source.IsSet() || !source.IsActive(now) || !source.Data().Size())
-      continue;
-
-    if (source.Priority() > m_active_priority) {
-      changed_source_is_active = false;
-      active_sources.clear();
-      m_active_priority = source.Priority();
-    }
-
-    if (source.Priority() == m_active_priority) {
-      active_sources.push_back(source);
-      if (*client_iter == client)
-        changed_source_is_active = true;
-    }
-  }
-
-  if (active_sources.empty()) {
-    OLA_WARN << "Something changed but we didn't find any active sources " <<
-      " for universe " << UniverseId();
-    return false;
-  }
-
-  if (!changed_source_is_active)
-    // this source didn't have any effect, skip
+  if (!m_merger->UpdateSource(source, data, now, m_merge_mode == MERGE_HTP,
+                              &m_buffer))
     return false;
-
-  // only one source at the active priority
-  if (active_sources.size() == 1) {
-    m_buffer.Set(active_sources[0].Data());
-  } else {
-    // multi source merge
-    if (m_merge_mode == Universe::MERGE_LTP) {
-      vector<DmxSource>::const_iterator source_iter = active_sources.begin();
-      DmxSource changed_source;
-      if (port)
-        changed_source = port->SourceData();
-      else
-        changed_source = client->SourceData(UniverseId());
-
-      // check that the current port/client is newer than all other active
-      // sources
-      for (; source_iter != active_sources.end(); source_iter++) {
-        if (changed_source.Timestamp() < source_iter->Timestamp())
-          return false;
-      }
-      // if we made it to here this is the newest source
-      m_buffer.Set(changed_source.Data());
-    } else {
-      HTPMergeSources(active_sources);
-    }
+  m_active_priority = m_merger->ActivePriority();
+  // If frames are coalesced, the latency is measured from the first one.
+  if (!m_latency_pending) {
+    m_input_time = data.Timestamp();
+    m_latency_pending = m_input_time.IsSet();
   }
   return true;
 }
@@ -0,0 +1,128 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * UniverseBenchmark.cpp
+ * Measures how many source client updates a universe can merge per second.
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <stdint.h>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "ola/BaseTypes.h"
+#include "ola/Clock.h"
+#include "ola/DmxBuffer.h"
+#include "ola/Logging.h"
+#include "ola/base/Flags.h"
+#include "olad/Client.h"
+#include "olad/DmxSource.h"
+#include "olad/Universe.h"
+#include "olad/UniverseStore.h"
+
+using ola::Client;
+using ola::Clock;
+using ola::DmxBuffer;
+using ola::DmxSource;
+using ola::TimeInterval;
+using ola::TimeStamp;
+using ola::Universe;
+using std::cout;
+using std::endl;
+using std::vector;
+
+DEFINE_s_uint32(iterations, i, 100000, "The number of updates to time");
+
+static const unsigned int TEST_UNIVERSE = 1;
+static const unsigned int MAX_SOURCES = 256;
+static const uint8_t BACKUP_PRIORITY = 100;
+static const uint8_t PRIMARY_PRIORITY = 150;
+
+
+/*
+ * Time updates from a number of source clients, returns the updates per
+ * second.
+ * @param source_count the number of source clients
+ * @param merge_mode the merge mode for the universe
+ * @param with_primary if true, the first client has a higher priority than
+ *   the rest, so only its updates change the universe.
+ */
+double TimeUpdates(unsigned int source_count,
+                   Universe::merge_mode merge_mode,
+                   bool with_primary) {
+  Clock clock;
+  ola::UniverseStore store(NULL, NULL);
+  Universe *universe = store.GetUniverseOrCreate(TEST_UNIVERSE);
+  universe->SetMergeMode(merge_mode);
+
+  vector<Client*> clients;
+  DmxBuffer buffer;
+  buffer.Blackout();
+  TimeStamp now;
+  for (unsigned int i = 0; i < source_count; i++) {
+    Client *client = new Client(NULL);
+    uint8_t priority = (with_primary && i == 0) ? PRIMARY_PRIORITY :
+                       BACKUP_PRIORITY;
+    clock.CurrentTime(&now);
+    client->DMXRecieved(TEST_UNIVERSE, DmxSource(buffer, now, priority));
+    universe->SourceClientDataChanged(client);
+    clients.push_back(client);
+  }
+
+  TimeStamp start, end;
+  clock.CurrentTime(&start);
+  for (uint32_t i = 0; i < FLAGS_iterations; i++) {
+    unsigned int index = i % source_count;
+    uint8_t priority = (with_primary && index == 0) ? PRIMARY_PRIORITY :
+                       BACKUP_PRIORITY;
+    buffer.SetChannel(i % DMX_UNIVERSE_SIZE, i);
+    clock.CurrentTime(&now);
+    clients[index]->DMXRecieved(TEST_UNIVERSE,
+                                DmxSource(buffer, now, priority));
+    universe->SourceClientDataChanged(clients[index]);
+  }
+  clock.CurrentTime(&end);
+
+  vector<Client*>::iterator iter = clients.begin();
+  for (; iter != clients.end(); ++iter) {
+    universe->RemoveSourceClient(*iter);
+    delete *iter;
+  }
+
+  TimeInterval elapsed = end - start;
+  return elapsed.AsInt() ?
+      FLAGS_iterations * 1000000.0 / elapsed.AsInt() : 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  ola::SetHelpString(
+      "[options]",
+      "Benchmark the rate at which a universe merges source client updates.");
+  ola::ParseFlags(&argc, argv);
+  ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
+
+  cout << "Sources  HTP (updates/s)  LTP (updates/s)  HTP + primary "
+       << "(updates/s)" << endl;
+  for (unsigned int count = 1; count <= MAX_SOURCES; count *= 4) {
+    cout << std::setw(7) << count << std::fixed << std::setprecision(0)
+         << std::setw(17) << TimeUpdates(count, Universe::MERGE_HTP, false)
+         << std::setw(17) << TimeUpdates(count, Universe::MERGE_LTP, false)
+         << std::setw(27) << TimeUpdates(count, Universe::MERGE_HTP, true)
+         << endl;
+  }
+  return 0;
+}
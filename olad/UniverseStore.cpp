@@ -31,6 +31,7 @@
 #include "ola/ExportMap.h"
 #include "ola/Logging.h"
 #include "ola/StringUtils.h"
+#include "olad/EventLoopPool.h"
 #include "olad/Preferences.h"
 #include "olad/Universe.h"
 #include "olad/UniverseStore.h"
@@ -41,24 +42,16 @@ using std::pair;
 const unsigned int UniverseStore::MINIMUM_RDM_DISCOVERY_INTERVAL = 30;
 
 UniverseStore::UniverseStore(Preferences *preferences,
-                             ExportMap *export_map)
+                             ExportMap *export_map,
+                             EventLoopPool *loop_pool)
     : m_preferences(preferences),
-      m_export_map(export_map) {
-  if (export_map) {
-    export_map->GetStringMapVar(Universe::K_UNIVERSE_NAME_VAR, "universe");
-    export_map->GetStringMapVar(Universe::K_UNIVERSE_MODE_VAR, "universe");
-
-    const char *vars[] = {
-      Universe::K_FPS_VAR,
-      Universe::K_UNIVERSE_INPUT_PORT_VAR,
-      Universe::K_UNIVERSE_OUTPUT_PORT_VAR,
-      Universe::K_UNIVERSE_SINK_CLIENTS_VAR,
-      Universe::K_UNIVERSE_SOURCE_CLIENTS_VAR,
-      Universe::K_UNIVERSE_UID_COUNT_VAR,
-    };
-
-    for (unsigned int i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i)
-      export_map->GetUIntMapVar(string(vars[i]), "universe");
+      m_export_map(export_map),
+      m_loop_pool(loop_pool) {
+  if (loop_pool) {
+    for (unsigned int i = 0; i < loop_pool->LoopCount(); i++)
+      RegisterVariables(loop_pool->GetExportMap(i));
+  } else {
+    RegisterVariables(export_map);
   }
 }
 
@@ -92,9 +85,13 @@ Universe *UniverseStore::GetUniverseOrCreate(unsigned int universe_id) {
   Universe *universe = GetUniverse(universe_id);
 
   if (!universe) {
-    universe = new Universe(universe_id, this, m_export_map, &m_clock);
+    universe = new Universe(universe_id, this,
+                            ExportMapForUniverse(universe_id), &m_clock,
+                            m_loop_pool);
 
     if (universe) {
+      universe->SetOutputKeepAlive(m_output_keepalive);
+      universe->SetOutputScheduler(SchedulerForUniverse(universe_id));
       pair<unsigned int, Universe*> pair(universe_id, universe);
       m_universe_map.insert(pair);
 
@@ -122,6 +119,35 @@ void UniverseStore::GetList(std::vector<Universe*> *universes) const {
 }
 
 
+/*
+ * Set the output keep alive interval for all universes, including ones that
+ * are created later.
+ * @param keepalive the interval, a zero interval sends every update.
+ */
+void UniverseStore::SetOutputKeepAlive(const TimeInterval &keepalive) {
+  m_output_keepalive = keepalive;
+  universe_map::iterator iter;
+  for (iter = m_universe_map.begin(); iter != m_universe_map.end(); ++iter)
+    iter->second->SetOutputKeepAlive(keepalive);
+}
+
+
+/*
+ * Set the schedulers used to send the universe data, one for each event loop.
+ * @param schedulers the OutputSchedulers, indexed by loop. If this is empty,
+ *   universes send their data every time it changes.
+ */
+void UniverseStore::SetOutputSchedulers(
+    const std::vector<OutputScheduler*> &schedulers) {
+  m_output_schedulers = schedulers;
+  universe_map::iterator iter;
+  for (iter = m_universe_map.begin(); iter != m_universe_map.end(); ++iter) {
+    iter->second->SetOutputScheduler(
+        SchedulerForUniverse(iter->second->UniverseId()));
+  }
+}
+
+
 /*
  * Delete all universes
  */
@@ -250,4 +276,55 @@ bool UniverseStore::SaveUniverseSettings(Universe *universe) const {
 
   return 0;
 }
+
+
+/*
+ * Get the scheduler for the loop a universe runs in.
+ */
+OutputScheduler *UniverseStore::SchedulerForUniverse(
+    unsigned int universe_id) const {
+  if (m_output_schedulers.empty())
+    return NULL;
+  unsigned int loop = m_loop_pool ? m_loop_pool->LoopForUniverse(universe_id)
+                                  : 0;
+  return m_output_schedulers[loop % m_output_schedulers.size()];
+}
+
+
+/*
+ * Get the ExportMap for the loop a universe runs in, so the variables it
+ * bumps from that loop aren't shared with other threads.
+ */
+ExportMap *UniverseStore::ExportMapForUniverse(
+    unsigned int universe_id) const {
+  if (!m_loop_pool)
+    return m_export_map;
+  return m_loop_pool->GetExportMap(m_loop_pool->LoopForUniverse(universe_id));
+}
+
+
+/*
+ * Register the universe variables, so they're labeled even if there are no
+ * universes in a loop.
+ */
+void UniverseStore::RegisterVariables(ExportMap *export_map) {
+  if (!export_map)
+    return;
+
+  export_map->GetStringMapVar(Universe::K_UNIVERSE_NAME_VAR, "universe");
+  export_map->GetStringMapVar(Universe::K_UNIVERSE_MODE_VAR, "universe");
+
+  const char *vars[] = {
+    Universe::K_FPS_VAR,
+    Universe::K_UNIVERSE_COALESCED_FRAMES_VAR,
+    Universe::K_UNIVERSE_INPUT_PORT_VAR,
+    Universe::K_UNIVERSE_OUTPUT_PORT_VAR,
+    Universe::K_UNIVERSE_SINK_CLIENTS_VAR,
+    Universe::K_UNIVERSE_SOURCE_CLIENTS_VAR,
+    Universe::K_UNIVERSE_UID_COUNT_VAR,
+  };
+
+  for (unsigned int i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i)
+    export_map->GetUIntMapVar(string(vars[i]), "universe");
+}
 }  // namespace ola
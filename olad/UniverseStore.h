@@ -29,11 +29,14 @@
 
 namespace ola {
 
+class OutputScheduler;
 class Universe;
 
 class UniverseStore {
   public:
-    UniverseStore(class Preferences *preferences, class ExportMap *export_map);
+    UniverseStore(class Preferences *preferences,
+                  class ExportMap *export_map,
+                  class EventLoopPool *loop_pool = NULL);
     ~UniverseStore();
 
     Universe *GetUniverse(unsigned int universe_id) const;
@@ -42,6 +45,9 @@ class UniverseStore {
     unsigned int UniverseCount() const { return m_universe_map.size(); }
     void GetList(std::vector<Universe*> *universes) const;
 
+    void SetOutputKeepAlive(const TimeInterval &keepalive);
+    void SetOutputSchedulers(const std::vector<OutputScheduler*> &schedulers);
+
     void DeleteAll();
     void AddUniverseGarbageCollection(Universe *universe);
     void GarbageCollectUniverses();
@@ -51,6 +57,9 @@ class UniverseStore {
 
     Preferences *m_preferences;
     ExportMap *m_export_map;
+    EventLoopPool *m_loop_pool;
+    TimeInterval m_output_keepalive;
+    std::vector<OutputScheduler*> m_output_schedulers;
     // map of universe_id to Universe
     universe_map m_universe_map;
     std::set<Universe*> m_deletion_candiates;  // list of universes we may be
@@ -61,6 +70,10 @@ class UniverseStore {
     UniverseStore& operator=(const UniverseStore&);
     bool RestoreUniverseSettings(Universe *universe) const;
     bool SaveUniverseSettings(Universe *universe) const;
+    OutputScheduler *SchedulerForUniverse(unsigned int universe_id) const;
+    ExportMap *ExportMapForUniverse(unsigned int universe_id) const;
+
+    static void RegisterVariables(ExportMap *export_map);
 
     static const unsigned int MINIMUM_RDM_DISCOVERY_INTERVAL;
 };
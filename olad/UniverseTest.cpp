@@ -26,6 +26,7 @@
 #include "ola/Callback.h"
 #include "ola/Clock.h"
 #include "ola/DmxBuffer.h"
+#include "ola/ExportMap.h"
 #include "ola/rdm/RDMCommand.h"
 #include "ola/rdm/RDMResponseCodes.h"
 #include "ola/rdm/UID.h"
@@ -45,8 +46,13 @@
 using ola::AbstractDevice;
 using ola::Clock;
 using ola::DmxBuffer;
+using ola::ExportMap;
+using ola::Histogram;
+using ola::HistogramMap;
+using ola::MockClock;
 using ola::NewCallback;
 using ola::NewSingleCallback;
+using ola::TimeInterval;
 using ola::TimeStamp;
 using ola::Universe;
 using ola::rdm::NewDiscoveryUniqueBranchRequest;
@@ -68,6 +74,8 @@ class UniverseTest: public CppUnit::TestFixture {
   CPPUNIT_TEST(testLifecycle);
   CPPUNIT_TEST(testSetGetDmx);
   CPPUNIT_TEST(testSendDmx);
+  CPPUNIT_TEST(testOutputKeepAlive);
+  CPPUNIT_TEST(testOutputLatency);
   CPPUNIT_TEST(testReceiveDmx);
   CPPUNIT_TEST(testSourceClients);
   CPPUNIT_TEST(testSinkClients);
@@ -83,6 +91,8 @@ class UniverseTest: public CppUnit::TestFixture {
     void testLifecycle();
     void testSetGetDmx();
     void testSendDmx();
+    void testOutputKeepAlive();
+    void testOutputLatency();
     void testReceiveDmx();
     void testSourceClients();
     void testSinkClients();
@@ -229,6 +239,108 @@ void UniverseTest::testSendDmx() {
 }
 
 
+/*
+ * Check that unchanged data is only resent once the keep alive expires.
+ */
+void UniverseTest::testOutputKeepAlive() {
+  MockClock clock;
+  Universe universe(TEST_UNIVERSE, m_store, NULL, &clock);
+  universe.SetOutputKeepAlive(TimeInterval(1, 0));
+  DmxBuffer empty_buffer;
+
+  TestMockOutputPort port(NULL, 1);
+  universe.AddPort(&port);
+  OLA_ASSERT(universe.SetDMX(m_buffer));
+  OLA_ASSERT(m_buffer == port.ReadDMX());
+
+  // the same data isn't sent again
+  port.WriteDMX(empty_buffer, 0);
+  OLA_ASSERT(universe.SetDMX(m_buffer));
+  OLA_ASSERT(empty_buffer == port.ReadDMX());
+
+  // until the keep alive interval has passed
+  clock.AdvanceTime(1, 0);
+  OLA_ASSERT(universe.SetDMX(m_buffer));
+  OLA_ASSERT(m_buffer == port.ReadDMX());
+
+  // new data is always sent
+  DmxBuffer new_buffer(m_buffer);
+  new_buffer.SetChannel(0, 255);
+  port.WriteDMX(empty_buffer, 0);
+  OLA_ASSERT(universe.SetDMX(new_buffer));
+  OLA_ASSERT(new_buffer == port.ReadDMX());
+
+  // as is the first update after a port is added
+  TestMockOutputPort port2(NULL, 2);
+  universe.AddPort(&port2);
+  OLA_ASSERT(universe.SetDMX(new_buffer));
+  OLA_ASSERT(new_buffer == port2.ReadDMX());
+
+  // a zero interval sends every update
+  universe.SetOutputKeepAlive(TimeInterval());
+  port.WriteDMX(empty_buffer, 0);
+  OLA_ASSERT(universe.SetDMX(new_buffer));
+  OLA_ASSERT(new_buffer == port.ReadDMX());
+
+  universe.RemovePort(&port);
+  universe.RemovePort(&port2);
+}
+
+
+/*
+ * Check the time from the data arriving until it's sent is recorded.
+ */
+void UniverseTest::testOutputLatency() {
+  MockClock clock;
+  ExportMap export_map;
+  Universe universe(TEST_UNIVERSE, m_store, &export_map, &clock);
+  Histogram &universe_latency = (*export_map.GetHistogramMapVar(
+      Universe::K_UNIVERSE_OUTPUT_LATENCY_VAR))["1"];
+
+  TestMockPlugin plugin(NULL, ola::OLA_PLUGIN_ARTNET);
+  MockDevice device(&plugin, "foo");
+  TestMockOutputPort port(&device, 1);
+  universe.AddPort(&port);
+  HistogramMap *port_latencies = export_map.GetHistogramMapVar(
+      Universe::K_PORT_OUTPUT_LATENCY_VAR);
+  Histogram &port_latency = (*port_latencies)[port.UniqueId()];
+
+  // the data arrives 5ms before the universe gets to it
+  TimeStamp time_stamp;
+  clock.CurrentTime(&time_stamp);
+  clock.AdvanceTime(0, 5000);
+  MockClient client;
+  client.DMXRecieved(TEST_UNIVERSE,
+                     ola::DmxSource(m_buffer, time_stamp,
+                                    ola::DmxSource::PRIORITY_DEFAULT));
+  universe.SourceClientDataChanged(&client);
+  OLA_ASSERT(m_buffer == port.ReadDMX());
+  OLA_ASSERT_EQ(1u, universe_latency.Count());
+  OLA_ASSERT_TRUE(universe_latency.Sum() >= 5000);
+  OLA_ASSERT_EQ(1u, port_latency.Count());
+
+  // data that didn't come from an input isn't timed
+  OLA_ASSERT(universe.SetDMX(m_buffer));
+  OLA_ASSERT_EQ(1u, universe_latency.Count());
+  OLA_ASSERT_EQ(1u, port_latency.Count());
+
+  // once the port is removed, its histogram goes and only the universe is
+  // timed
+  universe.RemovePort(&port);
+  OLA_ASSERT_EQ(0u, (*port_latencies)[port.UniqueId()].Count());
+  DmxBuffer new_buffer(m_buffer);
+  new_buffer.SetChannel(0, 255);
+  clock.CurrentTime(&time_stamp);
+  client.DMXRecieved(TEST_UNIVERSE,
+                     ola::DmxSource(new_buffer, time_stamp,
+                                    ola::DmxSource::PRIORITY_DEFAULT));
+  universe.SourceClientDataChanged(&client);
+  OLA_ASSERT_EQ(2u, universe_latency.Count());
+  OLA_ASSERT_EQ(0u, (*port_latencies)[port.UniqueId()].Count());
+  universe.RemoveSourceClient(&client);
+}
+
+
 /*
  * Check that we update when ports have new data
  */
@@ -33,6 +33,7 @@
 #include "ola/network/SocketAddress.h"
 #include "ola/rdm/RDMEnums.h"
 #include "ola/rdm/RDMCommandSerializer.h"
+#include "ola/thread/Trace.h"
 #include "plugins/artnet/ArtNetNode.h"
 
 
@@ -760,6 +761,7 @@ bool ArtNetNodeImpl::SendTimeCode(const ola::timecode::TimeCode &timecode) {
  * Called when there is data on this socket
  */
 void ArtNetNodeImpl::SocketReady() {
+  ola::thread::TraceScope trace("ArtNetNodeImpl::SocketReady");
   artnet_packet packet;
   ssize_t packet_size = sizeof(packet);
   ola::network::IPV4Address source;
@@ -1520,17 +1522,13 @@ void ArtNetNodeImpl::UpdatePortFromSource(OutputPort *port,
     (*port->buffer) = source.buffer;
   } else {
     // HTP merge
-    bool first = true;
+    const DmxBuffer *buffers[MAX_MERGE_SOURCES];
+    unsigned int buffer_count = 0;
     for (unsigned int i = 0; i < MAX_MERGE_SOURCES; i++) {
-      if (!port->sources[i].address.IsWildcard()) {
-        if (first) {
-          (*port->buffer) = port->sources[i].buffer;
-          first = false;
-        } else {
-          port->buffer->HTPMerge(port->sources[i].buffer);
-        }
-      }
+      if (!port->sources[i].address.IsWildcard())
+        buffers[buffer_count++] = &port->sources[i].buffer;
     }
+    port->buffer->SetFromHTPMerge(buffers, buffer_count);
   }
   port->on_data->Run();
 }
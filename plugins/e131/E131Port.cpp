@@ -66,7 +66,8 @@ void E131InputPort::PostSetUniverse(Universe *old_universe,
         new_universe->UniverseId(),
         &m_buffer,
         &m_priority,
-        NewCallback<E131InputPort, void>(this, &E131InputPort::DmxChanged));
+        NewCallback<E131InputPort, void>(this, &E131InputPort::DmxChanged),
+        &m_slot_priorities);
 }
 
 
@@ -57,9 +57,13 @@ class E131InputPort: public BasicInputPort {
     const DmxBuffer &ReadDMX() const { return m_buffer; }
     bool SupportsPriorities() const { return true; }
     uint8_t InheritedPriority() const { return m_priority; }
+    const DmxBuffer *InheritedSlotPriorities() const {
+      return &m_slot_priorities;
+    }
 
   private:
     DmxBuffer m_buffer;
+    DmxBuffer m_slot_priorities;
     E131Node *m_node;
     E131PortHelper m_helper;
     uint8_t m_priority;
@@ -115,21 +115,29 @@ bool DMPE131Inflator::HandlePDUData(uint32_t vector,
     start_code = *(data + available_length);
 
   // The only time we want to continue processing a non-0 start code is if it
-  // contains a Terminate message.
-  if (start_code && !e131_header.StreamTerminated()) {
+  // contains a Terminate message, or it's per-slot priorities and the handler
+  // wants them.
+  bool slot_priorities = (start_code == PRIORITY_START_CODE &&
+                          universe_iter->second.slot_priorities);
+  if (start_code && !slot_priorities && !e131_header.StreamTerminated()) {
     OLA_INFO << "Skipping packet with non-0 start code: " << start_code;
     return true;
   }
 
-  DmxBuffer *target_buffer;
-  if (!TrackSourceIfRequired(&universe_iter->second, headers,
-                             &target_buffer)) {
+  dmx_source *source;
+  if (!TrackSourceIfRequired(&universe_iter->second, headers, &source)) {
     // no need to continue processing
     return true;
   }
 
   // Reaching here means that we actually have new data and we should merge.
-  if (target_buffer && start_code == 0) {
+  if (source && (start_code == 0 || slot_priorities)) {
+    DmxBuffer *target_buffer = &source->buffer;
+    if (slot_priorities) {
+      target_buffer = &source->priorities;
+      source->priorities_heard_from = source->last_heard_from;
+    }
+
     unsigned int channels = std::min(length_remaining, address->Number());
     if (e131_header.UsingRev2())
       target_buffer->Set(data + available_length, channels);
@@ -140,25 +148,7 @@ bool DMPE131Inflator::HandlePDUData(uint32_t vector,
   if (universe_iter->second.priority)
     *universe_iter->second.priority = universe_iter->second.active_priority;
 
-  // merge the sources
-  switch (universe_iter->second.sources.size()) {
-    case 0:
-      universe_iter->second.buffer->Reset();
-      break;
-    case 1:
-      universe_iter->second.buffer->Set(
-          universe_iter->second.sources[0].buffer);
-      universe_iter->second.closure->Run();
-      break;
-    default:
-      // HTP Merge
-      universe_iter->second.buffer->Reset();
-      std::vector<dmx_source>::const_iterator source_iter =
-        universe_iter->second.sources.begin();
-      for (; source_iter != universe_iter->second.sources.end(); ++source_iter)
-        universe_iter->second.buffer->HTPMerge(source_iter->buffer);
-      universe_iter->second.closure->Run();
-  }
+  MergeSources(&universe_iter->second);
   return true;
 }
 
@@ -169,11 +159,14 @@ bool DMPE131Inflator::HandlePDUData(uint32_t vector,
  * @param buffer the DmxBuffer to update with the data
  * @param handler the Callback0 to call when there is data for this universe.
  * Ownership of the closure is transferred to the node.
+ * @param slot_priorities if not NULL, this is updated with the per-slot
+ *   priorities for the universe, and is empty when there aren't any.
  */
 bool DMPE131Inflator::SetHandler(unsigned int universe,
                                  ola::DmxBuffer *buffer,
                                  uint8_t *priority,
-                                 ola::Callback0<void> *closure) {
+                                 ola::Callback0<void> *closure,
+                                 ola::DmxBuffer *slot_priorities) {
   if (!closure || !buffer)
     return false;
 
@@ -186,12 +179,14 @@ bool DMPE131Inflator::SetHandler(unsigned int universe,
     handler.closure = closure;
     handler.active_priority = 0;
     handler.priority = priority;
+    handler.slot_priorities = slot_priorities;
     m_handlers[universe] = handler;
   } else {
     Callback0<void> *old_closure = iter->second.closure;
     iter->second.closure = closure;
     iter->second.buffer = buffer;
     iter->second.priority = priority;
+    iter->second.slot_priorities = slot_priorities;
     delete old_closure;
   }
   return true;
@@ -237,16 +232,16 @@ void DMPE131Inflator::RegisteredUniverses(vector<unsigned int> *universes) {
  * priority.
  * @param universe_data the universe_handler struct for this universe,
  * @param HeaderSet the set of headers in this packet
- * @param buffer, if set to a non-NULL pointer, the caller should copy the data
- * in the buffer.
+ * @param source, if set to a non-NULL pointer, the caller should copy the data
+ * into the source.
  * @returns true if we should remerge the data, false otherwise.
  */
 bool DMPE131Inflator::TrackSourceIfRequired(
     universe_handler *universe_data,
     const HeaderSet &headers,
-    DmxBuffer **buffer) {
+    dmx_source **source) {
 
-  *buffer = NULL;  // default the buffer to NULL
+  *source = NULL;  // default the source to NULL
   ola::TimeStamp now;
   m_clock.CurrentTime(&now);
   const E131Header &e131_header = headers.GetE131Header();
@@ -263,6 +258,13 @@ bool DMPE131Inflator::TrackSourceIfRequired(
         continue;
       }
     }
+    // sources that stop sending priorities fall back to the packet priority
+    if (iter->priorities.Size() &&
+        now > iter->priorities_heard_from + EXPIRY_INTERVAL) {
+      OLA_INFO << "source " << iter->cid.ToString() <<
+        " stopped sending per-slot priorities";
+      iter->priorities.Reset();
+    }
     iter++;
   }
 
@@ -303,7 +305,7 @@ bool DMPE131Inflator::TrackSourceIfRequired(
       new_source.sequence = e131_header.Sequence();
       new_source.last_heard_from = now;
       iter = sources.insert(sources.end(), new_source);
-      *buffer = &iter->buffer;
+      *source = &(*iter);
       return true;
     }
 
@@ -326,7 +328,7 @@ bool DMPE131Inflator::TrackSourceIfRequired(
       if (sources.empty())
         universe_data->active_priority = 0;
       // We need to trigger a merge here else the buffer will be stale, we keep
-      // the buffer as NULL though so we don't use the data.
+      // the source as NULL though so we don't use the data.
       return true;
     }
 
@@ -348,10 +350,57 @@ bool DMPE131Inflator::TrackSourceIfRequired(
         iter = sources.insert(sources.end(), this_source);
       }
     }
-    *buffer = &iter->buffer;
+    *source = &(*iter);
     return true;
   }
 }
+
+
+/*
+ * Merge the sources for a universe into the handler's buffer. If any of the
+ * sources have per-slot priorities, and the handler wants them, the merge is
+ * done slot by slot.
+ */
+void DMPE131Inflator::MergeSources(universe_handler *universe_data) {
+  const vector<dmx_source> &sources = universe_data->sources;
+  if (sources.empty()) {
+    universe_data->buffer->Reset();
+    if (universe_data->slot_priorities)
+      universe_data->slot_priorities->Reset();
+    return;
+  }
+
+  const DmxBuffer *buffers[MAX_MERGE_SOURCES];
+  const DmxBuffer *slot_priorities[MAX_MERGE_SOURCES];
+  uint8_t priorities[MAX_MERGE_SOURCES];
+  bool have_slot_priorities = false;
+  unsigned int buffer_count = 0;
+  vector<dmx_source>::const_iterator iter = sources.begin();
+  for (; iter != sources.end() && buffer_count < MAX_MERGE_SOURCES; ++iter) {
+    buffers[buffer_count] = &iter->buffer;
+    slot_priorities[buffer_count] = NULL;
+    if (iter->priorities.Size() && universe_data->slot_priorities) {
+      slot_priorities[buffer_count] = &iter->priorities;
+      have_slot_priorities = true;
+    }
+    priorities[buffer_count] = universe_data->active_priority;
+    buffer_count++;
+  }
+
+  if (have_slot_priorities) {
+    universe_data->buffer->SetFromPriorityMerge(
+        buffers, slot_priorities, priorities, buffer_count, true,
+        universe_data->slot_priorities);
+  } else {
+    if (universe_data->slot_priorities)
+      universe_data->slot_priorities->Reset();
+    if (buffer_count == 1)
+      universe_data->buffer->Set(*buffers[0]);
+    else
+      universe_data->buffer->SetFromHTPMerge(buffers, buffer_count);
+  }
+  universe_data->closure->Run();
+}
 }  // namespace e131
 }  // namespace plugin
 }  // namespace ola
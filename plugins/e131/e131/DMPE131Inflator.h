@@ -44,7 +44,8 @@ class DMPE131Inflator: public DMPInflator {
     ~DMPE131Inflator();
 
     bool SetHandler(unsigned int universe, ola::DmxBuffer *buffer,
-                    uint8_t *priority, ola::Callback0<void> *handler);
+                    uint8_t *priority, ola::Callback0<void> *handler,
+                    ola::DmxBuffer *slot_priorities = NULL);
     bool RemoveHandler(unsigned int universe);
 
     void RegisteredUniverses(std::vector<unsigned int> *universes);
@@ -61,6 +62,9 @@ class DMPE131Inflator: public DMPInflator {
       uint8_t sequence;
       TimeStamp last_heard_from;
       DmxBuffer buffer;
+      // the per-slot priorities from 0xDD packets, if any
+      DmxBuffer priorities;
+      TimeStamp priorities_heard_from;
     } dmx_source;
 
     typedef struct {
@@ -68,6 +72,7 @@ class DMPE131Inflator: public DMPInflator {
       Callback0<void> *closure;
       uint8_t active_priority;
       uint8_t *priority;
+      DmxBuffer *slot_priorities;
       std::vector<dmx_source> sources;
     } universe_handler;
 
@@ -77,11 +82,14 @@ class DMPE131Inflator: public DMPInflator {
 
     bool TrackSourceIfRequired(universe_handler *universe_data,
                                const HeaderSet &headers,
-                               DmxBuffer **buffer);
+                               dmx_source **source);
+    void MergeSources(universe_handler *universe_data);
 
     // The max number of sources we'll track per universe.
     static const uint8_t MAX_MERGE_SOURCES = 6;
     static const uint8_t MAX_PRIORITY = 200;
+    // The start code for per-slot priorities
+    static const uint8_t PRIORITY_START_CODE = 0xdd;
     // ignore packets that differ by less than this amount from the last one
     static const int8_t SEQUENCE_DIFF_THRESHOLD = -20;
     // expire sources after 2.5s
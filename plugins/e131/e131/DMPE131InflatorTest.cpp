@@ -0,0 +1,155 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * DMPE131InflatorTest.cpp
+ * Test fixture for the DMPE131Inflator class
+ * Copyright (C) 2013 Simon Newton
+ */
+
+#include <string.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <vector>
+
+#include "ola/BaseTypes.h"
+#include "ola/Callback.h"
+#include "ola/DmxBuffer.h"
+#include "plugins/e131/e131/DMPAddress.h"
+#include "plugins/e131/e131/DMPE131Inflator.h"
+#include "plugins/e131/e131/DMPPDU.h"
+#include "plugins/e131/e131/HeaderSet.h"
+#include "ola/testing/TestUtils.h"
+
+
+namespace ola {
+namespace plugin {
+namespace e131 {
+
+using ola::DmxBuffer;
+using std::vector;
+
+
+class DMPE131InflatorTest: public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(DMPE131InflatorTest);
+  CPPUNIT_TEST(testSlotPriorities);
+  CPPUNIT_TEST_SUITE_END();
+
+  public:
+    void setUp() { m_handler_calls = 0; }
+    void testSlotPriorities();
+
+  private:
+    unsigned int m_handler_calls;
+
+    void DmxChanged() { m_handler_calls++; }
+    void SendData(DMPE131Inflator *inflator, const CID &cid,
+                  uint8_t sequence, uint8_t start_code,
+                  const uint8_t *data, unsigned int length);
+
+    static const uint16_t UNIVERSE = 1;
+    static const uint8_t PRIORITY = 100;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DMPE131InflatorTest);
+
+const uint16_t DMPE131InflatorTest::UNIVERSE;
+const uint8_t DMPE131InflatorTest::PRIORITY;
+
+
+/*
+ * Pass a DMP PDU with the given start code and data to the inflator, as if
+ * it had come from a source with this CID.
+ */
+void DMPE131InflatorTest::SendData(DMPE131Inflator *inflator, const CID &cid,
+                                   uint8_t sequence, uint8_t start_code,
+                                   const uint8_t *data, unsigned int length) {
+  uint8_t dmp_data[DMX_UNIVERSE_SIZE + 1];
+  dmp_data[0] = start_code;
+  memcpy(dmp_data + 1, data, length);
+
+  TwoByteRangeDMPAddress range_addr(0, 1, (uint16_t) (length + 1));
+  DMPAddressData<TwoByteRangeDMPAddress> range_chunk(&range_addr, dmp_data,
+                                                     length + 1);
+  vector<DMPAddressData<TwoByteRangeDMPAddress> > ranged_chunks;
+  ranged_chunks.push_back(range_chunk);
+  const DMPPDU *pdu = NewRangeDMPSetProperty<uint16_t>(true, false,
+                                                       ranged_chunks);
+
+  unsigned int size = pdu->Size();
+  uint8_t *packed = new uint8_t[size];
+  OLA_ASSERT(pdu->Pack(packed, &size));
+
+  RootHeader root_header;
+  root_header.SetCid(cid);
+  HeaderSet headers;
+  headers.SetRootHeader(root_header);
+  headers.SetE131Header(E131Header("source", PRIORITY, sequence, UNIVERSE));
+  OLA_ASSERT_EQ(size, inflator->InflatePDUBlock(&headers, packed, size));
+  delete[] packed;
+  delete pdu;
+}
+
+
+/*
+ * Check that the per-slot priorities (start code 0xDD) are passed on, and
+ * used to merge the sources.
+ */
+void DMPE131InflatorTest::testSlotPriorities() {
+  DMPE131Inflator inflator(true);
+  DmxBuffer buffer, slot_priorities;
+  uint8_t priority = 0;
+  OLA_ASSERT(inflator.SetHandler(
+      UNIVERSE, &buffer, &priority,
+      NewCallback(this, &DMPE131InflatorTest::DmxChanged),
+      &slot_priorities));
+
+  CID cid1 = CID::Generate();
+  CID cid2 = CID::Generate();
+  const uint8_t priorities1[] = {200, 50, 100};
+  const uint8_t data1[] = {10, 20, 30};
+  const uint8_t data2[] = {40, 5, 6};
+
+  // a single source with per-slot priorities
+  SendData(&inflator, cid1, 0, 0xdd, priorities1, sizeof(priorities1));
+  SendData(&inflator, cid1, 1, 0, data1, sizeof(data1));
+  OLA_ASSERT_EQ(2u, m_handler_calls);
+  OLA_ASSERT_EQ(PRIORITY, priority);
+  OLA_ASSERT(DmxBuffer(data1, sizeof(data1)) == buffer);
+  OLA_ASSERT(DmxBuffer(priorities1, sizeof(priorities1)) == slot_priorities);
+
+  // a second source at the same priority, without per-slot priorities. Each
+  // slot goes to the source with the highest priority for it, and ties are
+  // HTP merged.
+  SendData(&inflator, cid2, 0, 0, data2, sizeof(data2));
+  const uint8_t merged_data[] = {10, 5, 30};
+  const uint8_t merged_priorities[] = {200, PRIORITY, PRIORITY};
+  OLA_ASSERT(DmxBuffer(merged_data, sizeof(merged_data)) == buffer);
+  OLA_ASSERT(DmxBuffer(merged_priorities, sizeof(merged_priorities)) ==
+             slot_priorities);
+
+  // without a handler for the per-slot priorities, 0xDD packets are ignored
+  // and the sources are HTP merged.
+  DMPE131Inflator htp_inflator(true);
+  OLA_ASSERT(htp_inflator.SetHandler(
+      UNIVERSE, &buffer, &priority,
+      NewCallback(this, &DMPE131InflatorTest::DmxChanged)));
+  SendData(&htp_inflator, cid1, 0, 0xdd, priorities1, sizeof(priorities1));
+  SendData(&htp_inflator, cid1, 1, 0, data1, sizeof(data1));
+  SendData(&htp_inflator, cid2, 0, 0, data2, sizeof(data2));
+  const uint8_t htp_data[] = {40, 20, 30};
+  OLA_ASSERT(DmxBuffer(htp_data, sizeof(htp_data)) == buffer);
+}
+}  // namespace e131
+}  // namespace plugin
+}  // namespace ola
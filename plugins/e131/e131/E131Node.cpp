@@ -293,11 +293,14 @@ bool E131Node::StreamTerminated(uint16_t universe,
  * @param universe the universe to register the handler for
  * @param handler the Callback0 to call when there is data for this universe.
  * Ownership of the closure is transferred to the node.
+ * @param slot_priorities if not NULL, this is updated with the per-slot
+ *   priorities (start code 0xDD) for the universe.
  */
 bool E131Node::SetHandler(unsigned int universe,
                           DmxBuffer *buffer,
                           uint8_t *priority,
-                          Callback0<void> *closure) {
+                          Callback0<void> *closure,
+                          DmxBuffer *slot_priorities) {
   IPV4Address addr;
   if (!m_e131_sender.UniverseIP(universe, &addr)) {
     OLA_WARN << "Unable to determine multicast group for universe " <<
@@ -310,7 +313,8 @@ bool E131Node::SetHandler(unsigned int universe,
     return false;
   }
 
-  return m_dmp_inflator.SetHandler(universe, buffer, priority, closure);
+  return m_dmp_inflator.SetHandler(universe, buffer, priority, closure,
+                                   slot_priorities);
 }
 
 
@@ -75,7 +75,8 @@ class E131Node {
                           uint8_t priority = DEFAULT_PRIORITY);
 
     bool SetHandler(unsigned int universe, ola::DmxBuffer *buffer,
-                    uint8_t *priority, ola::Callback0<void> *handler);
+                    uint8_t *priority, ola::Callback0<void> *handler,
+                    ola::DmxBuffer *slot_priorities = NULL);
     bool RemoveHandler(unsigned int universe);
 
     const ola::network::Interface &GetInterface() const { return m_interface; }
@@ -24,6 +24,7 @@
 #include "ola/Logging.h"
 #include "ola/network/IPV4Address.h"
 #include "ola/network/NetworkUtils.h"
+#include "ola/thread/Trace.h"
 #include "plugins/e131/e131/BaseInflator.h"
 #include "plugins/e131/e131/HeaderSet.h"
 #include "plugins/e131/e131/UDPTransport.h"
@@ -76,6 +77,7 @@ IncomingUDPTransport::IncomingUDPTransport(ola::network::UDPSocket *socket,
  * Called when new data arrives.
  */
 void IncomingUDPTransport::Receive() {
+  ola::thread::TraceScope trace("IncomingUDPTransport::Receive");
   if (!m_recv_buffer)
     m_recv_buffer = new uint8_t[PreamblePacker::MAX_DATAGRAM_SIZE];
 
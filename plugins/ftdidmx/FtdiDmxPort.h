@@ -42,13 +42,19 @@ class FtdiDmxOutputPort : public ola::BasicOutputPort {
                       unsigned int freq)
         : BasicOutputPort(parent, id),
           m_device(device),
-          m_thread(device, freq) {
+          m_thread(this, device, freq) {
       m_thread.Start();
     }
     ~FtdiDmxOutputPort() { m_thread.Stop(); }
 
     bool WriteDMX(const ola::DmxBuffer &buffer, uint8_t) {
-      return m_thread.WriteDMX(buffer);
+      return m_thread.WriteDMX(buffer, TimeStamp());
+    }
+
+    // See BasicOutputPort::WriteTimedDMX.
+    bool WriteTimedDMX(const ola::DmxBuffer &buffer, uint8_t,
+                       const TimeStamp &input_time) {
+      return m_thread.WriteDMX(buffer, input_time);
     }
 
     string Description() const { return m_device->Description(); }
@@ -24,6 +24,8 @@
 #include "ola/Clock.h"
 #include "ola/Logging.h"
 #include "ola/StringUtils.h"
+#include "ola/thread/Trace.h"
+#include "olad/Port.h"
 #include "plugins/ftdidmx/FtdiWidget.h"
 #include "plugins/ftdidmx/FtdiDmxThread.h"
 
@@ -31,8 +33,10 @@ namespace ola {
 namespace plugin {
 namespace ftdidmx {
 
-FtdiDmxThread::FtdiDmxThread(FtdiWidget *widget, unsigned int frequency)
+FtdiDmxThread::FtdiDmxThread(BasicOutputPort *port, FtdiWidget *widget,
+                             unsigned int frequency)
   : m_granularity(UNKNOWN),
+    m_port(port),
     m_widget(widget),
     m_term(false),
     m_frequency(frequency) {
@@ -56,14 +60,17 @@ bool FtdiDmxThread::Stop() {
 
 
 /**
- * Copy a DMXBuffer to the output thread
+ * Pass a snapshot of a DMXBuffer to the output thread
+ * @param buffer the data to send
+ * @param input_time when the data arrived
  */
-bool FtdiDmxThread::WriteDMX(const DmxBuffer &buffer) {
-  {
-    ola::thread::MutexLocker locker(&m_buffer_mutex);
-    m_buffer.Set(buffer);
-    return true;
-  }
+bool FtdiDmxThread::WriteDMX(const DmxBuffer &buffer,
+                             const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
+  ola::thread::MutexLocker locker(&m_buffer_mutex);
+  m_frame = frame;
+  m_input_time = input_time;
+  return true;
 }
 
 
@@ -74,7 +81,9 @@ void *FtdiDmxThread::Run() {
   TimeStamp ts1, ts2;
   Clock clock;
   CheckTimeGranularity();
-  DmxBuffer buffer;
+  DmxFrame frame;
+  TimeStamp input_time;
+  ola::thread::SetTraceThreadName("ftdidmx");
 
   int frameTime = static_cast<int>(floor(
     (static_cast<double>(1000) / m_frequency) + static_cast<double>(0.5)));
@@ -92,7 +101,8 @@ void *FtdiDmxThread::Run() {
 
     {
       ola::thread::MutexLocker locker(&m_buffer_mutex);
-      buffer.Set(m_buffer);
+      frame = m_frame;
+      input_time = m_input_time;
     }
 
     clock.CurrentTime(&ts1);
@@ -109,8 +119,12 @@ void *FtdiDmxThread::Run() {
     if (m_granularity == GOOD)
       usleep(DMX_MAB);
 
-    if (!m_widget->Write(buffer))
-      goto framesleep;
+    {
+      ola::thread::TraceScope trace("FtdiWidget::Write");
+      if (!m_widget->Write(frame))
+        goto framesleep;
+    }
+    m_port->RecordLatency(input_time);
 
   framesleep:
     // Sleep for the remainder of the DMX frame time
@@ -21,30 +21,38 @@
 #ifndef PLUGINS_FTDIDMX_FTDIDMXTHREAD_H_
 #define PLUGINS_FTDIDMX_FTDIDMXTHREAD_H_
 
+#include "ola/Clock.h"
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 
 namespace ola {
+
+class BasicOutputPort;
+
 namespace plugin {
 namespace ftdidmx {
 
 class FtdiDmxThread : public ola::thread::Thread {
   public:
-    FtdiDmxThread(FtdiWidget *widget, unsigned int frequency);
+    FtdiDmxThread(BasicOutputPort *port, FtdiWidget *widget,
+                  unsigned int frequency);
     ~FtdiDmxThread();
 
     bool Stop();
     void *Run();
-    bool WriteDMX(const DmxBuffer &buffer);
+    bool WriteDMX(const DmxBuffer &buffer, const TimeStamp &input_time);
 
   private:
     enum TimerGranularity { UNKNOWN, GOOD, BAD };
 
     TimerGranularity m_granularity;
+    BasicOutputPort *m_port;
     FtdiWidget *m_widget;
     bool m_term;
     int unsigned m_frequency;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     ola::thread::Mutex m_term_mutex;
     ola::thread::Mutex m_buffer_mutex;
 
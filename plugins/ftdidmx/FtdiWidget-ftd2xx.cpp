@@ -234,7 +234,7 @@ bool FtdiWidget::SetBreak(bool on) {
   }
 }
 
-bool FtdiWidget::Write(const DmxBuffer& data) {
+bool FtdiWidget::Write(const DmxFrame& data) {
   DWORD written = 0;
   unsigned char buffer[DMX_UNIVERSE_SIZE + 1];
   int unsigned length = DMX_UNIVERSE_SIZE;
@@ -166,7 +166,7 @@ bool FtdiWidget::SetBreak(bool on) {
   }
 }
 
-bool FtdiWidget::Write(const ola::DmxBuffer& data) {
+bool FtdiWidget::Write(const ola::DmxFrame& data) {
   unsigned char buffer[DMX_UNIVERSE_SIZE + 1];
   int unsigned length = DMX_UNIVERSE_SIZE;
   buffer[0] = 0x00;
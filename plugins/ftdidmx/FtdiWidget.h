@@ -42,6 +42,7 @@
 #include <vector>
 
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 
 namespace ola {
 namespace plugin {
@@ -155,7 +156,7 @@ class FtdiWidget {
     bool SetBreak(bool on);
 
     /** Write data to a previously-opened line */
-    bool Write(const ola::DmxBuffer &data);
+    bool Write(const ola::DmxFrame &data);
 
     /** Read data from a previously-opened line */
     bool Read(unsigned char* buff, int size);
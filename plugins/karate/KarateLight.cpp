@@ -31,7 +31,7 @@
 #include <string>
 
 #include "ola/BaseTypes.h"
-#include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/Logging.h"
 #include "plugins/karate/KarateLight.h"
 
@@ -205,10 +205,10 @@ bool KarateLight::Blank() {
 }
 
 /**
- * copy contents of the DmxBuffer into my local scope
+ * copy contents of the DmxFrame into my local scope
  * \returns true on success
  */
-bool KarateLight::SetColors(const DmxBuffer &da) {
+bool KarateLight::SetColors(const DmxFrame &da) {
   // make sure not to request data beyond the bounds of the universe
   unsigned int length = std::min(static_cast<int>(da.Size()),
                                  DMX_UNIVERSE_SIZE - m_dmx_offset);
@@ -24,7 +24,7 @@
 #include <string>
 
 #include "ola/BaseTypes.h"
-#include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 
 using std::string;
 
@@ -40,7 +40,7 @@ class KarateLight {
   void Close();
 
   bool Blank();
-  bool SetColors(const DmxBuffer &da);
+  bool SetColors(const DmxFrame &da);
 
   uint16_t GetnChannels() const { return m_nChannels; }
   uint8_t GetFWVersion() const { return m_fw_version; }
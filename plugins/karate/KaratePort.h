@@ -39,7 +39,7 @@ class KarateOutputPort: public BasicOutputPort {
                      unsigned int id,
                      const string &path)
         : BasicOutputPort(parent, id),
-          m_thread(path),
+          m_thread(this, path),
           m_path(path) {
       m_thread.Start();
     }
@@ -51,10 +51,16 @@ class KarateOutputPort: public BasicOutputPort {
     string Description() const { return "KarateLight at " + m_path; }
 
     bool WriteDMX(const DmxBuffer &buffer, uint8_t priority) {
-      return m_thread.WriteDmx(buffer);
+      return m_thread.WriteDmx(buffer, TimeStamp());
       (void) priority;
     }
 
+    // See BasicOutputPort::WriteTimedDMX.
+    bool WriteTimedDMX(const DmxBuffer &buffer, uint8_t,
+                       const TimeStamp &input_time) {
+      return m_thread.WriteDmx(buffer, input_time);
+    }
+
   private:
     KarateThread m_thread;
     string m_path;
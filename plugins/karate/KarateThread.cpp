@@ -35,6 +35,7 @@
 #include "ola/BaseTypes.h"
 #include "ola/Clock.h"
 #include "ola/Logging.h"
+#include "olad/Port.h"
 #include "plugins/karate/KarateLight.h"
 #include "plugins/karate/KarateThread.h"
 
@@ -49,8 +50,9 @@ using ola::thread::MutexLocker;
 /*
  * Create a new KarateThread object
  */
-KarateThread::KarateThread(const string &path)
+KarateThread::KarateThread(BasicOutputPort *port, const string &path)
     : ola::thread::Thread(),
+      m_port(port),
       m_path(path),
       m_term(false) {
 }
@@ -90,13 +92,18 @@ void *KarateThread::Run() {
       k.Init();
 
     } else {
+      DmxFrame frame;
+      TimeStamp input_time;
       {
         MutexLocker locker(&m_mutex);
-        write_success = k.SetColors(m_buffer);
+        frame = m_frame;
+        input_time = m_input_time;
       }
+      write_success = k.SetColors(frame);
       if (!write_success) {
         OLA_WARN << "Failed to write color data";
       }  else {
+        m_port->RecordLatency(input_time);
         usleep(20000);  // 50Hz
       }
     }  // port is okay
@@ -120,11 +127,15 @@ bool KarateThread::Stop() {
 
 /*
  * Store the data in the shared buffer.
+ * @param buffer the data to send
+ * @param input_time when the data arrived
  */
-bool KarateThread::WriteDmx(const DmxBuffer &buffer) {
+bool KarateThread::WriteDmx(const DmxBuffer &buffer,
+                            const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
   MutexLocker locker(&m_mutex);
-  // avoid the reference counting
-  m_buffer.Set(buffer);
+  m_frame = frame;
+  m_input_time = input_time;
   return true;
 }
 }  // namespace karate
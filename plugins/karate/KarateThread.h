@@ -22,24 +22,31 @@
 #define PLUGINS_KARATE_KARATETHREAD_H_
 
 #include <string>
+#include "ola/Clock.h"
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 
 namespace ola {
+
+class BasicOutputPort;
+
 namespace plugin {
 namespace karate {
 
 class KarateThread: public ola::thread::Thread {
   public:
-    explicit KarateThread(const string &path);
+    KarateThread(BasicOutputPort *port, const string &path);
 
     bool Stop();
-    bool WriteDmx(const DmxBuffer &buffer);
+    bool WriteDmx(const DmxBuffer &buffer, const TimeStamp &input_time);
     void *Run();
 
   private:
+    BasicOutputPort *m_port;
     string m_path;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     bool m_term;
     ola::thread::Mutex m_mutex;
     ola::thread::Mutex m_term_mutex;
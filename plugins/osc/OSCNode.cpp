@@ -320,26 +320,36 @@ bool OSCNode::SendData(unsigned int group, const ola::DmxBuffer &dmx_data) {
     lo_blob_free(osc_data);
 
   } else {
+    // Only the slots that changed are sent, so we only need to look at the
+    // range that Set() marked as changed.
+    uint8_t last_values[DMX_UNIVERSE_SIZE];
+    unsigned int last_length = sizeof(last_values);
+    m_last_values.Get(last_values, &last_length);
+    m_last_values.Checkpoint();
+    if (!m_last_values.Set(dmx_data))
+      m_last_values.Reset();
+
+    unsigned int start, length;
+    m_last_values.GetChangedRange(&start, &length);
+
     // iterate over all the targets, and send to each one.
     OSCTargetVector::iterator target_iter = targets->begin();
     for (; target_iter != targets->end(); ++target_iter) {
       OLA_DEBUG << "Sending to " << (*target_iter)->socket_address;
 
-      for (size_t i = 0; i < DMX_UNIVERSE_SIZE; ++i) {
-        if (dmx_data.Get(i) != m_last_values.Get(i)) {
-          std::stringstream path;
-          path << (*target_iter)->osc_address << "/" << i;
-
-
-          // OLA_DEBUG << "Sending " << path.str() << "@" << dmx_data.Get(i) / 255.0f;
-          m_last_values.SetChannel(i, dmx_data.Get(i));
-          int ret = lo_send_from((*target_iter)->liblo_address,
-                                 m_osc_server,
-                                 LO_TT_IMMEDIATE,
-                                 path.str().c_str(),
-                                 "f", dmx_data.Get(i) / 255.0f);
-          ok &= (ret > 0);
-        }
+      for (unsigned int i = start; i < start + length; ++i) {
+        uint8_t last_value = i < last_length ? last_values[i] : 0;
+        if (dmx_data.Get(i) == last_value)
+          continue;
+
+        std::stringstream path;
+        path << (*target_iter)->osc_address << "/" << i;
+        int ret = lo_send_from((*target_iter)->liblo_address,
+                               m_osc_server,
+                               LO_TT_IMMEDIATE,
+                               path.str().c_str(),
+                               "f", dmx_data.Get(i) / 255.0f);
+        ok &= (ret > 0);
       }
     }
   }
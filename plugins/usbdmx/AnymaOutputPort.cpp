@@ -23,6 +23,7 @@
 #include <string>
 
 #include "ola/Logging.h"
+#include "ola/thread/Trace.h"
 #include "plugins/usbdmx/AnymaOutputPort.h"
 #include "plugins/usbdmx/AnymaDevice.h"
 
@@ -79,7 +80,9 @@ bool AnymaOutputPort::Start() {
  * Run this thread
  */
 void *AnymaOutputPort::Run() {
-  DmxBuffer buffer;
+  ola::thread::SetTraceThreadName("usbdmx-anyma");
+  DmxFrame frame;
+  TimeStamp input_time;
   if (!m_usb_handle)
     return NULL;
 
@@ -92,14 +95,16 @@ void *AnymaOutputPort::Run() {
 
     {
       ola::thread::MutexLocker locker(&m_data_mutex);
-      buffer.Set(m_buffer);
+      frame = m_frame;
+      input_time = m_input_time;
     }
 
-    if (buffer.Size()) {
-      if (!SendDMX(buffer)) {
+    if (frame.Size()) {
+      if (!SendDMX(frame)) {
         OLA_WARN << "Send failed, stopping thread...";
         break;
       }
+      RecordLatency(input_time);
     } else {
       // sleep for a bit
       usleep(40000);
@@ -112,11 +117,20 @@ void *AnymaOutputPort::Run() {
 
 
 /*
- * Store the data in the shared buffer
+ * Store a snapshot of the data in the shared frame
  */
 bool AnymaOutputPort::WriteDMX(const DmxBuffer &buffer, uint8_t priority) {
+  return WriteTimedDMX(buffer, priority, TimeStamp());
+}
+
+
+bool AnymaOutputPort::WriteTimedDMX(const DmxBuffer &buffer,
+                                    uint8_t priority,
+                                    const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
   ola::thread::MutexLocker locker(&m_data_mutex);
-  m_buffer.Set(buffer);
+  m_frame = frame;
+  m_input_time = input_time;
   return true;
   (void) priority;
 }
@@ -126,7 +140,8 @@ bool AnymaOutputPort::WriteDMX(const DmxBuffer &buffer, uint8_t priority) {
  * Send the dmx out the widget
  * @return true on success, false on failure
  */
-bool AnymaOutputPort::SendDMX(const DmxBuffer &buffer) {
+bool AnymaOutputPort::SendDMX(const DmxFrame &buffer) {
+  ola::thread::TraceScope trace("AnymaOutputPort::SendDMX");
   int r = libusb_control_transfer(m_usb_handle,
           LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE |
           LIBUSB_ENDPOINT_OUT,
@@ -28,6 +28,7 @@
 #include <pthread.h>
 #include <string>
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 #include "olad/Port.h"
 
@@ -50,6 +51,8 @@ class AnymaOutputPort: public BasicOutputPort, ola::thread::Thread {
     void *Run();
 
     bool WriteDMX(const DmxBuffer &buffer, uint8_t priority);
+    bool WriteTimedDMX(const DmxBuffer &buffer, uint8_t priority,
+                       const TimeStamp &input_time);
     string Description() const { return ""; }
 
   private:
@@ -59,11 +62,12 @@ class AnymaOutputPort: public BasicOutputPort, ola::thread::Thread {
     bool m_term;
     string m_serial;
     libusb_device_handle *m_usb_handle;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     ola::thread::Mutex m_data_mutex;
     ola::thread::Mutex m_term_mutex;
 
-    bool SendDMX(const DmxBuffer &buffer_old);
+    bool SendDMX(const DmxFrame &buffer_old);
     bool GetDescriptorString(libusb_device_handle *usb_handle,
                              uint8_t desc_index,
                              string *data);
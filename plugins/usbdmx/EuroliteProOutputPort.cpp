@@ -24,6 +24,7 @@
 
 #include "ola/BaseTypes.h"
 #include "ola/Logging.h"
+#include "ola/thread/Trace.h"
 #include "plugins/usbdmx/EuroliteProOutputPort.h"
 #include "plugins/usbdmx/EuroliteProDevice.h"
 
@@ -157,7 +158,9 @@ bool EuroliteProOutputPort::Start() {
  * The main loop for the sender thread.
  */
 void *EuroliteProOutputPort::Run() {
-  DmxBuffer buffer;
+  ola::thread::SetTraceThreadName("usbdmx-eurolite-pro");
+  DmxFrame frame;
+  TimeStamp input_time;
 
   if (!m_usb_handle)
     return NULL;
@@ -171,14 +174,16 @@ void *EuroliteProOutputPort::Run() {
 
     {
       ola::thread::MutexLocker locker(&m_data_mutex);
-      buffer.Set(m_buffer);
+      frame = m_frame;
+      input_time = m_input_time;
     }
 
-    if (buffer.Size()) {
-      if (!SendDMX(buffer)) {
+    if (frame.Size()) {
+      if (!SendDMX(frame)) {
         OLA_WARN << "Send bufferfailed, stopping thread...";
         break;
       }
+      RecordLatency(input_time);
     } else {
       // sleep for a bit
       usleep(40000);
@@ -191,12 +196,21 @@ void *EuroliteProOutputPort::Run() {
 
 
 /*
- * Store the data in the shared buffer
+ * Store a snapshot of the data in the shared frame
  */
 bool EuroliteProOutputPort::WriteDMX(const DmxBuffer &buffer,
                                      uint8_t priority) {
+  return WriteTimedDMX(buffer, priority, TimeStamp());
+}
+
+
+bool EuroliteProOutputPort::WriteTimedDMX(const DmxBuffer &buffer,
+                                          uint8_t priority,
+                                          const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
   ola::thread::MutexLocker locker(&m_data_mutex);
-  m_buffer.Set(buffer);
+  m_frame = frame;
+  m_input_time = input_time;
   return true;
   (void) priority;
 }
@@ -206,7 +220,8 @@ bool EuroliteProOutputPort::WriteDMX(const DmxBuffer &buffer,
  * Send the dmx out the widget
  * @return true on success, false on failure
  */
-bool EuroliteProOutputPort::SendDMX(const DmxBuffer &buffer) {
+bool EuroliteProOutputPort::SendDMX(const DmxFrame &buffer) {
+  ola::thread::TraceScope trace("EuroliteProOutputPort::SendDMX");
   uint8_t usb_data[FRAME_SIZE];
   unsigned int frame_size = buffer.Size();
 
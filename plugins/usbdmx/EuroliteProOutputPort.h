@@ -25,6 +25,7 @@
 #include <libusb.h>
 #include <string>
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 #include "olad/Port.h"
 
@@ -45,6 +46,8 @@ class EuroliteProOutputPort: public BasicOutputPort, ola::thread::Thread {
     void *Run();
 
     bool WriteDMX(const DmxBuffer &buffer, uint8_t priority);
+    bool WriteTimedDMX(const DmxBuffer &buffer, uint8_t priority,
+                       const TimeStamp &input_time);
     string Description() const { return ""; }
 
   private:
@@ -61,11 +64,12 @@ class EuroliteProOutputPort: public BasicOutputPort, ola::thread::Thread {
 
     libusb_device *m_usb_device;
     libusb_device_handle *m_usb_handle;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     ola::thread::Mutex m_data_mutex;
     ola::thread::Mutex m_term_mutex;
 
-    bool SendDMX(const DmxBuffer &buffer_old);
+    bool SendDMX(const DmxFrame &buffer_old);
 
     bool GetDescriptorString(libusb_device_handle *usb_handle,
                              uint8_t desc_index,
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 
 #include "ola/Logging.h"
+#include "ola/thread/Trace.h"
 #include "plugins/usbdmx/SunliteOutputPort.h"
 #include "plugins/usbdmx/SunliteDevice.h"
 
@@ -93,7 +94,9 @@ bool SunliteOutputPort::Start() {
  * Run this thread
  */
 void *SunliteOutputPort::Run() {
-  DmxBuffer buffer;
+  ola::thread::SetTraceThreadName("usbdmx-sunlite");
+  DmxFrame frame;
+  TimeStamp input_time;
   bool new_data;
 
   if (!m_usb_handle)
@@ -108,16 +111,18 @@ void *SunliteOutputPort::Run() {
 
     {
       ola::thread::MutexLocker locker(&m_data_mutex);
-      buffer.Set(m_buffer);
+      frame = m_frame;
+      input_time = m_input_time;
       new_data = m_new_data;
       m_new_data = false;
     }
 
     if (new_data) {
-      if (!SendDMX(buffer)) {
+      if (!SendDMX(frame)) {
         OLA_WARN << "Send failed, stopping thread...";
         break;
       }
+      RecordLatency(input_time);
     } else {
       // sleep for a bit
       usleep(40000);
@@ -130,11 +135,20 @@ void *SunliteOutputPort::Run() {
 
 
 /*
- * Store the data in the shared buffer
+ * Store a snapshot of the data in the shared frame
  */
 bool SunliteOutputPort::WriteDMX(const DmxBuffer &buffer, uint8_t priority) {
+  return WriteTimedDMX(buffer, priority, TimeStamp());
+}
+
+
+bool SunliteOutputPort::WriteTimedDMX(const DmxBuffer &buffer,
+                                      uint8_t priority,
+                                      const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
   ola::thread::MutexLocker locker(&m_data_mutex);
-  m_buffer.Set(buffer);
+  m_frame = frame;
+  m_input_time = input_time;
   m_new_data = true;
   return true;
   (void) priority;
@@ -179,7 +193,8 @@ void SunliteOutputPort::InitPacket() {
 /*
  * Send DMX to the widget
  */
-bool SunliteOutputPort::SendDMX(const DmxBuffer &buffer) {
+bool SunliteOutputPort::SendDMX(const DmxFrame &buffer) {
+  ola::thread::TraceScope trace("SunliteOutputPort::SendDMX");
   for (unsigned int i = 0; i < buffer.Size(); i++)
     m_packet[(i / CHANNELS_PER_CHUNK) * CHUNK_SIZE +
              ((i / 4) % 5) * 6 + 3 + (i % 4)] = buffer.Get(i);
@@ -29,6 +29,7 @@
 #include <pthread.h>
 #include <string>
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 #include "olad/Port.h"
 
@@ -49,6 +50,8 @@ class SunliteOutputPort: public BasicOutputPort, ola::thread::Thread {
     void *Run();
 
     bool WriteDMX(const DmxBuffer &buffer, uint8_t priority);
+    bool WriteTimedDMX(const DmxBuffer &buffer, uint8_t priority,
+                       const TimeStamp &input_time);
     string Description() const { return ""; }
 
   private:
@@ -65,12 +68,13 @@ class SunliteOutputPort: public BasicOutputPort, ola::thread::Thread {
     uint8_t m_packet[SUNLITE_PACKET_SIZE];
     libusb_device *m_usb_device;
     libusb_device_handle *m_usb_handle;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     ola::thread::Mutex m_data_mutex;
     ola::thread::Mutex m_term_mutex;
 
     void InitPacket();
-    bool SendDMX(const DmxBuffer &buffer);
+    bool SendDMX(const DmxFrame &buffer);
 };
 }  // namespace usbdmx
 }  // namespace plugin
@@ -26,6 +26,7 @@
 #include <string>
 
 #include "ola/Logging.h"
+#include "ola/thread/Trace.h"
 #include "plugins/usbdmx/VellemanOutputPort.h"
 #include "plugins/usbdmx/VellemanDevice.h"
 
@@ -135,7 +136,9 @@ bool VellemanOutputPort::Start() {
  * Run this thread
  */
 void *VellemanOutputPort::Run() {
-  DmxBuffer buffer;
+  ola::thread::SetTraceThreadName("usbdmx-velleman");
+  DmxFrame frame;
+  TimeStamp input_time;
   if (!m_usb_handle)
     return NULL;
 
@@ -148,14 +151,16 @@ void *VellemanOutputPort::Run() {
 
     {
       ola::thread::MutexLocker locker(&m_data_mutex);
-      buffer.Set(m_buffer);
+      frame = m_frame;
+      input_time = m_input_time;
     }
 
-    if (buffer.Size()) {
-      if (!SendDMX(buffer)) {
+    if (frame.Size()) {
+      if (!SendDMX(frame)) {
         OLA_WARN << "Send failed, stopping thread...";
         break;
       }
+      RecordLatency(input_time);
     } else {
       // sleep for a bit
       usleep(40000);
@@ -168,11 +173,20 @@ void *VellemanOutputPort::Run() {
 
 
 /*
- * Store the data in the shared buffer
+ * Store a snapshot of the data in the shared frame
  */
 bool VellemanOutputPort::WriteDMX(const DmxBuffer &buffer, uint8_t priority) {
+  return WriteTimedDMX(buffer, priority, TimeStamp());
+}
+
+
+bool VellemanOutputPort::WriteTimedDMX(const DmxBuffer &buffer,
+                                       uint8_t priority,
+                                       const TimeStamp &input_time) {
+  DmxFrame frame(buffer);
   ola::thread::MutexLocker locker(&m_data_mutex);
-  m_buffer.Set(buffer);
+  m_frame = frame;
+  m_input_time = input_time;
   return true;
   (void) priority;
 }
@@ -193,7 +207,8 @@ string VellemanOutputPort::Description() const {
  * Send the dmx out the widget
  * @return true on success, false on failure
  */
-bool VellemanOutputPort::SendDMX(const DmxBuffer &buffer) {
+bool VellemanOutputPort::SendDMX(const DmxFrame &buffer) {
+  ola::thread::TraceScope trace("VellemanOutputPort::SendDMX");
   unsigned char usb_data[m_chunk_size];
   unsigned int size = buffer.Size();
   const uint8_t *data = buffer.GetRaw();
@@ -32,6 +32,7 @@
 #include <pthread.h>
 #include <string>
 #include "ola/DmxBuffer.h"
+#include "ola/DmxFrame.h"
 #include "ola/thread/Thread.h"
 #include "olad/Port.h"
 
@@ -52,6 +53,8 @@ class VellemanOutputPort: public BasicOutputPort, ola::thread::Thread {
     void *Run();
 
     bool WriteDMX(const DmxBuffer &buffer, uint8_t priority);
+    bool WriteTimedDMX(const DmxBuffer &buffer, uint8_t priority,
+                       const TimeStamp &input_time);
     string Description() const;
 
   private:
@@ -66,11 +69,12 @@ class VellemanOutputPort: public BasicOutputPort, ola::thread::Thread {
     unsigned int m_chunk_size;
     libusb_device *m_usb_device;
     libusb_device_handle *m_usb_handle;
-    DmxBuffer m_buffer;
+    DmxFrame m_frame;
+    TimeStamp m_input_time;
     ola::thread::Mutex m_data_mutex;
     ola::thread::Mutex m_term_mutex;
 
-    bool SendDMX(const DmxBuffer &buffer_old);
+    bool SendDMX(const DmxFrame &buffer_old);
     bool SendDataChunk(uint8_t *usb_data);
 };
 }  // namespace usbdmx
@@ -31,6 +31,7 @@
 #include <string>
 #include "ola/BaseTypes.h"
 #include "ola/Logging.h"
+#include "ola/thread/Trace.h"
 #include "plugins/usbpro/BaseUsbProWidget.h"
 
 namespace ola {
@@ -95,6 +96,7 @@ bool BaseUsbProWidget::SendMessage(uint8_t label,
   if (length && !data)
     return false;
 
+  ola::thread::TraceScope trace("BaseUsbProWidget::SendMessage");
   ssize_t frame_size = HEADER_SIZE + length + 1;
   uint8_t frame[frame_size];
   message_header *header = reinterpret_cast<message_header*>(frame);
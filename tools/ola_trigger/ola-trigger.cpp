@@ -26,6 +26,7 @@
 #include <ola/BaseTypes.h>
 #include <ola/Callback.h>
 #include <ola/DmxBuffer.h>
+#include <ola/DmxSubscription.h>
 #include <ola/Logging.h>
 #include <ola/OlaCallbackClient.h>
 #include <ola/OlaClientWrapper.h>
@@ -268,6 +269,24 @@ bool ApplyOffset(uint16_t offset, SlotList *all_slots) {
 }
 
 
+/*
+ * Build a subscription for the slots we have actions for, so the server only
+ * sends us those. The slots are in order, so adjacent ones can be merged.
+ */
+void BuildSubscription(const SlotList &slots,
+                       ola::DmxSubscription *subscription) {
+  SlotList::const_iterator iter = slots.begin();
+  while (iter != slots.end()) {
+    unsigned int start = (*iter)->SlotOffset();
+    unsigned int length = 1;
+    for (++iter; iter != slots.end() &&
+         (*iter)->SlotOffset() == start + length; ++iter)
+      length++;
+    subscription->AddSlotRange(start, length);
+  }
+}
+
+
 /*
  * Main
  */
@@ -325,7 +344,9 @@ int main(int argc, char *argv[]) {
     ola::OlaCallbackClient *client = wrapper.GetClient();
     client->SetDmxCallback(
         ola::NewCallback(&NewDmx, opts.universe, &trigger));
-    client->RegisterUniverse(opts.universe, ola::REGISTER, NULL);
+    ola::DmxSubscription subscription;
+    BuildSubscription(slots, &subscription);
+    client->RegisterUniverse(opts.universe, subscription, NULL);
 
     // start the client
     wrapper.GetSelectServer()->Run();